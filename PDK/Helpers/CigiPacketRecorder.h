@@ -0,0 +1,571 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// CigiPacketRecorder.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "INetworkServices.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup networkservices */ /** @{ */
+
+    /// ICigiPacketCallbackV440 callback a packet was captured from and is replayed to.
+    enum CIGI_PACKET_DIRECTION
+    {
+        CIGI_PACKET_CUSTOM_SEND     = 0,    ///< OnCustomSend()
+        CIGI_PACKET_P3D_RECEIVE     = 1,    ///< OnP3DReceive()
+        CIGI_PACKET_P3D_SEND        = 2,    ///< OnP3DSend()
+    };
+
+    /// Replay pacing used by CigiPacketReplayer.
+    enum CIGI_REPLAY_MODE
+    {
+        CIGI_REPLAY_REAL_TIME,      ///< Deliver packets with their recorded spacing
+        CIGI_REPLAY_MAX_RATE,       ///< Deliver packets back to back
+    };
+
+    /**
+    * Common definitions of the CIGI packet recording format.  A recording is a 4 byte magic and a 16-bit
+    * version followed by one record per packet:
+    * varint time since the previous record (microseconds), direction byte, 16-bit packet ID,
+    * major and minor version bytes, varint payload size and the payload itself.
+    */
+    class CigiPacketFile
+    {
+    public:
+        static const UINT32 MAGIC = 0x52474943;     // "CIGR"
+        static const UINT16 VERSION = 1;
+
+        static void WriteVarUInt(__inout std::vector<BYTE>& vBuffer, __in UINT64 uValue)
+        {
+            while (uValue >= 0x80)
+            {
+                vBuffer.push_back((BYTE)(uValue | 0x80));
+                uValue >>= 7;
+            }
+            vBuffer.push_back((BYTE)uValue);
+        }
+
+        static bool ReadVarUInt(__in const BYTE* pData, __in size_t uSize, __inout size_t& uPos, __out UINT64& uValue)
+        {
+            uValue = 0;
+            for (UINT uShift = 0; uShift < 64 && uPos < uSize; uShift += 7)
+            {
+                BYTE y = pData[uPos++];
+                uValue |= (UINT64)(y & 0x7F) << uShift;
+                if ((y & 0x80) == 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    /**
+    * ICigiPacketCallbackV440 implementation that writes every packet it sees to a recording file.
+    * Register it with ICigiServiceV430::RegisterCigiPacketCallback() for the packet IDs to capture.
+    * If an inner callback is given, packets are forwarded to it after being recorded and its result
+    * is returned, so the recorder can be slotted in front of an existing handler.
+    * @remarks  Records are staged in memory and written in 64 KB blocks.
+    */
+    class CigiPacketRecorder : public ICigiPacketCallbackV440
+    {
+    public:
+        /**
+        * @param pInner     Optional callback to forward packets to.
+        */
+        explicit CigiPacketRecorder(__in ICigiPacketCallbackV440* pInner = nullptr)
+            : m_spInner(pInner)
+        {
+        }
+
+        virtual ~CigiPacketRecorder()
+        {
+            Close();
+        }
+
+        /** Creates the recording file.  Closes any recording in progress first. */
+        HRESULT Open(__in LPCWSTR pszPath)
+        {
+            Close();
+
+            if (_wfopen_s(&m_pFile, pszPath, L"wb") != 0 || m_pFile == nullptr)
+            {
+                m_pFile = nullptr;
+                return E_FAIL;
+            }
+
+            m_vBuffer.clear();
+            const UINT32 uMagic = CigiPacketFile::MAGIC;
+            const UINT16 uVersion = CigiPacketFile::VERSION;
+            m_vBuffer.insert(m_vBuffer.end(), (const BYTE*)&uMagic, (const BYTE*)&uMagic + sizeof(uMagic));
+            m_vBuffer.insert(m_vBuffer.end(), (const BYTE*)&uVersion, (const BYTE*)&uVersion + sizeof(uVersion));
+            m_tLast = std::chrono::steady_clock::now();
+            m_uRecorded = 0;
+            m_uBytes = 0;
+            return S_OK;
+        }
+
+        /** Flushes staged records and closes the recording file. */
+        HRESULT Close()
+        {
+            HRESULT hr = S_OK;
+            if (m_pFile != nullptr)
+            {
+                hr = Flush();
+                fclose(m_pFile);
+                m_pFile = nullptr;
+            }
+            return hr;
+        }
+
+        /** Writes staged records to the file. */
+        HRESULT Flush()
+        {
+            if (m_pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+            HRESULT hr = S_OK;
+            if (!m_vBuffer.empty())
+            {
+                if (fwrite(m_vBuffer.data(), 1, m_vBuffer.size(), m_pFile) != m_vBuffer.size())
+                {
+                    hr = E_FAIL;
+                }
+                m_uBytes += m_vBuffer.size();
+                m_vBuffer.clear();
+            }
+            return hr;
+        }
+
+        /** Appends a packet to the recording. */
+        HRESULT Record(__in CIGI_PACKET_DIRECTION eDirection, __in const ICigiPacketV440& packet)
+        {
+            if (m_pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+
+            const USHORT uSize = packet.GetPacketSize();
+            m_vPayload.resize(uSize);
+            HRESULT hr = uSize > 0 ? packet.GetData(m_vPayload.data(), uSize) : S_OK;
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            auto tNow = std::chrono::steady_clock::now();
+            UINT64 uDeltaUs = (UINT64)std::chrono::duration_cast<std::chrono::microseconds>(tNow - m_tLast).count();
+            // Advance by the recorded amount so rounding never accumulates.
+            m_tLast += std::chrono::microseconds(uDeltaUs);
+
+            const USHORT uID = packet.GetPacketID();
+            CigiPacketFile::WriteVarUInt(m_vBuffer, uDeltaUs);
+            m_vBuffer.push_back((BYTE)eDirection);
+            m_vBuffer.push_back((BYTE)uID);
+            m_vBuffer.push_back((BYTE)(uID >> 8));
+            m_vBuffer.push_back(packet.GetMajorVersion());
+            m_vBuffer.push_back(packet.GetMinorVersion());
+            CigiPacketFile::WriteVarUInt(m_vBuffer, uSize);
+            m_vBuffer.insert(m_vBuffer.end(), m_vPayload.begin(), m_vPayload.end());
+            m_uRecorded++;
+
+            if (m_vBuffer.size() >= FLUSH_SIZE)
+            {
+                hr = Flush();
+            }
+            return hr;
+        }
+
+        /// True while a recording file is open.
+        bool IsRecording() const { return m_pFile != nullptr; }
+        /// Number of packets recorded since Open().
+        UINT64 GetRecordedCount() const { return m_uRecorded; }
+        /// Number of bytes written to the file since Open(), excluding staged records.
+        UINT64 GetBytesWritten() const { return m_uBytes; }
+
+        virtual HRESULT OnCustomSend(const USHORT& uPacketID, ICigiPacketV440& pPacket) override
+        {
+            Record(CIGI_PACKET_CUSTOM_SEND, pPacket);
+            return m_spInner != nullptr ? m_spInner->OnCustomSend(uPacketID, pPacket) : S_OK;
+        }
+
+        virtual HRESULT OnP3DReceive(const USHORT& uPacketID, ICigiPacketV440& pPacket) override
+        {
+            Record(CIGI_PACKET_P3D_RECEIVE, pPacket);
+            return m_spInner != nullptr ? m_spInner->OnP3DReceive(uPacketID, pPacket) : S_OK;
+        }
+
+        virtual HRESULT OnP3DSend(const USHORT& uPacketID, ICigiPacketV440& pPacket) override
+        {
+            Record(CIGI_PACKET_P3D_SEND, pPacket);
+            return m_spInner != nullptr ? m_spInner->OnP3DSend(uPacketID, pPacket) : S_OK;
+        }
+
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+        STDMETHODIMP QueryInterface(REFIID riid, PVOID* ppv)
+        {
+            HRESULT hr = E_NOINTERFACE;
+
+            if (ppv == nullptr)
+            {
+                return E_POINTER;
+            }
+
+            *ppv = nullptr;
+
+            if (IsEqualIID(riid, IID_ICigiPacketCallbackV440))
+            {
+                *ppv = static_cast<ICigiPacketCallbackV440*>(this);
+            }
+            else if (IsEqualIID(riid, IID_IUnknown))
+            {
+                *ppv = static_cast<IUnknown*>(this);
+            }
+            if (*ppv)
+            {
+                hr = S_OK;
+                AddRef();
+            }
+
+            return hr;
+        }
+
+    private:
+        static const size_t FLUSH_SIZE = 64 * 1024;
+
+        CComPtr<ICigiPacketCallbackV440>        m_spInner;
+        FILE*                                   m_pFile = nullptr;
+        std::vector<BYTE>                       m_vBuffer;
+        std::vector<BYTE>                       m_vPayload;
+        std::chrono::steady_clock::time_point   m_tLast;
+        UINT64                                  m_uRecorded = 0;
+        UINT64                                  m_uBytes = 0;
+    };
+
+    /// Handler latency statistics for one packet ID, in microseconds.
+    struct CigiLatencyStats
+    {
+        UINT64  uCount;
+        double  dMeanUs;
+        double  dP50Us;
+        double  dP90Us;
+        double  dP99Us;
+        double  dMaxUs;
+    };
+
+    /**
+    * Replays a recording made by CigiPacketRecorder into an ICigiPacketCallbackV440, outside of a live
+    * CIGI session, and measures how long the callback takes for each packet.
+    * Sample usage:
+    * ```
+    *      CigiPacketReplayer replayer;
+    *      if (SUCCEEDED(replayer.Load(L"session.cigr")))
+    *      {
+    *          replayer.Replay(pHandler, CIGI_REPLAY_MAX_RATE);
+    *          CigiLatencyStats stats;
+    *          replayer.GetLatencyStats(uPacketID, stats);
+    *      }
+    * ```
+    */
+    class CigiPacketReplayer
+    {
+    public:
+        /** Reads a recording into memory. @return S_OK, or E_FAIL if the file is missing, not a recording or truncated. */
+        HRESULT Load(__in LPCWSTR pszPath)
+        {
+            m_vPackets.clear();
+            m_vData.clear();
+
+            FILE* pFile = nullptr;
+            if (_wfopen_s(&pFile, pszPath, L"rb") != 0 || pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+            // Read straight into m_vData so no large buffer lives on the caller's stack.
+            const size_t READ_CHUNK = 64 * 1024;
+            size_t uRead = 0;
+            do
+            {
+                const size_t uOffset = m_vData.size();
+                m_vData.resize(uOffset + READ_CHUNK);
+                uRead = fread(m_vData.data() + uOffset, 1, READ_CHUNK, pFile);
+                m_vData.resize(uOffset + uRead);
+            } while (uRead > 0);
+            fclose(pFile);
+
+            const BYTE* pData = m_vData.data();
+            const size_t uSize = m_vData.size();
+            UINT32 uMagic = 0;
+            UINT16 uVersion = 0;
+            if (uSize < sizeof(uMagic) + sizeof(uVersion))
+            {
+                return E_FAIL;
+            }
+            memcpy(&uMagic, pData, sizeof(uMagic));
+            memcpy(&uVersion, pData + sizeof(uMagic), sizeof(uVersion));
+            if (uMagic != CigiPacketFile::MAGIC || uVersion != CigiPacketFile::VERSION)
+            {
+                return E_FAIL;
+            }
+
+            size_t uPos = sizeof(uMagic) + sizeof(uVersion);
+            UINT64 uTimeUs = 0;
+            while (uPos < uSize)
+            {
+                UINT64 uDeltaUs = 0;
+                UINT64 uPayload = 0;
+                Packet packet;
+                if (!CigiPacketFile::ReadVarUInt(pData, uSize, uPos, uDeltaUs) || uPos + 5 > uSize)
+                {
+                    return E_FAIL;
+                }
+                packet.eDirection = (CIGI_PACKET_DIRECTION)pData[uPos];
+                packet.uID = (USHORT)(pData[uPos + 1] | (pData[uPos + 2] << 8));
+                packet.uMajor = pData[uPos + 3];
+                packet.uMinor = pData[uPos + 4];
+                uPos += 5;
+                if (!CigiPacketFile::ReadVarUInt(pData, uSize, uPos, uPayload) || uPayload > 0xFFFF || uPayload > uSize - uPos)
+                {
+                    return E_FAIL;
+                }
+                uTimeUs += uDeltaUs;
+                packet.uTimeUs = uTimeUs;
+                packet.uOffset = (UINT)uPos;
+                packet.uSize = (USHORT)uPayload;
+                uPos += (size_t)uPayload;
+                m_vPackets.push_back(packet);
+            }
+            return S_OK;
+        }
+
+        /**
+        * Delivers every loaded packet to the matching callback method and records its latency.
+        * @param pTarget        Callback under test.
+        * @param eMode          Real time or maximum rate pacing.
+        * @param uDirections    Bit mask of (1 << CIGI_PACKET_DIRECTION) values to replay.
+        * @return               S_OK, or E_FAIL if nothing is loaded.
+        * @remarks              Previous latency samples are discarded.
+        */
+        HRESULT Replay(__in __notnull ICigiPacketCallbackV440* pTarget, __in CIGI_REPLAY_MODE eMode, __in UINT uDirections = 0x7)
+        {
+            if (m_vPackets.empty())
+            {
+                return E_FAIL;
+            }
+
+            m_mapSamples.clear();
+            m_uReplayed = 0;
+            m_uSendDataCalls = 0;
+
+            ReplayPacket packet(*this);
+            auto tStart = std::chrono::steady_clock::now();
+            const UINT64 uFirstUs = m_vPackets.front().uTimeUs;
+
+            for (const Packet& recorded : m_vPackets)
+            {
+                if ((uDirections & (1u << recorded.eDirection)) == 0)
+                {
+                    continue;
+                }
+                if (eMode == CIGI_REPLAY_REAL_TIME)
+                {
+                    std::this_thread::sleep_until(tStart + std::chrono::microseconds(recorded.uTimeUs - uFirstUs));
+                }
+
+                packet.Reset(recorded, m_vData.data() + recorded.uOffset);
+                const USHORT uID = recorded.uID;
+
+                auto tCall = std::chrono::steady_clock::now();
+                switch (recorded.eDirection)
+                {
+                case CIGI_PACKET_CUSTOM_SEND:   pTarget->OnCustomSend(uID, packet); break;
+                case CIGI_PACKET_P3D_RECEIVE:   pTarget->OnP3DReceive(uID, packet); break;
+                default:                        pTarget->OnP3DSend(uID, packet); break;
+                }
+                float fUs = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - tCall).count();
+
+                m_mapSamples[uID].push_back(fUs);
+                m_uReplayed++;
+            }
+
+            m_dElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+            return S_OK;
+        }
+
+        /** Computes latency statistics for a packet ID. @return False if the ID was not replayed. */
+        bool GetLatencyStats(__in USHORT uPacketID, __out CigiLatencyStats& stats) const
+        {
+            auto it = m_mapSamples.find(uPacketID);
+            if (it == m_mapSamples.end() || it->second.empty())
+            {
+                return false;
+            }
+
+            std::vector<float> vSorted = it->second;
+            std::sort(vSorted.begin(), vSorted.end());
+            double dSum = 0.0;
+            for (float f : vSorted)
+            {
+                dSum += f;
+            }
+            stats.uCount = vSorted.size();
+            stats.dMeanUs = dSum / vSorted.size();
+            stats.dP50Us = Percentile(vSorted, 0.50);
+            stats.dP90Us = Percentile(vSorted, 0.90);
+            stats.dP99Us = Percentile(vSorted, 0.99);
+            stats.dMaxUs = vSorted.back();
+            return true;
+        }
+
+        /** Returns the packet IDs seen by the last Replay(), in ascending order. */
+        void GetReplayedPacketIds(__out std::vector<USHORT>& vIds) const
+        {
+            vIds.clear();
+            for (const auto& entry : m_mapSamples)
+            {
+                vIds.push_back(entry.first);
+            }
+        }
+
+        /// Number of packets loaded.
+        UINT GetPacketCount() const { return (UINT)m_vPackets.size(); }
+        /// Recorded duration in seconds.
+        double GetRecordedDuration() const { return m_vPackets.empty() ? 0.0 : (m_vPackets.back().uTimeUs - m_vPackets.front().uTimeUs) * 1.0e-6; }
+        /// Number of packets delivered by the last Replay().
+        UINT64 GetReplayedCount() const { return m_uReplayed; }
+        /// Packets per second achieved by the last Replay().
+        double GetPacketsPerSecond() const { return m_dElapsed > 0.0 ? m_uReplayed / m_dElapsed : 0.0; }
+        /// Number of ICigiPacketV440::SendData() calls made by the callback during the last Replay().
+        UINT64 GetSendDataCount() const { return m_uSendDataCalls; }
+
+    private:
+        struct Packet
+        {
+            UINT64                  uTimeUs;
+            UINT                    uOffset;
+            USHORT                  uSize;
+            USHORT                  uID;
+            CIGI_PACKET_DIRECTION   eDirection;
+            BYTE                    uMajor;
+            BYTE                    uMinor;
+        };
+
+        /// Stand-in for the packet Prepar3D passes to the callbacks.  Lives on the stack for the whole replay.
+        class ReplayPacket : public ICigiPacketV440
+        {
+        public:
+            explicit ReplayPacket(CigiPacketReplayer& replayer)
+                : m_Replayer(replayer)
+            {
+            }
+
+            void Reset(const Packet& packet, const BYTE* pData)
+            {
+                m_uID = packet.uID;
+                m_uMajor = packet.uMajor;
+                m_uMinor = packet.uMinor;
+                m_vData.assign(pData, pData + packet.uSize);
+            }
+
+            STDMETHOD_(USHORT, GetPacketID)() const override { return m_uID; }
+            STDMETHOD_(USHORT, GetPacketSize)() const override { return (USHORT)m_vData.size(); }
+            STDMETHOD_(BYTE, GetMajorVersion)() const override { return m_uMajor; }
+            STDMETHOD_(BYTE, GetMinorVersion)() const override { return m_uMinor; }
+            STDMETHOD_(void, SetPacketID)(USHORT PacketID) override { m_uID = PacketID; }
+
+            STDMETHOD(GetData)(void* pData, UINT cbSize) const override
+            {
+                if (pData == nullptr || cbSize > m_vData.size())
+                {
+                    return E_INVALIDARG;
+                }
+                memcpy(pData, m_vData.data(), cbSize);
+                return S_OK;
+            }
+
+            STDMETHOD(SetData)(void* pData, UINT cbSize) override
+            {
+                if (pData == nullptr && cbSize > 0)
+                {
+                    return E_INVALIDARG;
+                }
+                m_vData.assign((const BYTE*)pData, (const BYTE*)pData + cbSize);
+                return S_OK;
+            }
+
+            STDMETHOD(SendData)() override
+            {
+                m_Replayer.m_uSendDataCalls++;
+                return S_OK;
+            }
+
+            // Not heap allocated, so reference counting never deletes it.
+            STDMETHOD_(ULONG, AddRef)() override { return 1; }
+            STDMETHOD_(ULONG, Release)() override { return 1; }
+
+            STDMETHODIMP QueryInterface(REFIID riid, PVOID* ppv)
+            {
+                HRESULT hr = E_NOINTERFACE;
+
+                if (ppv == nullptr)
+                {
+                    return E_POINTER;
+                }
+
+                *ppv = nullptr;
+
+                if (IsEqualIID(riid, IID_ICigiPacketV440))
+                {
+                    *ppv = static_cast<ICigiPacketV440*>(this);
+                }
+                else if (IsEqualIID(riid, IID_IUnknown))
+                {
+                    *ppv = static_cast<IUnknown*>(this);
+                }
+                if (*ppv)
+                {
+                    hr = S_OK;
+                }
+
+                return hr;
+            }
+
+        private:
+            CigiPacketReplayer& m_Replayer;
+            std::vector<BYTE>   m_vData;
+            USHORT              m_uID = 0;
+            BYTE                m_uMajor = 0;
+            BYTE                m_uMinor = 0;
+        };
+
+        static double Percentile(const std::vector<float>& vSorted, double dFraction)
+        {
+            size_t uIndex = (size_t)(dFraction * (vSorted.size() - 1) + 0.5);
+            return vSorted[uIndex];
+        }
+
+        std::vector<Packet>                     m_vPackets;
+        std::vector<BYTE>                       m_vData;
+        std::map<USHORT, std::vector<float>>    m_mapSamples;
+        UINT64                                  m_uReplayed = 0;
+        UINT64                                  m_uSendDataCalls = 0;
+        double                                  m_dElapsed = 0.0;
+    };
+    /** @} */
+}
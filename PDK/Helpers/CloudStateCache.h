@@ -0,0 +1,422 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// CloudStateCache.h
+
+#pragma once
+#include <ObjBase.h>
+#include "IWeatherSystem.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace P3D
+{
+    /** @addtogroup weatherservice */ /** @{ */
+
+    /// Counters kept by CloudStateCache.
+    struct CloudStateCacheStats
+    {
+        UINT64  uQueries;           ///< Calls to RequestCloudState() on the cache
+        UINT64  uTileRequests;      ///< Calls made to IWeatherSystemV500::RequestCloudState()
+        UINT64  uStaleTilesServed;  ///< Tile reads that used an expired tile because the refresh budget was spent
+        UINT    uTileCount;         ///< Tiles currently cached
+    };
+
+    /**
+    * Serves IWeatherSystemV500::RequestCloudState() queries from a cache of world aligned tiles.
+    * The world is divided into tiles of a fixed latitude and longitude span and altitude band, and each
+    * tile is fetched with one RequestCloudState() call over exactly its bounds.  A query is answered by
+    * sampling the 64 x 64 cells of the tiles it overlaps, so sensors re-requesting overlapping volumes
+    * every frame are served from memory.  When a query spans several altitude bands a cell reports the
+    * largest layer count among the bands.
+    * @remarks  Tiles expire every refresh period passed to SetDynamicUpdateRate().  The SDK does not say how
+    *           often each rate changes the clouds, so the period is the caller's choice, e.g. measured by
+    *           comparing fetched grids over time; at rate 0 formations never change and tiles do not expire
+    *           by time.  Each tile's expiry is offset by a per tile phase, so tiles expire a few at a time.
+    * @remarks  The weather system only models about 128 km around the user aircraft and returns zeros
+    *           beyond it.  A tile not wholly inside that radius when fetched is fetched again once the user
+    *           has moved at least a cell and the tile is at least partly inside the radius, whatever the rate.
+    * @remarks  Expired tiles are refreshed as queries touch them, up to a refresh budget per frame; beyond
+    *           the budget, or if the refresh fails, the previous tile is served.  Missing tiles are always fetched.
+    * @remarks  Cells are assumed to be stored latitude row by row as in RequestCloudState(), with row 0
+    *           and column 0 at the minimum latitude and longitude.
+    * Sample usage:
+    * ```
+    *      CloudStateCache cache;
+    *      cache.SetDynamicUpdateRate(spWeatherSystem, 3, 30.0);
+    *
+    *      // Every frame, with the user aircraft position:
+    *      cache.BeginFrame(dSimSeconds, dUserLatRadians, dUserLonRadians);
+    *      BYTE cloudState[CloudStateCache::CELL_COUNT];
+    *      UINT64 uVersion = 0;
+    *      if (SUCCEEDED(cache.RequestCloudState(spWeatherSystem, dLatMin, dLonMin, dAltMin, dLatMax, dLonMax, dAltMax,
+    *                                            sizeof(cloudState), cloudState, &uVersion)) && uVersion != uLastVersion)
+    *      {
+    *          // Cloud state changed since the last query of this volume.
+    *      }
+    * ```
+    */
+    class CloudStateCache
+    {
+    public:
+        /// Cells per side of a cloud state grid.
+        static const UINT GRID_SIZE = 64;
+        /// Bytes in a cloud state grid.
+        static const UINT CELL_COUNT = GRID_SIZE * GRID_SIZE;
+        /// Default radius around the user aircraft the weather system models, about 128 km as documented by RequestCloudState().
+        static constexpr double MODELED_RADIUS_FEET = 128000.0 / 0.3048;
+
+        /**
+        * @param dTileRadians   Latitude and longitude span of a tile.
+        * @param dBandFeet      Altitude span of a tile.
+        * @param uMaxTiles      Tiles kept before the least recently used are evicted.
+        * @param uRefreshBudget Expired tiles refreshed per frame.
+        */
+        CloudStateCache(__in double dTileRadians = 0.25 * 0.01745329251994, __in double dBandFeet = 10000.0,
+                        __in UINT uMaxTiles = 256, __in UINT uRefreshBudget = 4)
+            : m_dTileRadians(dTileRadians),
+              m_dBandFeet(dBandFeet),
+              m_uMaxTiles(std::max(uMaxTiles, 1u)),
+              m_uRefreshBudget(uRefreshBudget),
+              m_uRefreshesLeft(uRefreshBudget)
+        {
+            memset(&m_Stats, 0, sizeof(m_Stats));
+        }
+
+        /**
+        * Starts a frame.  Resets the refresh budget and sets the time and user position used to expire tiles.
+        * @param dSimSeconds        Simulation time.
+        * @param dUserLatRadians    Latitude of the user aircraft, the center of the modeled weather region.
+        * @param dUserLonRadians    Longitude of the user aircraft.
+        */
+        void BeginFrame(__in double dSimSeconds, __in double dUserLatRadians, __in double dUserLonRadians)
+        {
+            m_dNow = dSimSeconds;
+            m_dUserLat = dUserLatRadians;
+            m_dUserLon = dUserLonRadians;
+            m_uRefreshesLeft = m_uRefreshBudget;
+            m_uFrame++;
+        }
+
+        /**
+        * Sets the cloud update rate on the weather system and how long tiles stay valid at that rate.
+        * @param pWeather           Weather system.
+        * @param dwRate             0 to 5, as IWeatherSystemV500::SetDynamicUpdateRate().
+        * @param dRefreshSeconds    Tile lifetime at this rate.  Ignored for rate 0, where clouds do not change.
+        */
+        HRESULT SetDynamicUpdateRate(__in __notnull IWeatherSystemV500* pWeather, __in DWORD dwRate, __in double dRefreshSeconds)
+        {
+            HRESULT hr = pWeather->SetDynamicUpdateRate(dwRate);
+            if (SUCCEEDED(hr))
+            {
+                SetRefreshPeriod(dwRate == 0 ? 0.0 : dRefreshSeconds);
+            }
+            return hr;
+        }
+
+        /// Sets the tile lifetime for a rate the weather system was set to elsewhere.  0 never expires tiles by time.
+        void SetRefreshPeriod(__in double dSeconds)
+        {
+            m_dRefreshPeriod = std::max(dSeconds, 0.0);
+        }
+
+        /// Sets the radius around the user aircraft the weather system is assumed to model.
+        void SetModeledRadius(__in double dFeet)
+        {
+            m_dModeledRadiusFeet = std::max(dFeet, 0.0);
+        }
+
+        /// Expires every tile, e.g. after the weather theme or METAR data changed.
+        void Invalidate()
+        {
+            m_uGeneration++;
+        }
+
+        /**
+        * Fills a cloud state grid for a volume, as IWeatherSystemV500::RequestCloudState().
+        * @param pWeather   Weather system used to fetch missing and expired tiles.
+        * @param pVersion   Optional.  Receives a version that changes whenever a tile covering the volume was
+        *                   fetched again, so callers can skip reprocessing an unchanged grid.
+        * @return           S_OK, E_INVALIDARG if cbCloudState is not CELL_COUNT or the volume is empty, or the
+        *                   error of a failed tile fetch.
+        */
+        HRESULT RequestCloudState(__in __notnull IWeatherSystemV500* pWeather,
+                                  __in double dLatRadiansMin, __in double dLonRadiansMin, __in double dAltFeetMin,
+                                  __in double dLatRadiansMax, __in double dLonRadiansMax, __in double dAltFeetMax,
+                                  __in UINT cbCloudState, __out __notnull BYTE* pCloudState, __out UINT64* pVersion = nullptr)
+        {
+            if (cbCloudState != CELL_COUNT || !(dLatRadiansMax > dLatRadiansMin) || !(dLonRadiansMax > dLonRadiansMin) || dAltFeetMax < dAltFeetMin)
+            {
+                return E_INVALIDARG;
+            }
+            m_Stats.uQueries++;
+
+            const int iBandMin = (int)floor(dAltFeetMin / m_dBandFeet);
+            const int iBandMax = std::max((int)ceil(dAltFeetMax / m_dBandFeet) - 1, iBandMin);
+            const int iLatMin = (int)floor(dLatRadiansMin / m_dTileRadians);
+            const int iLatMax = std::max((int)ceil(dLatRadiansMax / m_dTileRadians) - 1, iLatMin);
+            const int iLonMin = (int)floor(dLonRadiansMin / m_dTileRadians);
+            const int iLonMax = std::max((int)ceil(dLonRadiansMax / m_dTileRadians) - 1, iLonMin);
+
+            // Resolve every overlapped tile first so that a failed fetch leaves pCloudState untouched.
+            UINT64 uVersion = 0;
+            for (int iBand = iBandMin; iBand <= iBandMax; iBand++)
+            {
+                for (int iLat = iLatMin; iLat <= iLatMax; iLat++)
+                {
+                    for (int iLon = iLonMin; iLon <= iLonMax; iLon++)
+                    {
+                        const Tile* pTile = nullptr;
+                        HRESULT hr = GetTile(pWeather, iLat, iLon, iBand, pTile);
+                        if (FAILED(hr))
+                        {
+                            return hr;
+                        }
+                        uVersion = std::max(uVersion, pTile->uSerial);
+                    }
+                }
+            }
+
+            const double dLatStep = (dLatRadiansMax - dLatRadiansMin) / GRID_SIZE;
+            const double dLonStep = (dLonRadiansMax - dLonRadiansMin) / GRID_SIZE;
+            const double dCellsPerRadian = GRID_SIZE / m_dTileRadians;
+            memset(pCloudState, 0, CELL_COUNT);
+            for (int iBand = iBandMin; iBand <= iBandMax; iBand++)
+            {
+                for (UINT uRow = 0; uRow < GRID_SIZE; uRow++)
+                {
+                    // Absolute cell row of the sample, split into tile and cell within the tile.
+                    const INT64 iRow = (INT64)floor((dLatRadiansMin + (uRow + 0.5) * dLatStep) * dCellsPerRadian);
+                    const int iLat = (int)FloorDiv(iRow, GRID_SIZE);
+                    const UINT uTileRow = (UINT)(iRow - (INT64)iLat * GRID_SIZE);
+
+                    const Tile* pTile = nullptr;
+                    int iTileLon = INT_MIN;
+                    BYTE* pOut = pCloudState + uRow * GRID_SIZE;
+                    for (UINT uColumn = 0; uColumn < GRID_SIZE; uColumn++)
+                    {
+                        const INT64 iColumn = (INT64)floor((dLonRadiansMin + (uColumn + 0.5) * dLonStep) * dCellsPerRadian);
+                        const int iLon = (int)FloorDiv(iColumn, GRID_SIZE);
+                        if (iLon != iTileLon)
+                        {
+                            pTile = FindTile(iLat, iLon, iBand);
+                            iTileLon = iLon;
+                        }
+                        if (pTile != nullptr)
+                        {
+                            BYTE uCell = pTile->Cells[uTileRow * GRID_SIZE + (UINT)(iColumn - (INT64)iLon * GRID_SIZE)];
+                            pOut[uColumn] = std::max(pOut[uColumn], uCell);
+                        }
+                    }
+                }
+            }
+
+            if (pVersion != nullptr)
+            {
+                *pVersion = uVersion;
+            }
+            return S_OK;
+        }
+
+        /// Drops every cached tile.
+        void Clear()
+        {
+            m_Tiles.clear();
+        }
+
+        /// Cache counters.
+        CloudStateCacheStats GetStats() const
+        {
+            CloudStateCacheStats stats = m_Stats;
+            stats.uTileCount = (UINT)m_Tiles.size();
+            return stats;
+        }
+
+    private:
+        static constexpr double EARTH_RADIUS_FEET = 20902231.0;
+
+        struct Tile
+        {
+            BYTE    Cells[CELL_COUNT];
+            UINT64  uSerial;        ///< Fetch number, unique and increasing across the cache
+            UINT64  uGeneration;    ///< Invalidate() count when fetched
+            INT64   iTick;          ///< Update tick when fetched
+            UINT    uLastUsedFrame;
+            bool    bPartial;       ///< Some of the tile was outside the modeled radius when fetched
+            double  dFetchLat;      ///< User position when fetched
+            double  dFetchLon;
+        };
+
+        static INT64 FloorDiv(INT64 iValue, INT64 iDivisor)
+        {
+            INT64 iQuotient = iValue / iDivisor;
+            return (iValue % iDivisor != 0 && iValue < 0) ? iQuotient - 1 : iQuotient;
+        }
+
+        static UINT64 MakeKey(int iLat, int iLon, int iBand)
+        {
+            return ((UINT64)(UINT)(iLat & 0xFFFFFF) << 40) | ((UINT64)(UINT)(iLon & 0xFFFFFF) << 16) | (UINT64)(iBand & 0xFFFF);
+        }
+
+        /// Update tick a tile belongs to at the current time.  The phase staggers expiry across tiles.
+        INT64 GetTick(UINT64 uKey) const
+        {
+            if (m_dRefreshPeriod <= 0.0)
+            {
+                return 0;
+            }
+            const double dPhase = (double)((uKey * 0x9E3779B97F4A7C15ull) >> 40) / (double)(1ull << 24);
+            return (INT64)floor(m_dNow / m_dRefreshPeriod + dPhase);
+        }
+
+        /// Flat earth distance, accurate enough at the scale of the modeled region.
+        static double DistanceFeet(double dLat0, double dLon0, double dLat1, double dLon1)
+        {
+            const double dNorth = dLat1 - dLat0;
+            const double dEast = (dLon1 - dLon0) * cos(0.5 * (dLat0 + dLat1));
+            return sqrt(dNorth * dNorth + dEast * dEast) * EARTH_RADIUS_FEET;
+        }
+
+        /// Distances from the user to the nearest and farthest points of a tile.
+        void GetTileRange(int iLat, int iLon, double& dNearestFeet, double& dFarthestFeet) const
+        {
+            const double dLat0 = iLat * m_dTileRadians;
+            const double dLon0 = iLon * m_dTileRadians;
+            const double dNearLat = std::min(std::max(m_dUserLat, dLat0), dLat0 + m_dTileRadians);
+            const double dNearLon = std::min(std::max(m_dUserLon, dLon0), dLon0 + m_dTileRadians);
+            dNearestFeet = DistanceFeet(m_dUserLat, m_dUserLon, dNearLat, dNearLon);
+            dFarthestFeet = 0.0;
+            for (int i = 0; i < 4; i++)
+            {
+                const double dCornerLat = dLat0 + (i & 1) * m_dTileRadians;
+                const double dCornerLon = dLon0 + (i >> 1) * m_dTileRadians;
+                dFarthestFeet = std::max(dFarthestFeet, DistanceFeet(m_dUserLat, m_dUserLon, dCornerLat, dCornerLon));
+            }
+        }
+
+        /// True if a tile fetched partly outside the modeled radius could now hold more of the region.
+        bool IsCoverageStale(const Tile& tile, int iLat, int iLon) const
+        {
+            if (!tile.bPartial)
+            {
+                return false;
+            }
+            const double dCellFeet = m_dTileRadians / GRID_SIZE * EARTH_RADIUS_FEET;
+            if (DistanceFeet(tile.dFetchLat, tile.dFetchLon, m_dUserLat, m_dUserLon) < dCellFeet)
+            {
+                return false;
+            }
+            double dNearestFeet, dFarthestFeet;
+            GetTileRange(iLat, iLon, dNearestFeet, dFarthestFeet);
+            return dNearestFeet < m_dModeledRadiusFeet;
+        }
+
+        const Tile* FindTile(int iLat, int iLon, int iBand) const
+        {
+            auto it = m_Tiles.find(MakeKey(iLat, iLon, iBand));
+            return it != m_Tiles.end() ? &it->second : nullptr;
+        }
+
+        HRESULT GetTile(IWeatherSystemV500* pWeather, int iLat, int iLon, int iBand, const Tile*& pTile)
+        {
+            const UINT64 uKey = MakeKey(iLat, iLon, iBand);
+            const INT64 iTick = GetTick(uKey);
+            auto it = m_Tiles.find(uKey);
+            if (it != m_Tiles.end())
+            {
+                Tile& tile = it->second;
+                tile.uLastUsedFrame = m_uFrame;
+                pTile = &tile;
+                if (tile.uGeneration == m_uGeneration && tile.iTick == iTick && !IsCoverageStale(tile, iLat, iLon))
+                {
+                    return S_OK;
+                }
+                if (m_uRefreshesLeft == 0)
+                {
+                    m_Stats.uStaleTilesServed++;
+                    return S_OK;
+                }
+                m_uRefreshesLeft--;
+                if (FAILED(FetchTile(pWeather, iLat, iLon, iBand, iTick, tile)))
+                {
+                    m_Stats.uStaleTilesServed++;
+                }
+                return S_OK;
+            }
+
+            if (m_Tiles.size() >= m_uMaxTiles)
+            {
+                EvictLeastRecentlyUsed();
+            }
+            Tile& tile = m_Tiles[uKey];
+            tile.uLastUsedFrame = m_uFrame;
+            HRESULT hr = FetchTile(pWeather, iLat, iLon, iBand, iTick, tile);
+            if (FAILED(hr))
+            {
+                m_Tiles.erase(uKey);
+                return hr;
+            }
+            pTile = &tile;
+            return S_OK;
+        }
+
+        HRESULT FetchTile(IWeatherSystemV500* pWeather, int iLat, int iLon, int iBand, INT64 iTick, Tile& tile)
+        {
+            m_Stats.uTileRequests++;
+            HRESULT hr = pWeather->RequestCloudState(iLat * m_dTileRadians, iLon * m_dTileRadians, iBand * m_dBandFeet,
+                                                     (iLat + 1) * m_dTileRadians, (iLon + 1) * m_dTileRadians, (iBand + 1) * m_dBandFeet,
+                                                     CELL_COUNT, tile.Cells);
+            if (SUCCEEDED(hr))
+            {
+                double dNearestFeet, dFarthestFeet;
+                GetTileRange(iLat, iLon, dNearestFeet, dFarthestFeet);
+                tile.uSerial = ++m_uSerial;
+                tile.uGeneration = m_uGeneration;
+                tile.iTick = iTick;
+                tile.bPartial = dFarthestFeet > m_dModeledRadiusFeet;
+                tile.dFetchLat = m_dUserLat;
+                tile.dFetchLon = m_dUserLon;
+            }
+            return hr;
+        }
+
+        void EvictLeastRecentlyUsed()
+        {
+            // Tiles used this frame may still be sampled by the current query, so the cache grows instead.
+            auto itOldest = m_Tiles.end();
+            for (auto it = m_Tiles.begin(); it != m_Tiles.end(); ++it)
+            {
+                if (it->second.uLastUsedFrame != m_uFrame &&
+                    (itOldest == m_Tiles.end() || it->second.uLastUsedFrame < itOldest->second.uLastUsedFrame))
+                {
+                    itOldest = it;
+                }
+            }
+            if (itOldest != m_Tiles.end())
+            {
+                m_Tiles.erase(itOldest);
+            }
+        }
+
+        const double                        m_dTileRadians;
+        const double                        m_dBandFeet;
+        const UINT                          m_uMaxTiles;
+        const UINT                          m_uRefreshBudget;
+        double                              m_dRefreshPeriod = 0.0;
+        double                              m_dModeledRadiusFeet = MODELED_RADIUS_FEET;
+        std::unordered_map<UINT64, Tile>    m_Tiles;
+        CloudStateCacheStats                m_Stats;
+        double                              m_dNow = 0.0;
+        double                              m_dUserLat = 0.0;
+        double                              m_dUserLon = 0.0;
+        UINT64                              m_uSerial = 0;
+        UINT64                              m_uGeneration = 0;
+        UINT                                m_uFrame = 0;
+        UINT                                m_uRefreshesLeft;
+    };
+    /** @} */
+}
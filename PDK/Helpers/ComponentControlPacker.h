@@ -0,0 +1,336 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// ComponentControlPacker.h
+
+#pragma once
+#include <ObjBase.h>
+#include "INetworkServices.h"
+
+#include <cstring>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup networkservices */ /** @{ */
+
+    /// Field types a ComponentControlPacker layout can map.
+    enum COMPONENT_FIELD_TYPE
+    {
+        COMPONENT_FIELD_UCHAR,
+        COMPONENT_FIELD_CHAR,
+        COMPONENT_FIELD_USHORT,
+        COMPONENT_FIELD_SHORT,
+        COMPONENT_FIELD_UINT,
+        COMPONENT_FIELD_INT,
+        COMPONENT_FIELD_FLOAT,
+        COMPONENT_FIELD_UINT64,
+        COMPONENT_FIELD_DOUBLE,
+    };
+
+    /// Component Control header values that vary per component.
+    struct ComponentControlHeader
+    {
+        UINT16  uComponentID;
+        UINT16  uInstanceID;
+        UINT8   uComponentClass;
+        UINT8   uComponentState;
+    };
+
+    /**
+    * Maps a caller defined struct onto the data words of a CIGI Component Control packet.  The layout is
+    * declared once with AddField(); Encode() then fills an IComponentControlV430 from a struct instance and
+    * EncodeBatch() sends an array of them from a single IComponentControlCallbackV430::OnSend() call.
+    * @remarks  Byte, short and 32-bit fields sharing a data word are merged locally, so each data word
+    *           costs one SetUIntData() call no matter how many fields it holds.  64-bit fields are written
+    *           with SetUInt64Data()/SetDoubleData() and occupy data words 2n and 2n+1 for 64-bit word n.
+    * Sample usage:
+    * ```
+    *      struct Lights { float fIntensity; UINT8 uMode; UINT8 uColor; UINT16 uFlags; };
+    *
+    *      ComponentControlPacker packer;
+    *      packer.AddField(COMPONENT_FIELD_FLOAT, offsetof(Lights, fIntensity), 0);
+    *      packer.AddField(COMPONENT_FIELD_UCHAR, offsetof(Lights, uMode), 1, BYTE_POS_0);
+    *      packer.AddField(COMPONENT_FIELD_UCHAR, offsetof(Lights, uColor), 1, BYTE_POS_1);
+    *      packer.AddField(COMPONENT_FIELD_USHORT, offsetof(Lights, uFlags), 1, SHORT_POS_1);
+    *
+    *      // In OnSend():
+    *      packer.EncodeBatch(CompCtrl, headers, lights, sizeof(Lights), uCount);
+    * ```
+    */
+    class ComponentControlPacker
+    {
+    public:
+        /// Number of 32-bit data words in a Component Control packet.
+        static const UINT MAX_WORDS = 6;
+        /// Number of 32-bit data words in a Short Component Control packet.
+        static const UINT MAX_SHORT_WORDS = 2;
+
+        /**
+        * @param bShortComponent    True to send Short Component Control packets.
+        */
+        explicit ComponentControlPacker(__in bool bShortComponent = false)
+            : m_bShort(bShortComponent)
+        {
+        }
+
+        /**
+        * Adds a struct field to the layout.
+        * @param eType      Type of the field in both the struct and the packet.
+        * @param uOffset    Byte offset of the field in the struct, e.g. from offsetof().
+        * @param uWord      Data word index.  For 64-bit types this is the 64-bit word index.
+        * @param uPos       BYTE_POS for byte fields or SHORT_POS for short fields; ignored otherwise.
+        * @return           S_OK, or E_INVALIDARG if the field is out of range or overlaps another field.
+        */
+        HRESULT AddField(__in COMPONENT_FIELD_TYPE eType, __in UINT uOffset, __in UINT uWord, __in UINT uPos = 0)
+        {
+            const UINT uSize = GetFieldSize(eType);
+            const UINT uWords = m_bShort ? MAX_SHORT_WORDS : MAX_WORDS;
+
+            // Packet byte range covered by the field, with word w occupying bytes [4w, 4w + 4).
+            UINT uFirstByte = 0;
+            if (uSize == 8)
+            {
+                uFirstByte = uWord * 8;
+            }
+            else if (uSize == 4)
+            {
+                uFirstByte = uWord * 4;
+            }
+            else if (uPos < 4 / uSize)
+            {
+                uFirstByte = uWord * 4 + uPos * uSize;
+            }
+            else
+            {
+                return E_INVALIDARG;
+            }
+
+            if (uFirstByte + uSize > uWords * 4)
+            {
+                return E_INVALIDARG;
+            }
+
+            UINT uMask = ((1u << uSize) - 1) << uFirstByte;
+            if ((m_uUsedBytes & uMask) != 0)
+            {
+                return E_INVALIDARG;
+            }
+            m_uUsedBytes |= uMask;
+
+            Field field = { eType, uOffset, uWord, uPos };
+            if (uSize == 8)
+            {
+                m_vWideFields.push_back(field);
+            }
+            else
+            {
+                m_vFields.push_back(field);
+            }
+            return S_OK;
+        }
+
+        /** Removes every field from the layout. */
+        void ClearLayout()
+        {
+            m_vFields.clear();
+            m_vWideFields.clear();
+            m_uUsedBytes = 0;
+        }
+
+        /**
+        * Fills the component control interface from a struct and queues it with SendData().
+        * @param CompCtrl   Interface passed to IComponentControlCallbackV430::OnSend().
+        * @param header     Component ID, instance, class and state.
+        * @param pStruct    Struct matching the layout.
+        */
+        void Encode(__in IComponentControlV430& CompCtrl, __in const ComponentControlHeader& header, __in __notnull const void* pStruct)
+        {
+            const BYTE* pSrc = static_cast<const BYTE*>(pStruct);
+
+            CompCtrl.SetShortComponent(m_bShort);
+            CompCtrl.SetComponentID(header.uComponentID);
+            CompCtrl.SetInstanceID(header.uInstanceID);
+            CompCtrl.SetComponentClass(header.uComponentClass);
+            CompCtrl.SetComponentState(header.uComponentState);
+
+            UINT32 uPacked[MAX_WORDS] = {};
+            for (const Field& field : m_vFields)
+            {
+                UINT32 uValue = 0;
+                switch (GetFieldSize(field.eType))
+                {
+                case 1: uValue = *(pSrc + field.uOffset); break;
+                case 2: { UINT16 u; memcpy(&u, pSrc + field.uOffset, sizeof(u)); uValue = u; break; }
+                default: memcpy(&uValue, pSrc + field.uOffset, sizeof(uValue)); break;
+                }
+                uPacked[field.uWord] |= uValue << (field.uPos * GetFieldSize(field.eType) * 8);
+            }
+
+            // Every 32-bit word not owned by a 64-bit field is written, so stale data never leaks between components.
+            const UINT uWords = m_bShort ? MAX_SHORT_WORDS : MAX_WORDS;
+            for (UINT uWord = 0; uWord < uWords; uWord++)
+            {
+                if (!IsWideWord(uWord))
+                {
+                    CompCtrl.SetUIntData(uPacked[uWord], uWord);
+                }
+            }
+
+            for (const Field& field : m_vWideFields)
+            {
+                if (field.eType == COMPONENT_FIELD_DOUBLE)
+                {
+                    double d;
+                    memcpy(&d, pSrc + field.uOffset, sizeof(d));
+                    CompCtrl.SetDoubleData(d, field.uWord);
+                }
+                else
+                {
+                    UINT64 u;
+                    memcpy(&u, pSrc + field.uOffset, sizeof(u));
+                    CompCtrl.SetUInt64Data(u, field.uWord);
+                }
+            }
+
+            CompCtrl.SendData();
+            m_uEncoded++;
+        }
+
+        /**
+        * Encodes and sends an array of components.
+        * @param CompCtrl   Interface passed to IComponentControlCallbackV430::OnSend().
+        * @param pHeaders   One header per component.
+        * @param pStructs   First struct of the array.
+        * @param uStride    Distance in bytes between consecutive structs, usually sizeof(struct).
+        * @param uCount     Number of components.
+        */
+        void EncodeBatch(__in IComponentControlV430& CompCtrl, __in const ComponentControlHeader* pHeaders, __in const void* pStructs,
+                         __in UINT uStride, __in UINT uCount)
+        {
+            const BYTE* pSrc = static_cast<const BYTE*>(pStructs);
+            for (UINT i = 0; i < uCount; i++)
+            {
+                Encode(CompCtrl, pHeaders[i], pSrc + (size_t)i * uStride);
+            }
+        }
+
+        /**
+        * Reads a received component into a struct, the inverse of Encode().
+        * @param CompCtrl   Interface passed to IComponentControlCallbackV430::OnReceive().
+        * @param header     Received component ID, instance, class and state.
+        * @param pStruct    Struct matching the layout.  Fields not in the layout are left unchanged.
+        */
+        void Decode(__in const IComponentControlV430& CompCtrl, __out ComponentControlHeader& header, __out void* pStruct) const
+        {
+            BYTE* pDest = static_cast<BYTE*>(pStruct);
+
+            header.uComponentID = CompCtrl.GetComponentID();
+            header.uInstanceID = CompCtrl.GetInstanceID();
+            header.uComponentClass = CompCtrl.GetComponentClass();
+            header.uComponentState = CompCtrl.GetComponentState();
+
+            UINT32 uPacked[MAX_WORDS] = {};
+            const UINT uWords = m_bShort ? MAX_SHORT_WORDS : MAX_WORDS;
+            for (UINT uWord = 0; uWord < uWords; uWord++)
+            {
+                if (IsNarrowWord(uWord))
+                {
+                    uPacked[uWord] = CompCtrl.GetUIntData(uWord);
+                }
+            }
+
+            for (const Field& field : m_vFields)
+            {
+                const UINT uSize = GetFieldSize(field.eType);
+                UINT32 uValue = uPacked[field.uWord] >> (field.uPos * uSize * 8);
+                switch (uSize)
+                {
+                case 1: *(pDest + field.uOffset) = (BYTE)uValue; break;
+                case 2: { UINT16 u = (UINT16)uValue; memcpy(pDest + field.uOffset, &u, sizeof(u)); break; }
+                default: memcpy(pDest + field.uOffset, &uValue, sizeof(uValue)); break;
+                }
+            }
+
+            for (const Field& field : m_vWideFields)
+            {
+                if (field.eType == COMPONENT_FIELD_DOUBLE)
+                {
+                    double d = CompCtrl.GetDoubleData(field.uWord);
+                    memcpy(pDest + field.uOffset, &d, sizeof(d));
+                }
+                else
+                {
+                    UINT64 u = CompCtrl.GetUInt64Data(field.uWord);
+                    memcpy(pDest + field.uOffset, &u, sizeof(u));
+                }
+            }
+        }
+
+        /// Number of components encoded so far.
+        UINT64 GetEncodedCount() const { return m_uEncoded; }
+        /// True if the packer sends Short Component Control packets.
+        bool IsShortComponent() const { return m_bShort; }
+
+        /// Size in bytes of a field type.
+        static UINT GetFieldSize(__in COMPONENT_FIELD_TYPE eType)
+        {
+            switch (eType)
+            {
+            case COMPONENT_FIELD_UCHAR:
+            case COMPONENT_FIELD_CHAR:
+                return 1;
+            case COMPONENT_FIELD_USHORT:
+            case COMPONENT_FIELD_SHORT:
+                return 2;
+            case COMPONENT_FIELD_UINT64:
+            case COMPONENT_FIELD_DOUBLE:
+                return 8;
+            default:
+                return 4;
+            }
+        }
+
+    private:
+        struct Field
+        {
+            COMPONENT_FIELD_TYPE    eType;
+            UINT                    uOffset;
+            UINT                    uWord;
+            UINT                    uPos;
+        };
+
+        /// True if the 32-bit word belongs to a 64-bit field.
+        bool IsWideWord(UINT uWord) const
+        {
+            for (const Field& field : m_vWideFields)
+            {
+                if (field.uWord * 2 == uWord || field.uWord * 2 + 1 == uWord)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// True if the 32-bit word holds at least one byte, short or 32-bit field.
+        bool IsNarrowWord(UINT uWord) const
+        {
+            for (const Field& field : m_vFields)
+            {
+                if (field.uWord == uWord)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::vector<Field>  m_vFields;
+        std::vector<Field>  m_vWideFields;
+        UINT64              m_uEncoded = 0;
+        UINT                m_uUsedBytes = 0;
+        bool                m_bShort;
+    };
+    /** @} */
+}
@@ -0,0 +1,510 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// CustomPacketScheduler.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "INetworkServices.h"
+#include "NetInOutPublic.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cwchar>
+#include <deque>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup networkservices */ /** @{ */
+
+    /**
+    * Statistics kept by CustomPacketScheduler for each registered custom packet.
+    */
+    struct CustomPacketStats
+    {
+        UINT64 uSent = 0;           ///< Packets passed to SendCustomPacket()
+        UINT64 uBytesSent = 0;      ///< Bytes serialized by OnSend() for sent packets
+        UINT64 uReceived = 0;       ///< Packets received through OnReceive()
+        UINT64 uBytesReceived = 0;  ///< Bytes consumed by OnReceive()
+        UINT64 uCoalesced = 0;      ///< Queued sends replaced by a newer send before going out
+        UINT64 uDeferred = 0;       ///< Pump() passes where a pending send was held back by its rate cap or the bandwidth budget
+        UINT64 uDropped = 0;        ///< Queued sends dropped because the queue was full
+    };
+
+    /**
+    * Custom packet scheduler built on IMultiplayerServiceV540::RegisterCustomPacket() and SendCustomPacket().
+    * Instead of sending immediately, plugins Queue() packets and call Pump() once per frame.  Pump() sends
+    * pending packets in priority order while honoring a per-packet rate cap and a shared bandwidth budget,
+    * so bursty plugin traffic yields to the simulation's own multiplayer data.
+    * @remarks  Packets registered as coalescing represent state that supersedes itself: a newer Queue() call
+    *           replaces the pending one rather than adding to the queue.
+    * @remarks  The scheduler registers a wrapper for each ICustomPacketV530 so the bytes written in OnSend()
+    *           and read in OnReceive() can be measured.  Each broadcast is charged to every player returned by
+    *           GetPlayerCount()/GetPlayerObjectID() at send time; see GetPlayerBytesSent().
+    * @remarks  Context pointers passed to Queue() must stay valid until the packet has been sent.
+    */
+    class CustomPacketScheduler
+    {
+    public:
+        /// Maximum number of queued sends kept for a non-coalescing packet.
+        static const UINT MAX_QUEUE_LENGTH = 64;
+
+        explicit CustomPacketScheduler(__in __notnull IMultiplayerServiceV540* pService)
+            : m_spService(pService)
+        {
+        }
+
+        ~CustomPacketScheduler()
+        {
+            for (Entry& entry : m_Entries)
+            {
+                m_spService->UnregisterCustomPacket(entry.guidPacket);
+            }
+        }
+
+        /**
+        * Registers a custom packet with the multiplayer service through the scheduler.
+        * @param guidPacketID   Unique ID of the custom packet.
+        * @param pCustomPacket  The plugin's packet implementation.
+        * @param uPriority      Higher priorities are sent first when bandwidth is limited.
+        * @param fMaxRateHz     Maximum send rate of this packet.  0 for no cap.
+        * @param bCoalesce      True if a newer send supersedes a pending one (state packets).
+        * @param bGuaranteed    Passed to SetCustomPacketGuaranteed().
+        * @param bReceive       True if this client should receive the packet.
+        * @return               The result of RegisterCustomPacket(), or E_INVALIDARG if the ID is already registered.
+        */
+        HRESULT RegisterPacket(__in const GUID& guidPacketID, __in __notnull ICustomPacketV530* pCustomPacket, __in UINT uPriority,
+                               __in float fMaxRateHz, __in bool bCoalesce, __in bool bGuaranteed = true, __in bool bReceive = true)
+        {
+            if (FindEntry(guidPacketID) != nullptr)
+            {
+                return E_INVALIDARG;
+            }
+
+            m_Entries.emplace_back();
+            Entry& entry = m_Entries.back();
+            entry.guidPacket = guidPacketID;
+            entry.uPriority = uPriority;
+            entry.dMinInterval = fMaxRateHz > 0.0f ? 1.0 / fMaxRateHz : 0.0;
+            entry.bCoalesce = bCoalesce;
+            entry.spWrapper.Attach(new PacketWrapper(pCustomPacket));
+
+            HRESULT hr = m_spService->RegisterCustomPacket(guidPacketID, entry.spWrapper, true, bReceive);
+            if (SUCCEEDED(hr))
+            {
+                m_spService->SetCustomPacketGuaranteed(guidPacketID, bGuaranteed);
+            }
+            else
+            {
+                m_Entries.pop_back();
+            }
+
+            return hr;
+        }
+
+        /** Unregisters a custom packet and discards its pending sends. */
+        HRESULT UnregisterPacket(__in const GUID& guidPacketID)
+        {
+            HRESULT hr = E_INVALIDARG;
+
+            for (auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+            {
+                if (IsEqualGUID(it->guidPacket, guidPacketID))
+                {
+                    hr = m_spService->UnregisterCustomPacket(guidPacketID);
+                    m_Entries.erase(it);
+                    break;
+                }
+            }
+
+            return hr;
+        }
+
+        /**
+        * Queues a packet to be sent by a later Pump().
+        * @param guidPacketID   ID of a packet registered with RegisterPacket().
+        * @param pContext       Context passed to the packet's OnSend().
+        * @return               S_OK if queued, S_FALSE if it replaced or displaced a pending send, E_INVALIDARG for unknown IDs.
+        */
+        HRESULT Queue(__in const GUID& guidPacketID, __in void* pContext = nullptr)
+        {
+            Entry* pEntry = FindEntry(guidPacketID);
+            if (pEntry == nullptr)
+            {
+                return E_INVALIDARG;
+            }
+
+            HRESULT hr = S_OK;
+            if (pEntry->vPending.empty())
+            {
+                pEntry->dQueuedTime = m_dNow;
+            }
+            if (pEntry->bCoalesce && !pEntry->vPending.empty())
+            {
+                pEntry->vPending.back() = pContext;
+                pEntry->Stats.uCoalesced++;
+                hr = S_FALSE;
+            }
+            else
+            {
+                if (pEntry->vPending.size() >= MAX_QUEUE_LENGTH)
+                {
+                    pEntry->vPending.pop_front();
+                    pEntry->Stats.uDropped++;
+                    hr = S_FALSE;
+                }
+                pEntry->vPending.push_back(pContext);
+            }
+
+            return hr;
+        }
+
+        /**
+        * Sets the bandwidth budget shared by all scheduled packets.
+        * @param uBytesPerSecond    Sustained bytes per second each remote player may receive from the scheduler.  0 disables the budget.
+        * @param uBurstBytes        Maximum budget that can accumulate while idle.
+        */
+        void SetBandwidthLimit(__in UINT uBytesPerSecond, __in UINT uBurstBytes)
+        {
+            m_dBytesPerSecond = uBytesPerSecond;
+            m_dBurstBytes = uBurstBytes;
+            m_dTokens = m_dBurstBytes;
+        }
+
+        /** Sends pending packets using the steady clock as the time source.  Call once per frame. */
+        UINT Pump()
+        {
+            double dNow = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            return Pump(dNow);
+        }
+
+        /**
+        * Sends pending packets in priority order, oldest first within a priority.
+        * @param dNowSeconds    Current time in seconds from any monotonic source.
+        * @return               Number of packets sent.
+        */
+        UINT Pump(__in double dNowSeconds)
+        {
+            const double dElapsed = m_bHasTime ? std::max(0.0, dNowSeconds - m_dNow) : 0.0;
+            m_dNow = dNowSeconds;
+            m_bHasTime = true;
+            m_dTokens = std::min(m_dTokens + dElapsed * m_dBytesPerSecond, m_dBurstBytes);
+
+            if (!m_spService->InSession())
+            {
+                return 0;
+            }
+
+            RefreshPlayers();
+
+            m_vOrder.clear();
+            for (UINT i = 0; i < (UINT)m_Entries.size(); i++)
+            {
+                if (!m_Entries[i].vPending.empty())
+                {
+                    m_vOrder.push_back(i);
+                }
+            }
+            std::stable_sort(m_vOrder.begin(), m_vOrder.end(), [this](UINT a, UINT b)
+            {
+                const Entry& ea = m_Entries[a];
+                const Entry& eb = m_Entries[b];
+                return ea.uPriority != eb.uPriority ? ea.uPriority > eb.uPriority : ea.dQueuedTime < eb.dQueuedTime;
+            });
+
+            UINT uSent = 0;
+            for (UINT uIndex : m_vOrder)
+            {
+                Entry& entry = m_Entries[uIndex];
+                const UINT64 uSentBefore = entry.Stats.uSent;
+                while (!entry.vPending.empty())
+                {
+                    // Small tolerance so a cap that is a multiple of the frame time is not missed to rounding.
+                    const bool bRateLimited = entry.bHasSent && dNowSeconds - entry.dLastSendTime < entry.dMinInterval * (1.0 - 1.0e-6);
+                    // A packet waits until the budget covers its last size, so low priority traffic cannot overdraw
+                    // the budget and hold back a higher priority packet on the next Pump().
+                    const double dNeeded = std::min((double)entry.uLastBytes, m_dBurstBytes);
+                    const bool bBudgetLimited = m_dBytesPerSecond > 0.0 && (m_dTokens <= 0.0 || m_dTokens < dNeeded);
+                    if (bRateLimited || bBudgetLimited)
+                    {
+                        entry.Stats.uDeferred++;
+                        break;
+                    }
+
+                    void* pContext = entry.vPending.front();
+                    entry.vPending.pop_front();
+
+                    entry.spWrapper->m_uLastSendBytes = 0;
+                    if (SUCCEEDED(m_spService->SendCustomPacket(entry.guidPacket, pContext)))
+                    {
+                        const UINT64 uBytes = entry.spWrapper->m_uLastSendBytes;
+                        entry.Stats.uSent++;
+                        entry.Stats.uBytesSent += uBytes;
+                        entry.dLastSendTime = dNowSeconds;
+                        entry.bHasSent = true;
+                        entry.uLastBytes = uBytes;
+                        m_dTokens -= (double)uBytes;
+                        ChargePlayers(uBytes);
+                        uSent++;
+                    }
+
+                    if (entry.dMinInterval > 0.0)
+                    {
+                        break;
+                    }
+                }
+                if (entry.Stats.uSent != uSentBefore)
+                {
+                    entry.dQueuedTime = dNowSeconds;
+                }
+            }
+
+            return uSent;
+        }
+
+        /// Gets the statistics of a registered packet.  Returns E_INVALIDARG for unknown IDs.
+        HRESULT GetPacketStats(__in const GUID& guidPacketID, __out CustomPacketStats& stats) const
+        {
+            HRESULT hr = E_INVALIDARG;
+
+            for (const Entry& entry : m_Entries)
+            {
+                if (IsEqualGUID(entry.guidPacket, guidPacketID))
+                {
+                    entry.spWrapper->CopyReceiveStats(entry.Stats, stats);
+                    hr = S_OK;
+                    break;
+                }
+            }
+
+            return hr;
+        }
+
+        /// Number of pending sends for a packet.
+        UINT GetPendingCount(__in const GUID& guidPacketID) const
+        {
+            for (const Entry& entry : m_Entries)
+            {
+                if (IsEqualGUID(entry.guidPacket, guidPacketID))
+                {
+                    return (UINT)entry.vPending.size();
+                }
+            }
+            return 0;
+        }
+
+        /// Number of players tracked for bandwidth accounting, including players who have left.
+        UINT GetTrackedPlayerCount() const
+        {
+            return (UINT)m_Players.size();
+        }
+
+        /**
+        * Gets the bytes broadcast by the scheduler while a player was in the session.
+        * @param uIndex         Index in [0, GetTrackedPlayerCount()).
+        * @param uObjectID      Player's object ID as returned by GetPlayerObjectID().
+        * @param uBytes         Bytes charged to the player.
+        * @param bConnected     True if the player was present at the last Pump().
+        */
+        HRESULT GetPlayerBytesSent(__in UINT uIndex, __out UINT& uObjectID, __out UINT64& uBytes, __out bool& bConnected) const
+        {
+            HRESULT hr = E_INVALIDARG;
+
+            if (uIndex < m_Players.size())
+            {
+                uObjectID = m_Players[uIndex].uObjectID;
+                uBytes = m_Players[uIndex].uBytes;
+                bConnected = m_Players[uIndex].bConnected;
+                hr = S_OK;
+            }
+
+            return hr;
+        }
+
+    private:
+        /**
+        * NetOutPublic proxy that counts the bytes written by a packet's OnSend().
+        */
+        class CountingNetOut : public NetOutPublic
+        {
+        public:
+            CountingNetOut(NetOutPublic& out) : m_Out(out) {}
+
+            virtual void WriteData(const void* pv, unsigned int len) override { m_uBytes += len; m_Out.WriteData(pv, len); }
+            virtual void WriteBool(bool b) override { m_uBytes += sizeof(bool); m_Out.WriteBool(b); }
+            virtual void WriteByte(unsigned char b) override { m_uBytes += sizeof(b); m_Out.WriteByte(b); }
+            virtual void WriteShort(short value) override { m_uBytes += sizeof(value); m_Out.WriteShort(value); }
+            virtual void WriteInt32(INT32 value) override { m_uBytes += sizeof(value); m_Out.WriteInt32(value); }
+            virtual void WriteUShort(unsigned short value) override { m_uBytes += sizeof(value); m_Out.WriteUShort(value); }
+            virtual void WriteFloat(float value) override { m_uBytes += sizeof(value); m_Out.WriteFloat(value); }
+            virtual void WriteDouble(double value) override { m_uBytes += sizeof(value); m_Out.WriteDouble(value); }
+            virtual void WriteDword(DWORD value) override { m_uBytes += sizeof(UINT32); m_Out.WriteDword(value); }
+            virtual void WriteString(LPCWSTR pszStr) override
+            {
+                m_uBytes += (pszStr != nullptr ? (UINT64)wcslen(pszStr) + 1 : 1) * sizeof(WCHAR);
+                m_Out.WriteString(pszStr);
+            }
+
+            UINT64 m_uBytes = 0;
+
+        private:
+            NetOutPublic& m_Out;
+        };
+
+        /**
+        * ICustomPacketV530 registered with the multiplayer service in place of the plugin's packet.
+        */
+        class PacketWrapper : public ICustomPacketV530
+        {
+        public:
+            PacketWrapper(ICustomPacketV530* pInner) : m_spInner(pInner)
+            {
+            }
+
+            STDMETHOD(OnSend)(__in NetOutPublic& out, __in void* pContext) override
+            {
+                CountingNetOut counter(out);
+                HRESULT hr = m_spInner->OnSend(counter, pContext);
+                m_uLastSendBytes = counter.m_uBytes;
+                return hr;
+            }
+
+            STDMETHOD(OnReceive)(__in NetInPublic& in) override
+            {
+                UINT uBefore = in.BytesLeft();
+                HRESULT hr = m_spInner->OnReceive(in);
+                m_uReceived++;
+                m_uBytesReceived += uBefore - in.BytesLeft();
+                return hr;
+            }
+
+            void CopyReceiveStats(const CustomPacketStats& source, CustomPacketStats& stats) const
+            {
+                stats = source;
+                stats.uReceived = m_uReceived;
+                stats.uBytesReceived = m_uBytesReceived;
+            }
+
+            CComPtr<ICustomPacketV530>  m_spInner;
+            UINT64                      m_uLastSendBytes = 0;
+            UINT64                      m_uReceived = 0;
+            UINT64                      m_uBytesReceived = 0;
+
+            DEFAULT_REFCOUNT_INLINE_IMPL();
+
+            STDMETHODIMP QueryInterface(REFIID riid, PVOID* ppv)
+            {
+                HRESULT hr = E_NOINTERFACE;
+
+                if (ppv == nullptr)
+                {
+                    return E_POINTER;
+                }
+
+                *ppv = nullptr;
+
+                if (IsEqualIID(riid, IID_ICustomPacketV530))
+                {
+                    *ppv = static_cast<ICustomPacketV530*>(this);
+                }
+                else if (IsEqualIID(riid, IID_IUnknown))
+                {
+                    *ppv = static_cast<IUnknown*>(this);
+                }
+                if (*ppv)
+                {
+                    hr = S_OK;
+                    AddRef();
+                }
+
+                return hr;
+            }
+        };
+
+        struct Entry
+        {
+            GUID                    guidPacket;
+            CComPtr<PacketWrapper>  spWrapper;
+            std::deque<void*>       vPending;
+            CustomPacketStats       Stats;
+            double                  dMinInterval = 0.0;
+            double                  dLastSendTime = 0.0;
+            double                  dQueuedTime = 0.0;
+            UINT64                  uLastBytes = 0;
+            UINT                    uPriority = 0;
+            bool                    bCoalesce = false;
+            bool                    bHasSent = false;
+        };
+
+        struct PlayerUsage
+        {
+            UINT    uObjectID = 0;
+            UINT64  uBytes = 0;
+            bool    bConnected = false;
+        };
+
+        Entry* FindEntry(const GUID& guidPacketID)
+        {
+            for (Entry& entry : m_Entries)
+            {
+                if (IsEqualGUID(entry.guidPacket, guidPacketID))
+                {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
+
+        void RefreshPlayers()
+        {
+            for (PlayerUsage& player : m_Players)
+            {
+                player.bConnected = false;
+            }
+
+            const UINT uCount = m_spService->GetPlayerCount();
+            for (UINT i = 0; i < uCount; i++)
+            {
+                const UINT uObjectID = m_spService->GetPlayerObjectID(i);
+                if (uObjectID == 0)
+                {
+                    continue;
+                }
+
+                auto it = std::find_if(m_Players.begin(), m_Players.end(), [uObjectID](const PlayerUsage& p) { return p.uObjectID == uObjectID; });
+                if (it == m_Players.end())
+                {
+                    m_Players.emplace_back();
+                    it = m_Players.end() - 1;
+                    it->uObjectID = uObjectID;
+                }
+                it->bConnected = true;
+            }
+        }
+
+        void ChargePlayers(UINT64 uBytes)
+        {
+            for (PlayerUsage& player : m_Players)
+            {
+                if (player.bConnected)
+                {
+                    player.uBytes += uBytes;
+                }
+            }
+        }
+
+        CComPtr<IMultiplayerServiceV540>    m_spService;
+        std::deque<Entry>                   m_Entries;
+        std::vector<PlayerUsage>            m_Players;
+        std::vector<UINT>                   m_vOrder;
+        double                              m_dBytesPerSecond = 0.0;
+        double                              m_dBurstBytes = 0.0;
+        double                              m_dTokens = 0.0;
+        double                              m_dNow = 0.0;
+        bool                                m_bHasTime = false;
+    };
+    /** @} */
+}
@@ -0,0 +1,348 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// DeadReckoning.h
+
+#pragma once
+#include <ObjBase.h>
+#include "ISimObject.h"
+
+#include <cmath>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Dead reckoning algorithms, following the DIS naming for the world-relative models.
+    */
+    enum DEAD_RECKONING_MODEL
+    {
+        DEAD_RECKONING_STATIC,          ///< No extrapolation (DRM_STATIC)
+        DEAD_RECKONING_FIRST_ORDER,     ///< Constant linear and angular velocity (DRM_FPW)
+        DEAD_RECKONING_SECOND_ORDER,    ///< Constant acceleration and angular velocity (DRM_FVW)
+    };
+
+    /**
+    * Kinematic state exchanged between the owner and remote copies of an object.  The layout matches
+    * IBaseObjectV520::GetPosition()/SetPosition() and is trivially copyable so it can be sent as a single
+    * block, e.g. with NetSpanWriter::WriteStruct().
+    */
+    struct DeadReckoningState
+    {
+        DXYZ    vLonAltLat;     ///< Longitude, altitude, latitude (radians, feet)
+        DXYZ    vPHB;           ///< Pitch, heading, bank (radians)
+        DXYZ    vLonAltLatVel;  ///< Longitude, altitude, latitude velocity (feet / second)
+        DXYZ    vPHBVel;        ///< Pitch, heading, bank velocity (radians / second)
+        DXYZ    vLonAltLatAcc;  ///< Longitude, altitude, latitude acceleration (feet / second^2)
+        double  dTime;          ///< Time of the state in seconds, on a clock shared by sender and receiver
+        BOOL    bIsOnGround;    ///< On-ground flag passed through to SetPosition()
+    };
+
+    /**
+    * Stateless dead reckoning math shared by DeadReckoningSender and DeadReckoningReceiver.
+    */
+    class DeadReckoning
+    {
+    public:
+        /// Mean earth radius in feet used to convert linear motion to latitude and longitude.
+        static double EarthRadiusFeet() { return 20902230.971; }
+
+        /**
+        * Extrapolates a state to a later time.
+        * @param state      State to extrapolate from.
+        * @param eModel     Dead reckoning model.
+        * @param dTime      Time to extrapolate to, on the same clock as state.dTime.
+        * @param result     Extrapolated state.  Velocity is advanced for the second-order model.
+        */
+        static void Extrapolate(__in const DeadReckoningState& state, __in DEAD_RECKONING_MODEL eModel, __in double dTime, __out DeadReckoningState& result)
+        {
+            result = state;
+            result.dTime = dTime;
+
+            const double dt = dTime - state.dTime;
+            if (eModel == DEAD_RECKONING_STATIC || dt <= 0.0)
+            {
+                return;
+            }
+
+            DXYZ vMove = state.vLonAltLatVel;
+            vMove.dX *= dt;
+            vMove.dY *= dt;
+            vMove.dZ *= dt;
+            if (eModel == DEAD_RECKONING_SECOND_ORDER)
+            {
+                const double dHalfT2 = 0.5 * dt * dt;
+                vMove.dX += state.vLonAltLatAcc.dX * dHalfT2;
+                vMove.dY += state.vLonAltLatAcc.dY * dHalfT2;
+                vMove.dZ += state.vLonAltLatAcc.dZ * dHalfT2;
+                result.vLonAltLatVel.dX += state.vLonAltLatAcc.dX * dt;
+                result.vLonAltLatVel.dY += state.vLonAltLatAcc.dY * dt;
+                result.vLonAltLatVel.dZ += state.vLonAltLatAcc.dZ * dt;
+            }
+
+            Offset(state.vLonAltLat, vMove, result.vLonAltLat);
+
+            result.vPHB.dX = state.vPHB.dX + state.vPHBVel.dX * dt;
+            result.vPHB.dY = WrapAngle(state.vPHB.dY + state.vPHBVel.dY * dt);
+            result.vPHB.dZ = WrapAngle(state.vPHB.dZ + state.vPHBVel.dZ * dt);
+        }
+
+        /// Moves a position by an east/up/north displacement in feet.
+        static void Offset(__in const DXYZ& vLonAltLat, __in const DXYZ& vFeet, __out DXYZ& vResult)
+        {
+            const double dRadius = EarthRadiusFeet() + vLonAltLat.dY;
+            const double dCosLat = std::cos(vLonAltLat.dZ);
+            vResult.dX = WrapAngle(vLonAltLat.dX + (dCosLat > 1.0e-6 ? vFeet.dX / (dRadius * dCosLat) : 0.0));
+            vResult.dY = vLonAltLat.dY + vFeet.dY;
+            vResult.dZ = vLonAltLat.dZ + vFeet.dZ / dRadius;
+        }
+
+        /// East/up/north displacement in feet from one position to another.  Accurate for nearby positions.
+        static void Difference(__in const DXYZ& vFrom, __in const DXYZ& vTo, __out DXYZ& vFeet)
+        {
+            const double dRadius = EarthRadiusFeet() + vFrom.dY;
+            vFeet.dX = WrapAngle(vTo.dX - vFrom.dX) * dRadius * std::cos(vFrom.dZ);
+            vFeet.dY = vTo.dY - vFrom.dY;
+            vFeet.dZ = (vTo.dZ - vFrom.dZ) * dRadius;
+        }
+
+        /// Wraps an angle to [-pi, pi).
+        static double WrapAngle(__in double dRadians)
+        {
+            const double dPi = 3.14159265358979323846;
+            dRadians = std::fmod(dRadians + dPi, 2.0 * dPi);
+            return (dRadians < 0.0 ? dRadians + 2.0 * dPi : dRadians) - dPi;
+        }
+    };
+
+    /**
+    * Owner side of dead reckoning.  Feed the object's state every frame; ShouldSend() returns true only
+    * when a remote copy extrapolating the last sent state would be off by more than the thresholds, or
+    * when the heartbeat interval has elapsed.  Sending only then replaces frame-rate updates with sparse ones.
+    */
+    class DeadReckoningSender
+    {
+    public:
+        /**
+        * @param eModel                 Model the receivers use to extrapolate.
+        * @param dPositionThresholdFeet Maximum tolerated position error.
+        * @param dAngleThresholdRadians Maximum tolerated pitch, heading or bank error.
+        * @param dHeartbeatSeconds      Maximum time between sends even if the error stays small.
+        */
+        DeadReckoningSender(__in DEAD_RECKONING_MODEL eModel = DEAD_RECKONING_SECOND_ORDER, __in double dPositionThresholdFeet = 3.0,
+                            __in double dAngleThresholdRadians = 0.05, __in double dHeartbeatSeconds = 5.0)
+            : m_eModel(eModel),
+              m_dPositionThreshold(dPositionThresholdFeet),
+              m_dAngleThreshold(dAngleThresholdRadians),
+              m_dHeartbeat(dHeartbeatSeconds)
+        {
+        }
+
+        /**
+        * Captures the object's current state and decides whether it must be sent.
+        * @param pObject    Object owned by this client.
+        * @param dTime      Current time on the clock shared with the receivers.
+        * @param state      Current state, including the acceleration estimated from the previous sample.
+        * @return           True if state should be sent.  The state is then recorded as the last sent state.
+        */
+        bool Update(__in __notnull IBaseObjectV520* pObject, __in double dTime, __out DeadReckoningState& state)
+        {
+            state = DeadReckoningState();
+            pObject->GetPosition(state.vLonAltLat, state.vPHB, state.vLonAltLatVel, state.vPHBVel);
+            state.bIsOnGround = pObject->IsOnGround();
+            state.dTime = dTime;
+
+            if (m_bHasSample && dTime > m_dSampleTime)
+            {
+                const double dInvT = 1.0 / (dTime - m_dSampleTime);
+                state.vLonAltLatAcc.dX = (state.vLonAltLatVel.dX - m_vSampleVel.dX) * dInvT;
+                state.vLonAltLatAcc.dY = (state.vLonAltLatVel.dY - m_vSampleVel.dY) * dInvT;
+                state.vLonAltLatAcc.dZ = (state.vLonAltLatVel.dZ - m_vSampleVel.dZ) * dInvT;
+            }
+            m_vSampleVel = state.vLonAltLatVel;
+            m_dSampleTime = dTime;
+            m_bHasSample = true;
+
+            return ShouldSend(state);
+        }
+
+        /**
+        * Decides whether a state must be sent, for callers that build the state themselves.
+        * @return   True if state should be sent.  The state is then recorded as the last sent state.
+        */
+        bool ShouldSend(__in const DeadReckoningState& state)
+        {
+            bool bSend = !m_bHasSent || state.dTime - m_LastSent.dTime >= m_dHeartbeat || state.bIsOnGround != m_LastSent.bIsOnGround;
+
+            if (!bSend)
+            {
+                DeadReckoningState predicted;
+                DeadReckoning::Extrapolate(m_LastSent, m_eModel, state.dTime, predicted);
+
+                DXYZ vError;
+                DeadReckoning::Difference(predicted.vLonAltLat, state.vLonAltLat, vError);
+                const double dPositionError = std::sqrt(vError.dX * vError.dX + vError.dY * vError.dY + vError.dZ * vError.dZ);
+                const double dAngleError = std::fmax(std::fabs(predicted.vPHB.dX - state.vPHB.dX),
+                                           std::fmax(std::fabs(DeadReckoning::WrapAngle(predicted.vPHB.dY - state.vPHB.dY)),
+                                                     std::fabs(DeadReckoning::WrapAngle(predicted.vPHB.dZ - state.vPHB.dZ))));
+
+                bSend = dPositionError > m_dPositionThreshold || dAngleError > m_dAngleThreshold;
+            }
+
+            m_uSamples++;
+            if (bSend)
+            {
+                m_LastSent = state;
+                m_bHasSent = true;
+                m_uSent++;
+            }
+            return bSend;
+        }
+
+        /// Forces the next update to be sent, e.g. when a player joins.
+        void ForceSend() { m_bHasSent = false; }
+        /// Number of states evaluated.
+        UINT64 GetSampleCount() const { return m_uSamples; }
+        /// Number of states that had to be sent.
+        UINT64 GetSendCount() const { return m_uSent; }
+
+    private:
+        DeadReckoningState      m_LastSent = DeadReckoningState();
+        DXYZ                    m_vSampleVel = DXYZ();
+        double                  m_dSampleTime = 0.0;
+        DEAD_RECKONING_MODEL    m_eModel;
+        double                  m_dPositionThreshold;
+        double                  m_dAngleThreshold;
+        double                  m_dHeartbeat;
+        UINT64                  m_uSamples = 0;
+        UINT64                  m_uSent = 0;
+        bool                    m_bHasSample = false;
+        bool                    m_bHasSent = false;
+    };
+
+    /**
+    * Remote side of dead reckoning.  Pass every received state to OnStateReceived() and call Update()
+    * once per frame to extrapolate the object and apply it through IBaseObjectV520::SetPosition().
+    * When a new state arrives, the jump between the displayed and the corrected position is not applied
+    * at once: it is kept as an offset that decays over the smoothing time, hiding the correction.
+    */
+    class DeadReckoningReceiver
+    {
+    public:
+        /**
+        * @param eModel             Model used to extrapolate.  Should match the sender.
+        * @param dSmoothingSeconds  Time constant over which corrections are blended in.  0 snaps immediately.
+        * @param dSnapFeet          Corrections larger than this are applied immediately (teleports, resets).
+        */
+        DeadReckoningReceiver(__in DEAD_RECKONING_MODEL eModel = DEAD_RECKONING_SECOND_ORDER, __in double dSmoothingSeconds = 0.3,
+                              __in double dSnapFeet = 500.0)
+            : m_eModel(eModel),
+              m_dSmoothing(dSmoothingSeconds),
+              m_dSnapFeet(dSnapFeet)
+        {
+        }
+
+        /** Records a state received from the owner.  Older states than the current one are ignored. */
+        void OnStateReceived(__in const DeadReckoningState& state)
+        {
+            if (m_bHasState && state.dTime < m_State.dTime)
+            {
+                return;
+            }
+
+            if (m_bHasState && m_bHasDisplayed)
+            {
+                // Keep showing where we were: the offset is the displayed position relative to the new extrapolation.
+                DeadReckoningState corrected;
+                DeadReckoning::Extrapolate(state, m_eModel, m_Displayed.dTime, corrected);
+                DeadReckoning::Difference(corrected.vLonAltLat, m_Displayed.vLonAltLat, m_vOffsetFeet);
+                m_vOffsetPHB.dX = m_Displayed.vPHB.dX - corrected.vPHB.dX;
+                m_vOffsetPHB.dY = DeadReckoning::WrapAngle(m_Displayed.vPHB.dY - corrected.vPHB.dY);
+                m_vOffsetPHB.dZ = DeadReckoning::WrapAngle(m_Displayed.vPHB.dZ - corrected.vPHB.dZ);
+
+                const double dJump = std::sqrt(m_vOffsetFeet.dX * m_vOffsetFeet.dX + m_vOffsetFeet.dY * m_vOffsetFeet.dY + m_vOffsetFeet.dZ * m_vOffsetFeet.dZ);
+                if (dJump > m_dSnapFeet || m_dSmoothing <= 0.0)
+                {
+                    m_vOffsetFeet = DXYZ();
+                    m_vOffsetPHB = DXYZ();
+                }
+            }
+
+            m_State = state;
+            m_bHasState = true;
+        }
+
+        /**
+        * Computes the state to display at the given time, including the decaying correction offset.
+        * @return   False if no state has been received yet.
+        */
+        bool GetDisplayState(__in double dTime, __out DeadReckoningState& state)
+        {
+            if (!m_bHasState)
+            {
+                return false;
+            }
+
+            DeadReckoning::Extrapolate(m_State, m_eModel, dTime, state);
+
+            if (m_bHasDisplayed && m_dSmoothing > 0.0 && dTime > m_Displayed.dTime)
+            {
+                const double dDecay = std::exp(-(dTime - m_Displayed.dTime) / m_dSmoothing);
+                m_vOffsetFeet.dX *= dDecay;
+                m_vOffsetFeet.dY *= dDecay;
+                m_vOffsetFeet.dZ *= dDecay;
+                m_vOffsetPHB.dX *= dDecay;
+                m_vOffsetPHB.dY *= dDecay;
+                m_vOffsetPHB.dZ *= dDecay;
+            }
+
+            DeadReckoning::Offset(state.vLonAltLat, m_vOffsetFeet, state.vLonAltLat);
+            state.vPHB.dX += m_vOffsetPHB.dX;
+            state.vPHB.dY = DeadReckoning::WrapAngle(state.vPHB.dY + m_vOffsetPHB.dY);
+            state.vPHB.dZ = DeadReckoning::WrapAngle(state.vPHB.dZ + m_vOffsetPHB.dZ);
+
+            m_Displayed = state;
+            m_bHasDisplayed = true;
+            return true;
+        }
+
+        /**
+        * Extrapolates the object to the given time and applies it with SetPosition().
+        * @param pObject    Remote object to position.
+        * @param dTime      Current time on the clock shared with the sender.
+        * @param dDeltaT    Frame delta passed through to SetPosition().
+        * @return           The result of SetPosition(), or S_FALSE if no state has been received yet.
+        */
+        HRESULT Update(__in __notnull IBaseObjectV520* pObject, __in double dTime, __in double dDeltaT)
+        {
+            DeadReckoningState state;
+            if (!GetDisplayState(dTime, state))
+            {
+                return S_FALSE;
+            }
+            return pObject->SetPosition(state.vLonAltLat, state.vPHB, state.vLonAltLatVel, state.vPHBVel, state.bIsOnGround, dDeltaT);
+        }
+
+        /// Drops all received state, e.g. when the owner leaves the session.
+        void Reset()
+        {
+            m_bHasState = false;
+            m_bHasDisplayed = false;
+            m_vOffsetFeet = DXYZ();
+            m_vOffsetPHB = DXYZ();
+        }
+
+    private:
+        DeadReckoningState      m_State = DeadReckoningState();
+        DeadReckoningState      m_Displayed = DeadReckoningState();
+        DXYZ                    m_vOffsetFeet = DXYZ();
+        DXYZ                    m_vOffsetPHB = DXYZ();
+        DEAD_RECKONING_MODEL    m_eModel;
+        double                  m_dSmoothing;
+        double                  m_dSnapFeet;
+        bool                    m_bHasState = false;
+        bool                    m_bHasDisplayed = false;
+    };
+    /** @} */
+}
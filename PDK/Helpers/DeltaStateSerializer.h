@@ -0,0 +1,352 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// DeltaStateSerializer.h
+
+#pragma once
+#include <ObjBase.h>
+#include "NetInOutPublic.h"
+
+#include <cmath>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Field layout and packing helpers shared by DeltaStateEncoder and DeltaStateDecoder.
+    * Each field is a double quantized to a fixed precision (e.g. 0.01 for centimeters) and packed as a
+    * zigzag varint, so small values and small changes take one or two bytes instead of eight.
+    */
+    class DeltaStateSchema
+    {
+    public:
+        /// Number of encoder states the decoder keeps to resolve delta baselines.
+        static const UINT HISTORY_SIZE = 32;
+
+        /**
+        * Adds a field to the state layout.  Encoder and decoder must declare identical layouts.
+        * @param dPrecision     Quantization step of the field.  Values are transmitted as multiples of this step.
+        * @return               Index of the field in the value arrays.
+        */
+        UINT AddField(__in double dPrecision)
+        {
+            m_vPrecision.push_back(dPrecision > 0.0 ? dPrecision : 1.0);
+            return (UINT)m_vPrecision.size() - 1;
+        }
+
+        /// Number of fields in the layout.
+        UINT GetFieldCount() const
+        {
+            return (UINT)m_vPrecision.size();
+        }
+
+        /// Appends an unsigned LEB128 varint.
+        static void WriteVarUInt(__inout std::vector<BYTE>& vBuffer, __in UINT64 uValue)
+        {
+            while (uValue >= 0x80)
+            {
+                vBuffer.push_back((BYTE)(uValue | 0x80));
+                uValue >>= 7;
+            }
+            vBuffer.push_back((BYTE)uValue);
+        }
+
+        /// Appends a signed value as a zigzag varint.
+        static void WriteVarInt(__inout std::vector<BYTE>& vBuffer, __in INT64 iValue)
+        {
+            WriteVarUInt(vBuffer, ((UINT64)iValue << 1) ^ (UINT64)(iValue >> 63));
+        }
+
+        /// Reads an unsigned LEB128 varint.  Returns false if the buffer ends early.
+        static bool ReadVarUInt(__inout const BYTE*& pCur, __in const BYTE* pEnd, __out UINT64& uValue)
+        {
+            uValue = 0;
+            for (UINT uShift = 0; uShift < 64 && pCur < pEnd; uShift += 7)
+            {
+                BYTE b = *pCur++;
+                uValue |= (UINT64)(b & 0x7F) << uShift;
+                if ((b & 0x80) == 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Reads a zigzag varint.  Returns false if the buffer ends early.
+        static bool ReadVarInt(__inout const BYTE*& pCur, __in const BYTE* pEnd, __out INT64& iValue)
+        {
+            UINT64 uValue = 0;
+            if (!ReadVarUInt(pCur, pEnd, uValue))
+            {
+                return false;
+            }
+            iValue = (INT64)(uValue >> 1) ^ -(INT64)(uValue & 1);
+            return true;
+        }
+
+    protected:
+        struct State
+        {
+            UINT uSequence = 0;
+            std::vector<INT64> vQuantized;
+        };
+
+        INT64 Quantize(UINT uField, double dValue) const
+        {
+            return (INT64)std::llround(dValue / m_vPrecision[uField]);
+        }
+
+        double Dequantize(UINT uField, INT64 iValue) const
+        {
+            return (double)iValue * m_vPrecision[uField];
+        }
+
+        std::vector<double> m_vPrecision;
+        State m_History[HISTORY_SIZE];
+    };
+
+    /**
+    * Sender side of the delta state serializer.  Call Write() from ISimulationV310::Serialize() with
+    * the current state values.  A keyframe carrying every field is sent on the first tick, every
+    * uKeyframeInterval ticks, and whenever the baseline would fall out of the receiver's history.
+    * Other ticks carry only the fields that changed relative to the baseline, as quantized differences.
+    * @remarks  The baseline is the last keyframe unless Acknowledge() is called with a more recent
+    *           sequence, e.g. from a custom packet sent back by the receivers.  Deltas against an
+    *           acknowledged state are smaller because they only carry recent changes.
+    * @remarks  Each packet is written with one WriteUShort() for its length and one WriteData() call.
+    */
+    class DeltaStateEncoder : public DeltaStateSchema
+    {
+    public:
+        /**
+        * @param uKeyframeInterval  Maximum number of ticks between keyframes.  Clamped to the history size.
+        */
+        explicit DeltaStateEncoder(__in UINT uKeyframeInterval = 30)
+            : m_uKeyframeInterval(uKeyframeInterval > 0 && uKeyframeInterval < HISTORY_SIZE ? uKeyframeInterval : HISTORY_SIZE - 1)
+        {
+        }
+
+        /**
+        * Encodes the current state and writes it to the network stream.
+        * @param netOut     Stream passed to ISimulationV310::Serialize().
+        * @param pValues    GetFieldCount() current field values.
+        * @return           S_OK on success, E_FAIL if the packet would exceed 64KB.
+        */
+        HRESULT Write(__in NetOutPublic& netOut, __in const double* pValues)
+        {
+            const UINT uFields = GetFieldCount();
+            const UINT uSequence = ++m_uSequence;
+
+            State& current = m_History[uSequence % HISTORY_SIZE];
+            current.uSequence = uSequence;
+            current.vQuantized.resize(uFields);
+            for (UINT i = 0; i < uFields; i++)
+            {
+                current.vQuantized[i] = Quantize(i, pValues[i]);
+            }
+
+            const bool bKeyframe = m_bKeyframeRequested ||
+                                   m_uBaseSequence == 0 ||
+                                   uSequence - m_uLastKeyframe >= m_uKeyframeInterval ||
+                                   uSequence - m_uBaseSequence >= HISTORY_SIZE;
+
+            m_vBuffer.clear();
+            WriteVarUInt(m_vBuffer, uSequence);
+            if (bKeyframe)
+            {
+                WriteVarUInt(m_vBuffer, 0);
+                for (UINT i = 0; i < uFields; i++)
+                {
+                    WriteVarInt(m_vBuffer, current.vQuantized[i]);
+                }
+                m_uLastKeyframe = uSequence;
+                m_uBaseSequence = uSequence;
+                m_Baseline = current;
+                m_bKeyframeRequested = false;
+                m_uKeyframes++;
+            }
+            else
+            {
+                WriteVarUInt(m_vBuffer, uSequence - m_uBaseSequence);
+
+                size_t uMaskOffset = m_vBuffer.size();
+                m_vBuffer.resize(uMaskOffset + (uFields + 7) / 8, 0);
+                for (UINT i = 0; i < uFields; i++)
+                {
+                    INT64 iDelta = current.vQuantized[i] - m_Baseline.vQuantized[i];
+                    if (iDelta != 0)
+                    {
+                        m_vBuffer[uMaskOffset + i / 8] |= (BYTE)(1 << (i % 8));
+                        WriteVarInt(m_vBuffer, iDelta);
+                    }
+                }
+            }
+
+            if (m_vBuffer.size() > 0xFFFF)
+            {
+                return E_FAIL;
+            }
+
+            netOut.WriteUShort((unsigned short)m_vBuffer.size());
+            netOut.WriteData(m_vBuffer.data(), (unsigned int)m_vBuffer.size());
+
+            m_uTicks++;
+            m_uBytes += sizeof(unsigned short) + m_vBuffer.size();
+            return S_OK;
+        }
+
+        /**
+        * Moves the delta baseline to a state the receivers have confirmed.
+        * @param uSequence  Sequence number of an acknowledged packet, as returned by DeltaStateDecoder::GetSequence().
+        * @return           S_OK if the state is still in the history and newer than the current baseline, E_FAIL otherwise.
+        * @remarks          A pending RequestKeyframe() is not cleared by an acknowledgement; the next Write() still sends a keyframe.
+        */
+        HRESULT Acknowledge(__in UINT uSequence)
+        {
+            HRESULT hr = E_FAIL;
+
+            const State& state = m_History[uSequence % HISTORY_SIZE];
+            if (state.uSequence == uSequence && uSequence > m_uBaseSequence && m_uSequence - uSequence < HISTORY_SIZE)
+            {
+                m_Baseline = state;
+                m_uBaseSequence = uSequence;
+                hr = S_OK;
+            }
+
+            return hr;
+        }
+
+        /// Forces the next Write() to send a keyframe, e.g. when a new player joins.
+        void RequestKeyframe()
+        {
+            m_bKeyframeRequested = true;
+        }
+
+        /// Number of packets written.
+        UINT64 GetTickCount() const { return m_uTicks; }
+        /// Number of keyframes written.
+        UINT64 GetKeyframeCount() const { return m_uKeyframes; }
+        /// Total bytes written to the network stream, including the length prefix.
+        UINT64 GetBytesWritten() const { return m_uBytes; }
+        /// Average bytes written per packet.  With one encoder per object this is bytes per object per tick.
+        double GetAverageBytesPerTick() const { return m_uTicks > 0 ? (double)m_uBytes / (double)m_uTicks : 0.0; }
+        /// Clears the byte and tick counters.
+        void ResetStatistics() { m_uTicks = 0; m_uKeyframes = 0; m_uBytes = 0; }
+
+    private:
+        std::vector<BYTE>   m_vBuffer;
+        State               m_Baseline;
+        UINT                m_uKeyframeInterval;
+        UINT                m_uSequence = 0;
+        UINT                m_uBaseSequence = 0;
+        UINT                m_uLastKeyframe = 0;
+        bool                m_bKeyframeRequested = false;
+        UINT64              m_uTicks = 0;
+        UINT64              m_uKeyframes = 0;
+        UINT64              m_uBytes = 0;
+    };
+
+    /**
+    * Receiver side of the delta state serializer.  Call Read() from ISimulationV310::Deserialize().
+    * Decoded states are kept in a short history so deltas can be resolved against any recent baseline.
+    * @remarks  A delta whose baseline was never received is consumed from the stream but rejected with
+    *           E_PENDING; the values are left untouched until the next keyframe arrives.
+    */
+    class DeltaStateDecoder : public DeltaStateSchema
+    {
+    public:
+        /**
+        * Reads one packet written by DeltaStateEncoder::Write().
+        * @param netIn      Stream passed to ISimulationV310::Deserialize().
+        * @param pValues    GetFieldCount() values that receive the decoded state.
+        * @return           S_OK if the state was decoded, E_PENDING if its baseline is missing, E_FAIL if the packet is malformed.
+        */
+        HRESULT Read(__in NetInPublic& netIn, __out double* pValues)
+        {
+            const UINT uFields = GetFieldCount();
+
+            unsigned short usLength = netIn.ReadUShort();
+            if (usLength > netIn.BytesLeft())
+            {
+                return E_FAIL;
+            }
+            const BYTE* pCur = static_cast<const BYTE*>(netIn.Read(usLength));
+            if (pCur == nullptr)
+            {
+                return E_FAIL;
+            }
+            const BYTE* pEnd = pCur + usLength;
+
+            UINT64 uSequence = 0;
+            UINT64 uBaseDistance = 0;
+            if (!ReadVarUInt(pCur, pEnd, uSequence) || !ReadVarUInt(pCur, pEnd, uBaseDistance) || uBaseDistance > uSequence)
+            {
+                return E_FAIL;
+            }
+
+            State& current = m_History[uSequence % HISTORY_SIZE];
+            m_vScratch.resize(uFields);
+
+            if (uBaseDistance == 0)
+            {
+                for (UINT i = 0; i < uFields; i++)
+                {
+                    if (!ReadVarInt(pCur, pEnd, m_vScratch[i]))
+                    {
+                        return E_FAIL;
+                    }
+                }
+            }
+            else
+            {
+                const UINT uBaseSequence = (UINT)(uSequence - uBaseDistance);
+                const State& base = m_History[uBaseSequence % HISTORY_SIZE];
+
+                const BYTE* pMask = pCur;
+                pCur += (uFields + 7) / 8;
+                if (pCur > pEnd)
+                {
+                    return E_FAIL;
+                }
+                if (uBaseDistance >= HISTORY_SIZE || base.uSequence != uBaseSequence || base.vQuantized.size() != uFields)
+                {
+                    m_uMissingBaseline++;
+                    return E_PENDING;
+                }
+
+                for (UINT i = 0; i < uFields; i++)
+                {
+                    INT64 iDelta = 0;
+                    if ((pMask[i / 8] & (1 << (i % 8))) != 0 && !ReadVarInt(pCur, pEnd, iDelta))
+                    {
+                        return E_FAIL;
+                    }
+                    m_vScratch[i] = base.vQuantized[i] + iDelta;
+                }
+            }
+
+            current.uSequence = (UINT)uSequence;
+            current.vQuantized.swap(m_vScratch);
+            for (UINT i = 0; i < uFields; i++)
+            {
+                pValues[i] = Dequantize(i, current.vQuantized[i]);
+            }
+            m_uSequence = (UINT)uSequence;
+            return S_OK;
+        }
+
+        /// Sequence number of the last successfully decoded packet.  Send this back to the encoder's Acknowledge().
+        UINT GetSequence() const { return m_uSequence; }
+        /// Number of deltas rejected because their baseline was not available.
+        UINT64 GetMissingBaselineCount() const { return m_uMissingBaseline; }
+
+    private:
+        std::vector<INT64>  m_vScratch;
+        UINT                m_uSequence = 0;
+        UINT64              m_uMissingBaseline = 0;
+    };
+    /** @} */
+}
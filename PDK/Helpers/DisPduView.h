@@ -0,0 +1,373 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// DisPduView.h
+
+#pragma once
+#include <ObjBase.h>
+#include "ISimObjectDIS.h"
+#include "DisPduWriter.h"
+
+#include <cstring>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Read-only view over the raw bytes of a DIS PDU, as returned by IPduReaderV440::GetRawData().
+    * Nothing is copied or converted up front: each accessor reads its field from the buffer and converts
+    * it from network byte order when called, so callbacks that only need a few fields pay only for those.
+    * @remarks  Every field read is bounds checked against the PDU length declared in the header, not the
+    *           buffer size, so padding or a following PDU in the same buffer is never read as fields.
+    *           Fields out of range read as zero.
+    * @remarks  The view does not own the buffer and is only valid for the duration of the callback.
+    * Sample usage from IPduCallbackV440::OnReceive():
+    * ```
+    *      DisEntityStateView view;
+    *      if (SUCCEEDED(view.Attach(pReader)))
+    *      {
+    *          DisEntityId id = view.GetEntityId();
+    *          DisWorldCoordinates location = view.GetLocation();
+    *      }
+    * ```
+    */
+    class DisPduView
+    {
+    public:
+        DisPduView()
+        {
+        }
+
+        DisPduView(__in const BYTE* pData, __in UINT uSize)
+        {
+            Attach(pData, uSize);
+        }
+
+        /**
+        * Attaches the view to a PDU buffer.
+        * @return   S_OK, or E_INVALIDARG if the buffer is too small to hold the header or the length it declares,
+        *           or the declared length is shorter than the header.
+        */
+        HRESULT Attach(__in const BYTE* pData, __in UINT uSize)
+        {
+            m_pData = pData;
+            m_uSize = uSize;
+            if (pData == nullptr || uSize < DIS_HEADER_SIZE || GetLength() > uSize || GetLength() < DIS_HEADER_SIZE)
+            {
+                m_pData = nullptr;
+                m_uSize = 0;
+                return E_INVALIDARG;
+            }
+            m_uSize = GetLength();
+            return S_OK;
+        }
+
+        /** Attaches the view to the data of a PDU reader. */
+        HRESULT Attach(__in __notnull IPduReaderV440* pReader)
+        {
+            return Attach(reinterpret_cast<const BYTE*>(pReader->GetRawData()), pReader->GetSize());
+        }
+
+        /// True if the view is attached to a PDU.
+        bool IsValid() const { return m_pData != nullptr; }
+        /// Raw PDU bytes.
+        const BYTE* GetData() const { return m_pData; }
+        /// Size of the PDU in bytes, as declared by its header length field.
+        UINT GetSize() const { return m_uSize; }
+
+        unsigned char   GetProtocolVersion()    const { return U8(0); }
+        unsigned char   GetExerciseId()         const { return U8(1); }
+        unsigned char   GetPduType()            const { return U8(2); }
+        unsigned char   GetProtocolFamily()     const { return U8(3); }
+        unsigned int    GetTimestamp()          const { return U32(4); }
+        unsigned short  GetLength()             const { return U16(8); }
+
+    protected:
+        /// Attaches and checks the PDU type and the minimum size of its fixed part.
+        HRESULT AttachTyped(__in const BYTE* pData, __in UINT uSize, __in BYTE yType, __in UINT uFixedSize)
+        {
+            HRESULT hr = Attach(pData, uSize);
+            if (SUCCEEDED(hr) && (GetPduType() != yType || m_uSize < uFixedSize))
+            {
+                m_pData = nullptr;
+                m_uSize = 0;
+                hr = E_INVALIDARG;
+            }
+            return hr;
+        }
+
+        bool InRange(UINT uOffset, UINT uBytes) const
+        {
+            return m_pData != nullptr && uOffset <= m_uSize && uBytes <= m_uSize - uOffset;
+        }
+
+        unsigned char U8(UINT uOffset) const
+        {
+            return InRange(uOffset, 1) ? m_pData[uOffset] : 0;
+        }
+
+        unsigned short U16(UINT uOffset) const
+        {
+            if (!InRange(uOffset, 2))
+            {
+                return 0;
+            }
+            const BYTE* p = m_pData + uOffset;
+            return (unsigned short)((p[0] << 8) | p[1]);
+        }
+
+        unsigned int U32(UINT uOffset) const
+        {
+            if (!InRange(uOffset, 4))
+            {
+                return 0;
+            }
+            const BYTE* p = m_pData + uOffset;
+            return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+        }
+
+        float F32(UINT uOffset) const
+        {
+            unsigned int u = U32(uOffset);
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            return f;
+        }
+
+        double F64(UINT uOffset) const
+        {
+            unsigned long long u = InRange(uOffset, 8) ? ((unsigned long long)U32(uOffset) << 32) | U32(uOffset + 4) : 0;
+            double d;
+            memcpy(&d, &u, sizeof(d));
+            return d;
+        }
+
+        DisEntityId ReadEntityId(UINT uOffset) const
+        {
+            DisEntityId id = { U16(uOffset), U16(uOffset + 2), U16(uOffset + 4) };
+            return id;
+        }
+
+        EntityType ReadEntityType(UINT uOffset) const
+        {
+            EntityType type;
+            type.SetKind(U8(uOffset));
+            type.SetDomain(U8(uOffset + 1));
+            type.SetCountry(U16(uOffset + 2));
+            type.SetCategory(U8(uOffset + 4));
+            type.SetSubcategory(U8(uOffset + 5));
+            type.SetSpecific(U8(uOffset + 6));
+            type.SetExtra(U8(uOffset + 7));
+            return type;
+        }
+
+        DisVector ReadVector(UINT uOffset) const
+        {
+            DisVector v = { F32(uOffset), F32(uOffset + 4), F32(uOffset + 8) };
+            return v;
+        }
+
+        DisWorldCoordinates ReadWorld(UINT uOffset) const
+        {
+            DisWorldCoordinates v = { F64(uOffset), F64(uOffset + 8), F64(uOffset + 16) };
+            return v;
+        }
+
+        DisBurstDescriptor ReadBurst(UINT uOffset) const
+        {
+            DisBurstDescriptor burst;
+            burst.MunitionType = ReadEntityType(uOffset);
+            burst.usWarhead = U16(uOffset + 8);
+            burst.usFuse = U16(uOffset + 10);
+            burst.usQuantity = U16(uOffset + 12);
+            burst.usRate = U16(uOffset + 14);
+            return burst;
+        }
+
+        bool ReadArticulation(UINT uOffset, ArticulatedParameter& param) const
+        {
+            if (!InRange(uOffset, DIS_ARTICULATION_RECORD_SIZE))
+            {
+                return false;
+            }
+            ArticulatedPart& part = param.m_ArticulatedPart;
+            part.m_yRecordType = U8(uOffset);
+            part.m_yChangeIndicator = U8(uOffset + 1);
+            part.m_usAttachedToId = U16(uOffset + 2);
+            part.m_uiParameterType = U32(uOffset + 4);
+            part.m_fParameterValue = F32(uOffset + 8);
+            part.m_fPadding = F32(uOffset + 12);
+            return true;
+        }
+
+        const BYTE* m_pData = nullptr;
+        UINT        m_uSize = 0;
+    };
+
+    /** View over an Entity State PDU. */
+    class DisEntityStateView : public DisPduView
+    {
+    public:
+        /** @return S_OK, or E_INVALIDARG if the buffer is not an Entity State PDU. */
+        HRESULT Attach(__in const BYTE* pData, __in UINT uSize)
+        {
+            return AttachTyped(pData, uSize, DIS_PDU_ENTITY_STATE, DIS_ENTITY_STATE_SIZE);
+        }
+
+        HRESULT Attach(__in __notnull IPduReaderV440* pReader)
+        {
+            return Attach(reinterpret_cast<const BYTE*>(pReader->GetRawData()), pReader->GetSize());
+        }
+
+        DisEntityId         GetEntityId()                   const { return ReadEntityId(12); }
+        unsigned char       GetForceId()                    const { return U8(18); }
+        unsigned char       GetArticulationCount()          const { return U8(19); }
+        EntityType          GetEntityType()                 const { return ReadEntityType(20); }
+        EntityType          GetAlternativeEntityType()      const { return ReadEntityType(28); }
+        DisVector           GetLinearVelocity()             const { return ReadVector(36); }
+        DisWorldCoordinates GetLocation()                   const { return ReadWorld(48); }
+        DisOrientation      GetOrientation()                const { DisOrientation o = { F32(72), F32(76), F32(80) }; return o; }
+        unsigned int        GetAppearance()                 const { return U32(84); }
+        unsigned char       GetDeadReckoningAlgorithm()     const { return U8(88); }
+        DisVector           GetLinearAcceleration()         const { return ReadVector(104); }
+        DisVector           GetAngularVelocity()            const { return ReadVector(116); }
+        unsigned char       GetMarkingCharacterSet()        const { return U8(128); }
+        unsigned int        GetCapabilities()               const { return U32(140); }
+
+        /** Returns a pointer to the 11 marking characters.  The marking is not null terminated when all 11 are used. */
+        const char* GetMarking() const { return InRange(129, 11) ? reinterpret_cast<const char*>(m_pData + 129) : nullptr; }
+
+        /** Reads an articulation parameter. @return False if the index is out of range. */
+        bool GetArticulation(__in UINT uIndex, __out ArticulatedParameter& param) const
+        {
+            return uIndex < GetArticulationCount() && ReadArticulation(DIS_ENTITY_STATE_SIZE + uIndex * DIS_ARTICULATION_RECORD_SIZE, param);
+        }
+
+        /** Converts every field to a record, e.g. to modify and reissue it with DisPduWriter. */
+        void ToRecord(__out DisEntityStateRecord& record) const
+        {
+            record = DisEntityStateRecord();
+            record.EntityId = GetEntityId();
+            record.yForceId = GetForceId();
+            record.Type = GetEntityType();
+            record.AlternativeType = GetAlternativeEntityType();
+            record.LinearVelocity = GetLinearVelocity();
+            record.Location = GetLocation();
+            record.Orientation = GetOrientation();
+            record.uAppearance = GetAppearance();
+            record.yDeadReckoningAlgorithm = GetDeadReckoningAlgorithm();
+            if (InRange(89, sizeof(record.yOtherParameters)))
+            {
+                memcpy(record.yOtherParameters, m_pData + 89, sizeof(record.yOtherParameters));
+            }
+            record.LinearAcceleration = GetLinearAcceleration();
+            record.AngularVelocity = GetAngularVelocity();
+            record.yMarkingCharacterSet = GetMarkingCharacterSet();
+            if (GetMarking() != nullptr)
+            {
+                memcpy(record.szMarking, GetMarking(), sizeof(record.szMarking));
+            }
+            record.uCapabilities = GetCapabilities();
+            while (record.uArticulationCount < DIS_MAX_ARTICULATION_RECORDS &&
+                   GetArticulation(record.uArticulationCount, record.Articulations[record.uArticulationCount]))
+            {
+                record.uArticulationCount++;
+            }
+        }
+    };
+
+    /** View over a Fire PDU. */
+    class DisFireView : public DisPduView
+    {
+    public:
+        /** @return S_OK, or E_INVALIDARG if the buffer is not a Fire PDU. */
+        HRESULT Attach(__in const BYTE* pData, __in UINT uSize)
+        {
+            return AttachTyped(pData, uSize, DIS_PDU_FIRE, DIS_FIRE_SIZE);
+        }
+
+        HRESULT Attach(__in __notnull IPduReaderV440* pReader)
+        {
+            return Attach(reinterpret_cast<const BYTE*>(pReader->GetRawData()), pReader->GetSize());
+        }
+
+        DisEntityId         GetFiringEntityId()     const { return ReadEntityId(12); }
+        DisEntityId         GetTargetEntityId()     const { return ReadEntityId(18); }
+        DisEntityId         GetMunitionId()         const { return ReadEntityId(24); }
+        DisEntityId         GetEventId()            const { return ReadEntityId(30); }
+        unsigned int        GetFireMissionIndex()   const { return U32(36); }
+        DisWorldCoordinates GetLocation()           const { return ReadWorld(40); }
+        DisBurstDescriptor  GetBurst()              const { return ReadBurst(64); }
+        DisVector           GetVelocity()           const { return ReadVector(80); }
+        float               GetRange()              const { return F32(92); }
+
+        /** Converts every field to a record. */
+        void ToRecord(__out DisFireRecord& record) const
+        {
+            record.FiringEntityId = GetFiringEntityId();
+            record.TargetEntityId = GetTargetEntityId();
+            record.MunitionId = GetMunitionId();
+            record.EventId = GetEventId();
+            record.uFireMissionIndex = GetFireMissionIndex();
+            record.Location = GetLocation();
+            record.Burst = GetBurst();
+            record.Velocity = GetVelocity();
+            record.fRange = GetRange();
+        }
+    };
+
+    /** View over a Detonation PDU. */
+    class DisDetonationView : public DisPduView
+    {
+    public:
+        /** @return S_OK, or E_INVALIDARG if the buffer is not a Detonation PDU. */
+        HRESULT Attach(__in const BYTE* pData, __in UINT uSize)
+        {
+            return AttachTyped(pData, uSize, DIS_PDU_DETONATION, DIS_DETONATION_SIZE);
+        }
+
+        HRESULT Attach(__in __notnull IPduReaderV440* pReader)
+        {
+            return Attach(reinterpret_cast<const BYTE*>(pReader->GetRawData()), pReader->GetSize());
+        }
+
+        DisEntityId         GetFiringEntityId()     const { return ReadEntityId(12); }
+        DisEntityId         GetTargetEntityId()     const { return ReadEntityId(18); }
+        DisEntityId         GetMunitionId()         const { return ReadEntityId(24); }
+        DisEntityId         GetEventId()            const { return ReadEntityId(30); }
+        DisVector           GetVelocity()           const { return ReadVector(36); }
+        DisWorldCoordinates GetLocation()           const { return ReadWorld(48); }
+        DisBurstDescriptor  GetBurst()              const { return ReadBurst(72); }
+        DisVector           GetEntityLocation()     const { return ReadVector(88); }
+        unsigned char       GetDetonationResult()   const { return U8(100); }
+        unsigned char       GetArticulationCount()  const { return U8(101); }
+
+        /** Reads an articulation parameter. @return False if the index is out of range. */
+        bool GetArticulation(__in UINT uIndex, __out ArticulatedParameter& param) const
+        {
+            return uIndex < GetArticulationCount() && ReadArticulation(DIS_DETONATION_SIZE + uIndex * DIS_ARTICULATION_RECORD_SIZE, param);
+        }
+
+        /** Converts every field to a record. */
+        void ToRecord(__out DisDetonationRecord& record) const
+        {
+            record = DisDetonationRecord();
+            record.FiringEntityId = GetFiringEntityId();
+            record.TargetEntityId = GetTargetEntityId();
+            record.MunitionId = GetMunitionId();
+            record.EventId = GetEventId();
+            record.Velocity = GetVelocity();
+            record.Location = GetLocation();
+            record.Burst = GetBurst();
+            record.EntityLocation = GetEntityLocation();
+            record.yDetonationResult = GetDetonationResult();
+            while (record.uArticulationCount < DIS_MAX_ARTICULATION_RECORDS &&
+                   GetArticulation(record.uArticulationCount, record.Articulations[record.uArticulationCount]))
+            {
+                record.uArticulationCount++;
+            }
+        }
+    };
+    /** @} */
+}
@@ -0,0 +1,496 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// DisPduWriter.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "ISimObjectDIS.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /// DIS PDU types written by DisPduWriter (IEEE 1278.1).
+    enum DIS_PDU_TYPE
+    {
+        DIS_PDU_ENTITY_STATE    = 1,
+        DIS_PDU_FIRE            = 2,
+        DIS_PDU_DETONATION      = 3,
+    };
+
+    /// DIS protocol families for the PDU types above.
+    enum DIS_PROTOCOL_FAMILY
+    {
+        DIS_FAMILY_ENTITY_INFORMATION   = 1,
+        DIS_FAMILY_WARFARE              = 2,
+    };
+
+    /// Sizes in bytes of the fixed part of each PDU on the wire.
+    enum DIS_PDU_SIZE
+    {
+        DIS_HEADER_SIZE                 = 12,
+        DIS_ARTICULATION_RECORD_SIZE    = 16,
+        DIS_ENTITY_STATE_SIZE           = 144,
+        DIS_FIRE_SIZE                   = 96,
+        DIS_DETONATION_SIZE             = 104,
+        DIS_MAX_ARTICULATION_RECORDS    = 32,
+    };
+
+    /// DIS entity identifier (site, application, entity).
+    struct DisEntityId
+    {
+        unsigned short  usSite;
+        unsigned short  usApplication;
+        unsigned short  usEntity;
+    };
+
+    /// Single precision vector, used for velocities, accelerations and entity relative locations.
+    struct DisVector
+    {
+        float   fX;
+        float   fY;
+        float   fZ;
+    };
+
+    /// Double precision geocentric world coordinates in meters.
+    struct DisWorldCoordinates
+    {
+        double  dX;
+        double  dY;
+        double  dZ;
+    };
+
+    /// Euler angles in radians.
+    struct DisOrientation
+    {
+        float   fPsi;
+        float   fTheta;
+        float   fPhi;
+    };
+
+    /// Munition description shared by Fire and Detonation PDUs.
+    struct DisBurstDescriptor
+    {
+        EntityType      MunitionType;
+        unsigned short  usWarhead;
+        unsigned short  usFuse;
+        unsigned short  usQuantity;
+        unsigned short  usRate;
+    };
+
+    /// Entity State PDU contents.  The header is filled in by DisPduWriter.
+    struct DisEntityStateRecord
+    {
+        DisEntityId             EntityId;
+        unsigned char           yForceId;
+        EntityType              Type;
+        EntityType              AlternativeType;
+        DisVector               LinearVelocity;
+        DisWorldCoordinates     Location;
+        DisOrientation          Orientation;
+        unsigned int            uAppearance;
+        unsigned char           yDeadReckoningAlgorithm;
+        unsigned char           yOtherParameters[15];
+        DisVector               LinearAcceleration;
+        DisVector               AngularVelocity;
+        unsigned char           yMarkingCharacterSet;
+        char                    szMarking[11];
+        unsigned int            uCapabilities;
+        unsigned int            uArticulationCount;                                 ///< Number of entries used in Articulations
+        ArticulatedParameter    Articulations[DIS_MAX_ARTICULATION_RECORDS];
+    };
+
+    /// Fire PDU contents.  The header is filled in by DisPduWriter.
+    struct DisFireRecord
+    {
+        DisEntityId             FiringEntityId;
+        DisEntityId             TargetEntityId;
+        DisEntityId             MunitionId;
+        DisEntityId             EventId;
+        unsigned int            uFireMissionIndex;
+        DisWorldCoordinates     Location;
+        DisBurstDescriptor      Burst;
+        DisVector               Velocity;
+        float                   fRange;
+    };
+
+    /// Detonation PDU contents.  The header is filled in by DisPduWriter.
+    struct DisDetonationRecord
+    {
+        DisEntityId             FiringEntityId;
+        DisEntityId             TargetEntityId;
+        DisEntityId             MunitionId;
+        DisEntityId             EventId;
+        DisVector               Velocity;
+        DisWorldCoordinates     Location;
+        DisBurstDescriptor      Burst;
+        DisVector               EntityLocation;                                     ///< Detonation location relative to the target
+        unsigned char           yDetonationResult;
+        unsigned int            uArticulationCount;                                 ///< Number of entries used in Articulations
+        ArticulatedParameter    Articulations[DIS_MAX_ARTICULATION_RECORDS];
+    };
+
+    /**
+    * Batched PDU writer for IDISManagerV540.  Records are serialized into a reusable staging buffer
+    * in network byte order when queued, and Flush() issues every queued PDU.  The header exercise ID
+    * and timestamp are read once per Flush() rather than once per PDU.
+    * @remarks  IPduBuilderV440 has no bulk write, so each staged PDU is handed to the builder eight bytes
+    *           at a time through WriteLongLong(), which takes roughly a fifth of the virtual calls needed
+    *           to write the same PDU field by field.  Like the per-field writes, this relies on the builder
+    *           emitting values in network byte order.
+    * @remarks  Builders are owned by Prepar3D and cannot be reused once issued, so one is created per PDU;
+    *           the staging buffer and PDU table are preallocated and reused across frames.
+    * Sample usage:
+    * ```
+    *      DisPduWriter writer(spDIS, 256);
+    *      for (auto& record : vEntityStates)
+    *      {
+    *          writer.QueueEntityState(record);
+    *      }
+    *      writer.Flush();
+    * ```
+    */
+    class DisPduWriter
+    {
+    public:
+        /**
+        * @param pDIS           DIS manager used to create and issue PDUs.
+        * @param uReservePdus   Number of PDUs per flush to preallocate space for.
+        */
+        DisPduWriter(__in __notnull IDISManagerV540* pDIS, __in UINT uReservePdus = 64)
+            : m_spDIS(pDIS)
+        {
+            m_vBuffer.reserve((size_t)uReservePdus * DIS_ENTITY_STATE_SIZE);
+            m_vPdus.reserve(uReservePdus);
+            m_tWindowStart = std::chrono::steady_clock::now();
+        }
+
+        ~DisPduWriter()
+        {
+        }
+
+        /** Queues an Entity State PDU. @return E_INVALIDARG if the record has too many articulation parameters. */
+        HRESULT QueueEntityState(__in const DisEntityStateRecord& record)
+        {
+            if (record.uArticulationCount > DIS_MAX_ARTICULATION_RECORDS)
+            {
+                return E_INVALIDARG;
+            }
+
+            BYTE* p = BeginPdu(DIS_PDU_ENTITY_STATE, DIS_FAMILY_ENTITY_INFORMATION, DIS_ENTITY_STATE_SIZE + record.uArticulationCount * DIS_ARTICULATION_RECORD_SIZE);
+            p = PutEntityId(p, record.EntityId);
+            p = PutU8(p, record.yForceId);
+            p = PutU8(p, (unsigned char)record.uArticulationCount);
+            p = PutEntityType(p, record.Type);
+            p = PutEntityType(p, record.AlternativeType);
+            p = PutVector(p, record.LinearVelocity);
+            p = PutWorld(p, record.Location);
+            p = PutF32(p, record.Orientation.fPsi);
+            p = PutF32(p, record.Orientation.fTheta);
+            p = PutF32(p, record.Orientation.fPhi);
+            p = PutU32(p, record.uAppearance);
+            p = PutU8(p, record.yDeadReckoningAlgorithm);
+            p = PutBytes(p, record.yOtherParameters, sizeof(record.yOtherParameters));
+            p = PutVector(p, record.LinearAcceleration);
+            p = PutVector(p, record.AngularVelocity);
+            p = PutU8(p, record.yMarkingCharacterSet);
+            p = PutBytes(p, record.szMarking, sizeof(record.szMarking));
+            p = PutU32(p, record.uCapabilities);
+            PutArticulations(p, record.Articulations, record.uArticulationCount);
+            return S_OK;
+        }
+
+        /** Queues a Fire PDU. */
+        HRESULT QueueFire(__in const DisFireRecord& record)
+        {
+            BYTE* p = BeginPdu(DIS_PDU_FIRE, DIS_FAMILY_WARFARE, DIS_FIRE_SIZE);
+            p = PutEntityId(p, record.FiringEntityId);
+            p = PutEntityId(p, record.TargetEntityId);
+            p = PutEntityId(p, record.MunitionId);
+            p = PutEntityId(p, record.EventId);
+            p = PutU32(p, record.uFireMissionIndex);
+            p = PutWorld(p, record.Location);
+            p = PutBurst(p, record.Burst);
+            p = PutVector(p, record.Velocity);
+            p = PutF32(p, record.fRange);
+            return S_OK;
+        }
+
+        /** Queues a Detonation PDU. @return E_INVALIDARG if the record has too many articulation parameters. */
+        HRESULT QueueDetonation(__in const DisDetonationRecord& record)
+        {
+            if (record.uArticulationCount > DIS_MAX_ARTICULATION_RECORDS)
+            {
+                return E_INVALIDARG;
+            }
+
+            BYTE* p = BeginPdu(DIS_PDU_DETONATION, DIS_FAMILY_WARFARE, DIS_DETONATION_SIZE + record.uArticulationCount * DIS_ARTICULATION_RECORD_SIZE);
+            p = PutEntityId(p, record.FiringEntityId);
+            p = PutEntityId(p, record.TargetEntityId);
+            p = PutEntityId(p, record.MunitionId);
+            p = PutEntityId(p, record.EventId);
+            p = PutVector(p, record.Velocity);
+            p = PutWorld(p, record.Location);
+            p = PutBurst(p, record.Burst);
+            p = PutVector(p, record.EntityLocation);
+            p = PutU8(p, record.yDetonationResult);
+            p = PutU8(p, (unsigned char)record.uArticulationCount);
+            p = PutU16(p, 0);
+            PutArticulations(p, record.Articulations, record.uArticulationCount);
+            return S_OK;
+        }
+
+        /**
+        * Issues every queued PDU and clears the queue.  The staging buffer keeps its capacity.
+        * @return   S_OK, or the first failure from IssuePdu().  PDUs after a failure are still attempted.
+        */
+        HRESULT Flush()
+        {
+            HRESULT hr = S_OK;
+
+            if (!m_vPdus.empty())
+            {
+                const BYTE yExercise = m_spDIS->GetExerciseId();
+                const UINT uTimestamp = m_spDIS->GetSimTimestamp();
+
+                for (const StagedPdu& pdu : m_vPdus)
+                {
+                    BYTE* pHeader = m_vBuffer.data() + pdu.uOffset;
+                    pHeader[1] = yExercise;
+                    PutU32(pHeader + 4, uTimestamp);
+
+                    IPduBuilderV440* pBuilder = m_spDIS->CreatePdu();
+                    if (pBuilder == nullptr)
+                    {
+                        hr = SUCCEEDED(hr) ? E_OUTOFMEMORY : hr;
+                        m_uFailed++;
+                        continue;
+                    }
+
+                    WriteBlock(pBuilder, pHeader, pdu.uSize);
+                    HRESULT hrIssue = m_spDIS->IssuePdu(pBuilder);
+                    pBuilder->Release();
+
+                    if (SUCCEEDED(hrIssue))
+                    {
+                        m_uIssued++;
+                        m_uBytes += pdu.uSize;
+                        m_uWindowPdus++;
+                        m_uWindowBytes += pdu.uSize;
+                    }
+                    else
+                    {
+                        hr = SUCCEEDED(hr) ? hrIssue : hr;
+                        m_uFailed++;
+                    }
+                }
+
+                m_vPdus.clear();
+                m_vBuffer.clear();
+            }
+
+            UpdateRates();
+            return hr;
+        }
+
+        /// Number of PDUs queued since the last Flush().
+        UINT GetQueuedCount() const { return (UINT)m_vPdus.size(); }
+        /// Total number of PDUs issued.
+        UINT64 GetIssuedCount() const { return m_uIssued; }
+        /// Total number of PDUs that could not be created or issued.
+        UINT64 GetFailedCount() const { return m_uFailed; }
+        /// Total number of bytes issued.
+        UINT64 GetIssuedBytes() const { return m_uBytes; }
+        /// PDUs issued per second, measured over the last complete one second window.
+        double GetPdusPerSecond() const { return m_dPdusPerSecond; }
+        /// Bytes issued per second, measured over the last complete one second window.
+        double GetBytesPerSecond() const { return m_dBytesPerSecond; }
+
+        /**
+        * Writes a block of network ordered bytes to a builder with as few calls as possible.
+        * @remarks  Exposed for callers building other PDU types in their own staging buffers.
+        */
+        static void WriteBlock(__in __notnull IPduBuilderV440* pBuilder, __in const BYTE* pData, __in UINT uSize)
+        {
+            UINT i = 0;
+            for (; i + 8 <= uSize; i += 8)
+            {
+                unsigned long long u = 0;
+                for (UINT j = 0; j < 8; j++)
+                {
+                    u = (u << 8) | pData[i + j];
+                }
+                pBuilder->WriteLongLong((long long)u);
+            }
+            if (i + 4 <= uSize)
+            {
+                pBuilder->WriteUInt(((unsigned int)pData[i] << 24) | ((unsigned int)pData[i + 1] << 16) | ((unsigned int)pData[i + 2] << 8) | pData[i + 3]);
+                i += 4;
+            }
+            if (i + 2 <= uSize)
+            {
+                pBuilder->WriteUShort((unsigned short)((pData[i] << 8) | pData[i + 1]));
+                i += 2;
+            }
+            if (i < uSize)
+            {
+                pBuilder->WriteUChar(pData[i]);
+            }
+        }
+
+    private:
+        struct StagedPdu
+        {
+            UINT    uOffset;
+            UINT    uSize;
+        };
+
+        BYTE* BeginPdu(BYTE yType, BYTE yFamily, UINT uSize)
+        {
+            StagedPdu pdu = { (UINT)m_vBuffer.size(), uSize };
+            m_vPdus.push_back(pdu);
+            m_vBuffer.resize(m_vBuffer.size() + uSize);
+
+            BYTE* p = m_vBuffer.data() + pdu.uOffset;
+            p = PutU8(p, 6);            // Protocol version (IEEE 1278.1-1995)
+            p = PutU8(p, 0);            // Exercise ID, filled in by Flush()
+            p = PutU8(p, yType);
+            p = PutU8(p, yFamily);
+            p = PutU32(p, 0);           // Timestamp, filled in by Flush()
+            p = PutU16(p, (unsigned short)uSize);
+            return PutU16(p, 0);
+        }
+
+        static BYTE* PutU8(BYTE* p, unsigned char y)
+        {
+            *p = y;
+            return p + 1;
+        }
+
+        static BYTE* PutU16(BYTE* p, unsigned short us)
+        {
+            p[0] = (BYTE)(us >> 8);
+            p[1] = (BYTE)us;
+            return p + 2;
+        }
+
+        static BYTE* PutU32(BYTE* p, unsigned int u)
+        {
+            p[0] = (BYTE)(u >> 24);
+            p[1] = (BYTE)(u >> 16);
+            p[2] = (BYTE)(u >> 8);
+            p[3] = (BYTE)u;
+            return p + 4;
+        }
+
+        static BYTE* PutF32(BYTE* p, float f)
+        {
+            unsigned int u;
+            memcpy(&u, &f, sizeof(u));
+            return PutU32(p, u);
+        }
+
+        static BYTE* PutF64(BYTE* p, double d)
+        {
+            unsigned long long u;
+            memcpy(&u, &d, sizeof(u));
+            p = PutU32(p, (unsigned int)(u >> 32));
+            return PutU32(p, (unsigned int)u);
+        }
+
+        static BYTE* PutBytes(BYTE* p, const void* pData, size_t uSize)
+        {
+            memcpy(p, pData, uSize);
+            return p + uSize;
+        }
+
+        static BYTE* PutEntityId(BYTE* p, const DisEntityId& id)
+        {
+            p = PutU16(p, id.usSite);
+            p = PutU16(p, id.usApplication);
+            return PutU16(p, id.usEntity);
+        }
+
+        static BYTE* PutEntityType(BYTE* p, const EntityType& type)
+        {
+            p = PutU8(p, type.GetKind());
+            p = PutU8(p, type.GetDomain());
+            p = PutU16(p, type.GetCountry());
+            p = PutU8(p, type.GetCategory());
+            p = PutU8(p, type.GetSubcategory());
+            p = PutU8(p, type.GetSpecific());
+            return PutU8(p, type.GetExtra());
+        }
+
+        static BYTE* PutVector(BYTE* p, const DisVector& v)
+        {
+            p = PutF32(p, v.fX);
+            p = PutF32(p, v.fY);
+            return PutF32(p, v.fZ);
+        }
+
+        static BYTE* PutWorld(BYTE* p, const DisWorldCoordinates& v)
+        {
+            p = PutF64(p, v.dX);
+            p = PutF64(p, v.dY);
+            return PutF64(p, v.dZ);
+        }
+
+        static BYTE* PutBurst(BYTE* p, const DisBurstDescriptor& burst)
+        {
+            p = PutEntityType(p, burst.MunitionType);
+            p = PutU16(p, burst.usWarhead);
+            p = PutU16(p, burst.usFuse);
+            p = PutU16(p, burst.usQuantity);
+            return PutU16(p, burst.usRate);
+        }
+
+        static BYTE* PutArticulations(BYTE* p, const ArticulatedParameter* pParams, UINT uCount)
+        {
+            for (UINT i = 0; i < uCount; i++)
+            {
+                const ArticulatedPart& part = pParams[i].m_ArticulatedPart;
+                p = PutU8(p, part.m_yRecordType);
+                p = PutU8(p, part.m_yChangeIndicator);
+                p = PutU16(p, part.m_usAttachedToId);
+                p = PutU32(p, part.m_uiParameterType);
+                p = PutF32(p, part.m_fParameterValue);
+                p = PutF32(p, part.m_fPadding);
+            }
+            return p;
+        }
+
+        void UpdateRates()
+        {
+            auto tNow = std::chrono::steady_clock::now();
+            double dElapsed = std::chrono::duration<double>(tNow - m_tWindowStart).count();
+            if (dElapsed >= 1.0)
+            {
+                m_dPdusPerSecond = m_uWindowPdus / dElapsed;
+                m_dBytesPerSecond = m_uWindowBytes / dElapsed;
+                m_uWindowPdus = 0;
+                m_uWindowBytes = 0;
+                m_tWindowStart = tNow;
+            }
+        }
+
+        CComPtr<IDISManagerV540>                m_spDIS;
+        std::vector<BYTE>                       m_vBuffer;
+        std::vector<StagedPdu>                  m_vPdus;
+        std::chrono::steady_clock::time_point   m_tWindowStart;
+        UINT64                                  m_uIssued = 0;
+        UINT64                                  m_uFailed = 0;
+        UINT64                                  m_uBytes = 0;
+        UINT64                                  m_uWindowPdus = 0;
+        UINT64                                  m_uWindowBytes = 0;
+        double                                  m_dPdusPerSecond = 0.0;
+        double                                  m_dBytesPerSecond = 0.0;
+    };
+    /** @} */
+}
@@ -0,0 +1,455 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// EntityIdCache.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "ISimObject.h"
+#include "ISimObjectDIS.h"
+#include "INetworkServices.h"
+#include "DisPduWriter.h"
+
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Open addressing hash map from 64-bit IDs to 64-bit IDs, stored in a single flat array.
+    * Uses linear probing with backward shift deletion, so lookups never walk over tombstones.
+    */
+    class FlatIdMap
+    {
+    public:
+        FlatIdMap()
+        {
+            m_vSlots.resize(64);
+        }
+
+        /** @return True and the value if the key is present. */
+        bool Find(__in UINT64 uKey, __out UINT64& uValue) const
+        {
+            const size_t uMask = m_vSlots.size() - 1;
+            for (size_t i = Hash(uKey) & uMask; m_vSlots[i].bUsed; i = (i + 1) & uMask)
+            {
+                if (m_vSlots[i].uKey == uKey)
+                {
+                    uValue = m_vSlots[i].uValue;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** Inserts or replaces a value. */
+        void Insert(__in UINT64 uKey, __in UINT64 uValue)
+        {
+            if ((m_uCount + 1) * 4 > m_vSlots.size() * 3)
+            {
+                Grow();
+            }
+
+            const size_t uMask = m_vSlots.size() - 1;
+            size_t i = Hash(uKey) & uMask;
+            for (; m_vSlots[i].bUsed; i = (i + 1) & uMask)
+            {
+                if (m_vSlots[i].uKey == uKey)
+                {
+                    m_vSlots[i].uValue = uValue;
+                    return;
+                }
+            }
+            m_vSlots[i].uKey = uKey;
+            m_vSlots[i].uValue = uValue;
+            m_vSlots[i].bUsed = true;
+            m_uCount++;
+        }
+
+        /** Removes a key. @return True if the key was present. */
+        bool Erase(__in UINT64 uKey)
+        {
+            const size_t uMask = m_vSlots.size() - 1;
+            size_t i = Hash(uKey) & uMask;
+            for (; m_vSlots[i].bUsed; i = (i + 1) & uMask)
+            {
+                if (m_vSlots[i].uKey == uKey)
+                {
+                    break;
+                }
+            }
+            if (!m_vSlots[i].bUsed)
+            {
+                return false;
+            }
+
+            // Shift following entries of the probe run back so no gap breaks their lookup.
+            size_t uHole = i;
+            for (size_t j = (i + 1) & uMask; m_vSlots[j].bUsed; j = (j + 1) & uMask)
+            {
+                size_t uHome = Hash(m_vSlots[j].uKey) & uMask;
+                if (((j - uHome) & uMask) >= ((j - uHole) & uMask))
+                {
+                    m_vSlots[uHole] = m_vSlots[j];
+                    uHole = j;
+                }
+            }
+            m_vSlots[uHole].bUsed = false;
+            m_uCount--;
+            return true;
+        }
+
+        void Clear()
+        {
+            for (Slot& slot : m_vSlots)
+            {
+                slot.bUsed = false;
+            }
+            m_uCount = 0;
+        }
+
+        size_t GetCount() const { return m_uCount; }
+
+    private:
+        struct Slot
+        {
+            UINT64  uKey = 0;
+            UINT64  uValue = 0;
+            bool    bUsed = false;
+        };
+
+        static size_t Hash(UINT64 uKey)
+        {
+            uKey ^= uKey >> 33;
+            uKey *= 0xff51afd7ed558ccdULL;
+            uKey ^= uKey >> 33;
+            return (size_t)uKey;
+        }
+
+        void Grow()
+        {
+            std::vector<Slot> vOld;
+            vOld.swap(m_vSlots);
+            m_vSlots.resize(vOld.size() * 2);
+            m_uCount = 0;
+            for (const Slot& slot : vOld)
+            {
+                if (slot.bUsed)
+                {
+                    Insert(slot.uKey, slot.uValue);
+                }
+            }
+        }
+
+        std::vector<Slot>   m_vSlots;
+        size_t              m_uCount = 0;
+    };
+
+    /// Lookup counters reported by EntityIdCache.
+    struct EntityIdCacheStats
+    {
+        UINT64  uHits;              ///< Lookups answered from the cache
+        UINT64  uMisses;            ///< Lookups forwarded to the DIS or CIGI service
+        UINT64  uFailures;          ///< Forwarded lookups the service could not resolve
+        UINT64  uInvalidations;     ///< Objects dropped from the cache when created or removed
+    };
+
+    /**
+    * Bidirectional cache in front of the DIS and CIGI entity ID lookups:
+    * IDISManagerV540::GetEntityIdByObjectId()/GetObjectIdByEntityId() and
+    * ICigiServiceV430::GetEntityID()/GetObjectID().  Successful lookups are cached in both directions;
+    * failed lookups are not, since an ID may be assigned after the object is created.
+    * @remarks  The cache stays coherent through the ISimObjectManagerV520 object create and remove
+    *           callbacks, which drop every mapping of the object so a reused object ID is never stale.
+    *           The callbacks are plain functions, so only one cache can be attached at a time; include
+    *           EntityIdCacheInit.h once in your DLL.
+    * @remarks  Not thread safe.  Use from the thread the object callbacks are raised on.
+    * Sample usage:
+    * ```
+    *      EntityIdCache cache(spDIS, spCigi, spObjectManager);
+    *      cache.Attach();
+    *      ...
+    *      DisEntityId id;
+    *      if (SUCCEEDED(cache.GetDisEntityId(uObjectId, id)))
+    *      ...
+    *      cache.Detach();
+    * ```
+    */
+    class EntityIdCache
+    {
+    public:
+        /**
+        * @param pDIS           DIS manager, or nullptr if DIS lookups are not used.
+        * @param pCigi          CIGI service, or nullptr if CIGI lookups are not used.
+        * @param pObjectManager Object manager used to track object removal.
+        */
+        EntityIdCache(__in IDISManagerV540* pDIS, __in ICigiServiceV430* pCigi, __in __notnull ISimObjectManagerV520* pObjectManager)
+            : m_spDIS(pDIS),
+              m_spCigi(pCigi),
+              m_spObjectManager(pObjectManager)
+        {
+            ResetStats();
+        }
+
+        ~EntityIdCache()
+        {
+            Detach();
+        }
+
+        /**
+        * Registers the object callbacks that keep the cache coherent.
+        * @return   S_OK, or E_FAIL if another cache is already attached.
+        */
+        HRESULT Attach()
+        {
+            HRESULT hr = E_FAIL;
+
+            if (m_pInstance == this)
+            {
+                return S_OK;
+            }
+            if (m_pInstance == nullptr)
+            {
+                hr = m_spObjectManager->RegisterOnObjectCreateCallback(OnObjectChanged);
+                if (SUCCEEDED(hr))
+                {
+                    hr = m_spObjectManager->RegisterOnObjectRemoveCallback(OnObjectChanged);
+                    if (SUCCEEDED(hr))
+                    {
+                        m_pInstance = this;
+                    }
+                    else
+                    {
+                        m_spObjectManager->UnRegisterOnObjectCreateCallback(OnObjectChanged);
+                    }
+                }
+            }
+            return hr;
+        }
+
+        /** Unregisters the object callbacks and clears the cache. */
+        void Detach()
+        {
+            if (m_pInstance == this)
+            {
+                m_spObjectManager->UnRegisterOnObjectCreateCallback(OnObjectChanged);
+                m_spObjectManager->UnRegisterOnObjectRemoveCallback(OnObjectChanged);
+                m_pInstance = nullptr;
+            }
+            Clear();
+        }
+
+        /** Cached IDISManagerV540::GetEntityIdByObjectId(). */
+        HRESULT GetDisEntityId(__in UINT uObjectId, __out DisEntityId& entityId)
+        {
+            UINT64 uKey = 0;
+            if (m_DisByObject.Find(uObjectId, uKey))
+            {
+                m_Stats.uHits++;
+                entityId = UnpackDis(uKey);
+                return S_OK;
+            }
+
+            m_Stats.uMisses++;
+            HRESULT hr = m_spDIS != nullptr ? m_spDIS->GetEntityIdByObjectId(uObjectId, entityId.usSite, entityId.usApplication, entityId.usEntity) : E_NOINTERFACE;
+            if (SUCCEEDED(hr))
+            {
+                AddDis(uObjectId, PackDis(entityId));
+            }
+            else
+            {
+                m_Stats.uFailures++;
+            }
+            return hr;
+        }
+
+        /** Cached IDISManagerV540::GetObjectIdByEntityId(). */
+        HRESULT GetDisObjectId(__in const DisEntityId& entityId, __out UINT& uObjectId)
+        {
+            UINT64 uValue = 0;
+            if (m_ObjectByDis.Find(PackDis(entityId), uValue))
+            {
+                m_Stats.uHits++;
+                uObjectId = (UINT)uValue;
+                return S_OK;
+            }
+
+            m_Stats.uMisses++;
+            UINT32 uId = 0;
+            HRESULT hr = m_spDIS != nullptr ? m_spDIS->GetObjectIdByEntityId(entityId.usSite, entityId.usApplication, entityId.usEntity, uId) : E_NOINTERFACE;
+            if (SUCCEEDED(hr))
+            {
+                uObjectId = uId;
+                AddDis(uId, PackDis(entityId));
+            }
+            else
+            {
+                m_Stats.uFailures++;
+            }
+            return hr;
+        }
+
+        /** Cached ICigiServiceV430::GetEntityID(). */
+        HRESULT GetCigiEntityId(__in UINT uObjectId, __out USHORT& usEntityId)
+        {
+            UINT64 uValue = 0;
+            if (m_CigiByObject.Find(uObjectId, uValue))
+            {
+                m_Stats.uHits++;
+                usEntityId = (USHORT)uValue;
+                return S_OK;
+            }
+
+            m_Stats.uMisses++;
+            HRESULT hr = m_spCigi != nullptr ? m_spCigi->GetEntityID(uObjectId, usEntityId) : E_NOINTERFACE;
+            if (SUCCEEDED(hr))
+            {
+                AddCigi(uObjectId, usEntityId);
+            }
+            else
+            {
+                m_Stats.uFailures++;
+            }
+            return hr;
+        }
+
+        /** Cached ICigiServiceV430::GetObjectID(). */
+        HRESULT GetCigiObjectId(__in USHORT usEntityId, __out UINT& uObjectId)
+        {
+            UINT64 uValue = 0;
+            if (m_ObjectByCigi.Find(usEntityId, uValue))
+            {
+                m_Stats.uHits++;
+                uObjectId = (UINT)uValue;
+                return S_OK;
+            }
+
+            m_Stats.uMisses++;
+            HRESULT hr = m_spCigi != nullptr ? m_spCigi->GetObjectID(usEntityId, uObjectId) : E_NOINTERFACE;
+            if (SUCCEEDED(hr))
+            {
+                AddCigi(uObjectId, usEntityId);
+            }
+            else
+            {
+                m_Stats.uFailures++;
+            }
+            return hr;
+        }
+
+        /** Drops every cached mapping of an object. */
+        void Invalidate(__in UINT uObjectId)
+        {
+            bool bFound = false;
+            UINT64 uValue = 0;
+            if (m_DisByObject.Find(uObjectId, uValue))
+            {
+                m_ObjectByDis.Erase(uValue);
+                m_DisByObject.Erase(uObjectId);
+                bFound = true;
+            }
+            if (m_CigiByObject.Find(uObjectId, uValue))
+            {
+                m_ObjectByCigi.Erase(uValue);
+                m_CigiByObject.Erase(uObjectId);
+                bFound = true;
+            }
+            if (bFound)
+            {
+                m_Stats.uInvalidations++;
+            }
+        }
+
+        /** Drops every cached mapping, e.g. when a DIS or CIGI session ends. */
+        void Clear()
+        {
+            m_DisByObject.Clear();
+            m_ObjectByDis.Clear();
+            m_CigiByObject.Clear();
+            m_ObjectByCigi.Clear();
+        }
+
+        const EntityIdCacheStats& GetStats() const { return m_Stats; }
+        void ResetStats() { m_Stats = EntityIdCacheStats(); }
+        /// Fraction of lookups answered from the cache.
+        double GetHitRate() const
+        {
+            UINT64 uTotal = m_Stats.uHits + m_Stats.uMisses;
+            return uTotal > 0 ? (double)m_Stats.uHits / uTotal : 0.0;
+        }
+        /// Number of objects with a cached DIS mapping.
+        size_t GetDisCount() const { return m_DisByObject.GetCount(); }
+        /// Number of objects with a cached CIGI mapping.
+        size_t GetCigiCount() const { return m_CigiByObject.GetCount(); }
+
+    private:
+        static HRESULT STDMETHODCALLTYPE OnObjectChanged(__in IUnknown& Obj)
+        {
+            if (m_pInstance != nullptr)
+            {
+                CComPtr<IBaseObjectV400> spObject;
+                if (SUCCEEDED(Obj.QueryInterface(IID_IBaseObjectV400, (void**)&spObject)) && spObject != nullptr)
+                {
+                    m_pInstance->Invalidate(spObject->GetId());
+                }
+            }
+            return S_OK;
+        }
+
+        static UINT64 PackDis(const DisEntityId& id)
+        {
+            return ((UINT64)id.usSite << 32) | ((UINT64)id.usApplication << 16) | id.usEntity;
+        }
+
+        static DisEntityId UnpackDis(UINT64 uKey)
+        {
+            DisEntityId id = { (unsigned short)(uKey >> 32), (unsigned short)(uKey >> 16), (unsigned short)uKey };
+            return id;
+        }
+
+        void AddDis(UINT uObjectId, UINT64 uKey)
+        {
+            // Remove a stale mapping in either direction so both maps stay inverse of each other.
+            UINT64 uOld = 0;
+            if (m_DisByObject.Find(uObjectId, uOld))
+            {
+                m_ObjectByDis.Erase(uOld);
+            }
+            if (m_ObjectByDis.Find(uKey, uOld))
+            {
+                m_DisByObject.Erase(uOld);
+            }
+            m_DisByObject.Insert(uObjectId, uKey);
+            m_ObjectByDis.Insert(uKey, uObjectId);
+        }
+
+        void AddCigi(UINT uObjectId, USHORT usEntityId)
+        {
+            UINT64 uOld = 0;
+            if (m_CigiByObject.Find(uObjectId, uOld))
+            {
+                m_ObjectByCigi.Erase(uOld);
+            }
+            if (m_ObjectByCigi.Find(usEntityId, uOld))
+            {
+                m_CigiByObject.Erase(uOld);
+            }
+            m_CigiByObject.Insert(uObjectId, usEntityId);
+            m_ObjectByCigi.Insert(usEntityId, uObjectId);
+        }
+
+        static EntityIdCache* m_pInstance;
+
+        CComPtr<IDISManagerV540>        m_spDIS;
+        CComPtr<ICigiServiceV430>       m_spCigi;
+        CComPtr<ISimObjectManagerV520>  m_spObjectManager;
+        FlatIdMap                       m_DisByObject;
+        FlatIdMap                       m_ObjectByDis;
+        FlatIdMap                       m_CigiByObject;
+        FlatIdMap                       m_ObjectByCigi;
+        EntityIdCacheStats              m_Stats;
+    };
+    /** @} */
+}
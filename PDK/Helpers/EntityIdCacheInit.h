@@ -0,0 +1,9 @@
+#pragma once
+#include "EntityIdCache.h"
+
+namespace P3D
+{
+    /** @use this once in your DLL to define the EntityIdCache callback instance */ /** @{ */
+
+    EntityIdCache* EntityIdCache::m_pInstance = nullptr;
+}
@@ -0,0 +1,500 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// EnvironmentForceField.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "IEnvironmentForces.h"
+#include "DeadReckoning.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup environmentforces */ /** @{ */
+
+    /// How a snapshotted force is evaluated by EnvironmentForceField.
+    enum ENVIRONMENT_FORCE_MODEL
+    {
+        ENVIRONMENT_FORCE_UNIFORM,      ///< Full force inside the volume
+        ENVIRONMENT_FORCE_LINEAR,       ///< Force falling linearly from the position to zero at the radius
+        ENVIRONMENT_FORCE_VIRTUAL,      ///< Matches neither model; evaluated with GetForceAtLocation()
+    };
+
+    /**
+    * Evaluates the sum of environment forces at many points per frame without a virtual call per
+    * force per point.
+    * Snapshot() collects the forces around a region once per frame and records each force's position,
+    * radius, half-angle and force vector in structure of arrays form, indexed by a spatial hash of
+    * fixed size cells.  Evaluate() then answers batched point queries from the snapshot, testing each
+    * candidate force of a cell against four points at a time in SSE2 lanes.
+    * @remarks  The volume of a force is the cone of its half-angle around the direction of its force,
+    *           cut at its radius; a half-angle of PI is a sphere.  Because GetForceAtLocation() is up to
+    *           each force, Snapshot() probes every force at a few points along its axis and just inside
+    *           and outside its half-angle, and compares the results with the uniform and linear models.
+    *           Forces that match neither, for example forces whose strength varies with time or altitude,
+    *           are evaluated through GetForceAtLocation().  MeasureError() compares the two paths.
+    * @remarks  Positions are converted to east/up/north feet around the snapshot center.  Horizontal
+    *           distances are rescaled to each force's latitude and altitude so volume edges match the
+    *           force's own frame.
+    * Sample usage:
+    * ```
+    *      EnvironmentForceField field;
+    *
+    *      // Every frame:
+    *      field.Snapshot(spForceManager, vAircraftLonAltLat, 5000.0f);
+    *      field.Evaluate(vBodyPointsLonAltLat, uPointCount, vForcesPounds, uAircraftId);
+    * ```
+    */
+    class EnvironmentForceField
+    {
+    public:
+        /**
+        * @param fCellFeet  Spatial hash cell size.  About the radius of a typical force works well.
+        */
+        explicit EnvironmentForceField(__in float fCellFeet = 2000.0f)
+            : m_fCellFeet(std::max(fCellFeet, 1.0f))
+        {
+        }
+
+        /**
+        * Collects the forces within a radius and rebuilds the spatial hash.
+        * @param pManager       Environment force manager.
+        * @param vCenter        Center of the region, longitude/altitude/latitude in radians and feet.
+        * @param fRadiusFeet    Radius of the region.  Include the extent of the points that will be queried.
+        * @return               S_OK, or the error of GetForcesInRadius().
+        */
+        HRESULT Snapshot(__in __notnull IEnvironmentForceManagerV410* pManager, __in const DXYZ& vCenter, __in float fRadiusFeet)
+        {
+            m_vCenter = vCenter;
+            m_Forces.Items.clear();
+            HRESULT hr = pManager->GetForcesInRadius(vCenter, fRadiusFeet, m_Forces);
+            if (FAILED(hr))
+            {
+                m_Forces.Items.clear();
+            }
+
+            const size_t uCount = m_Forces.Items.size();
+            m_vX.resize(uCount); m_vY.resize(uCount); m_vZ.resize(uCount); m_vEastScale.resize(uCount); m_vNorthScale.resize(uCount);
+            m_vAxisX.resize(uCount); m_vAxisY.resize(uCount); m_vAxisZ.resize(uCount);
+            m_vForceX.resize(uCount); m_vForceY.resize(uCount); m_vForceZ.resize(uCount);
+            m_vRadiusSq.resize(uCount); m_vInvRadius.resize(uCount); m_vCosHalfAngle.resize(uCount);
+            m_vFalloff.resize(uCount); m_vOwner.resize(uCount); m_vModel.resize(uCount);
+
+            for (size_t i = 0; i < uCount; i++)
+            {
+                IEnvironmentForceV400* pForce = m_Forces.Items[i];
+                DXYZ vPosition, vForce, vLocal;
+                pForce->GetPosition(vPosition);
+                pForce->GetForce(vForce);
+                DeadReckoning::Difference(m_vCenter, vPosition, vLocal);
+
+                const float fRadius = std::max(pForce->GetRadius(), 0.0f);
+                const double dLength = sqrt(vForce.dX * vForce.dX + vForce.dY * vForce.dY + vForce.dZ * vForce.dZ);
+                m_vX[i] = (float)vLocal.dX;
+                m_vY[i] = (float)vLocal.dY;
+                m_vZ[i] = (float)vLocal.dZ;
+                m_vNorthScale[i] = (float)((DeadReckoning::EarthRadiusFeet() + vPosition.dY) / (DeadReckoning::EarthRadiusFeet() + m_vCenter.dY));
+                m_vEastScale[i] = m_vNorthScale[i] * (float)(cos(vPosition.dZ) / cos(m_vCenter.dZ));
+                m_vAxisX[i] = dLength > 0.0 ? (float)(vForce.dX / dLength) : 0.0f;
+                m_vAxisY[i] = dLength > 0.0 ? (float)(vForce.dY / dLength) : 1.0f;
+                m_vAxisZ[i] = dLength > 0.0 ? (float)(vForce.dZ / dLength) : 0.0f;
+                m_vForceX[i] = (float)vForce.dX;
+                m_vForceY[i] = (float)vForce.dY;
+                m_vForceZ[i] = (float)vForce.dZ;
+                m_vRadiusSq[i] = fRadius * fRadius;
+                m_vInvRadius[i] = fRadius > 0.0f ? 1.0f / fRadius : 0.0f;
+                m_vCosHalfAngle[i] = pForce->GetHalfAngle() >= 3.14159265f ? -2.0f : cosf(pForce->GetHalfAngle());
+                m_vOwner[i] = pForce->GetOwnerId();
+                m_vModel[i] = Classify(pForce, (UINT)i, vPosition);
+                m_vFalloff[i] = m_vModel[i] == ENVIRONMENT_FORCE_LINEAR ? 1.0f : 0.0f;
+            }
+
+            BuildHash();
+            return hr;
+        }
+
+        /**
+        * Sums the forces at a batch of points.
+        * @param pPositions     Points, longitude/altitude/latitude in radians and feet.
+        * @param uCount         Number of points.
+        * @param pForces        Receives the world force in pounds at each point.
+        * @param uIgnoreOwnerId Forces owned by this object are skipped, e.g. the object's own downwash.  0 skips none.
+        * @remarks  The points are converted to local feet and sorted by cell, and every candidate force is then
+        *           tested against LANES points at once.  Evaluate() keeps its scratch arrays in the field, so
+        *           one field must not be evaluated from several threads at once.
+        */
+        void Evaluate(__in const DXYZ* pPositions, __in UINT uCount, __out DXYZ* pForces, __in UINT uIgnoreOwnerId = 0) const
+        {
+            // Points in local feet, structure of arrays, padded to whole lanes with copies of the last point.
+            const UINT uPadded = (uCount + LANES - 1) / LANES * LANES;
+            m_vQueryX.resize(uPadded); m_vQueryY.resize(uPadded); m_vQueryZ.resize(uPadded);
+            m_vSumX.assign(uPadded, 0.0f); m_vSumY.assign(uPadded, 0.0f); m_vSumZ.assign(uPadded, 0.0f);
+            m_vQueryKeys.resize(uCount);
+            m_vQueryOrder.resize(uCount);
+
+            const float fInvCell = 1.0f / m_fCellFeet;
+            for (UINT uPoint = 0; uPoint < uPadded; uPoint++)
+            {
+                if (uPoint >= uCount)
+                {
+                    m_vQueryX[uPoint] = m_vQueryX[uCount - 1];
+                    m_vQueryY[uPoint] = m_vQueryY[uCount - 1];
+                    m_vQueryZ[uPoint] = m_vQueryZ[uCount - 1];
+                    continue;
+                }
+                DXYZ vLocal;
+                DeadReckoning::Difference(m_vCenter, pPositions[uPoint], vLocal);
+                m_vQueryX[uPoint] = (float)vLocal.dX;
+                m_vQueryY[uPoint] = (float)vLocal.dY;
+                m_vQueryZ[uPoint] = (float)vLocal.dZ;
+                m_vQueryKeys[uPoint] = MakeKey((int)floorf(m_vQueryX[uPoint] * fInvCell), (int)floorf(m_vQueryY[uPoint] * fInvCell),
+                                               (int)floorf(m_vQueryZ[uPoint] * fInvCell));
+                m_vQueryOrder[uPoint] = uPoint;
+            }
+
+            // Points sharing a cell share its candidate forces, so each run of a cell is evaluated in whole lanes.
+            std::sort(m_vQueryOrder.begin(), m_vQueryOrder.end(), [this](UINT a, UINT b) { return m_vQueryKeys[a] < m_vQueryKeys[b]; });
+            for (UINT uRun = 0; uRun < uCount;)
+            {
+                const UINT64 uKey = m_vQueryKeys[m_vQueryOrder[uRun]];
+                UINT uRunEnd = uRun + 1;
+                while (uRunEnd < uCount && m_vQueryKeys[m_vQueryOrder[uRunEnd]] == uKey)
+                {
+                    uRunEnd++;
+                }
+
+                UINT uBegin, uEnd;
+                FindCell(uKey, uBegin, uEnd);
+                for (UINT uFirst = uRun; uBegin != uEnd && uFirst < uRunEnd; uFirst += LANES)
+                {
+                    UINT uLanes[LANES];
+                    float fX[LANES], fY[LANES], fZ[LANES], fSumX[LANES] = {}, fSumY[LANES] = {}, fSumZ[LANES] = {};
+                    for (UINT k = 0; k < LANES; k++)
+                    {
+                        uLanes[k] = m_vQueryOrder[std::min(uFirst + k, uRunEnd - 1)];
+                        fX[k] = m_vQueryX[uLanes[k]];
+                        fY[k] = m_vQueryY[uLanes[k]];
+                        fZ[k] = m_vQueryZ[uLanes[k]];
+                    }
+                    Accumulate(m_vCellForces.data() + uBegin, uEnd - uBegin, fX, fY, fZ, uIgnoreOwnerId, fSumX, fSumY, fSumZ);
+                    for (UINT k = 0; k < LANES && uFirst + k < uRunEnd; k++)
+                    {
+                        m_vSumX[uLanes[k]] += fSumX[k];
+                        m_vSumY[uLanes[k]] += fSumY[k];
+                        m_vSumZ[uLanes[k]] += fSumZ[k];
+                    }
+                }
+                uRun = uRunEnd;
+            }
+
+            // Large forces are candidates of every point, so they run straight over the arrays.
+            for (UINT uFirst = 0; uFirst < uPadded && !m_vLargeForces.empty(); uFirst += LANES)
+            {
+                Accumulate(m_vLargeForces.data(), (UINT)m_vLargeForces.size(), &m_vQueryX[uFirst], &m_vQueryY[uFirst], &m_vQueryZ[uFirst],
+                           uIgnoreOwnerId, &m_vSumX[uFirst], &m_vSumY[uFirst], &m_vSumZ[uFirst]);
+            }
+
+            for (UINT uPoint = 0; uPoint < uCount; uPoint++)
+            {
+                DXYZ& vForce = pForces[uPoint];
+                vForce.dX = m_vSumX[uPoint];
+                vForce.dY = m_vSumY[uPoint];
+                vForce.dZ = m_vSumZ[uPoint];
+
+                for (UINT i = 0; i < m_vVirtual.size(); i++)
+                {
+                    AddVirtual(m_vVirtual[i], pPositions[uPoint], m_vQueryX[uPoint], m_vQueryY[uPoint], m_vQueryZ[uPoint], uIgnoreOwnerId, vForce);
+                }
+            }
+        }
+
+        /**
+        * Compares Evaluate() with the sum of GetForceAtLocation() over the snapshotted forces.
+        * @return   Largest difference in pounds over the points.
+        */
+        double MeasureError(__in const DXYZ* pPositions, __in UINT uCount, __in UINT uIgnoreOwnerId = 0) const
+        {
+            double dError = 0.0;
+            for (UINT uPoint = 0; uPoint < uCount; uPoint++)
+            {
+                DXYZ vFast;
+                Evaluate(&pPositions[uPoint], 1, &vFast, uIgnoreOwnerId);
+
+                DXYZ vExact = {};
+                for (size_t i = 0; i < m_Forces.Items.size(); i++)
+                {
+                    if (uIgnoreOwnerId != 0 && m_vOwner[i] == uIgnoreOwnerId)
+                    {
+                        continue;
+                    }
+                    DXYZ vForce = {};
+                    m_Forces.Items[i]->GetForceAtLocation(pPositions[uPoint], vForce);
+                    vExact.dX += vForce.dX;
+                    vExact.dY += vForce.dY;
+                    vExact.dZ += vForce.dZ;
+                }
+                dError = std::max(dError, sqrt((vFast.dX - vExact.dX) * (vFast.dX - vExact.dX) + (vFast.dY - vExact.dY) * (vFast.dY - vExact.dY) +
+                                               (vFast.dZ - vExact.dZ) * (vFast.dZ - vExact.dZ)));
+            }
+            return dError;
+        }
+
+        /// Number of forces in the snapshot.
+        UINT GetForceCount() const { return (UINT)m_Forces.Items.size(); }
+        /// Model a snapshotted force is evaluated with.
+        ENVIRONMENT_FORCE_MODEL GetForceModel(__in UINT uIndex) const { return (ENVIRONMENT_FORCE_MODEL)m_vModel[uIndex]; }
+        /// Snapshotted force interface.
+        IEnvironmentForceV400* GetForce(__in UINT uIndex) const { return m_Forces.Items[uIndex]; }
+
+    private:
+        /// Points evaluated together by Accumulate(), one per SSE2 lane.
+        static const UINT LANES = 4;
+        /// Forces whose bounding box covers more cells than this are tested for every point instead.
+        static const UINT MAX_CELLS_PER_FORCE = 64;
+
+        static UINT64 MakeKey(int iX, int iY, int iZ)
+        {
+            return ((UINT64)(iX & 0x1FFFFF) << 42) | ((UINT64)(iY & 0x1FFFFF) << 21) | (UINT64)(iZ & 0x1FFFFF);
+        }
+
+        /**
+        * Adds the contribution of the model forces in pIndices to LANES points.  Each force is broadcast and
+        * tested against all lanes at once, with the volume test as a mask rather than a branch.
+        */
+        void Accumulate(const UINT* pIndices, UINT uCount, const float* pX, const float* pY, const float* pZ, UINT uIgnoreOwnerId,
+                        float* pSumX, float* pSumY, float* pSumZ) const
+        {
+            const __m128 vX = _mm_loadu_ps(pX);
+            const __m128 vY = _mm_loadu_ps(pY);
+            const __m128 vZ = _mm_loadu_ps(pZ);
+            const __m128 vOne = _mm_set1_ps(1.0f);
+            __m128 vSumX = _mm_loadu_ps(pSumX);
+            __m128 vSumY = _mm_loadu_ps(pSumY);
+            __m128 vSumZ = _mm_loadu_ps(pSumZ);
+            for (UINT j = 0; j < uCount; j++)
+            {
+                const UINT i = pIndices[j];
+                if (uIgnoreOwnerId != 0 && m_vOwner[i] == uIgnoreOwnerId)
+                {
+                    continue;
+                }
+                const __m128 vDX = _mm_mul_ps(_mm_sub_ps(vX, _mm_set1_ps(m_vX[i])), _mm_set1_ps(m_vEastScale[i]));
+                const __m128 vDY = _mm_sub_ps(vY, _mm_set1_ps(m_vY[i]));
+                const __m128 vDZ = _mm_mul_ps(_mm_sub_ps(vZ, _mm_set1_ps(m_vZ[i])), _mm_set1_ps(m_vNorthScale[i]));
+                const __m128 vDistanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vDX, vDX), _mm_mul_ps(vDY, vDY)), _mm_mul_ps(vDZ, vDZ));
+                const __m128 vDistance = _mm_sqrt_ps(vDistanceSq);
+                const __m128 vDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vDX, _mm_set1_ps(m_vAxisX[i])), _mm_mul_ps(vDY, _mm_set1_ps(m_vAxisY[i]))),
+                                               _mm_mul_ps(vDZ, _mm_set1_ps(m_vAxisZ[i])));
+
+                const __m128 vInside = _mm_and_ps(_mm_cmple_ps(vDistanceSq, _mm_set1_ps(m_vRadiusSq[i])),
+                                                  _mm_cmpge_ps(vDot, _mm_mul_ps(_mm_set1_ps(m_vCosHalfAngle[i]), vDistance)));
+                const __m128 vWeight = _mm_and_ps(vInside, _mm_sub_ps(vOne, _mm_mul_ps(_mm_set1_ps(m_vFalloff[i] * m_vInvRadius[i]), vDistance)));
+                vSumX = _mm_add_ps(vSumX, _mm_mul_ps(vWeight, _mm_set1_ps(m_vForceX[i])));
+                vSumY = _mm_add_ps(vSumY, _mm_mul_ps(vWeight, _mm_set1_ps(m_vForceY[i])));
+                vSumZ = _mm_add_ps(vSumZ, _mm_mul_ps(vWeight, _mm_set1_ps(m_vForceZ[i])));
+            }
+            _mm_storeu_ps(pSumX, vSumX);
+            _mm_storeu_ps(pSumY, vSumY);
+            _mm_storeu_ps(pSumZ, vSumZ);
+        }
+
+        void AddVirtual(UINT i, const DXYZ& vPosition, float fX, float fY, float fZ, UINT uIgnoreOwnerId, DXYZ& vSum) const
+        {
+            const float fDX = (fX - m_vX[i]) * m_vEastScale[i];
+            const float fDY = fY - m_vY[i];
+            const float fDZ = (fZ - m_vZ[i]) * m_vNorthScale[i];
+            if (fDX * fDX + fDY * fDY + fDZ * fDZ > m_vRadiusSq[i] || (uIgnoreOwnerId != 0 && m_vOwner[i] == uIgnoreOwnerId))
+            {
+                return;
+            }
+            DXYZ vForce = {};
+            m_Forces.Items[i]->GetForceAtLocation(vPosition, vForce);
+            vSum.dX += vForce.dX;
+            vSum.dY += vForce.dY;
+            vSum.dZ += vForce.dZ;
+        }
+
+        /**
+        * Probes a force to find the model that reproduces GetForceAtLocation().  Along its axis the force is
+        * probed at its position, at half and nine tenths of its radius, behind it, and just beyond its
+        * radius.  At half its radius it is also probed just inside its half-angle and, for a cone, just
+        * outside it.  A force that matches neither model at every probe is evaluated virtually.
+        */
+        BYTE Classify(IEnvironmentForceV400* pForce, UINT i, const DXYZ& vPosition) const
+        {
+            const float fRadius = sqrtf(m_vRadiusSq[i]);
+            if (fRadius <= 0.0f)
+            {
+                return ENVIRONMENT_FORCE_VIRTUAL;
+            }
+
+            const float fAxis[3] = { m_vAxisX[i], m_vAxisY[i], m_vAxisZ[i] };
+            bool bUniform = true;
+            bool bLinear = true;
+
+            static const float s_fProbes[] = { 0.0f, 0.5f, 0.9f, -0.5f, 1.1f };
+            for (float fProbe : s_fProbes)
+            {
+                const float fDirection[3] = { fAxis[0] * fProbe, fAxis[1] * fProbe, fAxis[2] * fProbe };
+                Probe(pForce, i, vPosition, fDirection, fRadius, bUniform, bLinear);
+            }
+
+            // Off the axis, rotate it towards a perpendicular by angles either side of the half-angle.
+            const float fHalfAngle = std::min(std::max(pForce->GetHalfAngle(), 0.0f), 3.14159265f);
+            const float fHelper[3] = { fabsf(fAxis[1]) < 0.9f ? 0.0f : 1.0f, fabsf(fAxis[1]) < 0.9f ? 1.0f : 0.0f, 0.0f };
+            float fPerpendicular[3] = { fAxis[1] * fHelper[2] - fAxis[2] * fHelper[1], fAxis[2] * fHelper[0] - fAxis[0] * fHelper[2],
+                                        fAxis[0] * fHelper[1] - fAxis[1] * fHelper[0] };
+            const float fLength = sqrtf(fPerpendicular[0] * fPerpendicular[0] + fPerpendicular[1] * fPerpendicular[1] + fPerpendicular[2] * fPerpendicular[2]);
+            for (float& f : fPerpendicular)
+            {
+                f /= fLength;
+            }
+
+            const float fInside = fHalfAngle * 0.9f;
+            const float fOutside = fHalfAngle * 1.1f + 0.01f;
+            const float fAngles[] = { fInside, fOutside };
+            const UINT uAngles = fOutside < 3.1f ? 2 : 1;
+            for (UINT k = 0; k < uAngles; k++)
+            {
+                const float fCos = cosf(fAngles[k]) * 0.5f;
+                const float fSin = sinf(fAngles[k]) * 0.5f;
+                const float fDirection[3] = { fAxis[0] * fCos + fPerpendicular[0] * fSin, fAxis[1] * fCos + fPerpendicular[1] * fSin,
+                                              fAxis[2] * fCos + fPerpendicular[2] * fSin };
+                Probe(pForce, i, vPosition, fDirection, fRadius, bUniform, bLinear);
+            }
+            return bUniform ? ENVIRONMENT_FORCE_UNIFORM : (bLinear ? ENVIRONMENT_FORCE_LINEAR : ENVIRONMENT_FORCE_VIRTUAL);
+        }
+
+        /// Compares GetForceAtLocation() at vPosition + fDirection * fRadius with both models, as Accumulate() evaluates them.
+        void Probe(IEnvironmentForceV400* pForce, UINT i, const DXYZ& vPosition, const float fDirection[3], float fRadius, bool& bUniform, bool& bLinear) const
+        {
+            DXYZ vOffset = { fDirection[0] * fRadius, fDirection[1] * fRadius, fDirection[2] * fRadius };
+            DXYZ vPoint, vActual = {};
+            DeadReckoning::Offset(vPosition, vOffset, vPoint);
+            pForce->GetForceAtLocation(vPoint, vActual);
+
+            const float fDistance = sqrtf(fDirection[0] * fDirection[0] + fDirection[1] * fDirection[1] + fDirection[2] * fDirection[2]) * fRadius;
+            const float fDot = (fDirection[0] * m_vAxisX[i] + fDirection[1] * m_vAxisY[i] + fDirection[2] * m_vAxisZ[i]) * fRadius;
+            const bool bInside = fDistance <= fRadius && fDot >= m_vCosHalfAngle[i] * fDistance;
+            const float fUniform = bInside ? 1.0f : 0.0f;
+            const float fLinear = bInside ? 1.0f - fDistance / fRadius : 0.0f;
+            bUniform = bUniform && Matches(vActual, fUniform, i);
+            bLinear = bLinear && Matches(vActual, fLinear, i);
+        }
+
+        bool Matches(const DXYZ& vActual, float fWeight, UINT i) const
+        {
+            const double dTolerance = 1.0e-3 * (fabs(m_vForceX[i]) + fabs(m_vForceY[i]) + fabs(m_vForceZ[i])) + 1.0e-6;
+            return fabs(vActual.dX - fWeight * m_vForceX[i]) <= dTolerance && fabs(vActual.dY - fWeight * m_vForceY[i]) <= dTolerance &&
+                   fabs(vActual.dZ - fWeight * m_vForceZ[i]) <= dTolerance;
+        }
+
+        void BuildHash()
+        {
+            m_vEntries.clear();
+            m_vLargeForces.clear();
+            m_vVirtual.clear();
+
+            const float fInvCell = 1.0f / m_fCellFeet;
+            for (UINT i = 0; i < (UINT)m_vX.size(); i++)
+            {
+                if (m_vModel[i] == ENVIRONMENT_FORCE_VIRTUAL)
+                {
+                    m_vVirtual.push_back(i);
+                    continue;
+                }
+
+                const float fRadius = sqrtf(m_vRadiusSq[i]);
+                const int iMinX = (int)floorf((m_vX[i] - fRadius) * fInvCell), iMaxX = (int)floorf((m_vX[i] + fRadius) * fInvCell);
+                const int iMinY = (int)floorf((m_vY[i] - fRadius) * fInvCell), iMaxY = (int)floorf((m_vY[i] + fRadius) * fInvCell);
+                const int iMinZ = (int)floorf((m_vZ[i] - fRadius) * fInvCell), iMaxZ = (int)floorf((m_vZ[i] + fRadius) * fInvCell);
+                const UINT64 uCells = (UINT64)(iMaxX - iMinX + 1) * (iMaxY - iMinY + 1) * (iMaxZ - iMinZ + 1);
+                if (uCells > MAX_CELLS_PER_FORCE)
+                {
+                    m_vLargeForces.push_back(i);
+                    continue;
+                }
+                for (int iX = iMinX; iX <= iMaxX; iX++)
+                {
+                    for (int iY = iMinY; iY <= iMaxY; iY++)
+                    {
+                        for (int iZ = iMinZ; iZ <= iMaxZ; iZ++)
+                        {
+                            CellEntry entry = { MakeKey(iX, iY, iZ), i };
+                            m_vEntries.push_back(entry);
+                        }
+                    }
+                }
+            }
+
+            // Sorted cell keys with the force indices of each cell stored contiguously.
+            std::sort(m_vEntries.begin(), m_vEntries.end(), [](const CellEntry& a, const CellEntry& b) { return a.uKey < b.uKey; });
+            m_vCellKeys.clear();
+            m_vCellStarts.clear();
+            m_vCellForces.resize(m_vEntries.size());
+            for (size_t j = 0; j < m_vEntries.size(); j++)
+            {
+                if (m_vCellKeys.empty() || m_vCellKeys.back() != m_vEntries[j].uKey)
+                {
+                    m_vCellKeys.push_back(m_vEntries[j].uKey);
+                    m_vCellStarts.push_back((UINT)j);
+                }
+                m_vCellForces[j] = m_vEntries[j].uForce;
+            }
+            m_vCellStarts.push_back((UINT)m_vEntries.size());
+        }
+
+        void FindCell(UINT64 uKey, UINT& uBegin, UINT& uEnd) const
+        {
+            auto it = std::lower_bound(m_vCellKeys.begin(), m_vCellKeys.end(), uKey);
+            if (it == m_vCellKeys.end() || *it != uKey)
+            {
+                uBegin = uEnd = 0;
+                return;
+            }
+            const size_t uCell = it - m_vCellKeys.begin();
+            uBegin = m_vCellStarts[uCell];
+            uEnd = m_vCellStarts[uCell + 1];
+        }
+
+        struct CellEntry
+        {
+            UINT64  uKey;
+            UINT    uForce;
+        };
+
+        const float                             m_fCellFeet;
+        DXYZ                                    m_vCenter = {};
+        CComPtrVecBuilder<IEnvironmentForceV400> m_Forces;
+
+        // Snapshot, one element per force.
+        std::vector<float>                      m_vX, m_vY, m_vZ;
+        std::vector<float>                      m_vEastScale, m_vNorthScale;    ///< Convert feet at the center to feet at the force
+        std::vector<float>                      m_vAxisX, m_vAxisY, m_vAxisZ;
+        std::vector<float>                      m_vForceX, m_vForceY, m_vForceZ;
+        std::vector<float>                      m_vRadiusSq, m_vInvRadius, m_vCosHalfAngle, m_vFalloff;
+        std::vector<UINT>                       m_vOwner;
+        std::vector<BYTE>                       m_vModel;
+
+        // Spatial hash.
+        std::vector<CellEntry>                  m_vEntries;
+        std::vector<UINT64>                     m_vCellKeys;
+        std::vector<UINT>                       m_vCellStarts;
+        std::vector<UINT>                       m_vCellForces;
+        std::vector<UINT>                       m_vLargeForces;
+        std::vector<UINT>                       m_vVirtual;
+
+        // Evaluate() scratch, one element per point.
+        mutable std::vector<float>              m_vQueryX, m_vQueryY, m_vQueryZ;
+        mutable std::vector<float>              m_vSumX, m_vSumY, m_vSumZ;
+        mutable std::vector<UINT64>             m_vQueryKeys;
+        mutable std::vector<UINT>               m_vQueryOrder;
+    };
+    /** @} */
+}
@@ -0,0 +1,404 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// EnvironmentForceNotifier.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "IEnvironmentForces.h"
+#include "DeadReckoning.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup environmentforces */ /** @{ */
+
+    /**
+    * One frame of coalesced environment force notifications.  Lists every watched object that has
+    * at least one force within its radius, together with those forces.
+    */
+    class EnvironmentForceBatch
+    {
+    public:
+        /// Number of objects with forces this frame.
+        UINT GetObjectCount() const { return (UINT)m_vObjectIds.size(); }
+        /// Id of an object in the batch.
+        UINT GetObjectId(__in UINT uIndex) const { return m_vObjectIds[uIndex]; }
+        /// Number of forces within the radius of an object.  Always at least one.
+        UINT GetForceCount(__in UINT uIndex) const { return m_vStarts[uIndex + 1] - m_vStarts[uIndex]; }
+        /// Forces within the radius of an object, in the form IEnvironmentForceCallbackV410::Invoke() receives them.
+        const IEnvironmentForceV400* const* GetForces(__in UINT uIndex) const { return m_vForces.data() + m_vStarts[uIndex]; }
+        /// Total number of object and force pairs.
+        UINT GetPairCount() const { return (UINT)m_vForces.size(); }
+
+    private:
+        friend class EnvironmentForceNotifier;
+
+        std::vector<UINT>                           m_vObjectIds;
+        std::vector<UINT>                           m_vStarts;
+        std::vector<const IEnvironmentForceV400*>   m_vForces;
+    };
+
+    /**
+    * Replaces a RegisterNotification() per object with one batched notification per frame.
+    * Objects are added with the radius they would have registered with and their positions are
+    * updated each frame.  Dispatch() groups the objects into clusters, fetches the forces around each
+    * cluster with a single GetForcesInRadius() call, finds every object and force overlap with one
+    * sort and sweep along the east axis, and calls the callback once with the forces of every object.
+    * @remarks  An object and a force overlap when the distance between them is within the object's
+    *           radius plus the force's radius.  An object's forces include forces it owns.
+    * @remarks  GetForcesInRadius() is asked for a radius padded by the largest force radius, so forces
+    *           whose center lies outside the cluster but whose volume reaches an object are found.  The
+    *           padding starts at the radius given to the constructor and grows with the largest force
+    *           radius seen.
+    * @remarks  Force pointers in the batch are held by the notifier until the next Dispatch().
+    * Sample usage:
+    * ```
+    *      static void OnForces(void* pContext, const EnvironmentForceBatch& batch)
+    *      {
+    *          for (UINT i = 0; i < batch.GetObjectCount(); i++)
+    *          {
+    *              ApplyForces(batch.GetObjectId(i), batch.GetForces(i), batch.GetForceCount(i));
+    *          }
+    *      }
+    *
+    *      EnvironmentForceNotifier notifier;
+    *      notifier.AddObject(uObjectId, 500.0f);
+    *
+    *      // Every frame:
+    *      notifier.SetObjectPosition(uObjectId, vLonAltLat);
+    *      notifier.Dispatch(spForceManager, OnForces, this);
+    * ```
+    */
+    class EnvironmentForceNotifier
+    {
+    public:
+        /// Batch callback.  Called at most once per Dispatch().
+        typedef void (*PBatchFunc)(void* pContext, const EnvironmentForceBatch& batch);
+
+        /**
+        * @param fClusterFeet       Size of the cells objects are grouped by for GetForcesInRadius() queries.
+        * @param fMaxForceRadiusFeet Largest radius a force is expected to have.  Larger forces raise it when first seen.
+        */
+        explicit EnvironmentForceNotifier(__in float fClusterFeet = 60000.0f, __in float fMaxForceRadiusFeet = 0.0f)
+            : m_dClusterFeet(std::max(fClusterFeet, 1000.0f))
+            , m_fMaxForceRadius(std::max(fMaxForceRadiusFeet, 0.0f))
+        {
+        }
+
+        /**
+        * Starts watching an object.
+        * @param uObjectId      Object id.
+        * @param fRadiusFeet    Notification radius around the object.
+        * @return               S_OK, S_FALSE if the object was already watched and its radius was updated,
+        *                       or E_INVALIDARG for an id of 0 or a negative radius.
+        */
+        HRESULT AddObject(__in UINT uObjectId, __in float fRadiusFeet)
+        {
+            if (uObjectId == 0 || !(fRadiusFeet >= 0.0f))
+            {
+                return E_INVALIDARG;
+            }
+            auto it = m_Lookup.find(uObjectId);
+            if (it != m_Lookup.end())
+            {
+                m_vObjects[it->second].fRadius = fRadiusFeet;
+                return S_FALSE;
+            }
+            WatchedObject object = { uObjectId, fRadiusFeet, false, DXYZ() };
+            m_Lookup[uObjectId] = (UINT)m_vObjects.size();
+            m_vObjects.push_back(object);
+            return S_OK;
+        }
+
+        /**
+        * Stops watching an object.
+        * @return   S_OK, or E_INVALIDARG if the object is not watched.
+        */
+        HRESULT RemoveObject(__in UINT uObjectId)
+        {
+            auto it = m_Lookup.find(uObjectId);
+            if (it == m_Lookup.end())
+            {
+                return E_INVALIDARG;
+            }
+            const UINT uIndex = it->second;
+            m_Lookup.erase(it);
+            if (uIndex + 1 != m_vObjects.size())
+            {
+                m_vObjects[uIndex] = m_vObjects.back();
+                m_Lookup[m_vObjects[uIndex].uId] = uIndex;
+            }
+            m_vObjects.pop_back();
+            return S_OK;
+        }
+
+        /**
+        * Sets the position of a watched object.  Objects whose position was never set are not dispatched.
+        * @param vLonAltLat Longitude/altitude/latitude in radians and feet.
+        * @return           S_OK, or E_INVALIDARG if the object is not watched.
+        */
+        HRESULT SetObjectPosition(__in UINT uObjectId, __in const DXYZ& vLonAltLat)
+        {
+            auto it = m_Lookup.find(uObjectId);
+            if (it == m_Lookup.end())
+            {
+                return E_INVALIDARG;
+            }
+            WatchedObject& object = m_vObjects[it->second];
+            object.vPosition = vLonAltLat;
+            object.bHasPosition = true;
+            return S_OK;
+        }
+
+        /**
+        * Computes this frame's notifications and calls the callback once with all of them.
+        * @param pManager   Environment force manager.
+        * @param pfnBatch   Callback, or nullptr to only build the batch returned by GetBatch().
+        * @param pContext   Passed to the callback.
+        * @return           S_OK if at least one object has forces, S_FALSE if none do and the callback was not
+        *                   called, or the first error of GetForcesInRadius().
+        */
+        HRESULT Dispatch(__in __notnull IEnvironmentForceManagerV410* pManager, __in_opt PBatchFunc pfnBatch, __in_opt void* pContext)
+        {
+            HRESULT hr = S_OK;
+            m_Forces.Items.clear();
+            m_vPairs.clear();
+            m_uQueryCount = 0;
+
+            // Group objects by cluster cell so each cluster is a contiguous range.
+            m_vOrder.clear();
+            for (UINT i = 0; i < (UINT)m_vObjects.size(); i++)
+            {
+                if (m_vObjects[i].bHasPosition)
+                {
+                    ClusterEntry entry = { ClusterKey(m_vObjects[i].vPosition), i };
+                    m_vOrder.push_back(entry);
+                }
+            }
+            std::sort(m_vOrder.begin(), m_vOrder.end(), [](const ClusterEntry& a, const ClusterEntry& b)
+            {
+                return a.uKey < b.uKey || (a.uKey == b.uKey && a.uObject < b.uObject);
+            });
+
+            for (size_t uBegin = 0; uBegin < m_vOrder.size();)
+            {
+                size_t uEnd = uBegin + 1;
+                while (uEnd < m_vOrder.size() && m_vOrder[uEnd].uKey == m_vOrder[uBegin].uKey)
+                {
+                    uEnd++;
+                }
+                HRESULT hrCluster = SweepCluster(pManager, uBegin, uEnd);
+                if (FAILED(hrCluster) && SUCCEEDED(hr))
+                {
+                    hr = hrCluster;
+                }
+                uBegin = uEnd;
+            }
+
+            BuildBatch();
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            if (m_Batch.m_vObjectIds.empty())
+            {
+                return S_FALSE;
+            }
+            if (pfnBatch != nullptr)
+            {
+                pfnBatch(pContext, m_Batch);
+            }
+            return S_OK;
+        }
+
+        /// Notifications built by the last Dispatch().
+        const EnvironmentForceBatch& GetBatch() const { return m_Batch; }
+        /// Number of watched objects.
+        UINT GetObjectCount() const { return (UINT)m_vObjects.size(); }
+        /// Number of GetForcesInRadius() calls made by the last Dispatch().
+        UINT GetQueryCount() const { return m_uQueryCount; }
+        /// Padding added to every GetForcesInRadius() query, in feet.
+        float GetMaxForceRadius() const { return m_fMaxForceRadius; }
+
+    private:
+        struct WatchedObject
+        {
+            UINT    uId;
+            float   fRadius;
+            bool    bHasPosition;
+            DXYZ    vPosition;
+        };
+
+        struct ClusterEntry
+        {
+            UINT64  uKey;
+            UINT    uObject;
+        };
+
+        /// East extent of an object or force in a cluster's local frame, for the sweep.
+        struct Interval
+        {
+            double  dMin;
+            double  dMax;
+            double  dY;
+            double  dZ;
+            double  dX;
+            float   fRadius;
+            UINT    uIndex;     ///< Object index, or force index in m_Forces
+            bool    bForce;
+        };
+
+        /// Collects forces from several GetForcesInRadius() calls into one list.
+        class AppendBuilder : public IEnvironmentForceList
+        {
+        public:
+            std::vector<CComPtr<IEnvironmentForceV400>> Items;
+
+            virtual bool AddItem(IEnvironmentForceV400* item) override
+            {
+                Items.push_back(item);
+                return true;
+            }
+
+            virtual void BeginBuilding() override
+            {
+            }
+        };
+
+        UINT64 ClusterKey(const DXYZ& vPosition) const
+        {
+            const double dRadius = DeadReckoning::EarthRadiusFeet();
+            const INT64 iNorth = (INT64)floor(vPosition.dZ * dRadius / m_dClusterFeet);
+            const INT64 iEast = (INT64)floor(vPosition.dX * dRadius * cos(vPosition.dZ) / m_dClusterFeet);
+            return ((UINT64)iNorth << 32) ^ (UINT64)(UINT)iEast;
+        }
+
+        HRESULT SweepCluster(IEnvironmentForceManagerV410* pManager, size_t uBegin, size_t uEnd)
+        {
+            // Query once around the cluster, centered on its first object.
+            const DXYZ vCenter = m_vObjects[m_vOrder[uBegin].uObject].vPosition;
+            m_vIntervals.clear();
+            double dQueryRadius = 0.0;
+            for (size_t j = uBegin; j < uEnd; j++)
+            {
+                const WatchedObject& object = m_vObjects[m_vOrder[j].uObject];
+                Interval interval = MakeInterval(vCenter, object.vPosition, object.fRadius, m_vOrder[j].uObject, false);
+                const double dDistance = sqrt(interval.dX * interval.dX + interval.dY * interval.dY + interval.dZ * interval.dZ);
+                dQueryRadius = std::max(dQueryRadius, dDistance + object.fRadius);
+                m_vIntervals.push_back(interval);
+            }
+
+            // A pair overlaps within the object radius plus the force radius, so pad by the largest force.
+            const UINT uFirstForce = (UINT)m_Forces.Items.size();
+            m_uQueryCount++;
+            HRESULT hr = pManager->GetForcesInRadius(vCenter, (float)(dQueryRadius + m_fMaxForceRadius), m_Forces);
+            if (FAILED(hr))
+            {
+                m_Forces.Items.resize(uFirstForce);
+                return hr;
+            }
+            for (UINT i = uFirstForce; i < (UINT)m_Forces.Items.size(); i++)
+            {
+                IEnvironmentForceV400* pForce = m_Forces.Items[i];
+                DXYZ vPosition;
+                pForce->GetPosition(vPosition);
+                const float fRadius = pForce->GetRadius();
+                m_fMaxForceRadius = std::max(m_fMaxForceRadius, fRadius);
+                m_vIntervals.push_back(MakeInterval(vCenter, vPosition, fRadius, i, true));
+            }
+
+            // Sort and sweep: an interval is tested against the active intervals of the other kind.
+            std::sort(m_vIntervals.begin(), m_vIntervals.end(), [](const Interval& a, const Interval& b) { return a.dMin < b.dMin; });
+            m_vActive[0].clear();
+            m_vActive[1].clear();
+            for (UINT i = 0; i < (UINT)m_vIntervals.size(); i++)
+            {
+                const Interval& current = m_vIntervals[i];
+                for (std::vector<UINT>& vActive : m_vActive)
+                {
+                    vActive.erase(std::remove_if(vActive.begin(), vActive.end(), [&](UINT uActive)
+                    {
+                        return m_vIntervals[uActive].dMax < current.dMin;
+                    }), vActive.end());
+                }
+
+                for (UINT uOther : m_vActive[current.bForce ? 0 : 1])
+                {
+                    const Interval& other = m_vIntervals[uOther];
+                    const double dX = current.dX - other.dX;
+                    const double dY = current.dY - other.dY;
+                    const double dZ = current.dZ - other.dZ;
+                    const double dReach = (double)current.fRadius + other.fRadius;
+                    if (dX * dX + dY * dY + dZ * dZ <= dReach * dReach)
+                    {
+                        const Interval& object = current.bForce ? other : current;
+                        const Interval& force = current.bForce ? current : other;
+                        ObjectForcePair pair = { object.uIndex, force.uIndex };
+                        m_vPairs.push_back(pair);
+                    }
+                }
+                m_vActive[current.bForce ? 1 : 0].push_back(i);
+            }
+            return S_OK;
+        }
+
+        static Interval MakeInterval(const DXYZ& vCenter, const DXYZ& vPosition, float fRadius, UINT uIndex, bool bForce)
+        {
+            DXYZ vLocal;
+            DeadReckoning::Difference(vCenter, vPosition, vLocal);
+            const float fSafeRadius = std::max(fRadius, 0.0f);
+            Interval interval = { vLocal.dX - fSafeRadius, vLocal.dX + fSafeRadius, vLocal.dY, vLocal.dZ, vLocal.dX, fSafeRadius, uIndex, bForce };
+            return interval;
+        }
+
+        void BuildBatch()
+        {
+            // Order by object, keeping forces in the order the manager returned them.
+            std::sort(m_vPairs.begin(), m_vPairs.end(), [](const ObjectForcePair& a, const ObjectForcePair& b)
+            {
+                return a.uObject < b.uObject || (a.uObject == b.uObject && a.uForce < b.uForce);
+            });
+
+            m_Batch.m_vObjectIds.clear();
+            m_Batch.m_vStarts.clear();
+            m_Batch.m_vForces.resize(m_vPairs.size());
+            for (size_t j = 0; j < m_vPairs.size(); j++)
+            {
+                if (j == 0 || m_vPairs[j].uObject != m_vPairs[j - 1].uObject)
+                {
+                    m_Batch.m_vObjectIds.push_back(m_vObjects[m_vPairs[j].uObject].uId);
+                    m_Batch.m_vStarts.push_back((UINT)j);
+                }
+                m_Batch.m_vForces[j] = m_Forces.Items[m_vPairs[j].uForce];
+            }
+            m_Batch.m_vStarts.push_back((UINT)m_vPairs.size());
+        }
+
+        struct ObjectForcePair
+        {
+            UINT    uObject;
+            UINT    uForce;
+        };
+
+        const double                        m_dClusterFeet;
+        float                               m_fMaxForceRadius;
+        std::vector<WatchedObject>          m_vObjects;
+        std::unordered_map<UINT, UINT>      m_Lookup;
+        AppendBuilder                       m_Forces;
+        EnvironmentForceBatch               m_Batch;
+        UINT                                m_uQueryCount = 0;
+
+        // Per Dispatch() scratch, kept to avoid allocating every frame.
+        std::vector<ClusterEntry>           m_vOrder;
+        std::vector<Interval>               m_vIntervals;
+        std::vector<UINT>                   m_vActive[2];
+        std::vector<ObjectForcePair>        m_vPairs;
+    };
+    /** @} */
+}
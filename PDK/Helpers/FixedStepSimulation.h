@@ -0,0 +1,248 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// FixedStepSimulation.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "ISimObject.h"
+
+#include <chrono>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Interface implemented by a wrapped simulation to expose the outputs that FixedStepSimulation
+    * interpolates between fixed steps (positions, rates, gauge values, ...).
+    */
+    class IInterpolatedState
+    {
+    public:
+        /// Number of values returned by CaptureState() and passed to ApplyState().
+        virtual UINT GetStateCount() const abstract;
+        /**
+        * Called after every fixed step to copy the current outputs.
+        * @param pState     Array of GetStateCount() values to fill.
+        */
+        virtual void CaptureState(__out double* pState) const abstract;
+        /**
+        * Called once per frame with the outputs blended between the last two fixed steps.
+        * @param pState     Array of GetStateCount() interpolated values.
+        */
+        virtual void ApplyState(__in const double* pState) abstract;
+    };
+
+    /**
+    * ISimulation adapter that runs a wrapped simulation at a fixed internal rate.  Frame delta times
+    * passed to Update() are accumulated and the wrapped simulation is stepped with a constant delta
+    * as many times as the accumulated time allows, which keeps stiff models stable and deterministic
+    * regardless of the rate the adapter is registered at.
+    * @remarks  If an IInterpolatedState is supplied, its outputs are blended between the previous and
+    *           current fixed step using the fraction of a step left in the accumulator.  This delays the
+    *           applied outputs by up to one step in exchange for smooth motion.
+    * @remarks  When the steps required in a frame exceed the maximum substep count or the frame budget,
+    *           the extra steps are shed: the simulation runs slower than real time for that frame instead
+    *           of spiraling into ever longer frames.  Shed steps are counted in GetShedStepCount().
+    */
+    class FixedStepSimulation : public ISimulationV310
+    {
+    public:
+        /**
+        * @param pSimulation    The simulation to step at a fixed rate.
+        * @param dStepHz        Fixed internal update rate.
+        * @param uMaxSubsteps   Maximum number of fixed steps run in a single Update().
+        * @param dBudgetMs      Optional per-frame time budget for the fixed steps.  0 disables the budget.
+        * @param pState         Optional outputs to interpolate.  Not reference counted; must outlive the adapter.
+        */
+        FixedStepSimulation(__in __notnull ISimulationV310* pSimulation, __in double dStepHz, __in UINT uMaxSubsteps = 8,
+                            __in double dBudgetMs = 0.0, __in IInterpolatedState* pState = nullptr)
+            : m_spSimulation(pSimulation),
+              m_pState(pState),
+              m_dStep(1.0 / dStepHz),
+              m_dBudgetMs(dBudgetMs),
+              m_uMaxSubsteps(uMaxSubsteps > 0 ? uMaxSubsteps : 1)
+        {
+            if (m_pState != nullptr)
+            {
+                UINT uCount = m_pState->GetStateCount();
+                m_vPrevious.resize(uCount);
+                m_vCurrent.resize(uCount);
+                m_vBlended.resize(uCount);
+            }
+        }
+
+        virtual ~FixedStepSimulation()
+        {
+        }
+
+        /** Clears the accumulator and interpolation history.  Call after the wrapped simulation has been repositioned or reloaded. */
+        void Reset()
+        {
+            m_dAccumulator = 0.0;
+            m_bHasState = false;
+        }
+
+        /// Fixed step size in seconds.
+        double GetStepSize() const { return m_dStep; }
+        /// Interpolation fraction used for the most recent frame, in [0,1).
+        double GetInterpolationAlpha() const { return m_dAlpha; }
+        /// Total number of fixed steps run.
+        UINT64 GetStepCount() const { return m_uStepCount; }
+        /// Total number of fixed steps dropped because of the substep limit or frame budget.
+        UINT64 GetShedStepCount() const { return m_uShedStepCount; }
+        /// Exponentially smoothed cost of one fixed step in milliseconds.
+        double GetAverageStepMs() const { return m_dAverageStepMs; }
+
+        STDMETHOD(Update)(double dDeltaT) override
+        {
+            HRESULT hr = S_OK;
+
+            m_dAccumulator += dDeltaT;
+
+            // Small tolerance so a frame delta equal to the step is not lost to rounding.
+            UINT uSteps = (UINT)(m_dAccumulator / m_dStep + 1.0e-6);
+            UINT uAllowed = m_uMaxSubsteps;
+            if (m_dBudgetMs > 0.0 && m_dAverageStepMs > 0.0)
+            {
+                double dBudgetSteps = m_dBudgetMs / m_dAverageStepMs;
+                if (dBudgetSteps < (double)uAllowed)
+                {
+                    // Always allow one step so the simulation cannot stall entirely.
+                    uAllowed = dBudgetSteps >= 1.0 ? (UINT)dBudgetSteps : 1;
+                }
+            }
+            if (uSteps > uAllowed)
+            {
+                m_uShedStepCount += uSteps - uAllowed;
+                m_dAccumulator -= (uSteps - uAllowed) * m_dStep;
+                uSteps = uAllowed;
+            }
+
+            for (UINT i = 0; i < uSteps && SUCCEEDED(hr); i++)
+            {
+                if (m_pState != nullptr)
+                {
+                    m_vPrevious.swap(m_vCurrent);
+                }
+
+                auto tStart = std::chrono::steady_clock::now();
+                hr = m_spSimulation->Update(m_dStep);
+                double dStepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+                m_dAverageStepMs = m_uStepCount == 0 ? dStepMs : m_dAverageStepMs + 0.1 * (dStepMs - m_dAverageStepMs);
+
+                m_dAccumulator -= m_dStep;
+                m_uStepCount++;
+
+                if (m_pState != nullptr)
+                {
+                    m_pState->CaptureState(m_vCurrent.data());
+                    if (!m_bHasState)
+                    {
+                        m_vPrevious = m_vCurrent;
+                        m_bHasState = true;
+                    }
+                }
+            }
+
+            m_dAlpha = m_dAccumulator / m_dStep;
+            if (m_dAlpha < 0.0)
+            {
+                m_dAlpha = 0.0;
+            }
+            else if (m_dAlpha > 1.0)
+            {
+                m_dAlpha = 1.0;
+            }
+
+            if (m_pState != nullptr && m_bHasState)
+            {
+                for (size_t i = 0; i < m_vBlended.size(); i++)
+                {
+                    m_vBlended[i] = m_vPrevious[i] + m_dAlpha * (m_vCurrent[i] - m_vPrevious[i]);
+                }
+                m_pState->ApplyState(m_vBlended.data());
+            }
+
+            return hr;
+        }
+
+        STDMETHOD(SaveLoadState)(__in __notnull PSaveLoadCallback pfnCallback, __in const BOOL bSave) override
+        {
+            if (!bSave)
+            {
+                Reset();
+            }
+            return m_spSimulation->SaveLoadState(pfnCallback, bSave);
+        }
+
+        STDMETHOD(Serialize)(__in NetOutPublic& netOut) override
+        {
+            return m_spSimulation->Serialize(netOut);
+        }
+
+        STDMETHOD(Deserialize)(__in NetInPublic& netIn) override
+        {
+            return m_spSimulation->Deserialize(netIn);
+        }
+
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+        STDMETHODIMP QueryInterface(REFIID riid, PVOID* ppv)
+        {
+            HRESULT hr = E_NOINTERFACE;
+
+            if (ppv == nullptr)
+            {
+                return E_POINTER;
+            }
+
+            *ppv = nullptr;
+
+            if (IsEqualIID(riid, IID_ISimulationV310))
+            {
+                *ppv = static_cast<ISimulationV310*>(this);
+            }
+            else if (IsEqualIID(riid, IID_ISimulationV01))
+            {
+                *ppv = static_cast<ISimulationV01*>(this);
+            }
+            else if (IsEqualIID(riid, IID_ISimulation))
+            {
+                *ppv = static_cast<ISimulation*>(this);
+            }
+            else if (IsEqualIID(riid, IID_IUnknown))
+            {
+                *ppv = static_cast<IUnknown*>(this);
+            }
+            if (*ppv)
+            {
+                hr = S_OK;
+                AddRef();
+            }
+
+            return hr;
+        }
+
+    private:
+        CComPtr<ISimulationV310>    m_spSimulation;
+        IInterpolatedState*         m_pState;
+        std::vector<double>         m_vPrevious;
+        std::vector<double>         m_vCurrent;
+        std::vector<double>         m_vBlended;
+        double                      m_dStep;
+        double                      m_dBudgetMs;
+        double                      m_dAccumulator = 0.0;
+        double                      m_dAlpha = 0.0;
+        double                      m_dAverageStepMs = 0.0;
+        UINT64                      m_uStepCount = 0;
+        UINT64                      m_uShedStepCount = 0;
+        UINT                        m_uMaxSubsteps;
+        bool                        m_bHasState = false;
+    };
+    /** @} */
+}
@@ -0,0 +1,615 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// FlightDataRecorder.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "ISimObject.h"
+#include "IRecordingService.h"
+#include "TelemetryCodec.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup recordingservice */ /** @{ */
+
+    /// A decoded flight data sample.
+    struct FlightDataSample
+    {
+        double  dTime;          ///< Time passed to FlightDataRecorder::Update(), in seconds
+        INT64   iTimestamp;     ///< IRecordingServiceV510::GetCurrentTimestamp() at the sample, or -1 if not recording or playing back
+        double  dValue;         ///< Property value, quantized to the channel precision
+    };
+
+    /// Description of a recorded channel.
+    struct FlightDataChannelInfo
+    {
+        UINT            uObjectId;      ///< IBaseObjectV400::GetId() of the sampled object
+        int             iIndex;         ///< Property index
+        double          dRateHz;        ///< Sample rate
+        double          dPrecision;     ///< Quantization step of the values
+        std::wstring    strProperty;    ///< Property name
+        std::wstring    strUnits;       ///< Property units
+    };
+
+    /**
+    * Always-on flight data recorder.  Object properties are sampled at a per-channel rate and kept in
+    * a fixed-size ring buffer of compressed blocks; when the buffer is full the oldest blocks are
+    * overwritten.  Dump() writes the most recent seconds to disk, either on demand or automatically
+    * after a trigger fires, for reading with FlightDataDumpReader.
+    * @remarks  Samples accumulate per channel until uBlockSamples are collected, and the block is then
+    *           compressed with TelemetryCodec into three columns: sample time, recording timestamp and
+    *           quantized value.  Steady rates and values take about one byte per sample or less.
+    * @remarks  Each sample carries IRecordingServiceV510::GetCurrentTimestamp() when a service is passed
+    *           to Update() and a recording is in progress or playing back, so a dump can be lined up with the
+    *           sim recording through ConvertTimestampToSeconds().
+    * Sample usage:
+    * ```
+    *      FlightDataRecorder recorder(8 * 1024 * 1024);
+    *      recorder.AddChannel(spObjectManager, spObject, L"PLANE ALTITUDE", L"feet", 10.0, 0.1);
+    *      recorder.AddChannel(spObjectManager, spObject, L"AIRSPEED INDICATED", L"knots", 10.0, 0.01);
+    *      recorder.SetTriggerDump(L"C:\\Debrief\\event.fdr", 300.0, 10.0);
+    *      recorder.SetTriggerCondition(1, 350.0, true);
+    *
+    *      // Every frame:
+    *      recorder.Update(dSimTime, spRecordingService);
+    * ```
+    */
+    class FlightDataRecorder
+    {
+    public:
+        /**
+        * @param uMemoryBytes   Size of the ring buffer holding compressed blocks.
+        * @param uBlockSamples  Samples per compressed block.
+        */
+        explicit FlightDataRecorder(__in size_t uMemoryBytes = 4 * 1024 * 1024, __in UINT uBlockSamples = 256)
+            : m_vRing(uMemoryBytes),
+              m_uBlockSamples(uBlockSamples > 0 ? uBlockSamples : 1)
+        {
+        }
+
+        /**
+        * Adds a property to sample.  The property and unit codes are resolved once here.
+        * @param pObjectManager Object manager service, used to resolve the unit code.
+        * @param pObject        Object to sample.
+        * @param pszProperty    Double property name, e.g. L"PLANE ALTITUDE".
+        * @param pszUnits       Units of the property, e.g. L"feet".
+        * @param dRateHz        Sample rate.
+        * @param dPrecision     Quantization step.  Smaller steps preserve more detail and compress less.
+        * @param iIndex         Property index.
+        * @param puChannel      Optionally receives the channel index.
+        * @return               S_OK, E_INVALIDARG for a non-positive rate or precision, or the error from resolving the property.
+        */
+        HRESULT AddChannel(__in __notnull ISimObjectManagerV520* pObjectManager, __in __notnull IBaseObjectV520* pObject, __in LPCWSTR pszProperty,
+                           __in LPCWSTR pszUnits, __in double dRateHz, __in double dPrecision, __in int iIndex = 0, __out UINT* puChannel = nullptr)
+        {
+            if (dRateHz <= 0.0 || dPrecision <= 0.0)
+            {
+                return E_INVALIDARG;
+            }
+
+            Channel channel;
+            int iResolvedIndex = iIndex;
+            HRESULT hr = pObject->GetPropertyCodeAndIndex(PROPERTY_TYPE_DOUBLE, pszProperty, channel.iProperty, iResolvedIndex);
+            if (SUCCEEDED(hr))
+            {
+                hr = pObjectManager->GetUnitCode(pszUnits, channel.iUnit);
+            }
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            channel.spObject = pObject;
+            channel.info.uObjectId = pObject->GetId();
+            channel.info.iIndex = iResolvedIndex;
+            channel.info.dRateHz = dRateHz;
+            channel.info.dPrecision = dPrecision;
+            channel.info.strProperty = pszProperty;
+            channel.info.strUnits = pszUnits;
+            channel.vTime.reserve(m_uBlockSamples);
+            channel.vTimestamp.reserve(m_uBlockSamples);
+            channel.vValue.reserve(m_uBlockSamples);
+
+            if (puChannel != nullptr)
+            {
+                *puChannel = (UINT)m_vChannels.size();
+            }
+            m_vChannels.push_back(channel);
+            return S_OK;
+        }
+
+        /**
+        * Samples every channel that is due and runs the trigger.
+        * @param dSimTime   Monotonic sim time in seconds.
+        * @param pService   Optional recording service used to timestamp the samples.
+        */
+        void Update(__in double dSimTime, __in IRecordingServiceV510* pService = nullptr)
+        {
+            INT64 iTimestamp = -1;
+            if (pService != nullptr && pService->GetRecordingState() != None)
+            {
+                iTimestamp = pService->GetCurrentTimestamp();
+            }
+
+            const INT64 iTime = TelemetryCodec::ToMicroseconds(dSimTime);
+            for (UINT i = 0; i < (UINT)m_vChannels.size(); i++)
+            {
+                Channel& channel = m_vChannels[i];
+                if (dSimTime < channel.dNextTime)
+                {
+                    continue;
+                }
+
+                // Stay on the rate grid unless the caller fell more than a period behind.
+                const double dPeriod = 1.0 / channel.info.dRateHz;
+                channel.dNextTime = dSimTime - channel.dNextTime < dPeriod ? channel.dNextTime + dPeriod : dSimTime + dPeriod;
+
+                double dValue = 0.0;
+                if (FAILED(channel.spObject->GetProperty(channel.iProperty, channel.iUnit, dValue, channel.info.iIndex)))
+                {
+                    continue;
+                }
+
+                if (i == m_uTriggerChannel && !m_bTriggered && channel.bHasValue)
+                {
+                    bool bCrossed = m_bTriggerRising ? (channel.dLastValue < m_dTriggerThreshold && dValue >= m_dTriggerThreshold)
+                                                     : (channel.dLastValue > m_dTriggerThreshold && dValue <= m_dTriggerThreshold);
+                    if (bCrossed)
+                    {
+                        Trigger(dSimTime);
+                    }
+                }
+                channel.dLastValue = dValue;
+                channel.bHasValue = true;
+
+                channel.vTime.push_back(iTime);
+                channel.vTimestamp.push_back(iTimestamp);
+                channel.vValue.push_back(TelemetryCodec::Quantize(dValue, channel.info.dPrecision));
+                if (channel.vTime.size() >= m_uBlockSamples)
+                {
+                    SealBlock(i);
+                }
+            }
+
+            m_iLastTime = iTime;
+            if (m_bTriggered && dSimTime >= m_dTriggerTime + m_dTriggerPostSeconds)
+            {
+                m_bTriggered = false;
+                m_hrTriggerDump = Dump(m_strTriggerPath.c_str(), m_dTriggerDumpSeconds);
+                m_uTriggerDumps++;
+            }
+        }
+
+        /**
+        * Sets where and how much is dumped when the trigger fires.
+        * @param pszPath        Dump file, overwritten by every triggered dump.
+        * @param dDumpSeconds   Seconds of history to dump, counted back from the dump time.
+        * @param dPostSeconds   Seconds to keep recording after the trigger before dumping.
+        */
+        void SetTriggerDump(__in LPCWSTR pszPath, __in double dDumpSeconds, __in double dPostSeconds)
+        {
+            m_strTriggerPath = pszPath;
+            m_dTriggerDumpSeconds = dDumpSeconds;
+            m_dTriggerPostSeconds = dPostSeconds;
+        }
+
+        /**
+        * Fires the trigger when a channel value crosses a threshold.
+        * @param uChannel       Channel to watch.
+        * @param dThreshold     Threshold in the channel units.
+        * @param bRising        True to fire when the value rises through the threshold, false when it falls through it.
+        */
+        HRESULT SetTriggerCondition(__in UINT uChannel, __in double dThreshold, __in bool bRising)
+        {
+            if (uChannel >= m_vChannels.size())
+            {
+                return E_INVALIDARG;
+            }
+            m_uTriggerChannel = uChannel;
+            m_dTriggerThreshold = dThreshold;
+            m_bTriggerRising = bRising;
+            return S_OK;
+        }
+
+        /**
+        * Fires the trigger from an external event, such as a crash notification.  Ignored if a triggered
+        * dump is already pending or no trigger dump has been set.
+        */
+        void Trigger(__in double dSimTime)
+        {
+            if (!m_bTriggered && !m_strTriggerPath.empty())
+            {
+                m_bTriggered = true;
+                m_dTriggerTime = dSimTime;
+            }
+        }
+
+        /**
+        * Writes the most recent history to a file.
+        * @param pszPath    Dump file.
+        * @param dSeconds   Seconds of history to write.  Whole blocks are written, so slightly more may be included.
+        */
+        HRESULT Dump(__in LPCWSTR pszPath, __in double dSeconds) const
+        {
+            const INT64 iFrom = m_iLastTime - TelemetryCodec::ToMicroseconds(dSeconds);
+
+            std::vector<BYTE> vFile;
+            DumpHeader header = { DUMP_MAGIC, DUMP_VERSION, (UINT32)m_vChannels.size(), 0 };
+            Append(vFile, &header, sizeof(header));
+            for (const Channel& channel : m_vChannels)
+            {
+                DumpChannel record = { channel.info.uObjectId, channel.info.iIndex, channel.info.dRateHz, channel.info.dPrecision,
+                                       (UINT32)channel.info.strProperty.size(), (UINT32)channel.info.strUnits.size() };
+                Append(vFile, &record, sizeof(record));
+                Append(vFile, channel.info.strProperty.c_str(), record.uPropertyLength * sizeof(WCHAR));
+                Append(vFile, channel.info.strUnits.c_str(), record.uUnitsLength * sizeof(WCHAR));
+            }
+
+            UINT32 uBlocks = 0;
+            for (const Block& block : m_Blocks)
+            {
+                if (block.iLastTime >= iFrom)
+                {
+                    AppendBlock(vFile, block, &m_vRing[(size_t)block.uOffset]);
+                    uBlocks++;
+                }
+            }
+
+            // Samples not yet sealed into a block.
+            std::vector<BYTE> vOpen;
+            for (UINT i = 0; i < (UINT)m_vChannels.size(); i++)
+            {
+                const Channel& channel = m_vChannels[i];
+                if (!channel.vTime.empty() && channel.vTime.back() >= iFrom)
+                {
+                    Block block;
+                    EncodeBlock(channel, i, vOpen, block);
+                    AppendBlock(vFile, block, vOpen.data());
+                    uBlocks++;
+                }
+            }
+            reinterpret_cast<DumpHeader*>(vFile.data())->uBlockCount = uBlocks;
+
+            FILE* pFile = nullptr;
+            if (_wfopen_s(&pFile, pszPath, L"wb") != 0 || pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+            HRESULT hr = fwrite(vFile.data(), 1, vFile.size(), pFile) == vFile.size() ? S_OK : E_FAIL;
+            if (fclose(pFile) != 0)
+            {
+                hr = E_FAIL;
+            }
+            return hr;
+        }
+
+        UINT GetChannelCount() const { return (UINT)m_vChannels.size(); }
+        const FlightDataChannelInfo& GetChannelInfo(__in UINT uChannel) const { return m_vChannels[uChannel].info; }
+
+        /// Number of compressed blocks in the ring buffer.
+        UINT GetBlockCount() const { return (UINT)m_Blocks.size(); }
+        /// Bytes of the ring buffer holding compressed blocks.
+        UINT64 GetUsedBytes() const { return m_uUsedBytes; }
+        /// Blocks overwritten because the ring buffer was full.
+        UINT64 GetOverwrittenBlocks() const { return m_uOverwritten; }
+        /// Seconds covered by the oldest block still in the ring buffer, or 0 if it is empty.
+        double GetOldestTime() const { return m_Blocks.empty() ? 0.0 : TelemetryCodec::ToSeconds(m_Blocks.front().iFirstTime); }
+        /// Number of dumps written by the trigger, and the result of the last one.
+        UINT GetTriggerDumpCount() const { return m_uTriggerDumps; }
+        HRESULT GetLastTriggerDumpResult() const { return m_hrTriggerDump; }
+
+        static const UINT32 DUMP_MAGIC = 0x44524446;     // "FDRD"
+        static const UINT32 DUMP_VERSION = 1;
+
+    private:
+        friend class FlightDataDumpReader;
+
+        struct Channel
+        {
+            CComPtr<IBaseObjectV520>    spObject;
+            FlightDataChannelInfo       info;
+            int                         iProperty = 0;
+            int                         iUnit = 0;
+            double                      dNextTime = 0.0;
+            double                      dLastValue = 0.0;
+            bool                        bHasValue = false;
+            std::vector<INT64>          vTime;
+            std::vector<INT64>          vTimestamp;
+            std::vector<INT64>          vValue;
+        };
+
+        struct Block
+        {
+            UINT32  uChannel;
+            UINT32  uCount;
+            UINT64  uOffset;
+            UINT32  uSize;
+            INT64   iFirstTime;
+            INT64   iLastTime;
+        };
+
+        struct DumpHeader
+        {
+            UINT32  uMagic;
+            UINT32  uVersion;
+            UINT32  uChannelCount;
+            UINT32  uBlockCount;
+        };
+
+        struct DumpChannel
+        {
+            UINT32  uObjectId;
+            INT32   iIndex;
+            double  dRateHz;
+            double  dPrecision;
+            UINT32  uPropertyLength;
+            UINT32  uUnitsLength;
+        };
+
+        struct DumpBlock
+        {
+            UINT32  uChannel;
+            UINT32  uCount;
+            UINT32  uSize;
+            UINT32  uReserved;
+        };
+
+        static void EncodeBlock(const Channel& channel, UINT uChannel, std::vector<BYTE>& vOut, Block& block)
+        {
+            const UINT uCount = (UINT)channel.vTime.size();
+            vOut.clear();
+            TelemetryCodec::EncodeColumn(channel.vTime.data(), uCount, TelemetryCodec::TIME_ORDER, vOut);
+            TelemetryCodec::EncodeColumn(channel.vTimestamp.data(), uCount, TelemetryCodec::TIME_ORDER, vOut);
+            TelemetryCodec::EncodeColumn(channel.vValue.data(), uCount, TelemetryCodec::VALUE_ORDER, vOut);
+
+            block.uChannel = uChannel;
+            block.uCount = uCount;
+            block.uOffset = 0;
+            block.uSize = (UINT32)vOut.size();
+            block.iFirstTime = channel.vTime.front();
+            block.iLastTime = channel.vTime.back();
+        }
+
+        /// Compresses a channel's open samples into the ring buffer, overwriting the oldest blocks as needed.
+        void SealBlock(UINT uChannel)
+        {
+            Channel& channel = m_vChannels[uChannel];
+            Block block;
+            EncodeBlock(channel, uChannel, m_vScratch, block);
+            channel.vTime.clear();
+            channel.vTimestamp.clear();
+            channel.vValue.clear();
+
+            const UINT64 uCapacity = m_vRing.size();
+            if (block.uSize > uCapacity)
+            {
+                m_uOverwritten++;
+                return;
+            }
+
+            // Blocks are laid out in time order from the write position around the ring.  When the block
+            // does not fit before the end, the tail blocks are dropped and writing wraps to the start.
+            if (m_uWrite + block.uSize > uCapacity)
+            {
+                while (!m_Blocks.empty() && m_Blocks.front().uOffset >= m_uWrite)
+                {
+                    PopOldest();
+                }
+                m_uWrite = 0;
+            }
+            while (!m_Blocks.empty() && m_Blocks.front().uOffset >= m_uWrite && m_Blocks.front().uOffset < m_uWrite + block.uSize)
+            {
+                PopOldest();
+            }
+
+            block.uOffset = m_uWrite;
+            memcpy(&m_vRing[(size_t)m_uWrite], m_vScratch.data(), block.uSize);
+            m_uWrite += block.uSize;
+            m_uUsedBytes += block.uSize;
+            m_Blocks.push_back(block);
+        }
+
+        void PopOldest()
+        {
+            m_uUsedBytes -= m_Blocks.front().uSize;
+            m_Blocks.pop_front();
+            m_uOverwritten++;
+        }
+
+        static void AppendBlock(std::vector<BYTE>& vFile, const Block& block, const BYTE* pData)
+        {
+            DumpBlock record = { block.uChannel, block.uCount, block.uSize, 0 };
+            Append(vFile, &record, sizeof(record));
+            Append(vFile, pData, block.uSize);
+        }
+
+        static void Append(std::vector<BYTE>& vFile, const void* pData, size_t uSize)
+        {
+            const BYTE* pBytes = static_cast<const BYTE*>(pData);
+            vFile.insert(vFile.end(), pBytes, pBytes + uSize);
+        }
+
+        std::vector<Channel>    m_vChannels;
+        std::vector<BYTE>       m_vRing;
+        std::vector<BYTE>       m_vScratch;
+        std::deque<Block>       m_Blocks;
+        UINT64                  m_uWrite = 0;
+        UINT64                  m_uUsedBytes = 0;
+        UINT64                  m_uOverwritten = 0;
+        INT64                   m_iLastTime = 0;
+        UINT                    m_uBlockSamples;
+
+        std::wstring            m_strTriggerPath;
+        double                  m_dTriggerDumpSeconds = 0.0;
+        double                  m_dTriggerPostSeconds = 0.0;
+        double                  m_dTriggerThreshold = 0.0;
+        double                  m_dTriggerTime = 0.0;
+        UINT                    m_uTriggerChannel = UINT_MAX;
+        UINT                    m_uTriggerDumps = 0;
+        HRESULT                 m_hrTriggerDump = S_OK;
+        bool                    m_bTriggerRising = true;
+        bool                    m_bTriggered = false;
+    };
+
+    /**
+    * Reads a file written by FlightDataRecorder::Dump().
+    * Sample usage:
+    * ```
+    *      FlightDataDumpReader reader;
+    *      reader.Load(L"C:\\Debrief\\event.fdr");
+    *      std::vector<FlightDataSample> vSamples;
+    *      reader.ReadChannel(0, vSamples);
+    * ```
+    */
+    class FlightDataDumpReader
+    {
+    public:
+        /** Loads a dump. @return S_OK, or E_FAIL if the file is missing or malformed. */
+        HRESULT Load(__in LPCWSTR pszPath)
+        {
+            m_vChannels.clear();
+            m_vBlocks.clear();
+            m_vData.clear();
+
+            FILE* pFile = nullptr;
+            if (_wfopen_s(&pFile, pszPath, L"rb") != 0 || pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+            // Read straight into m_vData so no large buffer lives on the caller's stack.
+            const size_t READ_CHUNK = 64 * 1024;
+            size_t uRead = 0;
+            do
+            {
+                const size_t uOffset = m_vData.size();
+                m_vData.resize(uOffset + READ_CHUNK);
+                uRead = fread(m_vData.data() + uOffset, 1, READ_CHUNK, pFile);
+                m_vData.resize(uOffset + uRead);
+            } while (uRead > 0);
+            fclose(pFile);
+
+            const BYTE* pCur = m_vData.data();
+            const BYTE* pEnd = pCur + m_vData.size();
+            FlightDataRecorder::DumpHeader header;
+            if (!Read(pCur, pEnd, &header, sizeof(header)) ||
+                header.uMagic != FlightDataRecorder::DUMP_MAGIC || header.uVersion != FlightDataRecorder::DUMP_VERSION)
+            {
+                return E_FAIL;
+            }
+
+            for (UINT32 i = 0; i < header.uChannelCount; i++)
+            {
+                FlightDataRecorder::DumpChannel record;
+                if (!Read(pCur, pEnd, &record, sizeof(record)) ||
+                    (UINT64)(record.uPropertyLength + (UINT64)record.uUnitsLength) * sizeof(WCHAR) > (UINT64)(pEnd - pCur))
+                {
+                    return E_FAIL;
+                }
+                FlightDataChannelInfo info;
+                info.uObjectId = record.uObjectId;
+                info.iIndex = record.iIndex;
+                info.dRateHz = record.dRateHz;
+                info.dPrecision = record.dPrecision;
+                info.strProperty.assign(reinterpret_cast<const WCHAR*>(pCur), record.uPropertyLength);
+                pCur += record.uPropertyLength * sizeof(WCHAR);
+                info.strUnits.assign(reinterpret_cast<const WCHAR*>(pCur), record.uUnitsLength);
+                pCur += record.uUnitsLength * sizeof(WCHAR);
+                m_vChannels.push_back(info);
+            }
+
+            for (UINT32 i = 0; i < header.uBlockCount; i++)
+            {
+                FlightDataRecorder::DumpBlock record;
+                if (!Read(pCur, pEnd, &record, sizeof(record)) || record.uChannel >= header.uChannelCount || record.uSize > (UINT64)(pEnd - pCur))
+                {
+                    return E_FAIL;
+                }
+                BlockRef block = { record.uChannel, record.uCount, (size_t)(pCur - m_vData.data()), record.uSize };
+                m_vBlocks.push_back(block);
+                pCur += record.uSize;
+            }
+            return S_OK;
+        }
+
+        UINT GetChannelCount() const { return (UINT)m_vChannels.size(); }
+        const FlightDataChannelInfo& GetChannelInfo(__in UINT uChannel) const { return m_vChannels[uChannel]; }
+
+        /**
+        * Decodes every sample of a channel in time order.
+        * @return   S_OK, E_INVALIDARG for an unknown channel, or E_FAIL if a block is malformed.
+        */
+        HRESULT ReadChannel(__in UINT uChannel, __out std::vector<FlightDataSample>& vSamples) const
+        {
+            vSamples.clear();
+            if (uChannel >= m_vChannels.size())
+            {
+                return E_INVALIDARG;
+            }
+
+            const double dPrecision = m_vChannels[uChannel].dPrecision;
+            std::vector<INT64> vTime;
+            std::vector<INT64> vTimestamp;
+            std::vector<INT64> vValue;
+            for (const BlockRef& block : m_vBlocks)
+            {
+                if (block.uChannel != uChannel)
+                {
+                    continue;
+                }
+
+                vTime.resize(block.uCount);
+                vTimestamp.resize(block.uCount);
+                vValue.resize(block.uCount);
+                const BYTE* pCur = m_vData.data() + block.uOffset;
+                const BYTE* pEnd = pCur + block.uSize;
+                if (!TelemetryCodec::DecodeColumn(pCur, pEnd, block.uCount, TelemetryCodec::TIME_ORDER, vTime.data()) ||
+                    !TelemetryCodec::DecodeColumn(pCur, pEnd, block.uCount, TelemetryCodec::TIME_ORDER, vTimestamp.data()) ||
+                    !TelemetryCodec::DecodeColumn(pCur, pEnd, block.uCount, TelemetryCodec::VALUE_ORDER, vValue.data()))
+                {
+                    return E_FAIL;
+                }
+
+                for (UINT32 i = 0; i < block.uCount; i++)
+                {
+                    FlightDataSample sample = { TelemetryCodec::ToSeconds(vTime[i]), vTimestamp[i], TelemetryCodec::Dequantize(vValue[i], dPrecision) };
+                    vSamples.push_back(sample);
+                }
+            }
+            return S_OK;
+        }
+
+    private:
+        struct BlockRef
+        {
+            UINT32  uChannel;
+            UINT32  uCount;
+            size_t  uOffset;
+            UINT32  uSize;
+        };
+
+        static bool Read(const BYTE*& pCur, const BYTE* pEnd, void* pData, size_t uSize)
+        {
+            if ((size_t)(pEnd - pCur) < uSize)
+            {
+                return false;
+            }
+            memcpy(pData, pCur, uSize);
+            pCur += uSize;
+            return true;
+        }
+
+        std::vector<FlightDataChannelInfo>  m_vChannels;
+        std::vector<BlockRef>               m_vBlocks;
+        std::vector<BYTE>                   m_vData;
+    };
+    /** @} */
+}
@@ -0,0 +1,937 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// MetarCodec.h
+
+#pragma once
+#include <ObjBase.h>
+#include "WeatherSystemTypes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace P3D
+{
+    /** @addtogroup weatherservice */ /** @{ */
+
+    /**
+    * Weather described by a METAR string, in the layer types of WeatherSystemTypes.h.
+    * The structure has fixed capacity so that parsing and formatting never allocate.
+    * @remarks  Wind layers with an altitude of zero are surface winds.  Their depth is fSurfaceWindDepth.
+    */
+    struct MetarData
+    {
+        /// Maximum number of layers of each kind.
+        static const UINT MAX_LAYERS = 16;
+
+        WCHAR           szIcao[5];
+        UINT            uDay;                   ///< Observation day of month, or 0 if the METAR has no time group
+        UINT            uHour;
+        UINT            uMinute;
+        float           fBaroPressure;          ///< Millibars at sea level, or 0 if the METAR has no pressure group
+        float           fSurfaceWindDepth;      ///< Meters
+
+        UINT            uCloudCount;
+        UINT            uWindCount;
+        UINT            uTempCount;
+        UINT            uVisibilityCount;
+        CloudLayer      Clouds[MAX_LAYERS];
+        WindAloftLayer  Winds[MAX_LAYERS];
+        TempLayer       Temps[MAX_LAYERS];
+        VisibilityLayer Visibilities[MAX_LAYERS];
+
+        /// Number of tokens MetarCodec::Parse() did not recognize or had no room for.
+        UINT            uSkippedTokens;
+    };
+
+    /**
+    * Allocation free tokenizer and formatter for the METAR Data Format used by GetStationMetarData(),
+    * GetInterpolatedMetarData() and SetMetarData().
+    * Parse() understands standard METAR groups as well as the layer extensions introduced with '&':
+    * - Wind:        dddssGggKT&D980NG (surface depth) or &A1500NG (altitude), both in meters, followed by
+    *                turbulence N/O/L/M/H/S and shear G/M/S/I.  Speeds may also be in MPS or KMH, and a
+    *                following dddVddd group sets the variance of the preceding layer.
+    * - Visibility:  dddd (meters), 10SM, 1 1/2SM, M1/4SM, P6SM or CAVOK, followed by &Bbase&Ddepth in meters.
+    * - Clouds:      FEW, SCT, BKN, OVC or VV with a base in hundreds of feet, followed by
+    *                &CU001FNMN000N: type, depth in hundreds of feet, top F/R/A, turbulence, precipitation
+    *                rate V/L/M/H/D, precipitation type N/R/F/H/S, precipitation base in hundreds of feet
+    *                and icing N/T/L/M/S.
+    * - Temperature: M05/M10&A1500, with the layer altitude in meters.
+    * - Pressure:    Q1013 (millibars) or A2992 (inches of mercury).
+    * Parsing stops at RMK.  Present weather groups are ignored.
+    * @remarks  Clouds without an extension are cumulus with a depth of 1000 feet, or cumulonimbus with
+    *           an anvil top when the group ends with CB.  Format() always writes the extensions, so a
+    *           string written by Format() parses back to the same layers within the METAR resolution.
+    * Sample usage:
+    * ```
+    *      WCHAR szMetar[MetarCodec::MAX_METAR_LENGTH + 1];
+    *      MetarData metar;
+    *      if (SUCCEEDED(spWeather->GetStationMetarData("KSEA", szMetar, ARRAYSIZE(szMetar))) &&
+    *          SUCCEEDED(MetarCodec::Parse(szMetar, metar)))
+    *      {
+    *          metar.Winds[0].fSpeed += 10.0f;
+    *          if (SUCCEEDED(MetarCodec::Format(metar, szMetar, ARRAYSIZE(szMetar))))
+    *          {
+    *              spWeather->SetMetarData(szMetar, 60);
+    *          }
+    *      }
+    * ```
+    */
+    class MetarCodec
+    {
+    public:
+        /// Maximum METAR length supported by the weather system, in characters.
+        static const UINT MAX_METAR_LENGTH = 2000;
+
+        /**
+        * Parses a METAR string.
+        * @param pszMetar   Null terminated METAR string.
+        * @param metar      Receives the parsed weather.
+        * @return           S_OK if every token was understood, S_FALSE if some were skipped (see
+        *                   MetarData::uSkippedTokens), E_INVALIDARG if the string has no station identifier.
+        */
+        static HRESULT Parse(__in __notnull LPCWSTR pszMetar, __out MetarData& metar)
+        {
+            const WCHAR* pEnd = pszMetar;
+            while (*pEnd != L'\0')
+            {
+                pEnd++;
+            }
+            return Parse(pszMetar, (size_t)(pEnd - pszMetar), metar);
+        }
+
+        /**
+        * Parses a METAR string of known length.
+        * @param pszMetar   METAR characters.  Need not be null terminated.
+        * @param cchMetar   Number of characters.
+        * @param metar      Receives the parsed weather.
+        * @return           See Parse(LPCWSTR, MetarData&).
+        */
+        static HRESULT Parse(__in __notnull LPCWSTR pszMetar, __in size_t cchMetar, __out MetarData& metar)
+        {
+            // Layers past the counts are left as they are.
+            memset(&metar, 0, offsetof(MetarData, Clouds));
+            metar.uSkippedTokens = 0;
+
+            const WCHAR* pCur = pszMetar;
+            const WCHAR* pEnd = pszMetar + cchMetar;
+            Token token;
+            if (!NextToken(pCur, pEnd, token))
+            {
+                return E_INVALIDARG;
+            }
+            if (token.Equals(L"METAR") || token.Equals(L"SPECI"))
+            {
+                if (!NextToken(pCur, pEnd, token))
+                {
+                    return E_INVALIDARG;
+                }
+            }
+            if (token.uLength != 4 || !IsAlphaNumeric(token.pBegin, token.pEnd))
+            {
+                return E_INVALIDARG;
+            }
+            for (UINT i = 0; i < 4; i++)
+            {
+                metar.szIcao[i] = token.pBegin[i];
+            }
+
+            while (NextToken(pCur, pEnd, token))
+            {
+                if (token.Equals(L"RMK"))
+                {
+                    break;
+                }
+
+                // "1 1/2SM" spans two tokens.
+                if (token.uLength <= 2 && IsDigits(token.pBegin, token.pEnd))
+                {
+                    const WCHAR* pNext = pCur;
+                    Token fraction;
+                    if (NextToken(pNext, pEnd, fraction) && ParseVisibility(fraction, metar, (float)ReadNumber(token.pBegin, token.pEnd)))
+                    {
+                        pCur = pNext;
+                        continue;
+                    }
+                }
+
+                if (!ParseToken(token, metar))
+                {
+                    metar.uSkippedTokens++;
+                }
+            }
+            return metar.uSkippedTokens == 0 ? S_OK : S_FALSE;
+        }
+
+        /**
+        * Formats weather as a METAR string with layer extensions.
+        * @param metar      Weather to format.
+        * @param pszMetar   Receives the null terminated METAR string.
+        * @param cchMetar   Size of pszMetar in characters.
+        * @param pcchLength Optional.  Receives the string length, not counting the terminator.
+        * @return           S_OK, or E_INVALIDARG if the buffer is too small.  pszMetar is empty on failure.
+        */
+        static HRESULT Format(__in const MetarData& metar, __out LPWSTR pszMetar, __in size_t cchMetar, __out size_t* pcchLength = nullptr)
+        {
+            Writer writer = { pszMetar, cchMetar, 0, cchMetar == 0 };
+            writer.String(metar.szIcao);
+            if (metar.uDay != 0)
+            {
+                writer.Char(L' ');
+                writer.Number(metar.uDay, 2);
+                writer.Number(metar.uHour, 2);
+                writer.Number(metar.uMinute, 2);
+                writer.Char(L'Z');
+            }
+
+            for (UINT i = 0; i < metar.uWindCount && i < MetarData::MAX_LAYERS; i++)
+            {
+                FormatWind(metar.Winds[i], metar.fSurfaceWindDepth, writer);
+            }
+            for (UINT i = 0; i < metar.uVisibilityCount && i < MetarData::MAX_LAYERS; i++)
+            {
+                const VisibilityLayer& layer = metar.Visibilities[i];
+                writer.Char(L' ');
+                writer.Number(std::min(Round(layer.fVis), 9999), 4);
+                writer.String(L"&B");
+                writer.Number(Round(layer.fBase), 4);
+                writer.String(L"&D");
+                writer.Number(Round(layer.fTops - layer.fBase), 4);
+            }
+            for (UINT i = 0; i < metar.uCloudCount && i < MetarData::MAX_LAYERS; i++)
+            {
+                FormatCloud(metar.Clouds[i], writer);
+            }
+            for (UINT i = 0; i < metar.uTempCount && i < MetarData::MAX_LAYERS; i++)
+            {
+                const TempLayer& layer = metar.Temps[i];
+                writer.Char(L' ');
+                writer.Temperature(Round(layer.fTemp));
+                writer.Char(L'/');
+                writer.Temperature(Round(layer.fDewPoint));
+                writer.String(L"&A");
+                writer.Number(Round(layer.fAlt), 1);
+            }
+            // Q0000 would read back as no pressure group.
+            if (Round(metar.fBaroPressure) > 0)
+            {
+                writer.String(L" Q");
+                writer.Number(Round(metar.fBaroPressure), 4);
+            }
+
+            if (writer.bOverflow || writer.uLength >= cchMetar)
+            {
+                if (cchMetar > 0)
+                {
+                    pszMetar[0] = L'\0';
+                }
+                return E_INVALIDARG;
+            }
+            pszMetar[writer.uLength] = L'\0';
+            if (pcchLength != nullptr)
+            {
+                *pcchLength = writer.uLength;
+            }
+            return S_OK;
+        }
+
+    private:
+        static constexpr float FEET_TO_METERS = 0.3048f;
+        static constexpr float HUNDREDS_OF_FEET_TO_METERS = 30.48f;
+
+        struct Token
+        {
+            const WCHAR*    pBegin;
+            const WCHAR*    pEnd;           ///< End of the main group, before any '&' extension
+            const WCHAR*    pExtension;     ///< End of the whole token
+            UINT            uLength;        ///< Length of the main group
+
+            bool Equals(const WCHAR* psz) const
+            {
+                const WCHAR* p = pBegin;
+                while (p < pEnd && *psz != L'\0' && *p == *psz)
+                {
+                    p++;
+                    psz++;
+                }
+                return p == pEnd && *psz == L'\0';
+            }
+
+            bool EndsWith(const WCHAR* psz, UINT uSuffix) const
+            {
+                return uLength >= uSuffix && Token{ pEnd - uSuffix, pEnd, pEnd, uSuffix }.Equals(psz);
+            }
+        };
+
+        struct Writer
+        {
+            LPWSTR  pszBuffer;
+            size_t  cchBuffer;
+            size_t  uLength;
+            bool    bOverflow;
+
+            void Char(WCHAR ch)
+            {
+                if (uLength + 1 < cchBuffer)
+                {
+                    pszBuffer[uLength++] = ch;
+                }
+                else
+                {
+                    bOverflow = true;
+                }
+            }
+
+            void String(const WCHAR* psz)
+            {
+                while (*psz != L'\0')
+                {
+                    Char(*psz++);
+                }
+            }
+
+            /// Writes an integer padded with zeros to at least uWidth digits.
+            void Number(int iValue, UINT uWidth)
+            {
+                if (iValue < 0)
+                {
+                    Char(L'-');
+                    iValue = -iValue;
+                }
+                WCHAR szDigits[12];
+                UINT uDigits = 0;
+                do
+                {
+                    szDigits[uDigits++] = (WCHAR)(L'0' + iValue % 10);
+                    iValue /= 10;
+                } while (iValue != 0 || uDigits < uWidth);
+                while (uDigits > 0)
+                {
+                    Char(szDigits[--uDigits]);
+                }
+            }
+
+            void Temperature(int iValue)
+            {
+                if (iValue < 0)
+                {
+                    Char(L'M');
+                    iValue = -iValue;
+                }
+                Number(iValue, 2);
+            }
+        };
+
+        static bool IsDigit(WCHAR ch) { return ch >= L'0' && ch <= L'9'; }
+        static bool IsUpper(WCHAR ch) { return ch >= L'A' && ch <= L'Z'; }
+        static bool IsSpace(WCHAR ch) { return ch == L' ' || ch == L'\t' || ch == L'\r' || ch == L'\n'; }
+        static int Round(float fValue) { return (int)lroundf(fValue); }
+
+        static bool IsDigits(const WCHAR* p, const WCHAR* pEnd)
+        {
+            if (p == pEnd)
+            {
+                return false;
+            }
+            for (; p < pEnd; p++)
+            {
+                if (!IsDigit(*p))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool IsAlphaNumeric(const WCHAR* p, const WCHAR* pEnd)
+        {
+            for (; p < pEnd; p++)
+            {
+                if (!IsDigit(*p) && !IsUpper(*p))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool NextToken(const WCHAR*& pCur, const WCHAR* pEnd, Token& token)
+        {
+            while (pCur < pEnd && IsSpace(*pCur))
+            {
+                pCur++;
+            }
+            if (pCur == pEnd || *pCur == L'\0')
+            {
+                return false;
+            }
+
+            token.pBegin = pCur;
+            token.pEnd = nullptr;
+            while (pCur < pEnd && *pCur != L'\0' && !IsSpace(*pCur))
+            {
+                if (*pCur == L'&' && token.pEnd == nullptr)
+                {
+                    token.pEnd = pCur;
+                }
+                pCur++;
+            }
+            token.pExtension = pCur;
+            if (token.pEnd == nullptr)
+            {
+                token.pEnd = pCur;
+            }
+            token.uLength = (UINT)(token.pEnd - token.pBegin);
+            return true;
+        }
+
+        /// Reads up to uMaxDigits digits and advances p past them.  Returns the number of digits read.
+        static UINT ReadDigits(const WCHAR*& p, const WCHAR* pEnd, UINT uMaxDigits, int& iValue)
+        {
+            UINT uDigits = 0;
+            iValue = 0;
+            while (p < pEnd && uDigits < uMaxDigits && IsDigit(*p))
+            {
+                iValue = iValue * 10 + (*p++ - L'0');
+                uDigits++;
+            }
+            return uDigits;
+        }
+
+        static int ReadNumber(const WCHAR* p, const WCHAR* pEnd)
+        {
+            int iValue = 0;
+            ReadDigits(p, pEnd, 9, iValue);
+            return iValue;
+        }
+
+        /// Reads an optionally signed extension number.
+        static bool ReadSigned(const WCHAR*& p, const WCHAR* pEnd, int& iValue)
+        {
+            bool bNegative = p < pEnd && *p == L'-';
+            if (bNegative)
+            {
+                p++;
+            }
+            // Six digits keep the value exact as a float, so Format() writes back the same number.
+            if (ReadDigits(p, pEnd, 6, iValue) == 0 || (p < pEnd && IsDigit(*p)))
+            {
+                return false;
+            }
+            iValue = bNegative ? -iValue : iValue;
+            return true;
+        }
+
+        /// Maps a character to its position in pszCodes, or returns iDefault.
+        static int Lookup(const WCHAR*& p, const WCHAR* pEnd, const WCHAR* pszCodes, int iDefault)
+        {
+            if (p < pEnd)
+            {
+                for (int i = 0; pszCodes[i] != L'\0'; i++)
+                {
+                    if (pszCodes[i] == *p)
+                    {
+                        p++;
+                        return i;
+                    }
+                }
+            }
+            return iDefault;
+        }
+
+        /// Reads a turbulence code.  O (occasional) is treated as light.
+        static TURBULANCE ReadTurbulence(const WCHAR*& p, const WCHAR* pEnd)
+        {
+            static const TURBULANCE s_eTurbulence[] = { TURB_NONE, TURB_LIGHT, TURB_LIGHT, TURB_MODERATE, TURB_HEAVY, TURB_SEVERE };
+            return s_eTurbulence[Lookup(p, pEnd, L"NOLMHS", 0)];
+        }
+
+        static bool ParseToken(const Token& token, MetarData& metar)
+        {
+            const WCHAR* pBegin = token.pBegin;
+            const WCHAR* pEnd = token.pEnd;
+            const WCHAR ch = *pBegin;
+
+            if (token.uLength == 7 && token.pEnd[-1] == L'Z' && IsDigits(pBegin, pEnd - 1))
+            {
+                int iValue;
+                ReadDigits(pBegin, pEnd, 2, iValue); metar.uDay = (UINT)iValue;
+                ReadDigits(pBegin, pEnd, 2, iValue); metar.uHour = (UINT)iValue;
+                ReadDigits(pBegin, pEnd, 2, iValue); metar.uMinute = (UINT)iValue;
+                return true;
+            }
+            if (token.EndsWith(L"KT", 2) || token.EndsWith(L"MPS", 3) || token.EndsWith(L"KMH", 3))
+            {
+                return ParseWind(token, metar);
+            }
+            if (token.uLength == 7 && pBegin[3] == L'V' && IsDigits(pBegin, pBegin + 3) && IsDigits(pBegin + 4, pEnd))
+            {
+                if (metar.uWindCount == 0)
+                {
+                    return false;
+                }
+                int iFrom = ReadNumber(pBegin, pBegin + 3);
+                int iTo = ReadNumber(pBegin + 4, pEnd);
+                metar.Winds[metar.uWindCount - 1].fVariance = (float)(((iTo - iFrom) % 360 + 360) % 360) * 0.5f;
+                return true;
+            }
+            if (token.Equals(L"CAVOK"))
+            {
+                return AddVisibility(token, 10000.0f, metar);
+            }
+            if (token.uLength == 4 && IsDigits(pBegin, pEnd))
+            {
+                return AddVisibility(token, (float)ReadNumber(pBegin, pEnd), metar);
+            }
+            if (token.EndsWith(L"SM", 2))
+            {
+                return ParseVisibility(token, metar, 0.0f);
+            }
+            if ((ch == L'Q' || ch == L'A') && token.uLength == 5 && IsDigits(pBegin + 1, pEnd))
+            {
+                float fValue = (float)ReadNumber(pBegin + 1, pEnd);
+                metar.fBaroPressure = ch == L'Q' ? fValue : fValue * 0.338639f;
+                return true;
+            }
+            if (token.Equals(L"CLR") || token.Equals(L"SKC") || token.Equals(L"NSC") || token.Equals(L"NCD"))
+            {
+                return true;
+            }
+            if (token.uLength >= 5 && (IsCloudCover(token) || (pBegin[0] == L'V' && pBegin[1] == L'V')))
+            {
+                return ParseCloud(token, metar);
+            }
+            if (IsDigit(ch) || ch == L'M' || ch == L'/')
+            {
+                const WCHAR* pSlash = pBegin;
+                while (pSlash < pEnd && *pSlash != L'/')
+                {
+                    pSlash++;
+                }
+                if (pSlash < pEnd)
+                {
+                    return ParseTemperature(token, pSlash, metar);
+                }
+            }
+            return token.Equals(L"AUTO") || token.Equals(L"COR") || token.Equals(L"NOSIG") || IsPresentWeather(token);
+        }
+
+        static bool IsCloudCover(const Token& token)
+        {
+            Token cover = { token.pBegin, token.pBegin + 3, token.pBegin + 3, 3 };
+            return cover.Equals(L"FEW") || cover.Equals(L"SCT") || cover.Equals(L"BKN") || cover.Equals(L"OVC");
+        }
+
+        static bool IsPresentWeather(const Token& token)
+        {
+            const WCHAR* p = token.pBegin;
+            if (p < token.pEnd && (*p == L'+' || *p == L'-'))
+            {
+                p++;
+            }
+            if (p == token.pEnd || (token.pEnd - p) % 2 != 0)
+            {
+                return false;
+            }
+            for (; p < token.pEnd; p++)
+            {
+                if (!IsUpper(*p))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool ParseWind(const Token& token, MetarData& metar)
+        {
+            const WCHAR* p = token.pBegin;
+            const WCHAR* pEnd = token.pEnd;
+
+            WindAloftLayer layer = {};
+            int iValue = 0;
+            if (Token{ p, p + 3, p + 3, 3 }.Equals(L"VRB"))
+            {
+                layer.fVariance = 180.0f;
+                p += 3;
+            }
+            else if (ReadDigits(p, pEnd, 3, iValue) == 3 && iValue <= 360)
+            {
+                layer.fDirection = (float)iValue;
+            }
+            else
+            {
+                return false;
+            }
+            if (ReadDigits(p, pEnd, 3, iValue) < 2)
+            {
+                return false;
+            }
+            float fSpeed = (float)iValue;
+            float fGusts = 0.0f;
+            if (p < pEnd && *p == L'G')
+            {
+                p++;
+                if (ReadDigits(p, pEnd, 3, iValue) < 2)
+                {
+                    return false;
+                }
+                fGusts = (float)iValue;
+            }
+
+            Token units = { p, pEnd, pEnd, (UINT)(pEnd - p) };
+            float fScale = 1.0f;
+            if (units.Equals(L"MPS"))
+            {
+                fScale = 1.943844f;
+            }
+            else if (units.Equals(L"KMH"))
+            {
+                fScale = 0.539957f;
+            }
+            else if (!units.Equals(L"KT"))
+            {
+                return false;
+            }
+            layer.fSpeed = fSpeed * fScale;
+            layer.fGusts = fGusts * fScale;
+
+            // &D980NG (surface depth) or &A1500NG (altitude), then turbulence and shear.
+            p = token.pEnd;
+            pEnd = token.pExtension;
+            if (p < pEnd)
+            {
+                p++;
+                WCHAR chKind = p < pEnd ? *p++ : L'\0';
+                if ((chKind != L'D' && chKind != L'A') || !ReadSigned(p, pEnd, iValue))
+                {
+                    return false;
+                }
+                if (chKind == L'A')
+                {
+                    layer.fAlt = (float)iValue;
+                }
+                else
+                {
+                    metar.fSurfaceWindDepth = (float)iValue;
+                }
+                layer.eTurb = ReadTurbulence(p, pEnd);
+                layer.eWindShear = (WINDSHEAR)Lookup(p, pEnd, L"GMSI", WINDSHEAR_GRADUAL);
+            }
+
+            if (metar.uWindCount == MetarData::MAX_LAYERS)
+            {
+                return false;
+            }
+            metar.Winds[metar.uWindCount++] = layer;
+            return true;
+        }
+
+        static void FormatWind(const WindAloftLayer& layer, float fSurfaceDepth, Writer& writer)
+        {
+            writer.Char(L' ');
+            // Compared after rounding: a 359 degree arc written as dddVddd would read back as no variance.
+            bool bVariable = Round(layer.fVariance) >= 180;
+            if (bVariable)
+            {
+                writer.String(L"VRB");
+            }
+            else
+            {
+                writer.Number(Round(layer.fDirection) % 360, 3);
+            }
+            // Speeds are limited to the three digits Parse() reads.
+            const int iSpeed = std::min(std::max(Round(layer.fSpeed), 0), 999);
+            const int iGusts = std::min(std::max(Round(layer.fGusts), 0), 999);
+            writer.Number(iSpeed, 2);
+            if (iGusts > iSpeed)
+            {
+                writer.Char(L'G');
+                writer.Number(iGusts, 2);
+            }
+            writer.String(L"KT");
+            if (layer.fAlt > 0.0f)
+            {
+                writer.String(L"&A");
+                writer.Number(Round(layer.fAlt), 1);
+            }
+            else
+            {
+                writer.String(L"&D");
+                writer.Number(Round(fSurfaceDepth), 1);
+            }
+            writer.Char(L"NLMHS"[std::min((UINT)layer.eTurb, (UINT)TURB_SEVERE)]);
+            writer.Char(L"GMSI"[std::min((UINT)layer.eWindShear, (UINT)WINDSHEAR_INSTANTANEOUS)]);
+
+            int iVariance = Round(layer.fVariance);
+            if (!bVariable && iVariance > 0)
+            {
+                int iDirection = Round(layer.fDirection);
+                writer.Char(L' ');
+                writer.Number(((iDirection - iVariance) % 360 + 360) % 360, 3);
+                writer.Char(L'V');
+                writer.Number((iDirection + iVariance) % 360, 3);
+            }
+        }
+
+        /// Parses a visibility ending in SM.  fWhole is the whole part of a "1 1/2SM" pair.
+        static bool ParseVisibility(const Token& token, MetarData& metar, float fWhole)
+        {
+            if (!token.EndsWith(L"SM", 2))
+            {
+                return false;
+            }
+            const WCHAR* p = token.pBegin;
+            const WCHAR* pEnd = token.pEnd - 2;
+            if (p < pEnd && (*p == L'M' || *p == L'P'))
+            {
+                p++;
+            }
+
+            int iNumerator = 0;
+            int iDenominator = 1;
+            if (ReadDigits(p, pEnd, 3, iNumerator) == 0)
+            {
+                return false;
+            }
+            if (p < pEnd && *p == L'/')
+            {
+                p++;
+                if (ReadDigits(p, pEnd, 3, iDenominator) == 0 || iDenominator == 0)
+                {
+                    return false;
+                }
+            }
+            else if (fWhole != 0.0f)
+            {
+                return false;
+            }
+            if (p != pEnd)
+            {
+                return false;
+            }
+            float fMiles = fWhole + (float)iNumerator / (float)iDenominator;
+            return AddVisibility(token, fMiles * 1609.344f, metar);
+        }
+
+        static bool AddVisibility(const Token& token, float fVis, MetarData& metar)
+        {
+            VisibilityLayer layer = { fVis, 0.0f, 0.0f };
+            float fDepth = 0.0f;
+            const WCHAR* p = token.pEnd;
+            const WCHAR* pEnd = token.pExtension;
+            while (p < pEnd)
+            {
+                int iValue = 0;
+                if (*p++ != L'&' || p == pEnd)
+                {
+                    return false;
+                }
+                WCHAR chKind = *p++;
+                if (!ReadSigned(p, pEnd, iValue))
+                {
+                    return false;
+                }
+                if (chKind == L'B')
+                {
+                    layer.fBase = (float)iValue;
+                }
+                else if (chKind == L'D')
+                {
+                    fDepth = (float)iValue;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            layer.fTops = layer.fBase + fDepth;
+
+            if (metar.uVisibilityCount == MetarData::MAX_LAYERS)
+            {
+                return false;
+            }
+            metar.Visibilities[metar.uVisibilityCount++] = layer;
+            return true;
+        }
+
+        static bool ParseCloud(const Token& token, MetarData& metar)
+        {
+            const WCHAR* p = token.pBegin;
+            const WCHAR* pEnd = token.pEnd;
+
+            CloudLayer layer = {};
+            if (p[0] == L'V')
+            {
+                layer.eCloudCover = CLOUD_OVERCAST_8_8;
+                p += 2;
+            }
+            else
+            {
+                static const CLOUD_COVER s_eCovers[] = { CLOUD_FEW_2_8, CLOUD_SCATTERED_4_8, CLOUD_BROKEN_6_8, CLOUD_OVERCAST_8_8 };
+                Token cover = { p, p + 3, p + 3, 3 };
+                layer.eCloudCover = s_eCovers[cover.Equals(L"FEW") ? 0 : cover.Equals(L"SCT") ? 1 : cover.Equals(L"BKN") ? 2 : 3];
+                p += 3;
+            }
+
+            int iBase = 0;
+            if (ReadDigits(p, pEnd, 3, iBase) != 3)
+            {
+                return false;
+            }
+            Token suffix = { p, pEnd, pEnd, (UINT)(pEnd - p) };
+            bool bCumulonimbus = suffix.Equals(L"CB");
+            if (!bCumulonimbus && !suffix.Equals(L"TCU") && p != pEnd)
+            {
+                return false;
+            }
+
+            layer.eCloudType = bCumulonimbus ? CLOUD_CUMULONIMBUS : CLOUD_CUMULUS;
+            layer.eCloudTop = bCumulonimbus ? CLOUDTOP_ANVIL : CLOUDTOP_FLAT;
+            layer.fCloudBase = iBase * HUNDREDS_OF_FEET_TO_METERS;
+            layer.fCloudTops = layer.fCloudBase + 1000.0f * FEET_TO_METERS;
+
+            // &CU001FNMN000N
+            p = token.pEnd;
+            pEnd = token.pExtension;
+            if (p < pEnd)
+            {
+                p++;
+                if (pEnd - p < 2)
+                {
+                    return false;
+                }
+                layer.eCloudType = CloudType(p[0], p[1]);
+                p += 2;
+
+                int iValue = 0;
+                if (ReadDigits(p, pEnd, 3, iValue) == 3)
+                {
+                    layer.fCloudTops = layer.fCloudBase + iValue * HUNDREDS_OF_FEET_TO_METERS;
+                }
+                layer.eCloudTop = (CLOUD_TOP)Lookup(p, pEnd, L"FRA", layer.eCloudTop);
+                layer.eTurbulance = ReadTurbulence(p, pEnd);
+                layer.ePrecipRate = (PRECIPRATE)Lookup(p, pEnd, L"VLMHD", PRECIPRATE_VLOW);
+                static const PRECIPTYPE s_ePrecipTypes[] = { PRECIP_NONE, PRECIP_RAIN, PRECIP_RAIN, PRECIP_RAIN, PRECIP_SNOW };
+                layer.ePrecipType = s_ePrecipTypes[Lookup(p, pEnd, L"NRFHS", 0)];
+                if (ReadDigits(p, pEnd, 3, iValue) == 3)
+                {
+                    layer.fPrecipBase = iValue * HUNDREDS_OF_FEET_TO_METERS;
+                }
+                layer.eIcingRate = (ICINGRATE)Lookup(p, pEnd, L"NTLMS", ICINGRATE_NONE);
+                if (p != pEnd)
+                {
+                    return false;
+                }
+            }
+
+            if (metar.uCloudCount == MetarData::MAX_LAYERS)
+            {
+                return false;
+            }
+            metar.Clouds[metar.uCloudCount++] = layer;
+            return true;
+        }
+
+        static CLOUD_TYPE CloudType(WCHAR ch0, WCHAR ch1)
+        {
+            if (ch0 == L'C' && (ch1 == L'I' || ch1 == L'C' || ch1 == L'S'))
+            {
+                return CLOUD_CIRRUS;
+            }
+            if (ch0 == L'C' && ch1 == L'B')
+            {
+                return CLOUD_CUMULONIMBUS;
+            }
+            if (ch0 == L'T' && ch1 == L'S')
+            {
+                return CLOUD_THUNDERSTORM;
+            }
+            if (ch1 == L'S' || ch1 == L'T' || (ch0 == L'S' && ch1 == L'C'))
+            {
+                return CLOUD_STRATUS;
+            }
+            return CLOUD_CUMULUS;
+        }
+
+        static void FormatCloud(const CloudLayer& layer, Writer& writer)
+        {
+            static const WCHAR* s_pszCovers[] = { L"FEW", L"FEW", L"FEW", L"SCT", L"SCT", L"BKN", L"BKN", L"BKN", L"OVC" };
+            static const WCHAR* s_pszTypes[] = { L"CU", L"CI", L"ST", L"CU", L"CB", L"ST", L"TS" };
+
+            writer.Char(L' ');
+            writer.String(s_pszCovers[std::min((UINT)layer.eCloudCover, (UINT)CLOUD_OVERCAST_8_8)]);
+            writer.Number(std::min(std::max(Round(layer.fCloudBase / HUNDREDS_OF_FEET_TO_METERS), 0), 999), 3);
+            writer.Char(L'&');
+            writer.String(s_pszTypes[std::min((UINT)layer.eCloudType, (UINT)CLOUD_THUNDERSTORM)]);
+            writer.Number(std::min(std::max(Round((layer.fCloudTops - layer.fCloudBase) / HUNDREDS_OF_FEET_TO_METERS), 0), 999), 3);
+            writer.Char(L"FRA"[std::min((UINT)layer.eCloudTop, (UINT)CLOUDTOP_ANVIL)]);
+            writer.Char(L"NLMHS"[std::min((UINT)layer.eTurbulance, (UINT)TURB_SEVERE)]);
+            writer.Char(L"VLMHD"[std::min((UINT)layer.ePrecipRate, (UINT)PRECIPRATE_VHIGH)]);
+            writer.Char(L"NRS"[std::min((UINT)layer.ePrecipType, (UINT)PRECIP_SNOW)]);
+            writer.Number(std::min(std::max(Round(layer.fPrecipBase / HUNDREDS_OF_FEET_TO_METERS), 0), 999), 3);
+            writer.Char(L"NTLMS"[std::min((UINT)layer.eIcingRate, (UINT)ICINGRATE_SEVERE)]);
+        }
+
+        static bool ReadTemperature(const WCHAR*& p, const WCHAR* pEnd, float& fValue)
+        {
+            bool bNegative = p < pEnd && *p == L'M';
+            if (bNegative)
+            {
+                p++;
+            }
+            int iValue = 0;
+            if (ReadDigits(p, pEnd, 2, iValue) != 2)
+            {
+                return false;
+            }
+            fValue = (float)(bNegative ? -iValue : iValue);
+            return true;
+        }
+
+        static bool ParseTemperature(const Token& token, const WCHAR* pSlash, MetarData& metar)
+        {
+            TempLayer layer = {};
+            const WCHAR* p = token.pBegin;
+            if (!ReadTemperature(p, pSlash, layer.fTemp) || p != pSlash)
+            {
+                return false;
+            }
+
+            // The dew point may be missing, as in "15/" or "15///".
+            p = pSlash + 1;
+            layer.fDewPoint = layer.fTemp;
+            if (p < token.pEnd && *p != L'/' && (!ReadTemperature(p, token.pEnd, layer.fDewPoint) || p != token.pEnd))
+            {
+                return false;
+            }
+
+            p = token.pEnd;
+            const WCHAR* pEnd = token.pExtension;
+            if (p < pEnd)
+            {
+                int iValue = 0;
+                if (pEnd - p < 3 || p[1] != L'A')
+                {
+                    return false;
+                }
+                p += 2;
+                if (!ReadSigned(p, pEnd, iValue) || p != pEnd)
+                {
+                    return false;
+                }
+                layer.fAlt = (float)iValue;
+            }
+
+            if (metar.uTempCount == MetarData::MAX_LAYERS)
+            {
+                return false;
+            }
+            metar.Temps[metar.uTempCount++] = layer;
+            return true;
+        }
+    };
+    /** @} */
+}
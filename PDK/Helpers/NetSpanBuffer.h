@@ -0,0 +1,309 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// NetSpanBuffer.h
+
+#pragma once
+#include <ObjBase.h>
+#include "NetInOutPublic.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup networkservices */ /** @{ */
+
+    /**
+    * Byte order helpers for the multiplayer stream.  NetOutPublic writes scalars in little-endian
+    * order, so the span adapters convert to and from little-endian; on little-endian hosts this
+    * compiles down to a plain copy.
+    */
+    class NetByteOrder
+    {
+    public:
+        static bool IsLittleEndian()
+        {
+            const UINT16 uProbe = 1;
+            return *reinterpret_cast<const BYTE*>(&uProbe) == 1;
+        }
+
+        /// Copies a scalar to or from its little-endian wire representation.
+        template <class T>
+        static void CopyLittleEndian(__out void* pDest, __in const void* pSrc)
+        {
+            static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "CopyLittleEndian requires a scalar type");
+            if (IsLittleEndian())
+            {
+                memcpy(pDest, pSrc, sizeof(T));
+            }
+            else
+            {
+                const BYTE* pIn = static_cast<const BYTE*>(pSrc);
+                BYTE* pOut = static_cast<BYTE*>(pDest);
+                for (size_t i = 0; i < sizeof(T); i++)
+                {
+                    pOut[i] = pIn[sizeof(T) - 1 - i];
+                }
+            }
+        }
+    };
+
+    /**
+    * Bulk writer for NetOutPublic.  Fields are staged in a contiguous local buffer and handed to
+    * NetOutPublic::WriteData() in a single call on Flush() or destruction, instead of one virtual
+    * call per field.  The bytes produced match the equivalent WriteInt32/WriteFloat/WriteDouble/...
+    * calls, so the receiving side may read them with either NetSpanReader or the per-field API.
+    * @remarks  Strings have no fixed-size wire format and are forwarded to NetOutPublic::WriteString()
+    *           after flushing the staged bytes.
+    * Sample usage from ICustomPacketV530::OnSend():
+    * ```
+    *      NetSpanWriter writer(out);
+    *      writer.Write(uCount);
+    *      writer.WriteArray(pPositions, uCount);
+    *      writer.WriteStruct(header);
+    * ```
+    */
+    class NetSpanWriter
+    {
+    public:
+        /**
+        * @param out        Stream to write to.
+        * @param uReserve   Initial staging capacity in bytes.
+        */
+        explicit NetSpanWriter(__in NetOutPublic& out, __in UINT uReserve = 256)
+            : m_Out(out)
+        {
+            m_vBuffer.resize(uReserve);
+        }
+
+        ~NetSpanWriter()
+        {
+            Flush();
+        }
+
+        /// Stages a scalar value in little-endian order.
+        template <class T>
+        void Write(__in const T& value)
+        {
+            BYTE* pDest = Reserve(sizeof(T));
+            NetByteOrder::CopyLittleEndian<T>(pDest, &value);
+        }
+
+        /// Stages an array of scalar values in little-endian order.
+        template <class T>
+        void WriteArray(__in const T* pValues, __in UINT uCount)
+        {
+            BYTE* pDest = Reserve(sizeof(T) * uCount);
+            if (NetByteOrder::IsLittleEndian())
+            {
+                memcpy(pDest, pValues, sizeof(T) * uCount);
+            }
+            else
+            {
+                for (UINT i = 0; i < uCount; i++)
+                {
+                    NetByteOrder::CopyLittleEndian<T>(pDest + i * sizeof(T), &pValues[i]);
+                }
+            }
+        }
+
+        /**
+        * Stages a POD structure with a single copy.  The structure is written in host layout, so both
+        * sides must use the same packing; use Write() for individual fields when that cannot be guaranteed.
+        */
+        template <class T>
+        void WriteStruct(__in const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "WriteStruct requires a trivially copyable type");
+            memcpy(Reserve(sizeof(T)), &value, sizeof(T));
+        }
+
+        /// Stages raw bytes.
+        void WriteBytes(__in const void* pData, __in UINT uSize)
+        {
+            memcpy(Reserve(uSize), pData, uSize);
+        }
+
+        /// Flushes staged bytes and writes a string through NetOutPublic::WriteString().
+        void WriteString(__in LPCWSTR pszString)
+        {
+            Flush();
+            m_Out.WriteString(pszString);
+        }
+
+        /// Hands all staged bytes to the stream with a single WriteData() call.
+        void Flush()
+        {
+            if (m_uUsed > 0)
+            {
+                m_Out.WriteData(m_vBuffer.data(), (unsigned int)m_uUsed);
+                m_uBytesFlushed += m_uUsed;
+                m_uUsed = 0;
+            }
+        }
+
+        /// Number of bytes staged but not yet flushed.
+        UINT GetPendingBytes() const { return (UINT)m_uUsed; }
+        /// Number of bytes handed to the stream so far.
+        UINT64 GetBytesFlushed() const { return m_uBytesFlushed; }
+
+    private:
+        // The buffer only grows; m_uUsed marks the staged bytes so per-field writes skip the vector's resize.
+        BYTE* Reserve(size_t uSize)
+        {
+            const size_t uOffset = m_uUsed;
+            if (uOffset + uSize > m_vBuffer.size())
+            {
+                m_vBuffer.resize(std::max(uOffset + uSize, m_vBuffer.size() * 2));
+            }
+            m_uUsed = uOffset + uSize;
+            return m_vBuffer.data() + uOffset;
+        }
+
+        NetOutPublic&       m_Out;
+        std::vector<BYTE>   m_vBuffer;
+        size_t              m_uUsed = 0;
+        UINT64              m_uBytesFlushed = 0;
+    };
+
+    /**
+    * Bulk reader for NetInPublic.  The reader parses fields directly from the buffer returned by
+    * NetInPublic::GetCurBuffer(), bounded by BytesLeft(), and advances the stream with a single
+    * NetInPublic::Read() call on Commit() or destruction.  If the stream does not expose its buffer,
+    * the reader falls back to one NetInPublic::Read() call per field.
+    * @remarks  All Read methods return false without consuming anything if not enough bytes remain.
+    */
+    class NetSpanReader
+    {
+    public:
+        explicit NetSpanReader(__in NetInPublic& in)
+            : m_In(in)
+        {
+            Attach();
+        }
+
+        ~NetSpanReader()
+        {
+            Commit();
+        }
+
+        /// Reads a little-endian scalar value.
+        template <class T>
+        bool Read(__out T& value)
+        {
+            const BYTE* pSrc = Consume(sizeof(T));
+            if (pSrc == nullptr)
+            {
+                return false;
+            }
+            NetByteOrder::CopyLittleEndian<T>(&value, pSrc);
+            return true;
+        }
+
+        /// Reads an array of little-endian scalar values.
+        template <class T>
+        bool ReadArray(__out T* pValues, __in UINT uCount)
+        {
+            const BYTE* pSrc = Consume(sizeof(T) * uCount);
+            if (pSrc == nullptr)
+            {
+                return false;
+            }
+            if (NetByteOrder::IsLittleEndian())
+            {
+                memcpy(pValues, pSrc, sizeof(T) * uCount);
+            }
+            else
+            {
+                for (UINT i = 0; i < uCount; i++)
+                {
+                    NetByteOrder::CopyLittleEndian<T>(&pValues[i], pSrc + i * sizeof(T));
+                }
+            }
+            return true;
+        }
+
+        /// Reads a POD structure written with NetSpanWriter::WriteStruct().
+        template <class T>
+        bool ReadStruct(__out T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "ReadStruct requires a trivially copyable type");
+            const BYTE* pSrc = Consume(sizeof(T));
+            if (pSrc == nullptr)
+            {
+                return false;
+            }
+            memcpy(&value, pSrc, sizeof(T));
+            return true;
+        }
+
+        /**
+        * Returns a pointer to the next uSize bytes without copying them and advances past them.
+        * @return   Pointer into the stream buffer, or nullptr if not enough bytes remain.
+        * @remarks  The pointer stays valid for the duration of the OnReceive()/Deserialize() call.
+        */
+        const BYTE* ReadBytes(__in UINT uSize)
+        {
+            return Consume(uSize);
+        }
+
+        /// Commits the bytes parsed so far and reads a string through NetInPublic::ReadString().
+        const WCHAR* ReadString()
+        {
+            Commit();
+            const WCHAR* pszString = m_In.ReadString();
+            Attach();
+            return pszString;
+        }
+
+        /// Advances the underlying stream past every byte parsed so far.
+        void Commit()
+        {
+            if (m_pCur != m_pBase)
+            {
+                m_In.Read((unsigned int)(m_pCur - m_pBase));
+                m_pBase = m_pCur;
+            }
+        }
+
+        /// Number of bytes left to parse.
+        UINT GetBytesLeft() const
+        {
+            return m_pBase != nullptr ? (UINT)(m_pEnd - m_pCur) : m_In.BytesLeft();
+        }
+
+    private:
+        void Attach()
+        {
+            m_pBase = m_In.GetCurBuffer();
+            m_pCur = m_pBase;
+            m_pEnd = m_pBase != nullptr ? m_pBase + m_In.BytesLeft() : nullptr;
+        }
+
+        // Without a stream buffer m_pCur == m_pEnd, so every field takes the fallback branch.
+        const BYTE* Consume(UINT uSize)
+        {
+            if (uSize > (size_t)(m_pEnd - m_pCur))
+            {
+                if (m_pBase == nullptr && uSize <= m_In.BytesLeft())
+                {
+                    // Fallback: the stream does not expose its buffer, read field by field.
+                    return static_cast<const BYTE*>(m_In.Read(uSize));
+                }
+                return nullptr;
+            }
+            const BYTE* pSrc = m_pCur;
+            m_pCur += uSize;
+            return pSrc;
+        }
+
+        NetInPublic&    m_In;
+        const BYTE*     m_pBase = nullptr;      // Start of the bytes not yet committed to the stream
+        const BYTE*     m_pCur = nullptr;       // Next byte to parse
+        const BYTE*     m_pEnd = nullptr;       // End of the stream buffer
+    };
+    /** @} */
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarBeam.h
+
+#pragma once
+#include <ObjBase.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Radar
+{
+    /** @addtogroup radarService */ /** @{ */
+
+    /**
+    * Position of a radar beam sweeping back and forth between its scan limits.
+    * Shared by RadarSweepAccumulator and RadarContactDetector so the scope and the detector step the
+    * beam identically.
+    * @remarks  A move that ends exactly on a scan limit reverses the beam and completes the sweep, so
+    *           IsSweepingRight() already points away from the limit before the next move.
+    */
+    class RadarBeam
+    {
+    public:
+        /**
+        * Moves the beam, reversing at the scan limits.
+        * @param dScanAzimuth   Maximum deviation of the beam from center in degrees.
+        * @param dTravel        Angle the beam moves in degrees, the sweep rate times the elapsed time.
+        * @param dMin           Receives the lowest azimuth the beam covered.
+        * @param dMax           Receives the highest azimuth the beam covered.
+        * @return               True if the beam reached a scan limit, completing a sweep.
+        */
+        bool Advance(__in double dScanAzimuth, __in double dTravel, __out double& dMin, __out double& dMax)
+        {
+            dMin = dMax = m_dAzimuth;
+            bool bLimit = false;
+            if (dTravel >= 2.0 * dScanAzimuth)
+            {
+                dMin = -dScanAzimuth;
+                dMax = dScanAzimuth;
+                bLimit = true;
+            }
+            double dRemaining = fmod(dTravel, 4.0 * dScanAzimuth);
+            while (dRemaining > 0.0)
+            {
+                const double dLimit = m_dDirection * dScanAzimuth;
+                const double dStep = std::min(dRemaining, fabs(dLimit - m_dAzimuth));
+                m_dAzimuth += m_dDirection * dStep;
+                dRemaining -= dStep;
+                dMin = std::min(dMin, m_dAzimuth);
+                dMax = std::max(dMax, m_dAzimuth);
+                if (dRemaining > 0.0 || m_dAzimuth == dLimit)
+                {
+                    m_dAzimuth = dLimit;
+                    m_dDirection = -m_dDirection;
+                    bLimit = true;
+                }
+            }
+            return bLimit;
+        }
+
+        /// Keeps the beam within new scan limits.
+        void Clamp(__in double dScanAzimuth)
+        {
+            m_dAzimuth = std::max(-dScanAzimuth, std::min(m_dAzimuth, dScanAzimuth));
+        }
+
+        /// Beam angle from center in degrees.
+        double GetAzimuth() const { return m_dAzimuth; }
+        /// True while the beam moves toward positive azimuths.
+        bool IsSweepingRight() const { return m_dDirection > 0.0; }
+        /// Places the beam, e.g. at ISimulatedRadarV500::GetCurrentRadarBeamOffsetDegrees().
+        void SetAzimuth(__in double dDegrees, __in bool bSweepingRight) { m_dAzimuth = dDegrees; m_dDirection = bSweepingRight ? 1.0 : -1.0; }
+
+    private:
+        double  m_dAzimuth = 0.0;
+        double  m_dDirection = 1.0;
+    };
+    /** @} */
+}
@@ -0,0 +1,580 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarContactDetector.h
+
+#pragma once
+#include <ObjBase.h>
+#include "ISimulatedRadar.h"
+#include "RadarBeam.h"
+#include "SimulationWorkerPool.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+namespace Radar
+{
+    /** @addtogroup radarService */ /** @{ */
+
+    /// Object the radar can detect.
+    struct RadarTarget
+    {
+        UINT    uObjectId;          ///< Sim object id
+        LLA     vPosition;          ///< Position in radians and feet
+        float   fRcsSquareMeters;   ///< Radar cross section
+    };
+
+    /// Entry of the track file published by RadarContactDetector.
+    struct RadarTrack
+    {
+        UINT    uObjectId;          ///< Sim object id of the detected target
+        LLA     vPosition;          ///< Position at the last detection
+        FEET    dRangeFeet;         ///< Slant range at the last detection
+        DEGREES dBearingDegrees;    ///< Bearing from the nose at the last detection, matching the beam azimuth
+        DEGREES dDepressionDegrees; ///< Angle below the radar's horizon at the last detection
+        float   fSignalDb;          ///< Margin of the return over the detection threshold
+        SECONDS dLastDetection;     ///< Detector time of the last detection
+        UINT    uHits;              ///< Consecutive looks with a detection
+        UINT    uMisses;            ///< Consecutive looks without a detection
+        bool    bConfirmed;         ///< Detected on enough consecutive looks to be reported
+    };
+
+    /**
+    * Produces discrete contacts from the radar's scan settings.
+    * Each Update() moves the beam to the radar's current beam offset and tests the targets in the wedge
+    * swept since the previous update.  Targets are binned in a grid around the aircraft so only the
+    * cells under the wedge are visited, and the candidates are tested in parallel on a
+    * SimulationWorkerPool.
+    * A target is detected when it is:
+    *   - within the radar range and the detection range for its radar cross section, which scales with
+    *     the fourth root of the cross section from the range for one square meter;
+    *   - inside the beam's elevation fan, taken from GetCurrentRadarScanElevationDegrees() or the angles
+    *     given to SetCustomRadarAngles().  The scan elevation is positive above the horizon and the
+    *     custom antenna elevation positive below it, so the scan elevation is negated;
+    *   - outside the front and side blind spots;
+    *   - above the radar horizon, using a 4/3 earth radius for refraction, and, if a terrain function is
+    *     set, not masked by terrain sampled along the line of sight.
+    * Tracks are confirmed after two consecutive detections and dropped after three consecutive looks
+    * without one.  A track is also dropped when it has not been detected for the track timeout, which
+    * removes tracks whose bearing the beam no longer sweeps, for example after the aircraft turns.
+    * The track file of confirmed tracks is published each time the beam completes a sweep.
+    * @remarks  The antenna is assumed to be stabilized: azimuth is measured from the heading and
+    *           elevation from the horizon, so pitch and bank do not move the beam.
+    * @remarks  The wedge runs from the previous beam offset to the current one in the beam's direction,
+    *           through a scan limit when the offset is behind the beam.  When that path is longer than
+    *           the sweep rate allows, the beam has turned the other way and the shorter path is used.
+    * Sample usage:
+    * ```
+    *      SimulationWorkerPool pool(3);
+    *      RadarContactDetector detector(&pool);
+    *
+    *      // Every frame:
+    *      detector.SetTargets(vTargets.data(), (UINT)vTargets.size());
+    *      if (detector.Update(spRadar, vAircraftLLA, dHeadingDegrees, dElapsedSeconds) == S_OK)
+    *      {
+    *          for (const RadarTrack& track : detector.GetTrackFile())
+    *          {
+    *              // Draw or report the track.
+    *          }
+    *      }
+    * ```
+    */
+    class RadarContactDetector
+    {
+    public:
+        /// Terrain elevation in feet at a position in radians.  Called from worker threads.
+        typedef double (*PTerrainFunc)(void* pContext, RADIANS dLat, RADIANS dLon);
+
+        /**
+        * @param pPool  Pool used to test targets in parallel, or nullptr to test them on the calling thread.
+        */
+        explicit RadarContactDetector(__in P3D::SimulationWorkerPool* pPool = nullptr)
+            : m_pPool(pPool)
+        {
+        }
+
+        /// Sets the targets tested by the following updates.  Exclude the aircraft carrying the radar.
+        void SetTargets(__in const RadarTarget* pTargets, __in UINT uCount)
+        {
+            m_vTargets.assign(pTargets, pTargets + uCount);
+        }
+
+        /**
+        * Sets the terrain used for masking.
+        * @param pfnTerrain     Terrain elevation function, or nullptr to only mask by the radar horizon.
+        * @param pContext       Passed to pfnTerrain.
+        * @param uSamples       Points sampled between the radar and a target.
+        */
+        void SetTerrainFunction(__in PTerrainFunc pfnTerrain, __in void* pContext, __in UINT uSamples = 8)
+        {
+            m_pfnTerrain = pfnTerrain;
+            m_pTerrainContext = pContext;
+            m_uTerrainSamples = std::max(uSamples, 1u);
+        }
+
+        /// Sets the range at which a one square meter target is detected.
+        void SetReferenceRange(__in double dNauticalMiles) { m_dReferenceFeet = dNauticalMiles * FEET_PER_NM; }
+
+        /// Sets the elevation width of the beam used with GetCurrentRadarScanElevationDegrees().
+        void SetBeamWidth(__in DEGREES dDegrees) { m_dBeamWidth = dDegrees; }
+
+        /**
+        * Sets how long a track is kept without a detection.
+        * @param dSeconds   Timeout, or 0 for three full scan cycles at the radar's sweep rate.
+        */
+        void SetTrackTimeout(__in SECONDS dSeconds) { m_dTrackTimeout = dSeconds; }
+
+        /**
+        * Points the radar antenna and the detection beam at custom angles.
+        * @param antennaElevation   Angle in degrees below the aircraft's horizon.
+        * @param antennaFov         Beam width in degrees centered on antennaElevation.
+        */
+        void SetCustomRadarAngles(__in __notnull ISimulatedRadarV500* pRadar, __in double antennaElevation, __in double antennaFov)
+        {
+            pRadar->SetCustomRadarAngles(antennaElevation, antennaFov);
+            pRadar->UseCustomRadarAngles(true);
+            m_bCustomAngles = true;
+            m_dCustomElevation = antennaElevation;
+            m_dCustomFov = antennaFov;
+        }
+
+        /// Returns the radar and the detection beam to the radar's own scan elevation.
+        void ClearCustomRadarAngles(__in __notnull ISimulatedRadarV500* pRadar)
+        {
+            pRadar->UseCustomRadarAngles(false);
+            m_bCustomAngles = false;
+        }
+
+        /**
+        * Advances the beam and detects targets in the swept wedge.
+        * @param pRadar             Radar service, read for range, scan azimuth, sweep rate, beam offset, blind spots and elevation.
+        * @param vPosition          Position of the radar.
+        * @param dHeadingDegrees    True heading of the aircraft.
+        * @param dElapsedSeconds    Time since the previous update.
+        * @return                   S_OK if a sweep completed and a new track file was published, S_FALSE if not,
+        *                           or E_INVALIDARG.
+        */
+        HRESULT Update(__in __notnull ISimulatedRadarV500* pRadar, __in const LLA& vPosition, __in DEGREES dHeadingDegrees, __in SECONDS dElapsedSeconds)
+        {
+            if (pRadar == nullptr || !(dElapsedSeconds >= 0.0))
+            {
+                return E_INVALIDARG;
+            }
+            m_dTime += dElapsedSeconds;
+            m_uCandidateCount = 0;
+            if (pRadar->FreezeEnabled())
+            {
+                return S_FALSE;
+            }
+
+            const double dScanAzimuth = pRadar->GetScanAzimuth();
+            if (!(dScanAzimuth > 0.0))
+            {
+                return S_FALSE;
+            }
+            const double dSweepRate = fabs(pRadar->GetSweepRate());
+            const double dOffset = std::max(-dScanAzimuth, std::min(pRadar->GetCurrentRadarBeamOffsetDegrees(), dScanAzimuth));
+            m_Beam.Clamp(dScanAzimuth);
+            double dMin, dMax;
+            const bool bSweepDone = m_Beam.Advance(dScanAzimuth, GetTravelTo(dOffset, dScanAzimuth, dSweepRate * dElapsedSeconds), dMin, dMax);
+            m_Beam.SetAzimuth(dOffset, m_Beam.IsSweepingRight());
+
+            // Beam geometry for this update, shared read only with the workers.
+            m_Scan.vOrigin = vPosition;
+            m_Scan.dHeading = dHeadingDegrees;
+            m_Scan.dMinBearing = dMin;
+            m_Scan.dMaxBearing = dMax;
+            m_Scan.dRangeFeet = pRadar->GetRangeMiles() * FEET_PER_NM;
+            m_Scan.dHalfFront = 0.5 * pRadar->GetFrontBlindspotDegrees();
+            m_Scan.dSideLimit = dScanAzimuth - pRadar->GetSideBlindspotDegrees();
+            // Depression is positive below the horizon; the radar's scan elevation is positive above it.
+            m_Scan.dBeamDepression = m_bCustomAngles ? m_dCustomElevation : -pRadar->GetCurrentRadarScanElevationDegrees();
+            m_Scan.dHalfBeamWidth = 0.5 * (m_bCustomAngles ? m_dCustomFov : m_dBeamWidth);
+            m_Scan.dFeetPerRadianEast = EARTH_RADIUS_FEET * cos(vPosition.Lat);
+
+            if (dMax > dMin && m_Scan.dRangeFeet > 0.0)
+            {
+                BuildGrid();
+                GatherCandidates();
+                DetectCandidates();
+                UpdateTracks();
+            }
+            const double dTimeout = m_dTrackTimeout > 0.0 ? m_dTrackTimeout : (dSweepRate > 0.0 ? DROP_MISSES * 4.0 * dScanAzimuth / dSweepRate : 0.0);
+            if (dTimeout > 0.0)
+            {
+                ExpireTracks(dTimeout);
+            }
+
+            if (!bSweepDone)
+            {
+                return S_FALSE;
+            }
+            PublishTrackFile();
+            return S_OK;
+        }
+
+        /// Confirmed tracks as of the last completed sweep, ordered by object id.
+        const std::vector<RadarTrack>& GetTrackFile() const { return m_vTrackFile; }
+        /// Incremented each time a track file is published.
+        UINT64 GetTrackFileVersion() const { return m_uTrackFileVersion; }
+        /// Targets tested by the last update after spatial culling.
+        UINT GetCandidateCount() const { return m_uCandidateCount; }
+        /// Current beam azimuth from the nose in degrees.
+        double GetBeamAzimuth() const { return m_Beam.GetAzimuth(); }
+
+        /// Drops all tracks, e.g. after the radar image is cleared.
+        void ClearTracks()
+        {
+            m_Tracks.clear();
+            m_vTrackFile.clear();
+            m_uTrackFileVersion++;
+        }
+
+    private:
+        static constexpr double FEET_PER_NM = 6076.12;
+        static constexpr double EARTH_RADIUS_FEET = 20902230.971;
+        /// Earth radius that accounts for standard atmospheric refraction of the radar beam.
+        static constexpr double EFFECTIVE_EARTH_RADIUS_FEET = EARTH_RADIUS_FEET * 4.0 / 3.0;
+        static constexpr double DEGREES_PER_RADIAN = 57.295779513082321;
+        static const UINT GRID_SIZE = 16;
+        static const UINT TARGETS_PER_TASK = 64;
+        static const UINT CONFIRM_HITS = 2;
+        static const UINT DROP_MISSES = 3;
+
+        struct ScanGeometry
+        {
+            LLA     vOrigin;
+            double  dHeading = 0.0;
+            double  dMinBearing = 0.0;
+            double  dMaxBearing = 0.0;
+            double  dRangeFeet = 0.0;
+            double  dHalfFront = 0.0;
+            double  dSideLimit = 0.0;
+            double  dBeamDepression = 0.0;
+            double  dHalfBeamWidth = 0.0;
+            double  dFeetPerRadianEast = 0.0;
+        };
+
+        struct Detection
+        {
+            bool    bDetected;
+            double  dRange;
+            double  dBearing;
+            double  dDepression;
+            float   fSignalDb;
+        };
+
+        static double WrapDegrees(double dDegrees)
+        {
+            return dDegrees - floor((dDegrees + 180.0) / 360.0) * 360.0;
+        }
+
+        /**
+        * Beam travel from the current azimuth to the radar's beam offset.  A travel of a whole scan or
+        * more covers every bearing and is kept.  An offset behind the beam is reached through the scan
+        * limit ahead, unless that is further than the sweep rate allows, in which case the beam turns.
+        */
+        double GetTravelTo(double dOffset, double dScanAzimuth, double dRateTravel)
+        {
+            if (dRateTravel >= 2.0 * dScanAzimuth)
+            {
+                return dRateTravel;
+            }
+            const double dFrom = m_Beam.GetAzimuth();
+            const bool bRight = m_Beam.IsSweepingRight();
+            if (bRight ? dOffset >= dFrom : dOffset <= dFrom)
+            {
+                return fabs(dOffset - dFrom);
+            }
+            const double dLimit = bRight ? dScanAzimuth : -dScanAzimuth;
+            const double dThroughLimit = fabs(dLimit - dFrom) + fabs(dLimit - dOffset);
+            if (dThroughLimit <= 1.5 * dRateTravel + 1.0)
+            {
+                return dThroughLimit;
+            }
+            m_Beam.SetAzimuth(dFrom, !bRight);
+            return fabs(dOffset - dFrom);
+        }
+
+        /// Bins the targets within range into a grid of east/north cells centered on the radar.
+        void BuildGrid()
+        {
+            const double dCell = 2.0 * m_Scan.dRangeFeet / GRID_SIZE;
+            m_vTargetCell.resize(m_vTargets.size());
+            m_vCellStarts.assign(GRID_SIZE * GRID_SIZE + 1, 0);
+            for (size_t i = 0; i < m_vTargets.size(); i++)
+            {
+                const LLA& vTarget = m_vTargets[i].vPosition;
+                const double dEast = WrapDegrees((vTarget.Lon - m_Scan.vOrigin.Lon) * DEGREES_PER_RADIAN) / DEGREES_PER_RADIAN * m_Scan.dFeetPerRadianEast;
+                const double dNorth = (vTarget.Lat - m_Scan.vOrigin.Lat) * EARTH_RADIUS_FEET;
+                const double dX = floor((dEast + m_Scan.dRangeFeet) / dCell);
+                const double dY = floor((dNorth + m_Scan.dRangeFeet) / dCell);
+                if (dX < 0.0 || dY < 0.0 || dX >= GRID_SIZE || dY >= GRID_SIZE)
+                {
+                    m_vTargetCell[i] = UINT_MAX;
+                    continue;
+                }
+                m_vTargetCell[i] = (UINT)dY * GRID_SIZE + (UINT)dX;
+                m_vCellStarts[m_vTargetCell[i] + 1]++;
+            }
+            for (UINT c = 0; c < GRID_SIZE * GRID_SIZE; c++)
+            {
+                m_vCellStarts[c + 1] += m_vCellStarts[c];
+            }
+            m_vCellTargets.resize(m_vCellStarts.back());
+            m_vCellFill.assign(m_vCellStarts.begin(), m_vCellStarts.end() - 1);
+            for (UINT i = 0; i < (UINT)m_vTargets.size(); i++)
+            {
+                if (m_vTargetCell[i] != UINT_MAX)
+                {
+                    m_vCellTargets[m_vCellFill[m_vTargetCell[i]]++] = i;
+                }
+            }
+        }
+
+        /// Collects the targets of the cells under the bounding box of the swept wedge.
+        void GatherCandidates()
+        {
+            // The wedge's extent is reached at its origin, its two edges, and any compass point between them.
+            double dMinEast = 0.0, dMaxEast = 0.0, dMinNorth = 0.0, dMaxNorth = 0.0;
+            auto extend = [&](double dBearing)
+            {
+                const double dTrue = (m_Scan.dHeading + dBearing) / DEGREES_PER_RADIAN;
+                const double dEast = sin(dTrue) * m_Scan.dRangeFeet;
+                const double dNorth = cos(dTrue) * m_Scan.dRangeFeet;
+                dMinEast = std::min(dMinEast, dEast);
+                dMaxEast = std::max(dMaxEast, dEast);
+                dMinNorth = std::min(dMinNorth, dNorth);
+                dMaxNorth = std::max(dMaxNorth, dNorth);
+            };
+            extend(m_Scan.dMinBearing);
+            extend(m_Scan.dMaxBearing);
+            for (double dCompass = ceil((m_Scan.dHeading + m_Scan.dMinBearing) / 90.0) * 90.0; dCompass < m_Scan.dHeading + m_Scan.dMaxBearing; dCompass += 90.0)
+            {
+                extend(dCompass - m_Scan.dHeading);
+            }
+
+            const double dCell = 2.0 * m_Scan.dRangeFeet / GRID_SIZE;
+            const UINT uMinX = (UINT)std::max(0.0, floor((dMinEast + m_Scan.dRangeFeet) / dCell));
+            const UINT uMaxX = (UINT)std::min(GRID_SIZE - 1.0, floor((dMaxEast + m_Scan.dRangeFeet) / dCell));
+            const UINT uMinY = (UINT)std::max(0.0, floor((dMinNorth + m_Scan.dRangeFeet) / dCell));
+            const UINT uMaxY = (UINT)std::min(GRID_SIZE - 1.0, floor((dMaxNorth + m_Scan.dRangeFeet) / dCell));
+
+            m_vCandidates.clear();
+            for (UINT y = uMinY; y <= uMaxY; y++)
+            {
+                const UINT uBegin = m_vCellStarts[y * GRID_SIZE + uMinX];
+                const UINT uEnd = m_vCellStarts[y * GRID_SIZE + uMaxX + 1];
+                m_vCandidates.insert(m_vCandidates.end(), m_vCellTargets.begin() + uBegin, m_vCellTargets.begin() + uEnd);
+            }
+            m_uCandidateCount = (UINT)m_vCandidates.size();
+        }
+
+        void DetectCandidates()
+        {
+            m_vDetections.resize(m_vCandidates.size());
+            const UINT uTaskCount = (UINT)((m_vCandidates.size() + TARGETS_PER_TASK - 1) / TARGETS_PER_TASK);
+            if (m_pPool == nullptr || uTaskCount <= 1)
+            {
+                for (UINT uTask = 0; uTask < uTaskCount; uTask++)
+                {
+                    DetectTask(this, uTask);
+                }
+                return;
+            }
+            m_vTasks.resize(uTaskCount);
+            for (UINT uTask = 0; uTask < uTaskCount; uTask++)
+            {
+                m_vTasks[uTask] = uTask;
+            }
+            m_pPool->Run(m_vTasks.data(), uTaskCount, &RadarContactDetector::DetectTask, this);
+        }
+
+        static void DetectTask(void* pContext, UINT uTask)
+        {
+            RadarContactDetector* pThis = static_cast<RadarContactDetector*>(pContext);
+            const UINT uEnd = std::min((UINT)pThis->m_vCandidates.size(), (uTask + 1) * TARGETS_PER_TASK);
+            for (UINT j = uTask * TARGETS_PER_TASK; j < uEnd; j++)
+            {
+                pThis->Detect(pThis->m_vTargets[pThis->m_vCandidates[j]], pThis->m_vDetections[j]);
+            }
+        }
+
+        /// Beam, blind spot, range and masking tests for one target.  Reads only shared state.
+        void Detect(const RadarTarget& target, Detection& result) const
+        {
+            result.bDetected = false;
+            const ScanGeometry& scan = m_Scan;
+            const double dEast = WrapDegrees((target.vPosition.Lon - scan.vOrigin.Lon) * DEGREES_PER_RADIAN) / DEGREES_PER_RADIAN * scan.dFeetPerRadianEast;
+            const double dNorth = (target.vPosition.Lat - scan.vOrigin.Lat) * EARTH_RADIUS_FEET;
+            const double dGround = sqrt(dEast * dEast + dNorth * dNorth);
+
+            result.dBearing = WrapDegrees(atan2(dEast, dNorth) * DEGREES_PER_RADIAN - scan.dHeading);
+            if (result.dBearing < scan.dMinBearing || result.dBearing > scan.dMaxBearing ||
+                fabs(result.dBearing) < scan.dHalfFront || fabs(result.dBearing) > scan.dSideLimit)
+            {
+                return;
+            }
+
+            // The earth falls away below a straight line of sight, lowering the target's apparent height.
+            const double dDrop = dGround * dGround / (2.0 * EFFECTIVE_EARTH_RADIUS_FEET);
+            const double dHeight = target.vPosition.Alt - scan.vOrigin.Alt - dDrop;
+            result.dRange = sqrt(dGround * dGround + dHeight * dHeight);
+            const double dRcs = std::max((double)target.fRcsSquareMeters, 1.0e-6);
+            const double dDetectionRange = std::min(scan.dRangeFeet, m_dReferenceFeet * sqrt(sqrt(dRcs)));
+            if (result.dRange > dDetectionRange || result.dRange < 1.0)
+            {
+                return;
+            }
+
+            result.dDepression = -atan2(dHeight, dGround) * DEGREES_PER_RADIAN;
+            if (fabs(result.dDepression - scan.dBeamDepression) > scan.dHalfBeamWidth)
+            {
+                return;
+            }
+
+            const double dHorizon = sqrt(2.0 * EFFECTIVE_EARTH_RADIUS_FEET * std::max(scan.vOrigin.Alt, 0.0)) +
+                                    sqrt(2.0 * EFFECTIVE_EARTH_RADIUS_FEET * std::max(target.vPosition.Alt, 0.0));
+            if (dGround > dHorizon || IsTerrainMasked(target.vPosition, dGround))
+            {
+                return;
+            }
+
+            result.fSignalDb = (float)(40.0 * log10(dDetectionRange / result.dRange));
+            result.bDetected = true;
+        }
+
+        /// Tests terrain at evenly spaced points against the line of sight, raised by the earth's bulge.
+        bool IsTerrainMasked(const LLA& vTarget, double dGround) const
+        {
+            if (m_pfnTerrain == nullptr)
+            {
+                return false;
+            }
+            const LLA& vOrigin = m_Scan.vOrigin;
+            const double dDeltaLon = WrapDegrees((vTarget.Lon - vOrigin.Lon) * DEGREES_PER_RADIAN) / DEGREES_PER_RADIAN;
+            for (UINT i = 1; i <= m_uTerrainSamples; i++)
+            {
+                const double dFraction = (double)i / (m_uTerrainSamples + 1);
+                const double dDistance = dFraction * dGround;
+                const double dSight = vOrigin.Alt + (vTarget.Alt - vOrigin.Alt) * dFraction -
+                                      dDistance * (dGround - dDistance) / (2.0 * EFFECTIVE_EARTH_RADIUS_FEET);
+                const double dTerrain = m_pfnTerrain(m_pTerrainContext, vOrigin.Lat + (vTarget.Lat - vOrigin.Lat) * dFraction, vOrigin.Lon + dDeltaLon * dFraction);
+                if (dTerrain > dSight)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void UpdateTracks()
+        {
+            for (UINT j = 0; j < (UINT)m_vCandidates.size(); j++)
+            {
+                const Detection& detection = m_vDetections[j];
+                if (!detection.bDetected)
+                {
+                    continue;
+                }
+                const RadarTarget& target = m_vTargets[m_vCandidates[j]];
+                auto it = m_Tracks.find(target.uObjectId);
+                if (it == m_Tracks.end())
+                {
+                    RadarTrack track = {};
+                    track.uObjectId = target.uObjectId;
+                    it = m_Tracks.emplace(target.uObjectId, track).first;
+                }
+                RadarTrack& track = it->second;
+                track.vPosition = target.vPosition;
+                track.dRangeFeet = detection.dRange;
+                track.dBearingDegrees = detection.dBearing;
+                track.dDepressionDegrees = detection.dDepression;
+                track.fSignalDb = detection.fSignalDb;
+                track.dLastDetection = m_dTime;
+                track.uHits++;
+                track.uMisses = 0;
+                track.bConfirmed = track.bConfirmed || track.uHits >= CONFIRM_HITS;
+            }
+
+            // A track whose bearing was swept without a detection missed a look.
+            for (auto it = m_Tracks.begin(); it != m_Tracks.end();)
+            {
+                RadarTrack& track = it->second;
+                if (track.dLastDetection != m_dTime && track.dBearingDegrees >= m_Scan.dMinBearing && track.dBearingDegrees <= m_Scan.dMaxBearing)
+                {
+                    track.uHits = 0;
+                    if (++track.uMisses >= DROP_MISSES)
+                    {
+                        it = m_Tracks.erase(it);
+                        continue;
+                    }
+                }
+                ++it;
+            }
+        }
+
+        /// Drops tracks not detected within the timeout, wherever their bearing lies.
+        void ExpireTracks(double dTimeout)
+        {
+            for (auto it = m_Tracks.begin(); it != m_Tracks.end();)
+            {
+                if (m_dTime - it->second.dLastDetection > dTimeout)
+                {
+                    it = m_Tracks.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+        }
+
+        void PublishTrackFile()
+        {
+            m_vTrackFile.clear();
+            for (const auto& entry : m_Tracks)
+            {
+                // Confirmed tracks stay in the file while coasting through missed looks.
+                if (entry.second.bConfirmed)
+                {
+                    m_vTrackFile.push_back(entry.second);
+                }
+            }
+            std::sort(m_vTrackFile.begin(), m_vTrackFile.end(), [](const RadarTrack& a, const RadarTrack& b) { return a.uObjectId < b.uObjectId; });
+            m_uTrackFileVersion++;
+        }
+
+        P3D::SimulationWorkerPool*          m_pPool;
+        std::vector<RadarTarget>            m_vTargets;
+        PTerrainFunc                        m_pfnTerrain = nullptr;
+        void*                               m_pTerrainContext = nullptr;
+        UINT                                m_uTerrainSamples = 8;
+        double                              m_dReferenceFeet = 50.0 * FEET_PER_NM;
+        double                              m_dBeamWidth = 20.0;
+        double                              m_dTrackTimeout = 0.0;
+        bool                                m_bCustomAngles = false;
+        double                              m_dCustomElevation = 0.0;
+        double                              m_dCustomFov = 0.0;
+        RadarBeam                           m_Beam;
+        ScanGeometry                        m_Scan;
+        double                              m_dTime = 0.0;
+
+        // Spatial grid, rebuilt each update.
+        std::vector<UINT>                   m_vTargetCell;
+        std::vector<UINT>                   m_vCellStarts;
+        std::vector<UINT>                   m_vCellFill;
+        std::vector<UINT>                   m_vCellTargets;
+
+        std::vector<UINT>                   m_vCandidates;
+        std::vector<Detection>              m_vDetections;
+        std::vector<UINT>                   m_vTasks;
+        UINT                                m_uCandidateCount = 0;
+
+        std::unordered_map<UINT, RadarTrack> m_Tracks;
+        std::vector<RadarTrack>             m_vTrackFile;
+        UINT64                              m_uTrackFileVersion = 0;
+    };
+    /** @} */
+}
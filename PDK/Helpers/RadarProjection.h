@@ -0,0 +1,589 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarProjection.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "ISimulatedRadar.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+#include <limits>
+
+namespace Radar
+{
+    /** @addtogroup radarService */ /** @{ */
+
+    /**
+    * Batched conversion between LLA and radar display coordinates.
+    * Capture() samples the radar's GetLLAFromGlobalXY(), GetGlobalXYCoord(), GetLLAFromLocalXY() and
+    * GetLocalXYCoord() over the display and fits a cubic polynomial to each direction, which captures
+    * the current origin, heading, range and zoom.  The batch methods then evaluate the polynomials
+    * two points per SSE2 lane over structure of arrays inputs, with no virtual calls per point, and
+    * convert the points the fit does not cover with the radar in a second pass.
+    * @remarks  Capture() checks the fit against the radar on a grid four times finer than the
+    *           samples.  If any differs by more than the tolerance, the batch methods call the radar
+    *           for every point instead, so results match the virtual methods within the tolerance.
+    * @remarks  The fit only covers the display the samples were taken over.  Display coordinates off
+    *           the display are converted by the radar.  A position is converted by the fit only if its
+    *           fitted display coordinates are on the display and convert back to the position; on a
+    *           rotated display this excludes the corners of the sampled span that lie off the display.
+    * @remarks  The LLA overloads copy the positions into arrays on the stack in blocks.  Longitudes are
+    *           expected within -PI to PI, as the simulation reports them.  Altitudes are only passed to
+    *           the radar, for the positions the fit does not cover.
+    * @remarks  The display moves with the aircraft, so capture again each frame or sweep, and before
+    *           the first use of the batch methods.
+    * Sample usage:
+    * ```
+    *      RadarProjection projection;
+    *
+    *      // Every sweep:
+    *      projection.Capture(spRadar);
+    *      projection.GetLocalXYCoords(vContactLat, vContactLon, vContactAlt, uContactCount, vX, vY);
+    * ```
+    */
+    class RadarProjection
+    {
+    public:
+        /**
+        * @param dToleranceXY   Largest display coordinate difference accepted from the fit, in the 0-1 units of the display.
+        * @param dToleranceFeet Largest horizontal position difference accepted from the fit.
+        */
+        explicit RadarProjection(__in double dToleranceXY = 1.0e-5, __in double dToleranceFeet = 1.0)
+            : m_dToleranceXY(dToleranceXY),
+              m_dToleranceFeet(dToleranceFeet)
+        {
+        }
+
+        /**
+        * Fits the current projections of the radar.
+        * @return   S_OK if the fitted projections match the radar, S_FALSE if the batch methods will call the
+        *           radar for each point, or E_INVALIDARG.
+        */
+        HRESULT Capture(__in __notnull ISimulatedRadarV500* pRadar)
+        {
+            if (pRadar == nullptr)
+            {
+                return E_INVALIDARG;
+            }
+            m_spRadar = pRadar;
+            const bool bGlobal = m_Global.Fit(pRadar, &ISimulatedRadarV500::GetLLAFromGlobalXY, &ISimulatedRadarV500::GetGlobalXYCoord, m_dToleranceXY, m_dToleranceFeet);
+            const bool bLocal = m_Local.Fit(pRadar, &ISimulatedRadarV500::GetLLAFromLocalXY, &ISimulatedRadarV500::GetLocalXYCoord, m_dToleranceXY, m_dToleranceFeet);
+            return bGlobal && bLocal ? S_OK : S_FALSE;
+        }
+
+        /**
+        * Batch GetGlobalXYCoord().
+        * @return   S_OK, or E_FAIL if Capture() has not been called.
+        */
+        HRESULT GetGlobalXYCoords(__in const double* pLat, __in const double* pLon, __in const double* pAlt, __in UINT uCount,
+                                  __out double* pX, __out double* pY) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Global.ToXY(m_spRadar, &ISimulatedRadarV500::GetGlobalXYCoord, pLat, pLon, pAlt, uCount, pX, pY);
+            return S_OK;
+        }
+
+        /**
+        * Batch GetLocalXYCoord().
+        * @return   S_OK, or E_FAIL if Capture() has not been called.
+        */
+        HRESULT GetLocalXYCoords(__in const double* pLat, __in const double* pLon, __in const double* pAlt, __in UINT uCount,
+                                 __out double* pX, __out double* pY) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Local.ToXY(m_spRadar, &ISimulatedRadarV500::GetLocalXYCoord, pLat, pLon, pAlt, uCount, pX, pY);
+            return S_OK;
+        }
+
+        /**
+        * Batch GetLLAFromGlobalXY().
+        * @return   S_OK, or E_FAIL if Capture() has not been called.
+        */
+        HRESULT GetLLAFromGlobalXY(__in const double* pX, __in const double* pY, __in UINT uCount, __out double* pLat, __out double* pLon,
+                                   __out double* pAlt) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Global.ToLLA(m_spRadar, &ISimulatedRadarV500::GetLLAFromGlobalXY, pX, pY, uCount, pLat, pLon, pAlt);
+            return S_OK;
+        }
+
+        /**
+        * Batch GetLLAFromLocalXY().
+        * @return   S_OK, or E_FAIL if Capture() has not been called.
+        */
+        HRESULT GetLLAFromLocalXY(__in const double* pX, __in const double* pY, __in UINT uCount, __out double* pLat, __out double* pLon,
+                                  __out double* pAlt) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Local.ToLLA(m_spRadar, &ISimulatedRadarV500::GetLLAFromLocalXY, pX, pY, uCount, pLat, pLon, pAlt);
+            return S_OK;
+        }
+
+        /// GetGlobalXYCoords() for an array of LLA.
+        HRESULT GetGlobalXYCoords(__in const LLA* pLLA, __in UINT uCount, __out double* pX, __out double* pY) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Global.ToXY(m_spRadar, &ISimulatedRadarV500::GetGlobalXYCoord, pLLA, uCount, pX, pY);
+            return S_OK;
+        }
+
+        /// GetLocalXYCoords() for an array of LLA.
+        HRESULT GetLocalXYCoords(__in const LLA* pLLA, __in UINT uCount, __out double* pX, __out double* pY) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Local.ToXY(m_spRadar, &ISimulatedRadarV500::GetLocalXYCoord, pLLA, uCount, pX, pY);
+            return S_OK;
+        }
+
+        /// GetLLAFromGlobalXY() into an array of LLA.
+        HRESULT GetLLAFromGlobalXY(__in const double* pX, __in const double* pY, __in UINT uCount, __out LLA* pLLA) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Global.ToLLA(m_spRadar, &ISimulatedRadarV500::GetLLAFromGlobalXY, pX, pY, uCount, pLLA);
+            return S_OK;
+        }
+
+        /// GetLLAFromLocalXY() into an array of LLA.
+        HRESULT GetLLAFromLocalXY(__in const double* pX, __in const double* pY, __in UINT uCount, __out LLA* pLLA) const
+        {
+            if (m_spRadar == nullptr)
+            {
+                return E_FAIL;
+            }
+            m_Local.ToLLA(m_spRadar, &ISimulatedRadarV500::GetLLAFromLocalXY, pX, pY, uCount, pLLA);
+            return S_OK;
+        }
+
+        /// True if the last Capture() fitted both projections within tolerance.
+        bool IsFitted() const { return m_Global.bFitted && m_Local.bFitted; }
+        /// Largest display coordinate difference found by the last Capture().
+        double GetErrorXY() const { return std::max(m_Global.dErrorXY, m_Local.dErrorXY); }
+        /// Largest position difference in feet found by the last Capture().
+        double GetErrorFeet() const { return std::max(m_Global.dErrorFeet, m_Local.dErrorFeet); }
+
+    private:
+        typedef void (ISimulatedRadarV500::*PToLLA)(LLA&, double, double) const;
+        typedef void (ISimulatedRadarV500::*PToXY)(double&, double&, const LLA&) const;
+
+        /// Samples per side of the fitting grid, and polynomial terms: 1, u, v, u^2, uv, v^2, u^3, u^2v, uv^2, v^3.
+        static const int GRID = 5;
+        static const int TERMS = 10;
+        /// Points per side of the grid Capture() checks the fit on.
+        static const int CHECK_GRID = 4 * (GRID - 1) + 1;
+
+        static void Terms(double dU, double dV, double* pTerms)
+        {
+            pTerms[0] = 1.0;
+            pTerms[1] = dU;
+            pTerms[2] = dV;
+            pTerms[3] = dU * dU;
+            pTerms[4] = dU * dV;
+            pTerms[5] = dV * dV;
+            pTerms[6] = dU * dU * dU;
+            pTerms[7] = dU * dU * dV;
+            pTerms[8] = dU * dV * dV;
+            pTerms[9] = dV * dV * dV;
+        }
+
+        /// Positions converted together by the LLA overloads.
+        static const UINT BLOCK = 64;
+
+        static double WrapRadians(double dRadians)
+        {
+            const double dPi = 3.14159265358979323846;
+            return dRadians - floor((dRadians + dPi) / (2.0 * dPi)) * 2.0 * dPi;
+        }
+
+        /// WrapRadians() of two angles within -3 PI to 3 PI, without a branch.
+        static __m128d WrapRadians(__m128d vRadians)
+        {
+            const __m128d vPi = _mm_set1_pd(3.14159265358979323846);
+            const __m128d vTwoPi = _mm_set1_pd(2.0 * 3.14159265358979323846);
+            vRadians = _mm_add_pd(vRadians, _mm_and_pd(_mm_cmplt_pd(vRadians, _mm_sub_pd(_mm_setzero_pd(), vPi)), vTwoPi));
+            return _mm_sub_pd(vRadians, _mm_and_pd(_mm_cmpge_pd(vRadians, vPi), vTwoPi));
+        }
+
+        static __m128d Abs(__m128d v)
+        {
+            return _mm_andnot_pd(_mm_set1_pd(-0.0), v);
+        }
+
+        /// True lanes where 0 <= v <= 1.
+        static __m128d InUnit(__m128d v)
+        {
+            return _mm_and_pd(_mm_cmpge_pd(v, _mm_setzero_pd()), _mm_cmple_pd(v, _mm_set1_pd(1.0)));
+        }
+
+        /// Evaluates the polynomial at two points, grouped as c0 + u(c1 + u(c3 + u c6 + v c7)) + v(c2 + v(c5 + v c9 + u c8)) + c4 u v.
+        static __m128d Evaluate(const double* pCoefficients, __m128d vU, __m128d vV)
+        {
+            const __m128d vUTerms = _mm_add_pd(_mm_set1_pd(pCoefficients[1]),
+                                               _mm_mul_pd(vU, _mm_add_pd(_mm_add_pd(_mm_set1_pd(pCoefficients[3]), _mm_mul_pd(vU, _mm_set1_pd(pCoefficients[6]))),
+                                                                         _mm_mul_pd(vV, _mm_set1_pd(pCoefficients[7])))));
+            const __m128d vVTerms = _mm_add_pd(_mm_set1_pd(pCoefficients[2]),
+                                               _mm_mul_pd(vV, _mm_add_pd(_mm_add_pd(_mm_set1_pd(pCoefficients[5]), _mm_mul_pd(vV, _mm_set1_pd(pCoefficients[9]))),
+                                                                         _mm_mul_pd(vU, _mm_set1_pd(pCoefficients[8])))));
+            return _mm_add_pd(_mm_add_pd(_mm_set1_pd(pCoefficients[0]), _mm_mul_pd(_mm_mul_pd(vU, vV), _mm_set1_pd(pCoefficients[4]))),
+                              _mm_add_pd(_mm_mul_pd(vU, vUTerms), _mm_mul_pd(vV, vVTerms)));
+        }
+
+        /// Keeps the lanes of v where vMask is set and makes the others NaN.
+        static __m128d SelectOrNaN(__m128d vMask, __m128d v)
+        {
+            return _mm_or_pd(_mm_and_pd(vMask, v), _mm_andnot_pd(vMask, _mm_set1_pd(std::numeric_limits<double>::quiet_NaN())));
+        }
+
+        /**
+        * Least squares fit of up to three outputs over sample points, by normal equations.
+        * @return   False if the samples do not determine the polynomial.
+        */
+        static bool Solve(const double (*pInputs)[2], const double (*pOutputs)[3], int iCount, int iOutputs, double (*pCoefficients)[TERMS])
+        {
+            double dMatrix[TERMS][TERMS + 3] = {};
+            for (int i = 0; i < iCount; i++)
+            {
+                double dTerms[TERMS];
+                Terms(pInputs[i][0], pInputs[i][1], dTerms);
+                for (int r = 0; r < TERMS; r++)
+                {
+                    for (int c = 0; c < TERMS; c++)
+                    {
+                        dMatrix[r][c] += dTerms[r] * dTerms[c];
+                    }
+                    for (int o = 0; o < iOutputs; o++)
+                    {
+                        dMatrix[r][TERMS + o] += dTerms[r] * pOutputs[i][o];
+                    }
+                }
+            }
+
+            // Gauss-Jordan elimination with partial pivoting.
+            for (int c = 0; c < TERMS; c++)
+            {
+                int iPivot = c;
+                for (int r = c + 1; r < TERMS; r++)
+                {
+                    if (fabs(dMatrix[r][c]) > fabs(dMatrix[iPivot][c]))
+                    {
+                        iPivot = r;
+                    }
+                }
+                if (fabs(dMatrix[iPivot][c]) < 1.0e-12)
+                {
+                    return false;
+                }
+                for (int k = 0; k < TERMS + 3; k++)
+                {
+                    std::swap(dMatrix[c][k], dMatrix[iPivot][k]);
+                }
+                for (int r = 0; r < TERMS; r++)
+                {
+                    if (r != c)
+                    {
+                        const double dScale = dMatrix[r][c] / dMatrix[c][c];
+                        for (int k = c; k < TERMS + 3; k++)
+                        {
+                            dMatrix[r][k] -= dScale * dMatrix[c][k];
+                        }
+                    }
+                }
+            }
+            for (int o = 0; o < iOutputs; o++)
+            {
+                for (int r = 0; r < TERMS; r++)
+                {
+                    pCoefficients[o][r] = dMatrix[r][TERMS + o] / dMatrix[r][r];
+                }
+            }
+            return true;
+        }
+
+        /// Fitted forward and inverse polynomials of one display.
+        struct Mapping
+        {
+            // LLA to XY works in scaled east/north angles around the display center.
+            double  dLat0 = 0.0;
+            double  dLon0 = 0.0;
+            double  dCosLat0 = 1.0;
+            double  dInvSpan = 1.0;
+            double  dToX[TERMS] = {};
+            double  dToY[TERMS] = {};
+            // XY to LLA works in display coordinates mapped to [-1, 1].
+            double  dToLat[TERMS] = {};
+            double  dToLon[TERMS] = {};
+            double  dToAlt[TERMS] = {};
+            double  dRoundTrip = 0.0;   ///< Largest difference in scaled angles accepted converting fitted XY back
+            bool    bFitted = false;
+            double  dErrorXY = 0.0;
+            double  dErrorFeet = 0.0;
+
+            bool Fit(ISimulatedRadarV500* pRadar, PToLLA pfnToLLA, PToXY pfnToXY, double dToleranceXY, double dToleranceFeet)
+            {
+                bFitted = false;
+                dErrorXY = dErrorFeet = 0.0;
+
+                LLA center;
+                (pRadar->*pfnToLLA)(center, 0.5, 0.5);
+                dLat0 = center.Lat;
+                dLon0 = center.Lon;
+                dCosLat0 = cos(center.Lat);
+
+                LLA samples[GRID * GRID];
+                double dXY[GRID * GRID][2];
+                double dAngles[GRID * GRID][2];
+                double dSpan = 0.0;
+                for (int i = 0; i < GRID * GRID; i++)
+                {
+                    dXY[i][0] = (double)(i % GRID) / (GRID - 1);
+                    dXY[i][1] = (double)(i / GRID) / (GRID - 1);
+                    (pRadar->*pfnToLLA)(samples[i], dXY[i][0], dXY[i][1]);
+                    dAngles[i][0] = WrapRadians(samples[i].Lon - dLon0) * dCosLat0;
+                    dAngles[i][1] = samples[i].Lat - dLat0;
+                    dSpan = std::max(dSpan, std::max(fabs(dAngles[i][0]), fabs(dAngles[i][1])));
+                }
+                if (!(dSpan > 0.0))
+                {
+                    return false;
+                }
+                dInvSpan = 1.0 / dSpan;
+
+                double dInputs[GRID * GRID][2];
+                double dOutputs[GRID * GRID][3];
+                for (int i = 0; i < GRID * GRID; i++)
+                {
+                    dAngles[i][0] *= dInvSpan;
+                    dAngles[i][1] *= dInvSpan;
+                    dInputs[i][0] = dXY[i][0] * 2.0 - 1.0;
+                    dInputs[i][1] = dXY[i][1] * 2.0 - 1.0;
+                    dOutputs[i][0] = samples[i].Lat - dLat0;
+                    dOutputs[i][1] = WrapRadians(samples[i].Lon - dLon0);
+                    dOutputs[i][2] = samples[i].Alt;
+                }
+                double dLLACoefficients[3][TERMS];
+                if (!Solve(dInputs, dOutputs, GRID * GRID, 3, dLLACoefficients))
+                {
+                    return false;
+                }
+                std::copy(dLLACoefficients[0], dLLACoefficients[0] + TERMS, dToLat);
+                std::copy(dLLACoefficients[1], dLLACoefficients[1] + TERMS, dToLon);
+                std::copy(dLLACoefficients[2], dLLACoefficients[2] + TERMS, dToAlt);
+
+                for (int i = 0; i < GRID * GRID; i++)
+                {
+                    dOutputs[i][0] = dXY[i][0];
+                    dOutputs[i][1] = dXY[i][1];
+                }
+                double dXYCoefficients[2][TERMS];
+                if (!Solve(dAngles, dOutputs, GRID * GRID, 2, dXYCoefficients))
+                {
+                    return false;
+                }
+                std::copy(dXYCoefficients[0], dXYCoefficients[0] + TERMS, dToX);
+                std::copy(dXYCoefficients[1], dXYCoefficients[1] + TERMS, dToY);
+
+                // A fitted XY within tolerance converts back within the tolerances of both directions, with
+                // the display spanning about 2 / dInvSpan in scaled angles.  Twice that allows for both errors.
+                const double dFeetPerRadian = 20902230.971;
+                dRoundTrip = 2.0 * (dToleranceFeet / dFeetPerRadian * dInvSpan + dToleranceXY * 2.0);
+
+                // Check both directions against the radar on a grid through the samples, between them and
+                // along the display edges, where the cubic is least constrained.
+                for (int i = 0; i < CHECK_GRID * CHECK_GRID; i++)
+                {
+                    const double dX = (double)(i % CHECK_GRID) / (CHECK_GRID - 1);
+                    const double dY = (double)(i / CHECK_GRID) / (CHECK_GRID - 1);
+                    LLA expected, fitted;
+                    (pRadar->*pfnToLLA)(expected, dX, dY);
+                    __m128d vLat, vLon, vAlt;
+                    ProjectLLA(_mm_set1_pd(dX), _mm_set1_pd(dY), vLat, vLon, vAlt);
+                    fitted.Lat = _mm_cvtsd_f64(vLat);
+                    fitted.Lon = _mm_cvtsd_f64(vLon);
+                    fitted.Alt = _mm_cvtsd_f64(vAlt);
+                    const double dNorth = (fitted.Lat - expected.Lat) * dFeetPerRadian;
+                    const double dEast = WrapRadians(fitted.Lon - expected.Lon) * dFeetPerRadian * dCosLat0;
+                    dErrorFeet = std::max(dErrorFeet, std::max(sqrt(dNorth * dNorth + dEast * dEast), fabs(fitted.Alt - expected.Alt)));
+
+                    // Positions the fit does not cover are never evaluated with it.
+                    __m128d vX, vY;
+                    ProjectXY(_mm_set1_pd(expected.Lat), _mm_set1_pd(expected.Lon), vX, vY);
+                    const double dFittedX = _mm_cvtsd_f64(vX);
+                    const double dFittedY = _mm_cvtsd_f64(vY);
+                    if (dFittedX == dFittedX)
+                    {
+                        double dExpectedX, dExpectedY;
+                        (pRadar->*pfnToXY)(dExpectedX, dExpectedY, expected);
+                        dErrorXY = std::max(dErrorXY, std::max(fabs(dFittedX - dExpectedX), fabs(dFittedY - dExpectedY)));
+                    }
+                }
+                bFitted = dErrorXY <= dToleranceXY && dErrorFeet <= dToleranceFeet;
+                return bFitted;
+            }
+
+            /**
+            * Fitted display coordinates of two positions.  vX is NaN in lanes the fit does not cover: positions
+            * outside the sampled span, off the display, or whose display coordinates do not convert back.
+            */
+            void ProjectXY(__m128d vLat, __m128d vLon, __m128d& vX, __m128d& vY) const
+            {
+                const __m128d vLonOffset = WrapRadians(_mm_sub_pd(vLon, _mm_set1_pd(dLon0)));
+                const __m128d vU = _mm_mul_pd(vLonOffset, _mm_set1_pd(dCosLat0 * dInvSpan));
+                const __m128d vV = _mm_mul_pd(_mm_sub_pd(vLat, _mm_set1_pd(dLat0)), _mm_set1_pd(dInvSpan));
+                vX = Evaluate(dToX, vU, vV);
+                vY = Evaluate(dToY, vU, vV);
+
+                const __m128d vTwo = _mm_set1_pd(2.0);
+                const __m128d vOne = _mm_set1_pd(1.0);
+                const __m128d vS = _mm_sub_pd(_mm_mul_pd(vX, vTwo), vOne);
+                const __m128d vT = _mm_sub_pd(_mm_mul_pd(vY, vTwo), vOne);
+                const __m128d vBackU = _mm_mul_pd(Evaluate(dToLon, vS, vT), _mm_set1_pd(dCosLat0 * dInvSpan));
+                const __m128d vBackV = _mm_mul_pd(Evaluate(dToLat, vS, vT), _mm_set1_pd(dInvSpan));
+                const __m128d vRoundTrip = _mm_set1_pd(dRoundTrip);
+
+                __m128d vCovered = _mm_and_pd(_mm_cmple_pd(Abs(vU), vOne), _mm_cmple_pd(Abs(vV), vOne));
+                vCovered = _mm_and_pd(vCovered, _mm_and_pd(InUnit(vX), InUnit(vY)));
+                vCovered = _mm_and_pd(vCovered, _mm_and_pd(_mm_cmple_pd(Abs(_mm_sub_pd(vBackU, vU)), vRoundTrip),
+                                                           _mm_cmple_pd(Abs(_mm_sub_pd(vBackV, vV)), vRoundTrip)));
+                vX = SelectOrNaN(vCovered, vX);
+            }
+
+            /// Fitted positions of two display coordinates.  vLat is NaN in lanes off the display.
+            void ProjectLLA(__m128d vX, __m128d vY, __m128d& vLat, __m128d& vLon, __m128d& vAlt) const
+            {
+                const __m128d vTwo = _mm_set1_pd(2.0);
+                const __m128d vOne = _mm_set1_pd(1.0);
+                const __m128d vU = _mm_sub_pd(_mm_mul_pd(vX, vTwo), vOne);
+                const __m128d vV = _mm_sub_pd(_mm_mul_pd(vY, vTwo), vOne);
+                vLat = SelectOrNaN(_mm_and_pd(InUnit(vX), InUnit(vY)), _mm_add_pd(_mm_set1_pd(dLat0), Evaluate(dToLat, vU, vV)));
+                vLon = WrapRadians(_mm_add_pd(_mm_set1_pd(dLon0), Evaluate(dToLon, vU, vV)));
+                vAlt = Evaluate(dToAlt, vU, vV);
+            }
+
+            void ToXY(ISimulatedRadarV500* pRadar, PToXY pfnToXY, const double* pLat, const double* pLon, const double* pAlt, UINT uCount,
+                      double* pX, double* pY) const
+            {
+                if (bFitted)
+                {
+                    // Two positions per lane, marking the ones the fit does not cover.
+                    UINT i = 0;
+                    __m128d vX, vY;
+                    for (; i + 2 <= uCount; i += 2)
+                    {
+                        ProjectXY(_mm_loadu_pd(pLat + i), _mm_loadu_pd(pLon + i), vX, vY);
+                        _mm_storeu_pd(pX + i, vX);
+                        _mm_storeu_pd(pY + i, vY);
+                    }
+                    if (i < uCount)
+                    {
+                        ProjectXY(_mm_set1_pd(pLat[i]), _mm_set1_pd(pLon[i]), vX, vY);
+                        _mm_store_sd(pX + i, vX);
+                        _mm_store_sd(pY + i, vY);
+                    }
+                }
+                for (UINT i = 0; i < uCount; i++)
+                {
+                    if (!bFitted || pX[i] != pX[i])
+                    {
+                        (pRadar->*pfnToXY)(pX[i], pY[i], LLA(pLat[i], pLon[i], pAlt[i]));
+                    }
+                }
+            }
+
+            void ToLLA(ISimulatedRadarV500* pRadar, PToLLA pfnToLLA, const double* pX, const double* pY, UINT uCount, double* pLat, double* pLon,
+                       double* pAlt) const
+            {
+                if (bFitted)
+                {
+                    UINT i = 0;
+                    __m128d vLat, vLon, vAlt;
+                    for (; i + 2 <= uCount; i += 2)
+                    {
+                        ProjectLLA(_mm_loadu_pd(pX + i), _mm_loadu_pd(pY + i), vLat, vLon, vAlt);
+                        _mm_storeu_pd(pLat + i, vLat);
+                        _mm_storeu_pd(pLon + i, vLon);
+                        _mm_storeu_pd(pAlt + i, vAlt);
+                    }
+                    if (i < uCount)
+                    {
+                        ProjectLLA(_mm_set1_pd(pX[i]), _mm_set1_pd(pY[i]), vLat, vLon, vAlt);
+                        _mm_store_sd(pLat + i, vLat);
+                        _mm_store_sd(pLon + i, vLon);
+                        _mm_store_sd(pAlt + i, vAlt);
+                    }
+                }
+                for (UINT i = 0; i < uCount; i++)
+                {
+                    if (!bFitted || pLat[i] != pLat[i])
+                    {
+                        LLA lla;
+                        (pRadar->*pfnToLLA)(lla, pX[i], pY[i]);
+                        pLat[i] = lla.Lat;
+                        pLon[i] = lla.Lon;
+                        pAlt[i] = lla.Alt;
+                    }
+                }
+            }
+
+            void ToXY(ISimulatedRadarV500* pRadar, PToXY pfnToXY, const LLA* pLLA, UINT uCount, double* pX, double* pY) const
+            {
+                double dLat[BLOCK], dLon[BLOCK], dAlt[BLOCK];
+                for (UINT uFirst = 0; uFirst < uCount; uFirst += BLOCK)
+                {
+                    const UINT uBlock = uCount - uFirst < BLOCK ? uCount - uFirst : BLOCK;
+                    for (UINT k = 0; k < uBlock; k++)
+                    {
+                        dLat[k] = pLLA[uFirst + k].Lat;
+                        dLon[k] = pLLA[uFirst + k].Lon;
+                        dAlt[k] = pLLA[uFirst + k].Alt;
+                    }
+                    ToXY(pRadar, pfnToXY, dLat, dLon, dAlt, uBlock, pX + uFirst, pY + uFirst);
+                }
+            }
+
+            void ToLLA(ISimulatedRadarV500* pRadar, PToLLA pfnToLLA, const double* pX, const double* pY, UINT uCount, LLA* pLLA) const
+            {
+                double dLat[BLOCK], dLon[BLOCK], dAlt[BLOCK];
+                for (UINT uFirst = 0; uFirst < uCount; uFirst += BLOCK)
+                {
+                    const UINT uBlock = uCount - uFirst < BLOCK ? uCount - uFirst : BLOCK;
+                    ToLLA(pRadar, pfnToLLA, pX + uFirst, pY + uFirst, uBlock, dLat, dLon, dAlt);
+                    for (UINT k = 0; k < uBlock; k++)
+                    {
+                        pLLA[uFirst + k] = LLA(dLat[k], dLon[k], dAlt[k]);
+                    }
+                }
+            }
+        };
+
+        const double                    m_dToleranceXY;
+        const double                    m_dToleranceFeet;
+        CComPtr<ISimulatedRadarV500>    m_spRadar;
+        Mapping                         m_Global;
+        Mapping                         m_Local;
+    };
+    /** @} */
+}
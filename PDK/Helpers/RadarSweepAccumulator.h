@@ -0,0 +1,267 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarSweepAccumulator.h
+
+#pragma once
+#include <ObjBase.h>
+#include "ISimulatedRadar.h"
+#include "RadarBeam.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace Radar
+{
+    /** @addtogroup radarService */ /** @{ */
+
+    /**
+    * Sweep incremental accumulation buffer for custom radar scopes.
+    * The buffer is a polar image of azimuth columns by range bins spanning the radar's scan azimuth
+    * and range.  Each Update() advances the beam by the sweep rate, back and forth between the scan
+    * limits, and asks the caller for returns only for the columns swept since the previous update.
+    * Columns are stored contiguously, so a sweep wedge is a contiguous block of memory.
+    * @remarks  Intensities are 16 bit fixed point.  Persistence is applied lazily: each column records
+    *           when it was last painted and its decay is computed once per column when it is painted
+    *           again or resolved, so columns outside the wedge are never touched by Update().  A
+    *           painted bin keeps the larger of its decayed value and the new return.
+    * @remarks  The beam is stepped by RadarBeam.  A move that ends exactly on a scan limit turns the beam
+    *           around, so the next Update() sweeps away from the limit instead of repainting its column.
+    * @remarks  Changing the scan azimuth, range or data zoom moves what every column represents, so
+    *           Update() clears the buffer when any of them change, as the radar clears its own image.
+    * Sample usage:
+    * ```
+    *      static void SampleColumn(void* pContext, double dAzimuthDegrees, USHORT* pBins, UINT uBinCount)
+    *      {
+    *          // Fill pBins[0] (nearest) to pBins[uBinCount - 1] (maximum range) with returns, 0-65535.
+    *      }
+    *
+    *      RadarSweepAccumulator accumulator(256, 256);
+    *      accumulator.SetPersistence(4.0);
+    *
+    *      // Every gauge update:
+    *      accumulator.Update(spRadar, dElapsedSeconds, SampleColumn, this);
+    *      accumulator.Resolve(pTextureBits, uTexturePitch);
+    * ```
+    */
+    class RadarSweepAccumulator
+    {
+    public:
+        /// Fills the range bins of one azimuth column with new returns.  pBins holds the column's decayed values on entry.
+        typedef void (*PSampleFunc)(void* pContext, double dAzimuthDegrees, USHORT* pBins, UINT uBinCount);
+
+        /**
+        * @param uAzimuthBins   Number of azimuth columns across the scan.
+        * @param uRangeBins     Number of range bins per column.
+        */
+        RadarSweepAccumulator(__in UINT uAzimuthBins, __in UINT uRangeBins)
+            : m_uAzimuthBins(std::max(uAzimuthBins, 1u)),
+              m_uRangeBins(std::max(uRangeBins, 1u)),
+              m_vBins((size_t)m_uAzimuthBins * m_uRangeBins),
+              m_vPaintTime(m_uAzimuthBins),
+              m_vSample(m_uRangeBins)
+        {
+            Clear();
+        }
+
+        /**
+        * Sets how long returns persist.
+        * @param dHalfLifeSeconds   Time for a return to fade to half intensity.  0 or less keeps returns until cleared.
+        */
+        void SetPersistence(__in double dHalfLifeSeconds)
+        {
+            m_dHalfLife = dHalfLifeSeconds;
+        }
+
+        /// Clears all returns.  Call along with ISimulatedRadarV500::ClearRadarImage().
+        void Clear()
+        {
+            std::fill(m_vBins.begin(), m_vBins.end(), (USHORT)0);
+            std::fill(m_vPaintTime.begin(), m_vPaintTime.end(), m_dTime);
+        }
+
+        /**
+        * Advances the beam using the radar's current scan settings and paints the swept columns.
+        * @param pRadar             Radar service.
+        * @param dElapsedSeconds    Time since the previous update.
+        * @param pfnSample          Called once per swept column.
+        * @param pContext           Passed to pfnSample.
+        * @return                   S_OK if columns were painted, S_FALSE if the radar is frozen or not sweeping,
+        *                           or E_INVALIDARG.
+        */
+        HRESULT Update(__in __notnull ISimulatedRadarV500* pRadar, __in double dElapsedSeconds, __in __notnull PSampleFunc pfnSample, __in void* pContext)
+        {
+            if (pRadar == nullptr)
+            {
+                return E_INVALIDARG;
+            }
+
+            const double dRange = pRadar->GetRangeMiles();
+            const double dDataZoom = pRadar->GetDataZoom();
+            if (dRange != m_dRangeMiles || dDataZoom != m_dDataZoom)
+            {
+                m_dRangeMiles = dRange;
+                m_dDataZoom = dDataZoom;
+                Clear();
+            }
+            if (pRadar->FreezeEnabled())
+            {
+                m_uFirstSwept = m_uSweptCount = 0;
+                return S_FALSE;
+            }
+            return Update(pRadar->GetScanAzimuth(), pRadar->GetSweepRate(), dElapsedSeconds, pfnSample, pContext);
+        }
+
+        /**
+        * Advances the beam with explicit scan settings and paints the swept columns.
+        * @param dScanAzimuth       Maximum deviation of the beam from center in degrees.
+        * @param dSweepRate         Beam rate in degrees per second.
+        * @param dElapsedSeconds    Time since the previous update.
+        * @param pfnSample          Called once per swept column.
+        * @param pContext           Passed to pfnSample.
+        * @return                   S_OK if columns were painted, S_FALSE if the beam did not move, or E_INVALIDARG.
+        */
+        HRESULT Update(__in double dScanAzimuth, __in double dSweepRate, __in double dElapsedSeconds, __in __notnull PSampleFunc pfnSample, __in void* pContext)
+        {
+            if (pfnSample == nullptr || !(dScanAzimuth > 0.0) || !(dElapsedSeconds >= 0.0))
+            {
+                return E_INVALIDARG;
+            }
+            if (dScanAzimuth != m_dScanAzimuth)
+            {
+                m_dScanAzimuth = dScanAzimuth;
+                m_Beam.Clamp(dScanAzimuth);
+                Clear();
+            }
+
+            m_dTime += dElapsedSeconds;
+            m_uFirstSwept = m_uSweptCount = 0;
+            const double dTravel = fabs(dSweepRate) * dElapsedSeconds;
+            if (dTravel <= 0.0)
+            {
+                return S_FALSE;
+            }
+
+            double dMin, dMax;
+            m_Beam.Advance(dScanAzimuth, dTravel, dMin, dMax);
+
+            m_uFirstSwept = AzimuthToColumn(dMin);
+            m_uSweptCount = AzimuthToColumn(dMax) - m_uFirstSwept + 1;
+            for (UINT uColumn = m_uFirstSwept; uColumn < m_uFirstSwept + m_uSweptCount; uColumn++)
+            {
+                PaintColumn(uColumn, pfnSample, pContext);
+            }
+            return S_OK;
+        }
+
+        /**
+        * Writes the decayed buffer as an 8 bit image, azimuth left to right and maximum range at the top.
+        * @param pImage     Image of GetAzimuthBins() x GetRangeBins() pixels.
+        * @param uPitch     Bytes per image row.
+        */
+        void Resolve(__out BYTE* pImage, __in UINT uPitch) const
+        {
+            // Columns are resolved in blocks so the image is written a row segment at a time while the
+            // block's columns stay in cache, rather than one byte per image row.
+            UINT uGains[RESOLVE_BLOCK];
+            for (UINT uBlock = 0; uBlock < m_uAzimuthBins; uBlock += RESOLVE_BLOCK)
+            {
+                const UINT uColumns = m_uAzimuthBins - uBlock < RESOLVE_BLOCK ? m_uAzimuthBins - uBlock : RESOLVE_BLOCK;
+                for (UINT k = 0; k < uColumns; k++)
+                {
+                    uGains[k] = GetGain(uBlock + k);
+                }
+                const USHORT* pBins = &m_vBins[(size_t)uBlock * m_uRangeBins];
+                BYTE* pRow = pImage + (size_t)(m_uRangeBins - 1) * uPitch + uBlock;
+                for (UINT uBin = 0; uBin < m_uRangeBins; uBin++, pRow -= uPitch)
+                {
+                    for (UINT k = 0; k < uColumns; k++)
+                    {
+                        pRow[k] = (BYTE)((pBins[(size_t)k * m_uRangeBins + uBin] * uGains[k]) >> 24);
+                    }
+                }
+            }
+        }
+
+        /**
+        * Gets a column's bins with decay applied.
+        * @param uColumn    Azimuth column.
+        * @param pBins      Receives GetRangeBins() values, nearest first.
+        */
+        void GetColumn(__in UINT uColumn, __out USHORT* pBins) const
+        {
+            const UINT uGain = GetGain(uColumn);
+            const USHORT* pSource = &m_vBins[(size_t)uColumn * m_uRangeBins];
+            for (UINT uBin = 0; uBin < m_uRangeBins; uBin++)
+            {
+                pBins[uBin] = (USHORT)((pSource[uBin] * uGain) >> 16);
+            }
+        }
+
+        /// Columns painted by the last Update(), for uploading only the changed part of a texture.
+        void GetSweptColumns(__out UINT& uFirst, __out UINT& uCount) const
+        {
+            uFirst = m_uFirstSwept;
+            uCount = m_uSweptCount;
+        }
+
+        /// Current beam angle from center in degrees.
+        double GetBeamAzimuth() const { return m_Beam.GetAzimuth(); }
+        /// Moves the beam, e.g. to follow ISimulatedRadarV500::GetCurrentRadarBeamOffsetDegrees().
+        void SetBeamAzimuth(__in double dDegrees, __in bool bSweepingRight) { m_Beam.SetAzimuth(dDegrees, bSweepingRight); }
+        UINT GetAzimuthBins() const { return m_uAzimuthBins; }
+        UINT GetRangeBins() const { return m_uRangeBins; }
+
+    private:
+        /// Columns resolved together by Resolve().
+        static const UINT RESOLVE_BLOCK = 16;
+
+        UINT AzimuthToColumn(double dAzimuth) const
+        {
+            const double dColumn = (dAzimuth + m_dScanAzimuth) / (2.0 * m_dScanAzimuth) * m_uAzimuthBins;
+            return (UINT)std::max(0.0, std::min(dColumn, m_uAzimuthBins - 1.0));
+        }
+
+        /// Decay of a column since it was painted, 16.16 fixed point.
+        UINT GetGain(UINT uColumn) const
+        {
+            if (m_dHalfLife <= 0.0)
+            {
+                return 0x10000;
+            }
+            const double dAge = std::max(m_dTime - m_vPaintTime[uColumn], 0.0);
+            return (UINT)(65536.0 * exp2(-dAge / m_dHalfLife) + 0.5);
+        }
+
+        void PaintColumn(UINT uColumn, PSampleFunc pfnSample, void* pContext)
+        {
+            GetColumn(uColumn, m_vSample.data());
+            USHORT* pBins = &m_vBins[(size_t)uColumn * m_uRangeBins];
+            std::copy(m_vSample.begin(), m_vSample.end(), pBins);
+
+            const double dAzimuth = ((uColumn + 0.5) / m_uAzimuthBins * 2.0 - 1.0) * m_dScanAzimuth;
+            pfnSample(pContext, dAzimuth, m_vSample.data(), m_uRangeBins);
+            for (UINT uBin = 0; uBin < m_uRangeBins; uBin++)
+            {
+                pBins[uBin] = std::max(pBins[uBin], m_vSample[uBin]);
+            }
+            m_vPaintTime[uColumn] = m_dTime;
+        }
+
+        const UINT              m_uAzimuthBins;
+        const UINT              m_uRangeBins;
+        std::vector<USHORT>     m_vBins;        ///< Column major, m_uRangeBins per column
+        std::vector<double>     m_vPaintTime;
+        std::vector<USHORT>     m_vSample;
+        double                  m_dHalfLife = 0.0;
+        double                  m_dTime = 0.0;
+        double                  m_dScanAzimuth = 0.0;
+        double                  m_dRangeMiles = 0.0;
+        double                  m_dDataZoom = 0.0;
+        RadarBeam               m_Beam;
+        UINT                    m_uFirstSwept = 0;
+        UINT                    m_uSweptCount = 0;
+    };
+    /** @} */
+}
@@ -0,0 +1,511 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RecordingCatalog.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "IRecordingService.h"
+#include "RecordingIndex.h"
+#include "SimulationWorkerPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup recordingservice */ /** @{ */
+
+    /// A recording in a RecordingCatalog.  Strings are offsets into the catalog string table.
+    struct RecordingCatalogEntry
+    {
+        UINT64  uSize;              ///< File size when the entry was read
+        UINT64  uWriteTime;         ///< File last write time (FILETIME) when the entry was read
+        INT64   iStartTime;         ///< IRecordingDataV510::GetStartTime()
+        INT64   iEndTime;           ///< IRecordingDataV510::GetEndTime()
+        double  dDuration;          ///< IRecordingDataV510::GetDuration()
+        UINT32  uPath;              ///< Full path of the recording
+        UINT32  uTitle;             ///< IRecordingDataV510::GetTitle()
+        UINT32  uDescription;       ///< IRecordingDataV510::GetDescription()
+        UINT32  uFirstBookmark;     ///< Index of the first bookmark in the catalog bookmark table
+        UINT32  uBookmarkCount;     ///< IRecordingDataV510::GetBookmarkCount()
+        UINT32  uReserved;
+    };
+
+    /// Work done by the last RecordingCatalog::Scan().
+    struct RecordingCatalogStats
+    {
+        UINT    uFiles = 0;         ///< Recordings found in the directory
+        UINT    uCached = 0;        ///< Recordings unchanged since the previous scan
+        UINT    uFromIndex = 0;     ///< Recordings read from a current RecordingIndex sidecar file
+        UINT    uQueried = 0;       ///< Recordings read with IRecordingServiceV510::GetRecordingData()
+        UINT    uFailed = 0;        ///< Recordings that could not be read and were left out
+    };
+
+    /**
+    * Compact catalog of the recordings in an archive directory: title, description, duration, start and
+    * end time and bookmarks, held in flat tables with a shared string table so the whole catalog can be
+    * saved and loaded with a single read or write.
+    * Scan() only reads recordings whose size or last write time changed since they were cataloged.  A
+    * changed recording is read from its RecordingIndex sidecar (the recording path followed by
+    * INDEX_EXTENSION) when one is current; sidecars are mapped in parallel on an optional worker pool.
+    * Only recordings without a sidecar fall back to IRecordingServiceV510::GetRecordingData() and the
+    * per-bookmark GetBookmarkData() queries, which are made on the calling thread.
+    * @remarks  Bookmark seconds are only known for recordings read from a sidecar, since timestamps can
+    *           not be converted outside recording or playback.  Other bookmarks have dSeconds set to -1
+    *           and are played back by index.
+    * Sample usage:
+    * ```
+    *      RecordingCatalog catalog;
+    *      catalog.Load(pszCatalogPath);
+    *      catalog.Scan(pszArchiveDirectory, pszRecordingPattern, spRecordingService, &workerPool);
+    *      catalog.Save(pszCatalogPath);
+    *
+    *      for (UINT32 i = 0; i < catalog.GetEntryCount(); i++)
+    *      {
+    *          AddRow(catalog.GetTitle(i), catalog.GetEntry(i).dDuration);
+    *      }
+    * ```
+    */
+    class RecordingCatalog
+    {
+    public:
+        static const UINT32 MAGIC = 0x54414352;     // "RCAT"
+        static const UINT32 VERSION = 2;         // 2: entries sorted by case-insensitive path
+
+        /// Appended to a recording path to name its RecordingIndex sidecar.
+        static LPCWSTR GetIndexExtension() { return L".ridx"; }
+
+        RecordingCatalog()
+        {
+            Clear();
+        }
+
+        void Clear()
+        {
+            m_vEntries.clear();
+            m_vBookmarks.clear();
+            m_vStrings.clear();
+            m_vStrings.push_back(L'\0');    // Offset 0 is the empty string
+        }
+
+        /**
+        * Updates the catalog from the recordings matching a pattern in a directory.  Recordings that
+        * no longer exist are removed.
+        * @param pszDirectory   Archive directory, without a trailing separator.
+        * @param pszPattern     File pattern of the recordings, as accepted by FindFirstFileW().
+        * @param pService       Service used to read recordings without a current sidecar, or nullptr to skip them.
+        * @param pPool          Optional pool used to read sidecars in parallel.
+        * @return               S_OK, S_FALSE if some recordings could not be read, or E_FAIL if the directory could not be listed.
+        */
+        HRESULT Scan(__in LPCWSTR pszDirectory, __in LPCWSTR pszPattern, __in IRecordingServiceV510* pService,
+                     __in SimulationWorkerPool* pPool = nullptr)
+        {
+            m_Stats = RecordingCatalogStats();
+
+            std::vector<FoundFile> vFiles;
+            HRESULT hr = ListFiles(pszDirectory, pszPattern, vFiles);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            m_Stats.uFiles = (UINT)vFiles.size();
+
+            // Recordings that changed since the last scan.
+            std::vector<ScannedRecording> vScanned;
+            std::vector<UINT> vTasks;
+            std::vector<UINT32> vCached(vFiles.size(), UINT32_MAX);
+            for (size_t i = 0; i < vFiles.size(); i++)
+            {
+                UINT32 uEntry = 0;
+                if (FindEntry(vFiles[i].strPath.c_str(), uEntry) &&
+                    m_vEntries[uEntry].uSize == vFiles[i].uSize && m_vEntries[uEntry].uWriteTime == vFiles[i].uWriteTime)
+                {
+                    vCached[i] = uEntry;
+                }
+                else
+                {
+                    ScannedRecording scanned;
+                    scanned.pFile = &vFiles[i];
+                    vTasks.push_back((UINT)vScanned.size());
+                    vScanned.push_back(scanned);
+                }
+            }
+
+            ScanContext context = { vScanned.data() };
+            if (pPool != nullptr)
+            {
+                pPool->Run(vTasks.data(), (UINT)vTasks.size(), &RecordingCatalog::ReadIndexTask, &context);
+            }
+            else
+            {
+                for (UINT uTask : vTasks)
+                {
+                    ReadIndexTask(&context, uTask);
+                }
+            }
+
+            // Rebuild the tables in path order, copying unchanged entries from the current catalog.
+            RecordingCatalog catalog;
+            catalog.m_vEntries.reserve(vFiles.size());
+            size_t uNextScanned = 0;
+            for (size_t i = 0; i < vFiles.size(); i++)
+            {
+                if (vCached[i] != UINT32_MAX)
+                {
+                    catalog.CopyEntry(*this, vCached[i]);
+                    m_Stats.uCached++;
+                    continue;
+                }
+
+                ScannedRecording& scanned = vScanned[uNextScanned++];
+                if (scanned.bRead)
+                {
+                    m_Stats.uFromIndex++;
+                }
+                else if (pService != nullptr && SUCCEEDED(QueryRecording(pService, scanned)))
+                {
+                    m_Stats.uQueried++;
+                }
+                else
+                {
+                    m_Stats.uFailed++;
+                    continue;
+                }
+                catalog.AddEntry(scanned);
+            }
+
+            m_vEntries.swap(catalog.m_vEntries);
+            m_vBookmarks.swap(catalog.m_vBookmarks);
+            m_vStrings.swap(catalog.m_vStrings);
+            return m_Stats.uFailed == 0 ? S_OK : S_FALSE;
+        }
+
+        /** Loads a catalog saved with Save(). @return S_OK, or E_FAIL if the file is missing or invalid. */
+        HRESULT Load(__in LPCWSTR pszPath)
+        {
+            FILE* pFile = nullptr;
+            if (_wfopen_s(&pFile, pszPath, L"rb") != 0 || pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+
+            HRESULT hr = E_FAIL;
+            Header header;
+            if (fread(&header, sizeof(header), 1, pFile) == 1 && header.uMagic == MAGIC && header.uVersion == VERSION && header.uStringCount > 0)
+            {
+                std::vector<RecordingCatalogEntry> vEntries(header.uEntryCount);
+                std::vector<RecordingIndexBookmark> vBookmarks(header.uBookmarkCount);
+                std::vector<WCHAR> vStrings(header.uStringCount);
+                if (ReadArray(pFile, vEntries) && ReadArray(pFile, vBookmarks) && ReadArray(pFile, vStrings) &&
+                    IsValid(vEntries, vBookmarks, vStrings))
+                {
+                    m_vEntries.swap(vEntries);
+                    m_vBookmarks.swap(vBookmarks);
+                    m_vStrings.swap(vStrings);
+                    hr = S_OK;
+                }
+            }
+            fclose(pFile);
+            return hr;
+        }
+
+        /** Saves the catalog to a file. */
+        HRESULT Save(__in LPCWSTR pszPath) const
+        {
+            FILE* pFile = nullptr;
+            if (_wfopen_s(&pFile, pszPath, L"wb") != 0 || pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+
+            Header header = { MAGIC, VERSION, (UINT32)m_vEntries.size(), (UINT32)m_vBookmarks.size(), (UINT32)m_vStrings.size(), 0 };
+            bool bWritten = fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+                            WriteArray(pFile, m_vEntries) && WriteArray(pFile, m_vBookmarks) && WriteArray(pFile, m_vStrings);
+            HRESULT hr = bWritten ? S_OK : E_FAIL;
+            if (fclose(pFile) != 0)
+            {
+                hr = E_FAIL;
+            }
+            return hr;
+        }
+
+        UINT32 GetEntryCount() const { return (UINT32)m_vEntries.size(); }
+        const RecordingCatalogEntry& GetEntry(__in UINT32 uIndex) const { return m_vEntries[uIndex]; }
+        LPCWSTR GetPath(__in UINT32 uIndex) const { return GetString(m_vEntries[uIndex].uPath); }
+        LPCWSTR GetTitle(__in UINT32 uIndex) const { return GetString(m_vEntries[uIndex].uTitle); }
+        LPCWSTR GetDescription(__in UINT32 uIndex) const { return GetString(m_vEntries[uIndex].uDescription); }
+
+        /**
+        * Returns a bookmark of a recording.
+        * @param uIndex     Recording index.
+        * @param uBookmark  Bookmark index within the recording, as passed to IRecordingServiceV510::PlaybackRecording().
+        */
+        const RecordingIndexBookmark& GetBookmark(__in UINT32 uIndex, __in UINT32 uBookmark) const
+        {
+            return m_vBookmarks[m_vEntries[uIndex].uFirstBookmark + uBookmark];
+        }
+
+        LPCWSTR GetBookmarkTitle(__in UINT32 uIndex, __in UINT32 uBookmark) const
+        {
+            return GetString(GetBookmark(uIndex, uBookmark).uTitle);
+        }
+
+        /** Returns a string from the string table, or an empty string if the offset is out of range. */
+        LPCWSTR GetString(__in UINT32 uOffset) const
+        {
+            return uOffset < m_vStrings.size() ? m_vStrings.data() + uOffset : L"";
+        }
+
+        /**
+        * Finds a recording by path.  Entries are kept sorted by path, so this is a binary search.
+        * Paths compare case-insensitively, as the file system does.
+        * @return   True and the entry index if the recording is in the catalog.
+        */
+        bool FindEntry(__in LPCWSTR pszPath, __out UINT32& uIndex) const
+        {
+            auto itEntry = std::lower_bound(m_vEntries.begin(), m_vEntries.end(), pszPath,
+                [this](const RecordingCatalogEntry& entry, LPCWSTR pszValue) { return _wcsicmp(GetString(entry.uPath), pszValue) < 0; });
+            if (itEntry == m_vEntries.end() || _wcsicmp(GetString(itEntry->uPath), pszPath) != 0)
+            {
+                return false;
+            }
+            uIndex = (UINT32)(itEntry - m_vEntries.begin());
+            return true;
+        }
+
+        /// Work done by the last Scan().
+        const RecordingCatalogStats& GetStats() const { return m_Stats; }
+
+    private:
+        struct Header
+        {
+            UINT32  uMagic;
+            UINT32  uVersion;
+            UINT32  uEntryCount;
+            UINT32  uBookmarkCount;
+            UINT32  uStringCount;
+            UINT32  uReserved;
+        };
+
+        struct FoundFile
+        {
+            std::wstring    strPath;
+            UINT64          uSize;
+            UINT64          uWriteTime;
+        };
+
+        struct ScannedBookmark
+        {
+            std::wstring    strTitle;
+            INT64           iTimestamp;
+            double          dSeconds;
+        };
+
+        /// Metadata of a changed recording, read from its sidecar or from the recording service.
+        struct ScannedRecording
+        {
+            const FoundFile*                pFile = nullptr;
+            std::wstring                    strTitle;
+            std::wstring                    strDescription;
+            double                          dDuration = 0.0;
+            INT64                           iStartTime = 0;
+            INT64                           iEndTime = 0;
+            std::vector<ScannedBookmark>    vBookmarks;
+            bool                            bRead = false;
+        };
+
+        struct ScanContext
+        {
+            ScannedRecording*   pScanned;
+        };
+
+        static HRESULT ListFiles(LPCWSTR pszDirectory, LPCWSTR pszPattern, std::vector<FoundFile>& vFiles)
+        {
+            std::wstring strSearch = std::wstring(pszDirectory) + L"\\" + pszPattern;
+            WIN32_FIND_DATAW data;
+            HANDLE hFind = FindFirstFileW(strSearch.c_str(), &data);
+            if (hFind == INVALID_HANDLE_VALUE)
+            {
+                return GetLastError() == ERROR_FILE_NOT_FOUND ? S_OK : E_FAIL;
+            }
+
+            do
+            {
+                if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+                {
+                    FoundFile file;
+                    file.strPath = std::wstring(pszDirectory) + L"\\" + data.cFileName;
+                    file.uSize = ((UINT64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+                    file.uWriteTime = ((UINT64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+                    vFiles.push_back(file);
+                }
+            } while (FindNextFileW(hFind, &data));
+            FindClose(hFind);
+
+            // Windows paths are case-insensitive: sort and drop duplicates the same way FindEntry() compares.
+            std::sort(vFiles.begin(), vFiles.end(), [](const FoundFile& a, const FoundFile& b) { return _wcsicmp(a.strPath.c_str(), b.strPath.c_str()) < 0; });
+            vFiles.erase(std::unique(vFiles.begin(), vFiles.end(), [](const FoundFile& a, const FoundFile& b) { return _wcsicmp(a.strPath.c_str(), b.strPath.c_str()) == 0; }),
+                         vFiles.end());
+            return S_OK;
+        }
+
+        /// Worker task: reads a changed recording from its sidecar if the sidecar is current.
+        static void ReadIndexTask(void* pContext, UINT uTask)
+        {
+            ScannedRecording& scanned = static_cast<ScanContext*>(pContext)->pScanned[uTask];
+            std::wstring strIndexPath = scanned.pFile->strPath + GetIndexExtension();
+
+            RecordingIndexFile file;
+            if (FAILED(file.Open(strIndexPath.c_str())))
+            {
+                return;
+            }
+
+            const RecordingIndexView& view = file.GetView();
+            if (!view.IsCurrent(scanned.pFile->uSize, scanned.pFile->uWriteTime))
+            {
+                return;
+            }
+
+            const RecordingIndexHeader& header = view.GetHeader();
+            scanned.strTitle = view.GetTitle();
+            scanned.strDescription = view.GetDescription();
+            scanned.dDuration = header.dDuration;
+            scanned.iStartTime = header.iStartTime;
+            scanned.iEndTime = header.iEndTime;
+            for (UINT32 i = 0; i < view.GetBookmarkCount(); i++)
+            {
+                const RecordingIndexBookmark& bookmark = view.GetBookmark(i);
+                ScannedBookmark scannedBookmark = { view.GetString(bookmark.uTitle), bookmark.iTimestamp, bookmark.dSeconds };
+                scanned.vBookmarks.push_back(scannedBookmark);
+            }
+            scanned.bRead = true;
+        }
+
+        static HRESULT QueryRecording(IRecordingServiceV510* pService, ScannedRecording& scanned)
+        {
+            CComPtr<IRecordingDataV510> spData;
+            HRESULT hr = pService->GetRecordingData(scanned.pFile->strPath.c_str(), IID_IRecordingDataV510, (void**)&spData);
+            if (FAILED(hr) || spData == nullptr)
+            {
+                return E_FAIL;
+            }
+
+            scanned.strTitle = NonNull(spData->GetTitle());
+            scanned.strDescription = NonNull(spData->GetDescription());
+            scanned.dDuration = spData->GetDuration();
+            scanned.iStartTime = spData->GetStartTime();
+            scanned.iEndTime = spData->GetEndTime();
+
+            const UINT32 uCount = spData->GetBookmarkCount();
+            for (UINT32 i = 0; i < uCount && SUCCEEDED(hr); i++)
+            {
+                CComPtr<IRecordingBookmarkDataV510> spBookmark;
+                hr = spData->GetBookmarkData(i, IID_IRecordingBookmarkDataV510, (void**)&spBookmark);
+                if (SUCCEEDED(hr) && spBookmark != nullptr)
+                {
+                    ScannedBookmark bookmark = { NonNull(spBookmark->GetTitle()), spBookmark->GetTimestamp(), -1.0 };
+                    scanned.vBookmarks.push_back(bookmark);
+                }
+            }
+            return hr;
+        }
+
+        void AddEntry(const ScannedRecording& scanned)
+        {
+            RecordingCatalogEntry entry = {};
+            entry.uSize = scanned.pFile->uSize;
+            entry.uWriteTime = scanned.pFile->uWriteTime;
+            entry.iStartTime = scanned.iStartTime;
+            entry.iEndTime = scanned.iEndTime;
+            entry.dDuration = scanned.dDuration;
+            entry.uPath = AddString(scanned.pFile->strPath.c_str());
+            entry.uTitle = AddString(scanned.strTitle.c_str());
+            entry.uDescription = AddString(scanned.strDescription.c_str());
+            entry.uFirstBookmark = (UINT32)m_vBookmarks.size();
+            entry.uBookmarkCount = (UINT32)scanned.vBookmarks.size();
+            for (UINT32 i = 0; i < entry.uBookmarkCount; i++)
+            {
+                const ScannedBookmark& scannedBookmark = scanned.vBookmarks[i];
+                RecordingIndexBookmark bookmark = { scannedBookmark.iTimestamp, scannedBookmark.dSeconds, AddString(scannedBookmark.strTitle.c_str()), i };
+                m_vBookmarks.push_back(bookmark);
+            }
+            m_vEntries.push_back(entry);
+        }
+
+        void CopyEntry(const RecordingCatalog& source, UINT32 uIndex)
+        {
+            RecordingCatalogEntry entry = source.m_vEntries[uIndex];
+            entry.uPath = AddString(source.GetString(entry.uPath));
+            entry.uTitle = AddString(source.GetString(entry.uTitle));
+            entry.uDescription = AddString(source.GetString(entry.uDescription));
+            entry.uFirstBookmark = (UINT32)m_vBookmarks.size();
+            for (UINT32 i = 0; i < entry.uBookmarkCount; i++)
+            {
+                RecordingIndexBookmark bookmark = source.GetBookmark(uIndex, i);
+                bookmark.uTitle = AddString(source.GetString(bookmark.uTitle));
+                m_vBookmarks.push_back(bookmark);
+            }
+            m_vEntries.push_back(entry);
+        }
+
+        UINT32 AddString(LPCWSTR pszString)
+        {
+            if (pszString == nullptr || pszString[0] == L'\0')
+            {
+                return 0;
+            }
+            UINT32 uOffset = (UINT32)m_vStrings.size();
+            m_vStrings.insert(m_vStrings.end(), pszString, pszString + wcslen(pszString) + 1);
+            return uOffset;
+        }
+
+        static LPCWSTR NonNull(LPCWSTR pszString)
+        {
+            return pszString != nullptr ? pszString : L"";
+        }
+
+        /// Checks that every string offset and bookmark range of a loaded catalog is in bounds.
+        static bool IsValid(const std::vector<RecordingCatalogEntry>& vEntries, const std::vector<RecordingIndexBookmark>& vBookmarks,
+                            const std::vector<WCHAR>& vStrings)
+        {
+            if (vStrings.back() != L'\0')
+            {
+                return false;
+            }
+            for (const RecordingCatalogEntry& entry : vEntries)
+            {
+                if ((UINT64)entry.uFirstBookmark + entry.uBookmarkCount > vBookmarks.size() ||
+                    entry.uPath >= vStrings.size() || entry.uTitle >= vStrings.size() || entry.uDescription >= vStrings.size())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template <class T>
+        static bool ReadArray(FILE* pFile, std::vector<T>& vData)
+        {
+            return vData.empty() || fread(vData.data(), sizeof(T), vData.size(), pFile) == vData.size();
+        }
+
+        template <class T>
+        static bool WriteArray(FILE* pFile, const std::vector<T>& vData)
+        {
+            return vData.empty() || fwrite(vData.data(), sizeof(T), vData.size(), pFile) == vData.size();
+        }
+
+        std::vector<RecordingCatalogEntry>  m_vEntries;
+        std::vector<RecordingIndexBookmark> m_vBookmarks;
+        std::vector<WCHAR>                  m_vStrings;
+        RecordingCatalogStats               m_Stats;
+    };
+    /** @} */
+}
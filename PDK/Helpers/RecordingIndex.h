@@ -0,0 +1,485 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RecordingIndex.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "IRecordingService.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup recordingservice */ /** @{ */
+
+    /// Flags of a RecordingIndexEntry.
+    enum RECORDING_INDEX_FLAGS
+    {
+        RECORDING_INDEX_KEYFRAME    = 0x1,      ///< Playback or decoding can start at this entry
+    };
+
+    /**
+    * Fixed layout of a recording index file.  All values are little-endian and naturally aligned, so a
+    * mapped file can be read in place:
+    * header, entries sorted by timestamp, keyframe entry indices (padded to 8 bytes), bookmarks, and
+    * a table of null terminated UTF-16 strings referenced by WCHAR offset.
+    */
+    struct RecordingIndexHeader
+    {
+        UINT32  uMagic;
+        UINT32  uVersion;
+        UINT32  uEntryCount;
+        UINT32  uKeyframeCount;
+        UINT32  uBookmarkCount;
+        UINT32  uStringCount;       ///< Size of the string table in WCHARs
+        INT64   iStartTime;         ///< IRecordingDataV510::GetStartTime()
+        INT64   iEndTime;           ///< IRecordingDataV510::GetEndTime()
+        double  dDuration;          ///< IRecordingDataV510::GetDuration()
+        UINT32  uTitle;             ///< String offset of the recording title
+        UINT32  uDescription;       ///< String offset of the recording description
+        UINT64  uSourceSize;        ///< Size of the recording the index was built for
+        UINT64  uSourceWriteTime;   ///< Last write time (FILETIME, high part in the upper 32 bits) of the recording the index was built for
+    };
+
+    /// Maps a recording timestamp to a position in a caller defined stream.
+    struct RecordingIndexEntry
+    {
+        INT64   iTimestamp;         ///< Packed recording timestamp, as from IRecordingServiceV510::GetCurrentTimestamp()
+        double  dSeconds;           ///< Timestamp in seconds, as passed to IRecordingServiceV510::PlaybackRecording()
+        UINT64  uOffset;            ///< Offset of the data for this time in the caller's stream
+        UINT32  uFlags;             ///< RECORDING_INDEX_FLAGS
+        UINT32  uReserved;
+    };
+
+    /// A recording bookmark.
+    struct RecordingIndexBookmark
+    {
+        INT64   iTimestamp;         ///< IRecordingBookmarkDataV510::GetTimestamp()
+        double  dSeconds;           ///< Bookmark time in seconds, or -1 if it could not be converted
+        UINT32  uTitle;             ///< String offset of the bookmark title
+        UINT32  uIndex;             ///< Bookmark index, as passed to IRecordingServiceV510::PlaybackRecording()
+    };
+
+    /**
+    * Read-only, zero-copy access to an index held in memory or mapped from a file.
+    * All searches are binary searches over the sorted entry and keyframe tables.
+    */
+    class RecordingIndexView
+    {
+    public:
+        static const UINT32 MAGIC = 0x58444952;     // "RIDX"
+        static const UINT32 VERSION = 1;
+
+        /**
+        * Attaches to index bytes.
+        * @return   S_OK, or E_FAIL if the data is not a complete index, a keyframe refers to a missing entry,
+        *           or the string table is not null terminated.
+        */
+        HRESULT Attach(__in const void* pData, __in UINT64 uSize)
+        {
+            m_pHeader = nullptr;
+            if (pData == nullptr || uSize < sizeof(RecordingIndexHeader))
+            {
+                return E_FAIL;
+            }
+
+            const RecordingIndexHeader* pHeader = static_cast<const RecordingIndexHeader*>(pData);
+            if (pHeader->uMagic != MAGIC || pHeader->uVersion != VERSION)
+            {
+                return E_FAIL;
+            }
+
+            UINT64 uKeyframes = 0;
+            UINT64 uBookmarks = 0;
+            UINT64 uStrings = 0;
+            UINT64 uEnd = GetLayout(pHeader->uEntryCount, pHeader->uKeyframeCount, pHeader->uBookmarkCount, pHeader->uStringCount, uKeyframes, uBookmarks, uStrings);
+            if (uEnd > uSize)
+            {
+                return E_FAIL;
+            }
+
+            // Entry and string lookups index these tables directly, so reject data that would read past them.
+            const BYTE* pBase = static_cast<const BYTE*>(pData);
+            const UINT32* pKeyframes = reinterpret_cast<const UINT32*>(pBase + uKeyframes);
+            for (UINT32 i = 0; i < pHeader->uKeyframeCount; i++)
+            {
+                if (pKeyframes[i] >= pHeader->uEntryCount)
+                {
+                    return E_FAIL;
+                }
+            }
+
+            const WCHAR* pStrings = reinterpret_cast<const WCHAR*>(pBase + uStrings);
+            if (pHeader->uStringCount > 0 && pStrings[pHeader->uStringCount - 1] != L'\0')
+            {
+                return E_FAIL;
+            }
+
+            m_pHeader = pHeader;
+            m_pEntries = reinterpret_cast<const RecordingIndexEntry*>(pBase + sizeof(RecordingIndexHeader));
+            m_pKeyframes = pKeyframes;
+            m_pBookmarks = reinterpret_cast<const RecordingIndexBookmark*>(pBase + uBookmarks);
+            m_pStrings = pStrings;
+            return S_OK;
+        }
+
+        bool IsValid() const { return m_pHeader != nullptr; }
+        const RecordingIndexHeader& GetHeader() const { return *m_pHeader; }
+
+        /// True if the index was built for a recording of the given size and last write time.
+        bool IsCurrent(__in UINT64 uSourceSize, __in UINT64 uSourceWriteTime) const
+        {
+            return m_pHeader != nullptr && m_pHeader->uSourceSize == uSourceSize && m_pHeader->uSourceWriteTime == uSourceWriteTime;
+        }
+
+        LPCWSTR GetTitle() const { return GetString(m_pHeader->uTitle); }
+        LPCWSTR GetDescription() const { return GetString(m_pHeader->uDescription); }
+
+        UINT32 GetEntryCount() const { return m_pHeader->uEntryCount; }
+        const RecordingIndexEntry& GetEntry(__in UINT32 uIndex) const { return m_pEntries[uIndex]; }
+
+        UINT32 GetBookmarkCount() const { return m_pHeader->uBookmarkCount; }
+        const RecordingIndexBookmark& GetBookmark(__in UINT32 uIndex) const { return m_pBookmarks[uIndex]; }
+        LPCWSTR GetBookmarkTitle(__in UINT32 uIndex) const { return GetString(m_pBookmarks[uIndex].uTitle); }
+
+        /** Returns a string from the string table, or an empty string if the offset is out of range. */
+        LPCWSTR GetString(__in UINT32 uOffset) const
+        {
+            return uOffset < m_pHeader->uStringCount ? m_pStrings + uOffset : L"";
+        }
+
+        /**
+        * Finds the last entry at or before a timestamp.
+        * @return   True and the entry index, or false if the timestamp is before the first entry.
+        */
+        bool FindEntry(__in INT64 iTimestamp, __out UINT32& uIndex) const
+        {
+            const RecordingIndexEntry* pEnd = m_pEntries + m_pHeader->uEntryCount;
+            const RecordingIndexEntry* pFound = std::upper_bound(m_pEntries, pEnd, iTimestamp,
+                [](INT64 iValue, const RecordingIndexEntry& entry) { return iValue < entry.iTimestamp; });
+            if (pFound == m_pEntries)
+            {
+                return false;
+            }
+            uIndex = (UINT32)(pFound - m_pEntries - 1);
+            return true;
+        }
+
+        /** Finds the last entry at or before a time in seconds.  Entries must have increasing seconds. */
+        bool FindEntryBySeconds(__in double dSeconds, __out UINT32& uIndex) const
+        {
+            const RecordingIndexEntry* pEnd = m_pEntries + m_pHeader->uEntryCount;
+            const RecordingIndexEntry* pFound = std::upper_bound(m_pEntries, pEnd, dSeconds,
+                [](double dValue, const RecordingIndexEntry& entry) { return dValue < entry.dSeconds; });
+            if (pFound == m_pEntries)
+            {
+                return false;
+            }
+            uIndex = (UINT32)(pFound - m_pEntries - 1);
+            return true;
+        }
+
+        /**
+        * Finds the last keyframe entry at or before a timestamp, the place to start decoding to reach it.
+        * @return   True and the entry index, or false if there is no keyframe before the timestamp.
+        */
+        bool FindKeyframe(__in INT64 iTimestamp, __out UINT32& uIndex) const
+        {
+            const UINT32* pEnd = m_pKeyframes + m_pHeader->uKeyframeCount;
+            const RecordingIndexEntry* pEntries = m_pEntries;
+            const UINT32* pFound = std::upper_bound(m_pKeyframes, pEnd, iTimestamp,
+                [pEntries](INT64 iValue, UINT32 uEntry) { return iValue < pEntries[uEntry].iTimestamp; });
+            if (pFound == m_pKeyframes)
+            {
+                return false;
+            }
+            uIndex = *(pFound - 1);
+            return true;
+        }
+
+        /**
+        * Computes the byte offsets of each section.
+        * @return   Total size of an index with the given counts.
+        */
+        static UINT64 GetLayout(__in UINT64 uEntries, __in UINT64 uKeyframes, __in UINT64 uBookmarks, __in UINT64 uStrings,
+                                __out UINT64& uKeyframeOffset, __out UINT64& uBookmarkOffset, __out UINT64& uStringOffset)
+        {
+            uKeyframeOffset = sizeof(RecordingIndexHeader) + uEntries * sizeof(RecordingIndexEntry);
+            uBookmarkOffset = (uKeyframeOffset + uKeyframes * sizeof(UINT32) + 7) & ~(UINT64)7;
+            uStringOffset = uBookmarkOffset + uBookmarks * sizeof(RecordingIndexBookmark);
+            return uStringOffset + uStrings * sizeof(WCHAR);
+        }
+
+    private:
+        const RecordingIndexHeader*     m_pHeader = nullptr;
+        const RecordingIndexEntry*      m_pEntries = nullptr;
+        const UINT32*                   m_pKeyframes = nullptr;
+        const RecordingIndexBookmark*   m_pBookmarks = nullptr;
+        const WCHAR*                    m_pStrings = nullptr;
+    };
+
+    /**
+    * Collects metadata, bookmarks and timestamp entries for a recording and writes them as an index.
+    * Sample usage while recording, next to a stream of the caller's own per-frame data:
+    * ```
+    *      builder.Sample(spRecordingService, uStreamOffset, bKeyframe);
+    *      ...
+    *      spRecordingService->StopAndSaveRecording(pszTitle, pszDescription, FALSE);
+    *      builder.AddMetadata(spRecordingData, spRecordingService);
+    *      builder.Save(pszIndexPath);
+    * ```
+    */
+    class RecordingIndexBuilder
+    {
+    public:
+        RecordingIndexBuilder()
+        {
+            Clear();
+        }
+
+        void Clear()
+        {
+            memset(&m_Header, 0, sizeof(m_Header));
+            m_Header.uMagic = RecordingIndexView::MAGIC;
+            m_Header.uVersion = RecordingIndexView::VERSION;
+            m_vEntries.clear();
+            m_vBookmarks.clear();
+            m_vStrings.clear();
+            m_vStrings.push_back(L'\0');    // Offset 0 is the empty string
+        }
+
+        /**
+        * Copies title, description, duration, start and end time and bookmarks from recording data.
+        * @param pData      Recording data from IRecordingServiceV510::GetRecordingData() or GetCurrentRecordingData().
+        * @param pService   Optional service used to convert bookmark timestamps to seconds.  Conversion is
+        *                   only possible while recording or playing back; otherwise seconds are stored as -1.
+        */
+        HRESULT AddMetadata(__in __notnull IRecordingDataV510* pData, __in IRecordingServiceV510* pService = nullptr)
+        {
+            m_Header.uTitle = AddString(pData->GetTitle());
+            m_Header.uDescription = AddString(pData->GetDescription());
+            m_Header.dDuration = pData->GetDuration();
+            m_Header.iStartTime = pData->GetStartTime();
+            m_Header.iEndTime = pData->GetEndTime();
+
+            HRESULT hr = S_OK;
+            const UINT32 uCount = pData->GetBookmarkCount();
+            for (UINT32 i = 0; i < uCount && SUCCEEDED(hr); i++)
+            {
+                CComPtr<IRecordingBookmarkDataV510> spBookmark;
+                hr = pData->GetBookmarkData(i, IID_IRecordingBookmarkDataV510, (void**)&spBookmark);
+                if (SUCCEEDED(hr) && spBookmark != nullptr)
+                {
+                    INT64 iTimestamp = spBookmark->GetTimestamp();
+                    double dSeconds = pService != nullptr ? pService->ConvertTimestampToSeconds(iTimestamp) : -1.0;
+                    AddBookmark(spBookmark->GetTitle(), iTimestamp, dSeconds, i);
+                }
+            }
+            return hr;
+        }
+
+        /**
+        * Identifies the recording the index belongs to, so stale indexes can be detected with RecordingIndexView::IsCurrent().
+        * @param uSize       Size of the recording file in bytes.
+        * @param uWriteTime  Last write time of the recording file as a FILETIME packed into 64 bits, e.g. from ftLastWriteTime.
+        */
+        void SetSource(__in UINT64 uSize, __in UINT64 uWriteTime)
+        {
+            m_Header.uSourceSize = uSize;
+            m_Header.uSourceWriteTime = uWriteTime;
+        }
+
+        /** Adds a timestamp entry.  Entries may be added in any order. */
+        void AddEntry(__in INT64 iTimestamp, __in double dSeconds, __in UINT64 uOffset, __in bool bKeyframe)
+        {
+            RecordingIndexEntry entry = { iTimestamp, dSeconds, uOffset, bKeyframe ? (UINT32)RECORDING_INDEX_KEYFRAME : 0u, 0 };
+            m_vEntries.push_back(entry);
+        }
+
+        /**
+        * Adds an entry for the current recording time.
+        * @return   S_OK, or E_FAIL if the service is not recording or playing back.
+        */
+        HRESULT Sample(__in __notnull IRecordingServiceV510* pService, __in UINT64 uOffset, __in bool bKeyframe)
+        {
+            INT64 iTimestamp = pService->GetCurrentTimestamp();
+            if (iTimestamp < 0)
+            {
+                return E_FAIL;
+            }
+            AddEntry(iTimestamp, pService->ConvertTimestampToSeconds(iTimestamp), uOffset, bKeyframe);
+            return S_OK;
+        }
+
+        /** Adds a bookmark. */
+        void AddBookmark(__in LPCWSTR pszTitle, __in INT64 iTimestamp, __in double dSeconds, __in UINT32 uIndex)
+        {
+            RecordingIndexBookmark bookmark = { iTimestamp, dSeconds, AddString(pszTitle), uIndex };
+            m_vBookmarks.push_back(bookmark);
+        }
+
+        /** Serializes the index to memory. */
+        void Serialize(__out std::vector<BYTE>& vData)
+        {
+            std::stable_sort(m_vEntries.begin(), m_vEntries.end(),
+                [](const RecordingIndexEntry& a, const RecordingIndexEntry& b) { return a.iTimestamp < b.iTimestamp; });
+
+            std::vector<UINT32> vKeyframes;
+            for (UINT32 i = 0; i < (UINT32)m_vEntries.size(); i++)
+            {
+                if (m_vEntries[i].uFlags & RECORDING_INDEX_KEYFRAME)
+                {
+                    vKeyframes.push_back(i);
+                }
+            }
+
+            RecordingIndexHeader header = m_Header;
+            header.uEntryCount = (UINT32)m_vEntries.size();
+            header.uKeyframeCount = (UINT32)vKeyframes.size();
+            header.uBookmarkCount = (UINT32)m_vBookmarks.size();
+            header.uStringCount = (UINT32)m_vStrings.size();
+
+            UINT64 uKeyframes = 0;
+            UINT64 uBookmarks = 0;
+            UINT64 uStrings = 0;
+            UINT64 uSize = RecordingIndexView::GetLayout(header.uEntryCount, header.uKeyframeCount, header.uBookmarkCount, header.uStringCount,
+                                                         uKeyframes, uBookmarks, uStrings);
+            vData.assign((size_t)uSize, 0);
+            BYTE* pBase = vData.data();
+            memcpy(pBase, &header, sizeof(header));
+            Copy(pBase + sizeof(header), m_vEntries);
+            Copy(pBase + uKeyframes, vKeyframes);
+            Copy(pBase + uBookmarks, m_vBookmarks);
+            Copy(pBase + uStrings, m_vStrings);
+        }
+
+        /** Writes the index to a file, typically next to the recording. */
+        HRESULT Save(__in LPCWSTR pszPath)
+        {
+            std::vector<BYTE> vData;
+            Serialize(vData);
+
+            FILE* pFile = nullptr;
+            if (_wfopen_s(&pFile, pszPath, L"wb") != 0 || pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+            HRESULT hr = fwrite(vData.data(), 1, vData.size(), pFile) == vData.size() ? S_OK : E_FAIL;
+            if (fclose(pFile) != 0)
+            {
+                hr = E_FAIL;
+            }
+            return hr;
+        }
+
+    private:
+        UINT32 AddString(LPCWSTR pszString)
+        {
+            if (pszString == nullptr || pszString[0] == L'\0')
+            {
+                return 0;
+            }
+            UINT32 uOffset = (UINT32)m_vStrings.size();
+            m_vStrings.insert(m_vStrings.end(), pszString, pszString + wcslen(pszString) + 1);
+            return uOffset;
+        }
+
+        template <class T>
+        static void Copy(BYTE* pDest, const std::vector<T>& vSource)
+        {
+            if (!vSource.empty())
+            {
+                memcpy(pDest, vSource.data(), vSource.size() * sizeof(T));
+            }
+        }
+
+        RecordingIndexHeader                m_Header;
+        std::vector<RecordingIndexEntry>    m_vEntries;
+        std::vector<RecordingIndexBookmark> m_vBookmarks;
+        std::vector<WCHAR>                  m_vStrings;
+    };
+
+    /**
+    * Maps an index file read-only and exposes it through RecordingIndexView.  Opening is O(1) in the
+    * size of the index: pages are only read when a search touches them.
+    */
+    class RecordingIndexFile
+    {
+    public:
+        RecordingIndexFile()
+        {
+        }
+
+        ~RecordingIndexFile()
+        {
+            Close();
+        }
+
+        /** Maps an index file. @return S_OK, or E_FAIL if the file cannot be mapped or is not a valid index. */
+        HRESULT Open(__in LPCWSTR pszPath)
+        {
+            Close();
+
+            m_hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (m_hFile == INVALID_HANDLE_VALUE)
+            {
+                return E_FAIL;
+            }
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart < (LONGLONG)sizeof(RecordingIndexHeader))
+            {
+                Close();
+                return E_FAIL;
+            }
+
+            m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            m_pView = m_hMapping != nullptr ? MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (m_pView == nullptr || FAILED(m_View.Attach(m_pView, (UINT64)size.QuadPart)))
+            {
+                Close();
+                return E_FAIL;
+            }
+            return S_OK;
+        }
+
+        void Close()
+        {
+            m_View = RecordingIndexView();
+            if (m_pView != nullptr)
+            {
+                UnmapViewOfFile(m_pView);
+                m_pView = nullptr;
+            }
+            if (m_hMapping != nullptr)
+            {
+                CloseHandle(m_hMapping);
+                m_hMapping = nullptr;
+            }
+            if (m_hFile != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_hFile);
+                m_hFile = INVALID_HANDLE_VALUE;
+            }
+        }
+
+        bool IsOpen() const { return m_View.IsValid(); }
+        const RecordingIndexView& GetView() const { return m_View; }
+
+    private:
+        RecordingIndexFile(const RecordingIndexFile&);
+        RecordingIndexFile& operator=(const RecordingIndexFile&);
+
+        RecordingIndexView  m_View;
+        HANDLE              m_hFile = INVALID_HANDLE_VALUE;
+        HANDLE              m_hMapping = nullptr;
+        const void*         m_pView = nullptr;
+    };
+    /** @} */
+}
@@ -0,0 +1,393 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// SimulationScheduler.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "ISimObject.h"
+#include "SimulationWorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Update cost statistics gathered for a single scheduled simulation.
+    */
+    struct SimulationCost
+    {
+        double dLastMs = 0.0;       ///< Duration of the most recent Update() call in milliseconds
+        double dAverageMs = 0.0;    ///< Exponentially smoothed Update() duration in milliseconds
+        double dMaxMs = 0.0;        ///< Longest Update() duration observed since the last reset
+        UINT64 uUpdateCount = 0;    ///< Number of Update() calls since the last reset
+    };
+
+    /**
+    * ISimulation implementation that drives a set of subsystem simulations in parallel.
+    * Subsystems are added with AddSimulation() and ordered with AddDependency().  The scheduler
+    * is then registered once with IBaseObjectV520::RegisterSimulation() in place of the individual
+    * subsystems.  Every Update() walks the dependency graph level by level: subsystems within a level
+    * have no dependencies on each other and run on the worker pool, and a level only starts once the
+    * previous one has fully completed.
+    * @remarks  Subsystems may be given their own rate.  A subsystem with a rate lower than the scheduler
+    *           rate accumulates delta time and is only updated once its period has elapsed.
+    * @remarks  SaveLoadState(), Serialize() and Deserialize() are forwarded serially in the order the
+    *           subsystems were added so that saved and networked data remain stable.
+    * @remarks  Subsystems running in the same level must not share unsynchronized state.
+    */
+    class SimulationScheduler : public ISimulationV310
+    {
+    public:
+        /**
+        * @param uWorkerCount   Number of worker threads in addition to the sim thread.  Defaults to one
+        *                       less than the number of hardware threads.
+        */
+        explicit SimulationScheduler(UINT uWorkerCount = DefaultWorkerCount())
+            : m_Pool(uWorkerCount)
+        {
+        }
+
+        virtual ~SimulationScheduler()
+        {
+        }
+
+        /**
+        * Adds a subsystem simulation to the scheduler.
+        * @param pSimulation    The subsystem to update.
+        * @param pszName        Optional name used when reporting update costs.
+        * @param fRateHz        Optional update rate.  A value of 0 updates the subsystem on every scheduler update.
+        * @return               Index of the subsystem used with AddDependency() and GetSimulationCost().
+        */
+        UINT AddSimulation(__in __notnull ISimulationV310* pSimulation, __in LPCWSTR pszName = nullptr, __in float fRateHz = 0.0f)
+        {
+            Node node;
+            node.spSimulation = pSimulation;
+            node.sName = pszName != nullptr ? pszName : L"";
+            node.dPeriod = fRateHz > 0.0f ? 1.0 / fRateHz : 0.0;
+            m_Nodes.push_back(node);
+            m_bGraphDirty = true;
+            return (UINT)m_Nodes.size() - 1;
+        }
+
+        /**
+        * Declares that a subsystem must be updated after another one within the same frame.
+        * @param uSimulation    Index of the dependent subsystem.
+        * @param uDependsOn     Index of the subsystem that must complete first.
+        * @return               S_OK if the dependency was added, E_INVALIDARG for unknown or identical indices.
+        */
+        HRESULT AddDependency(__in UINT uSimulation, __in UINT uDependsOn)
+        {
+            HRESULT hr = E_INVALIDARG;
+
+            if (uSimulation < m_Nodes.size() && uDependsOn < m_Nodes.size() && uSimulation != uDependsOn)
+            {
+                m_Nodes[uDependsOn].vDependents.push_back(uSimulation);
+                m_bGraphDirty = true;
+                hr = S_OK;
+            }
+
+            return hr;
+        }
+
+        /**
+        * Builds the dependency graph and registers the scheduler with the given base object.
+        * @return   E_FAIL if the dependency graph contains a cycle, otherwise the result of RegisterSimulation().
+        */
+        HRESULT Register(__in __notnull IBaseObjectV520* pBaseObject, __in float fMinRateHz, __in float fMaxRateHz)
+        {
+            HRESULT hr = BuildGraph();
+
+            if (SUCCEEDED(hr))
+            {
+                hr = pBaseObject->RegisterSimulation(this, fMinRateHz, fMaxRateHz);
+            }
+
+            return hr;
+        }
+
+        /**
+        * Sorts the subsystems into dependency levels.  Called automatically on the first update after
+        * the graph has changed.
+        * @return   S_OK on success, E_FAIL if the dependency graph contains a cycle.
+        */
+        HRESULT BuildGraph()
+        {
+            std::vector<UINT> vInDegree(m_Nodes.size(), 0);
+            for (const Node& node : m_Nodes)
+            {
+                for (UINT uDependent : node.vDependents)
+                {
+                    vInDegree[uDependent]++;
+                }
+            }
+
+            m_vLevelOrder.clear();
+            m_vLevelStart.clear();
+
+            // Kahn's algorithm, one level at a time, keeping indices sorted so the levels are deterministic.
+            std::vector<UINT> vCurrent;
+            for (UINT i = 0; i < (UINT)m_Nodes.size(); i++)
+            {
+                if (vInDegree[i] == 0)
+                {
+                    vCurrent.push_back(i);
+                }
+            }
+
+            std::vector<UINT> vNext;
+            while (!vCurrent.empty())
+            {
+                m_vLevelStart.push_back((UINT)m_vLevelOrder.size());
+                m_vLevelOrder.insert(m_vLevelOrder.end(), vCurrent.begin(), vCurrent.end());
+
+                vNext.clear();
+                for (UINT uNode : vCurrent)
+                {
+                    for (UINT uDependent : m_Nodes[uNode].vDependents)
+                    {
+                        if (--vInDegree[uDependent] == 0)
+                        {
+                            vNext.push_back(uDependent);
+                        }
+                    }
+                }
+                std::sort(vNext.begin(), vNext.end());
+                vCurrent.swap(vNext);
+            }
+            m_vLevelStart.push_back((UINT)m_vLevelOrder.size());
+
+            if (m_vLevelOrder.size() != m_Nodes.size())
+            {
+                m_vLevelOrder.clear();
+                m_vLevelStart.clear();
+                return E_FAIL;
+            }
+
+            m_bGraphDirty = false;
+            return S_OK;
+        }
+
+        /// Number of subsystems added to the scheduler.
+        UINT GetSimulationCount() const
+        {
+            return (UINT)m_Nodes.size();
+        }
+
+        /// Number of dependency levels.  Each level is a join point within an update.
+        UINT GetLevelCount() const
+        {
+            return m_vLevelStart.empty() ? 0 : (UINT)m_vLevelStart.size() - 1;
+        }
+
+        /// Name given to the subsystem in AddSimulation().
+        LPCWSTR GetSimulationName(__in UINT uSimulation) const
+        {
+            return uSimulation < m_Nodes.size() ? m_Nodes[uSimulation].sName.c_str() : nullptr;
+        }
+
+        /**
+        * Gets the update cost statistics for a subsystem.
+        * @return   S_OK if the index is valid, E_INVALIDARG otherwise.
+        */
+        HRESULT GetSimulationCost(__in UINT uSimulation, __out SimulationCost& cost) const
+        {
+            HRESULT hr = E_INVALIDARG;
+
+            if (uSimulation < m_Nodes.size())
+            {
+                cost = m_Nodes[uSimulation].Cost;
+                hr = S_OK;
+            }
+
+            return hr;
+        }
+
+        /// Clears the update cost statistics of all subsystems.
+        void ResetCosts()
+        {
+            for (Node& node : m_Nodes)
+            {
+                node.Cost = SimulationCost();
+            }
+        }
+
+        /** Updates every subsystem that is due, level by level. */
+        STDMETHOD(Update)(double dDeltaT) override
+        {
+            if (m_bGraphDirty && FAILED(BuildGraph()))
+            {
+                return E_FAIL;
+            }
+
+            m_dDeltaT = dDeltaT;
+            for (Node& node : m_Nodes)
+            {
+                node.dAccumulated += dDeltaT;
+                node.hrLast = S_OK;
+            }
+
+            std::vector<UINT> vDue;
+            vDue.reserve(m_Nodes.size());
+            for (size_t uLevel = 0; uLevel + 1 < m_vLevelStart.size(); uLevel++)
+            {
+                vDue.clear();
+                for (UINT i = m_vLevelStart[uLevel]; i < m_vLevelStart[uLevel + 1]; i++)
+                {
+                    const Node& node = m_Nodes[m_vLevelOrder[i]];
+                    // Small tolerance so accumulated frame deltas do not miss a period to rounding.
+                    if (node.dAccumulated >= node.dPeriod * (1.0 - 1.0e-6))
+                    {
+                        vDue.push_back(m_vLevelOrder[i]);
+                    }
+                }
+                m_Pool.Run(vDue.data(), (UINT)vDue.size(), &SimulationScheduler::RunNode, this);
+            }
+
+            HRESULT hr = S_OK;
+            for (const Node& node : m_Nodes)
+            {
+                if (FAILED(node.hrLast))
+                {
+                    hr = node.hrLast;
+                    break;
+                }
+            }
+            return hr;
+        }
+
+        STDMETHOD(SaveLoadState)(__in __notnull PSaveLoadCallback pfnCallback, __in const BOOL bSave) override
+        {
+            HRESULT hr = S_OK;
+            for (Node& node : m_Nodes)
+            {
+                HRESULT hrNode = node.spSimulation->SaveLoadState(pfnCallback, bSave);
+                if (SUCCEEDED(hr) && FAILED(hrNode))
+                {
+                    hr = hrNode;
+                }
+            }
+            return hr;
+        }
+
+        STDMETHOD(Serialize)(__in NetOutPublic& netOut) override
+        {
+            HRESULT hr = S_OK;
+            for (Node& node : m_Nodes)
+            {
+                HRESULT hrNode = node.spSimulation->Serialize(netOut);
+                if (SUCCEEDED(hr) && FAILED(hrNode))
+                {
+                    hr = hrNode;
+                }
+            }
+            return hr;
+        }
+
+        STDMETHOD(Deserialize)(__in NetInPublic& netIn) override
+        {
+            HRESULT hr = S_OK;
+            for (Node& node : m_Nodes)
+            {
+                HRESULT hrNode = node.spSimulation->Deserialize(netIn);
+                if (SUCCEEDED(hr) && FAILED(hrNode))
+                {
+                    hr = hrNode;
+                }
+            }
+            return hr;
+        }
+
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+        STDMETHODIMP QueryInterface(REFIID riid, PVOID* ppv)
+        {
+            HRESULT hr = E_NOINTERFACE;
+
+            if (ppv == nullptr)
+            {
+                return E_POINTER;
+            }
+
+            *ppv = nullptr;
+
+            if (IsEqualIID(riid, IID_ISimulationV310))
+            {
+                *ppv = static_cast<ISimulationV310*>(this);
+            }
+            else if (IsEqualIID(riid, IID_ISimulationV01))
+            {
+                *ppv = static_cast<ISimulationV01*>(this);
+            }
+            else if (IsEqualIID(riid, IID_ISimulation))
+            {
+                *ppv = static_cast<ISimulation*>(this);
+            }
+            else if (IsEqualIID(riid, IID_IUnknown))
+            {
+                *ppv = static_cast<IUnknown*>(this);
+            }
+            if (*ppv)
+            {
+                hr = S_OK;
+                AddRef();
+            }
+
+            return hr;
+        }
+
+        /// Default worker count: one less than the number of hardware threads.
+        static UINT DefaultWorkerCount()
+        {
+            UINT uThreads = std::thread::hardware_concurrency();
+            return uThreads > 1 ? uThreads - 1 : 0;
+        }
+
+    private:
+        struct Node
+        {
+            CComPtr<ISimulationV310>    spSimulation;
+            std::wstring                sName;
+            std::vector<UINT>           vDependents;
+            double                      dPeriod = 0.0;
+            double                      dAccumulated = 0.0;
+            HRESULT                     hrLast = S_OK;
+            SimulationCost              Cost;
+        };
+
+        static void RunNode(void* pContext, UINT uNode)
+        {
+            SimulationScheduler* pThis = static_cast<SimulationScheduler*>(pContext);
+            Node& node = pThis->m_Nodes[uNode];
+
+            const double dDeltaT = node.dPeriod > 0.0 ? node.dAccumulated : pThis->m_dDeltaT;
+            node.dAccumulated = 0.0;
+
+            auto tStart = std::chrono::steady_clock::now();
+            node.hrLast = node.spSimulation->Update(dDeltaT);
+            auto tEnd = std::chrono::steady_clock::now();
+
+            SimulationCost& cost = node.Cost;
+            cost.dLastMs = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+            cost.dAverageMs = cost.uUpdateCount == 0 ? cost.dLastMs : cost.dAverageMs + 0.1 * (cost.dLastMs - cost.dAverageMs);
+            cost.dMaxMs = cost.dLastMs > cost.dMaxMs ? cost.dLastMs : cost.dMaxMs;
+            cost.uUpdateCount++;
+        }
+
+        SimulationWorkerPool    m_Pool;
+        std::vector<Node>       m_Nodes;
+        std::vector<UINT>       m_vLevelOrder;
+        std::vector<UINT>       m_vLevelStart;
+        double                  m_dDeltaT = 0.0;
+        bool                    m_bGraphDirty = true;
+    };
+    /** @} */
+}
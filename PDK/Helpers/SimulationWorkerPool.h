@@ -0,0 +1,193 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// SimulationWorkerPool.h
+
+#pragma once
+#include <ObjBase.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Small work-stealing thread pool for batches of independent tasks, used by SimulationScheduler
+    * and by helpers that spread per-frame work across threads.  Each worker owns a task queue; a
+    * worker pops from the back of its own queue and steals from the front of the others when it
+    * runs dry.  The calling thread participates as queue 0, and Run() does not return until every
+    * task of the batch has completed, which gives callers a deterministic join point.
+    */
+    class SimulationWorkerPool
+    {
+    public:
+        /// Task entry point.  Called once per task index of a batch.
+        typedef void (*PTaskFunc)(void* pContext, UINT uTask);
+
+        /**
+        * @param uWorkerCount   Number of worker threads to create in addition to the calling thread.
+        */
+        explicit SimulationWorkerPool(UINT uWorkerCount)
+            : m_Queues(uWorkerCount + 1)
+        {
+            m_Threads.reserve(uWorkerCount);
+            for (UINT i = 0; i < uWorkerCount; i++)
+            {
+                m_Threads.emplace_back(&SimulationWorkerPool::WorkerMain, this, i + 1);
+            }
+        }
+
+        ~SimulationWorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Lock);
+                m_bShutdown = true;
+            }
+            m_WakeCondition.notify_all();
+            for (std::thread& thread : m_Threads)
+            {
+                thread.join();
+            }
+        }
+
+        /// Number of threads, including the caller, that execute tasks.
+        UINT GetThreadCount() const
+        {
+            return (UINT)m_Queues.size();
+        }
+
+        /**
+        * Runs a batch of independent tasks and blocks until all of them have completed.
+        * @param pTasks     Task indices to run.  Tasks are dealt round-robin to the worker queues.
+        * @param uCount     Number of task indices.
+        * @param pfnTask    Function invoked for each task index.
+        * @param pContext   Context pointer passed to pfnTask.
+        */
+        void Run(const UINT* pTasks, UINT uCount, PTaskFunc pfnTask, void* pContext)
+        {
+            if (uCount == 0)
+            {
+                return;
+            }
+            if (uCount == 1 || m_Threads.empty())
+            {
+                for (UINT i = 0; i < uCount; i++)
+                {
+                    pfnTask(pContext, pTasks[i]);
+                }
+                return;
+            }
+
+            // Publish the batch before queueing any task so a worker still draining the previous
+            // batch never runs a new task against stale state.
+            {
+                std::lock_guard<std::mutex> lock(m_Lock);
+                m_pfnTask = pfnTask;
+                m_pContext = pContext;
+                m_uRemaining.store(uCount);
+            }
+
+            const size_t nQueues = m_Queues.size();
+            for (UINT i = 0; i < uCount; i++)
+            {
+                WorkQueue& queue = m_Queues[i % nQueues];
+                std::lock_guard<std::mutex> lock(queue.Lock);
+                queue.Tasks.push_back(pTasks[i]);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_Lock);
+                m_uGeneration++;
+            }
+            m_WakeCondition.notify_all();
+
+            DrainQueues(0);
+
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_DoneCondition.wait(lock, [this] { return m_uRemaining.load() == 0; });
+        }
+
+    private:
+        struct WorkQueue
+        {
+            std::mutex Lock;
+            std::deque<UINT> Tasks;
+        };
+
+        bool PopTask(size_t uQueue, UINT& uTask)
+        {
+            WorkQueue& own = m_Queues[uQueue];
+            {
+                std::lock_guard<std::mutex> lock(own.Lock);
+                if (!own.Tasks.empty())
+                {
+                    uTask = own.Tasks.back();
+                    own.Tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < m_Queues.size(); i++)
+            {
+                WorkQueue& victim = m_Queues[(uQueue + i) % m_Queues.size()];
+                std::lock_guard<std::mutex> lock(victim.Lock);
+                if (!victim.Tasks.empty())
+                {
+                    uTask = victim.Tasks.front();
+                    victim.Tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void DrainQueues(size_t uQueue)
+        {
+            UINT uTask = 0;
+            while (PopTask(uQueue, uTask))
+            {
+                m_pfnTask(m_pContext, uTask);
+                if (m_uRemaining.fetch_sub(1) == 1)
+                {
+                    std::lock_guard<std::mutex> lock(m_Lock);
+                    m_DoneCondition.notify_all();
+                }
+            }
+        }
+
+        void WorkerMain(size_t uQueue)
+        {
+            UINT64 uSeenGeneration = 0;
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_Lock);
+                    m_WakeCondition.wait(lock, [&] { return m_bShutdown || m_uGeneration != uSeenGeneration; });
+                    if (m_bShutdown)
+                    {
+                        return;
+                    }
+                    uSeenGeneration = m_uGeneration;
+                }
+                DrainQueues(uQueue);
+            }
+        }
+
+        std::vector<WorkQueue>      m_Queues;
+        std::vector<std::thread>    m_Threads;
+        std::mutex                  m_Lock;
+        std::condition_variable     m_WakeCondition;
+        std::condition_variable     m_DoneCondition;
+        std::atomic<UINT>           m_uRemaining{ 0 };
+        UINT64                      m_uGeneration = 0;
+        PTaskFunc                   m_pfnTask = nullptr;
+        void*                       m_pContext = nullptr;
+        bool                        m_bShutdown = false;
+    };
+    /** @} */
+}
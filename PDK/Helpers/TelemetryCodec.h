@@ -0,0 +1,161 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// TelemetryCodec.h
+
+#pragma once
+#include <ObjBase.h>
+#include "DeltaStateSerializer.h"
+
+#include <climits>
+#include <cmath>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /**
+    * Column compression used by FlightDataRecorder and the telemetry file format.
+    * A column is a run of INT64 values, either times in microseconds or property values quantized
+    * to a fixed precision as in DeltaStateSchema.  Each value is replaced by its first or second
+    * order difference and written as a zigzag varint, with a run of zero differences collapsed into a
+    * zero followed by the varint length of the rest of the run.
+    * Sampled times at a fixed rate and properties that hold steady therefore cost a few bytes per run
+    * instead of eight bytes per sample.
+    */
+    class TelemetryCodec
+    {
+    public:
+        /// Difference order that fits timestamps sampled at a steady rate.
+        static const UINT TIME_ORDER = 2;
+        /// Difference order that fits slowly changing property values.
+        static const UINT VALUE_ORDER = 1;
+
+        /// Converts a time in seconds to the microseconds stored in time columns.
+        static INT64 ToMicroseconds(__in double dSeconds)
+        {
+            return (INT64)std::llround(dSeconds * 1000000.0);
+        }
+
+        /// Converts a time column value back to seconds.
+        static double ToSeconds(__in INT64 iMicroseconds)
+        {
+            return (double)iMicroseconds / 1000000.0;
+        }
+
+        /// Quantizes a property value to a multiple of dPrecision.
+        static INT64 Quantize(__in double dValue, __in double dPrecision)
+        {
+            return (INT64)std::llround(dValue / dPrecision);
+        }
+
+        /// Converts a quantized property value back to its units.
+        static double Dequantize(__in INT64 iValue, __in double dPrecision)
+        {
+            return (double)iValue * dPrecision;
+        }
+
+        /**
+        * Appends a compressed column.
+        * @param pValues    Column values.
+        * @param uCount     Number of values.
+        * @param uOrder     Difference order, 1 or 2.
+        * @param vOut       Buffer the column is appended to.
+        */
+        static void EncodeColumn(__in const INT64* pValues, __in UINT uCount, __in UINT uOrder, __inout std::vector<BYTE>& vOut)
+        {
+            INT64 iPrevious = 0;
+            INT64 iPreviousDelta = 0;
+            UINT64 uZeroRun = 0;
+            for (UINT i = 0; i < uCount; i++)
+            {
+                // Differences wrap in unsigned arithmetic, so any INT64 sequence round-trips.
+                INT64 iDelta = (INT64)((UINT64)pValues[i] - (UINT64)iPrevious);
+                INT64 iResidual = uOrder == 2 ? (INT64)((UINT64)iDelta - (UINT64)iPreviousDelta) : iDelta;
+                iPrevious = pValues[i];
+                iPreviousDelta = iDelta;
+
+                if (iResidual == 0)
+                {
+                    uZeroRun++;
+                    continue;
+                }
+                FlushZeroRun(vOut, uZeroRun);
+                DeltaStateSchema::WriteVarInt(vOut, iResidual);
+            }
+            FlushZeroRun(vOut, uZeroRun);
+        }
+
+        /**
+        * Upper bound on the number of values a column of uBytes bytes can decode to.  The densest encoding
+        * is a single zero run, whose length varint holds 7 bits per byte after the leading zero.
+        * @remarks  Readers use this to reject counts that could not have come from the column before
+        *           sizing buffers from them.
+        */
+        static UINT64 GetMaxCount(__in UINT64 uBytes)
+        {
+            if (uBytes <= 1)
+            {
+                return uBytes;
+            }
+            return uBytes - 1 >= 9 ? ULLONG_MAX : 1ull << (7 * (uBytes - 1));
+        }
+
+        /**
+        * Decodes a column written by EncodeColumn().
+        * @param pCur       Start of the column; advanced past it on success.
+        * @param pEnd       End of the buffer.
+        * @param uCount     Number of values in the column.
+        * @param uOrder     Difference order used to encode the column.
+        * @param pValues    Receives uCount values.
+        * @return           False if the buffer is truncated or malformed.
+        */
+        static bool DecodeColumn(__inout const BYTE*& pCur, __in const BYTE* pEnd, __in UINT uCount, __in UINT uOrder, __out INT64* pValues)
+        {
+            INT64 iPrevious = 0;
+            INT64 iPreviousDelta = 0;
+            UINT i = 0;
+            while (i < uCount)
+            {
+                INT64 iResidual = 0;
+                if (!DeltaStateSchema::ReadVarInt(pCur, pEnd, iResidual))
+                {
+                    return false;
+                }
+
+                UINT64 uRun = 1;
+                if (iResidual == 0)
+                {
+                    UINT64 uMore = 0;
+                    if (!DeltaStateSchema::ReadVarUInt(pCur, pEnd, uMore) || uMore >= uCount - i)
+                    {
+                        return false;
+                    }
+                    uRun += uMore;
+                }
+
+                for (UINT64 j = 0; j < uRun; j++)
+                {
+                    INT64 iDelta = uOrder == 2 ? (INT64)((UINT64)iPreviousDelta + (UINT64)iResidual) : iResidual;
+                    iPrevious = (INT64)((UINT64)iPrevious + (UINT64)iDelta);
+                    iPreviousDelta = iDelta;
+                    pValues[i++] = iPrevious;
+                }
+            }
+            return true;
+        }
+
+    private:
+        static void FlushZeroRun(std::vector<BYTE>& vOut, UINT64& uZeroRun)
+        {
+            if (uZeroRun > 0)
+            {
+                vOut.push_back(0);
+                DeltaStateSchema::WriteVarUInt(vOut, uZeroRun - 1);
+                uZeroRun = 0;
+            }
+        }
+    };
+    /** @} */
+}
@@ -0,0 +1,669 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// TelemetryFile.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "ISimObject.h"
+#include "TelemetryCodec.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup isim */ /** @{ */
+
+    /// Description of a telemetry column.
+    struct TelemetryColumnInfo
+    {
+        UINT            uObjectId;      ///< IBaseObjectV400::GetId() of the sampled object, or 0 for caller supplied values
+        int             iIndex;         ///< Property index
+        double          dPrecision;     ///< Quantization step of the values
+        std::wstring    strName;        ///< Property or column name
+        std::wstring    strUnits;       ///< Units of the values
+    };
+
+    /**
+    * File layout shared by TelemetryWriter and TelemetryReader.  All values are little-endian.
+    * The file starts with a FileHeader and is followed by chunks.  Each chunk holds a block of rows
+    * stored column by column: the time column first, then every value column, each compressed with
+    * TelemetryCodec.  The footer describes the columns and, for every chunk, its time range and the
+    * offset and size of each column, so a reader can seek straight to the bytes of the column it needs.
+    * A Trailer at the very end of the file locates the footer.
+    */
+    class TelemetryFile
+    {
+    public:
+        static const UINT32 MAGIC = 0x464D4C54;      // "TLMF"
+        static const UINT32 VERSION = 1;
+
+    protected:
+        struct FileHeader
+        {
+            UINT32  uMagic;
+            UINT32  uVersion;
+            UINT64  uReserved;
+        };
+
+        struct FooterHeader
+        {
+            UINT32  uColumnCount;
+            UINT32  uChunkCount;
+            UINT64  uRowCount;
+        };
+
+        struct FooterColumn
+        {
+            UINT32  uObjectId;
+            INT32   iIndex;
+            double  dPrecision;
+            UINT32  uNameLength;
+            UINT32  uUnitsLength;
+        };
+
+        struct FooterChunk
+        {
+            UINT32  uRows;
+            UINT32  uReserved;
+            INT64   iFirstTime;
+            INT64   iLastTime;
+        };
+
+        /// Location of one column of one chunk.  The time column is column 0.
+        struct ColumnSpan
+        {
+            UINT64  uOffset;
+            UINT32  uSize;
+            UINT32  uReserved;
+        };
+
+        struct Trailer
+        {
+            UINT64  uFooterOffset;
+            UINT32  uMagic;
+            UINT32  uVersion;
+        };
+    };
+
+    /**
+    * Streams rows of object properties to a columnar telemetry file.  Rows are buffered until a chunk
+    * is full and the chunk is then compressed and written, so memory use does not grow with the length
+    * of the export.  Close() writes the footer; a file that was not closed can not be read.
+    * @remarks  If a property read fails the previous value of the column is repeated, which costs one
+    *           byte or less once compressed.
+    * Sample usage:
+    * ```
+    *      TelemetryWriter writer;
+    *      writer.AddPropertyColumn(spObjectManager, spObject, L"PLANE ALTITUDE", L"feet", 0.1);
+    *      writer.AddPropertyColumn(spObjectManager, spObject, L"AIRSPEED INDICATED", L"knots", 0.01);
+    *      writer.Open(L"C:\\Debrief\\flight.tlm");
+    *
+    *      // From OnFrame or an ISimulation::Update():
+    *      writer.Sample(dSimTime);
+    *
+    *      writer.Close();
+    * ```
+    */
+    class TelemetryWriter : public TelemetryFile
+    {
+    public:
+        /**
+        * @param uRowsPerChunk  Rows per chunk.  Larger chunks compress slightly better; smaller chunks
+        *                       let readers skip more precisely by time.
+        */
+        explicit TelemetryWriter(__in UINT uRowsPerChunk = 4096)
+            : m_uRowsPerChunk(uRowsPerChunk > 0 ? uRowsPerChunk : 1)
+        {
+        }
+
+        ~TelemetryWriter()
+        {
+            Close();
+        }
+
+        // The writer owns its FILE*; copies would close it twice.
+        TelemetryWriter(const TelemetryWriter&) = delete;
+        TelemetryWriter& operator=(const TelemetryWriter&) = delete;
+
+        /**
+        * Adds a column read from a double property by Sample().  Columns must be added before Open().
+        * @param pObjectManager Object manager service, used to resolve the unit code.
+        * @param pObject        Object to sample.
+        * @param pszProperty    Double property name.
+        * @param pszUnits       Units of the property.
+        * @param dPrecision     Quantization step of the stored values.
+        * @param iIndex         Property index.
+        * @return               S_OK, E_INVALIDARG, E_UNEXPECTED if the file is open, or the error from resolving the property.
+        */
+        HRESULT AddPropertyColumn(__in __notnull ISimObjectManagerV520* pObjectManager, __in __notnull IBaseObjectV520* pObject,
+                                  __in LPCWSTR pszProperty, __in LPCWSTR pszUnits, __in double dPrecision, __in int iIndex = 0)
+        {
+            Column column;
+            HRESULT hr = InitColumn(column, pszProperty, pszUnits, dPrecision);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            column.info.iIndex = iIndex;
+            hr = pObject->GetPropertyCodeAndIndex(PROPERTY_TYPE_DOUBLE, pszProperty, column.iProperty, column.info.iIndex);
+            if (SUCCEEDED(hr))
+            {
+                hr = pObjectManager->GetUnitCode(pszUnits, column.iUnit);
+            }
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+
+            column.spObject = pObject;
+            column.info.uObjectId = pObject->GetId();
+            m_vColumns.push_back(column);
+            return S_OK;
+        }
+
+        /**
+        * Adds a column whose values are passed to Write() by the caller.  Columns must be added before Open().
+        * @return   S_OK, E_INVALIDARG for a non-positive precision, or E_UNEXPECTED if the file is open.
+        */
+        HRESULT AddColumn(__in LPCWSTR pszName, __in LPCWSTR pszUnits, __in double dPrecision)
+        {
+            Column column;
+            HRESULT hr = InitColumn(column, pszName, pszUnits, dPrecision);
+            if (SUCCEEDED(hr))
+            {
+                m_vColumns.push_back(column);
+            }
+            return hr;
+        }
+
+        /** Creates the file and writes its header. */
+        HRESULT Open(__in LPCWSTR pszPath)
+        {
+            Close();
+            if (_wfopen_s(&m_pFile, pszPath, L"wb") != 0 || m_pFile == nullptr)
+            {
+                m_pFile = nullptr;
+                return E_FAIL;
+            }
+
+            FileHeader header = { MAGIC, VERSION, 0 };
+            m_uOffset = 0;
+            m_uRows = 0;
+            m_vChunks.clear();
+            m_vSpans.clear();
+            m_bFailed = false;
+            m_vTime.clear();
+            m_vTime.reserve(m_uRowsPerChunk);
+            for (Column& column : m_vColumns)
+            {
+                column.vValues.clear();
+                column.vValues.reserve(m_uRowsPerChunk);
+            }
+            WriteBytes(&header, sizeof(header));
+            return m_bFailed ? E_FAIL : S_OK;
+        }
+
+        /**
+        * Reads every property column and appends a row.  Caller supplied columns repeat their last value.
+        * @param dTime  Row time in seconds.  Times should not decrease.
+        */
+        HRESULT Sample(__in double dTime)
+        {
+            if (m_pFile == nullptr)
+            {
+                return E_UNEXPECTED;
+            }
+
+            for (Column& column : m_vColumns)
+            {
+                double dValue = 0.0;
+                if (column.spObject != nullptr && SUCCEEDED(column.spObject->GetProperty(column.iProperty, column.iUnit, dValue, column.info.iIndex)))
+                {
+                    column.iLast = TelemetryCodec::Quantize(dValue, column.info.dPrecision);
+                }
+                column.vValues.push_back(column.iLast);
+            }
+            return AppendTime(dTime);
+        }
+
+        /**
+        * Appends a row of caller supplied values.
+        * @param dTime      Row time in seconds.  Times should not decrease.
+        * @param pValues    One value per column, in the order the columns were added.  Property columns are included.
+        */
+        HRESULT Write(__in double dTime, __in const double* pValues)
+        {
+            if (m_pFile == nullptr)
+            {
+                return E_UNEXPECTED;
+            }
+
+            for (size_t i = 0; i < m_vColumns.size(); i++)
+            {
+                Column& column = m_vColumns[i];
+                column.iLast = TelemetryCodec::Quantize(pValues[i], column.info.dPrecision);
+                column.vValues.push_back(column.iLast);
+            }
+            return AppendTime(dTime);
+        }
+
+        /** Writes the last chunk and the footer and closes the file. */
+        HRESULT Close()
+        {
+            if (m_pFile == nullptr)
+            {
+                return S_OK;
+            }
+
+            FlushChunk();
+
+            const UINT64 uFooterOffset = m_uOffset;
+            FooterHeader footer = { (UINT32)m_vColumns.size(), (UINT32)m_vChunks.size(), m_uRows };
+            WriteBytes(&footer, sizeof(footer));
+            for (const Column& column : m_vColumns)
+            {
+                FooterColumn record = { column.info.uObjectId, column.info.iIndex, column.info.dPrecision,
+                                        (UINT32)column.info.strName.size(), (UINT32)column.info.strUnits.size() };
+                WriteBytes(&record, sizeof(record));
+                WriteBytes(column.info.strName.c_str(), record.uNameLength * sizeof(WCHAR));
+                WriteBytes(column.info.strUnits.c_str(), record.uUnitsLength * sizeof(WCHAR));
+            }
+            const size_t uSpansPerChunk = m_vColumns.size() + 1;
+            for (size_t i = 0; i < m_vChunks.size(); i++)
+            {
+                WriteBytes(&m_vChunks[i], sizeof(FooterChunk));
+                WriteBytes(&m_vSpans[i * uSpansPerChunk], uSpansPerChunk * sizeof(ColumnSpan));
+            }
+            Trailer trailer = { uFooterOffset, MAGIC, VERSION };
+            WriteBytes(&trailer, sizeof(trailer));
+
+            if (fclose(m_pFile) != 0)
+            {
+                m_bFailed = true;
+            }
+            m_pFile = nullptr;
+            return m_bFailed ? E_FAIL : S_OK;
+        }
+
+        UINT GetColumnCount() const { return (UINT)m_vColumns.size(); }
+        /// Rows written since Open().
+        UINT64 GetRowCount() const { return m_uRows; }
+        /// Compressed bytes written since Open().
+        UINT64 GetBytesWritten() const { return m_uOffset; }
+
+    private:
+        struct Column
+        {
+            CComPtr<IBaseObjectV520>    spObject;
+            TelemetryColumnInfo         info;
+            int                         iProperty = 0;
+            int                         iUnit = 0;
+            INT64                       iLast = 0;
+            std::vector<INT64>          vValues;
+        };
+
+        HRESULT InitColumn(Column& column, LPCWSTR pszName, LPCWSTR pszUnits, double dPrecision) const
+        {
+            if (m_pFile != nullptr)
+            {
+                return E_UNEXPECTED;
+            }
+            if (pszName == nullptr || pszUnits == nullptr || dPrecision <= 0.0)
+            {
+                return E_INVALIDARG;
+            }
+            column.info.uObjectId = 0;
+            column.info.iIndex = 0;
+            column.info.dPrecision = dPrecision;
+            column.info.strName = pszName;
+            column.info.strUnits = pszUnits;
+            return S_OK;
+        }
+
+        HRESULT AppendTime(double dTime)
+        {
+            m_vTime.push_back(TelemetryCodec::ToMicroseconds(dTime));
+            m_uRows++;
+            if (m_vTime.size() >= m_uRowsPerChunk)
+            {
+                FlushChunk();
+            }
+            return m_bFailed ? E_FAIL : S_OK;
+        }
+
+        void FlushChunk()
+        {
+            if (m_vTime.empty())
+            {
+                return;
+            }
+
+            FooterChunk chunk = { (UINT32)m_vTime.size(), 0, m_vTime.front(), m_vTime.back() };
+            m_vChunks.push_back(chunk);
+
+            WriteColumn(m_vTime, TelemetryCodec::TIME_ORDER);
+            m_vTime.clear();
+            for (Column& column : m_vColumns)
+            {
+                WriteColumn(column.vValues, TelemetryCodec::VALUE_ORDER);
+                column.vValues.clear();
+            }
+        }
+
+        void WriteColumn(const std::vector<INT64>& vValues, UINT uOrder)
+        {
+            m_vBuffer.clear();
+            TelemetryCodec::EncodeColumn(vValues.data(), (UINT)vValues.size(), uOrder, m_vBuffer);
+
+            ColumnSpan span = { m_uOffset, (UINT32)m_vBuffer.size(), 0 };
+            m_vSpans.push_back(span);
+            WriteBytes(m_vBuffer.data(), m_vBuffer.size());
+        }
+
+        void WriteBytes(const void* pData, size_t uSize)
+        {
+            if (uSize > 0 && fwrite(pData, 1, uSize, m_pFile) != uSize)
+            {
+                m_bFailed = true;
+            }
+            m_uOffset += uSize;
+        }
+
+        std::vector<Column>         m_vColumns;
+        std::vector<INT64>          m_vTime;
+        std::vector<FooterChunk>    m_vChunks;
+        std::vector<ColumnSpan>     m_vSpans;
+        std::vector<BYTE>           m_vBuffer;
+        FILE*                       m_pFile = nullptr;
+        UINT64                      m_uOffset = 0;
+        UINT64                      m_uRows = 0;
+        UINT                        m_uRowsPerChunk;
+        bool                        m_bFailed = false;
+    };
+
+    /**
+    * Reads a file written by TelemetryWriter.  Open() only reads the footer; ReadColumn() then reads
+    * the time column and the requested column of the chunks overlapping the time range, and never
+    * touches the bytes of other columns.
+    * Sample usage:
+    * ```
+    *      TelemetryReader reader;
+    *      reader.Open(L"C:\\Debrief\\flight.tlm");
+    *
+    *      UINT uColumn = 0;
+    *      reader.FindColumn(L"PLANE ALTITUDE", uColumn);
+    *      std::vector<double> vTimes, vValues;
+    *      reader.ReadColumn(uColumn, 0.0, 3600.0, vTimes, vValues);
+    * ```
+    */
+    class TelemetryReader : public TelemetryFile
+    {
+    public:
+        TelemetryReader() = default;
+
+        ~TelemetryReader()
+        {
+            Close();
+        }
+
+        // The reader owns its FILE*; copies would close it twice.
+        TelemetryReader(const TelemetryReader&) = delete;
+        TelemetryReader& operator=(const TelemetryReader&) = delete;
+
+        /** Opens a file and reads its footer. @return S_OK, or E_FAIL if the file is missing, unclosed or malformed. */
+        HRESULT Open(__in LPCWSTR pszPath)
+        {
+            Close();
+            if (_wfopen_s(&m_pFile, pszPath, L"rb") != 0 || m_pFile == nullptr)
+            {
+                m_pFile = nullptr;
+                return E_FAIL;
+            }
+
+            HRESULT hr = ReadFooter();
+            if (FAILED(hr))
+            {
+                Close();
+            }
+            return hr;
+        }
+
+        void Close()
+        {
+            if (m_pFile != nullptr)
+            {
+                fclose(m_pFile);
+                m_pFile = nullptr;
+            }
+            m_vColumns.clear();
+            m_vChunks.clear();
+            m_vSpans.clear();
+            m_uRows = 0;
+            m_uBytesRead = 0;
+        }
+
+        UINT GetColumnCount() const { return (UINT)m_vColumns.size(); }
+        const TelemetryColumnInfo& GetColumnInfo(__in UINT uColumn) const { return m_vColumns[uColumn]; }
+        UINT GetChunkCount() const { return (UINT)m_vChunks.size(); }
+        UINT64 GetRowCount() const { return m_uRows; }
+        /// Bytes read by ReadColumn() since Open().
+        UINT64 GetBytesRead() const { return m_uBytesRead; }
+
+        /** Finds the first column with the given name. */
+        bool FindColumn(__in LPCWSTR pszName, __out UINT& uColumn) const
+        {
+            for (UINT i = 0; i < (UINT)m_vColumns.size(); i++)
+            {
+                if (m_vColumns[i].strName == pszName)
+                {
+                    uColumn = i;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+        * Reads the rows of one column within a time range.
+        * @param uColumn    Column index.
+        * @param dStart     Start of the range in seconds, inclusive.
+        * @param dEnd       End of the range in seconds, inclusive.
+        * @param vTimes     Receives the row times in seconds.
+        * @param vValues    Receives the column values.
+        * @return           S_OK, E_INVALIDARG for an unknown column, E_UNEXPECTED if no file is open, or E_FAIL on a read or decode error.
+        */
+        HRESULT ReadColumn(__in UINT uColumn, __in double dStart, __in double dEnd, __out std::vector<double>& vTimes, __out std::vector<double>& vValues)
+        {
+            vTimes.clear();
+            vValues.clear();
+            if (m_pFile == nullptr)
+            {
+                return E_UNEXPECTED;
+            }
+            if (uColumn >= m_vColumns.size())
+            {
+                return E_INVALIDARG;
+            }
+
+            const INT64 iStart = TelemetryCodec::ToMicroseconds(dStart);
+            const INT64 iEnd = TelemetryCodec::ToMicroseconds(dEnd);
+            const double dPrecision = m_vColumns[uColumn].dPrecision;
+            const size_t uSpansPerChunk = m_vColumns.size() + 1;
+            for (size_t i = 0; i < m_vChunks.size(); i++)
+            {
+                const FooterChunk& chunk = m_vChunks[i];
+                if (chunk.iLastTime < iStart || chunk.iFirstTime > iEnd)
+                {
+                    continue;
+                }
+
+                m_vTime.resize(chunk.uRows);
+                m_vValues.resize(chunk.uRows);
+                if (!DecodeSpan(m_vSpans[i * uSpansPerChunk], chunk.uRows, TelemetryCodec::TIME_ORDER, m_vTime.data()) ||
+                    !DecodeSpan(m_vSpans[i * uSpansPerChunk + 1 + uColumn], chunk.uRows, TelemetryCodec::VALUE_ORDER, m_vValues.data()))
+                {
+                    return E_FAIL;
+                }
+
+                for (UINT32 uRow = 0; uRow < chunk.uRows; uRow++)
+                {
+                    if (m_vTime[uRow] >= iStart && m_vTime[uRow] <= iEnd)
+                    {
+                        vTimes.push_back(TelemetryCodec::ToSeconds(m_vTime[uRow]));
+                        vValues.push_back(TelemetryCodec::Dequantize(m_vValues[uRow], dPrecision));
+                    }
+                }
+            }
+            return S_OK;
+        }
+
+    private:
+        HRESULT ReadFooter()
+        {
+            FileHeader header;
+            Trailer trailer;
+            if (!ReadAt(0, &header, sizeof(header)) || header.uMagic != MAGIC || header.uVersion != VERSION ||
+                _fseeki64(m_pFile, -(INT64)sizeof(trailer), SEEK_END) != 0 || fread(&trailer, sizeof(trailer), 1, m_pFile) != 1 ||
+                trailer.uMagic != MAGIC || trailer.uVersion != VERSION)
+            {
+                return E_FAIL;
+            }
+            const INT64 iTrailerOffset = _ftelli64(m_pFile) - (INT64)sizeof(trailer);
+            if (trailer.uFooterOffset < sizeof(header) || (INT64)trailer.uFooterOffset > iTrailerOffset)
+            {
+                return E_FAIL;
+            }
+
+            std::vector<BYTE> vFooter((size_t)(iTrailerOffset - (INT64)trailer.uFooterOffset));
+            if (!ReadAt(trailer.uFooterOffset, vFooter.data(), vFooter.size()))
+            {
+                return E_FAIL;
+            }
+
+            const BYTE* pCur = vFooter.data();
+            const BYTE* pEnd = pCur + vFooter.size();
+            FooterHeader footer;
+            if (!Read(pCur, pEnd, &footer, sizeof(footer)))
+            {
+                return E_FAIL;
+            }
+            m_uRows = footer.uRowCount;
+
+            for (UINT32 i = 0; i < footer.uColumnCount; i++)
+            {
+                FooterColumn record;
+                if (!Read(pCur, pEnd, &record, sizeof(record)) ||
+                    ((UINT64)record.uNameLength + record.uUnitsLength) * sizeof(WCHAR) > (UINT64)(pEnd - pCur))
+                {
+                    return E_FAIL;
+                }
+                TelemetryColumnInfo info;
+                info.uObjectId = record.uObjectId;
+                info.iIndex = record.iIndex;
+                info.dPrecision = record.dPrecision;
+                info.strName.assign(reinterpret_cast<const WCHAR*>(pCur), record.uNameLength);
+                pCur += record.uNameLength * sizeof(WCHAR);
+                info.strUnits.assign(reinterpret_cast<const WCHAR*>(pCur), record.uUnitsLength);
+                pCur += record.uUnitsLength * sizeof(WCHAR);
+                m_vColumns.push_back(info);
+            }
+
+            // Check the chunk table fits in the footer before sizing anything from its counts.  The per-chunk
+            // size fits in 64 bits for any column count; the product is checked by division.
+            const size_t uSpansPerChunk = m_vColumns.size() + 1;
+            const UINT64 uChunkBytes = sizeof(FooterChunk) + (UINT64)uSpansPerChunk * sizeof(ColumnSpan);
+            if (footer.uChunkCount > 0 && uChunkBytes > (UINT64)(pEnd - pCur) / footer.uChunkCount)
+            {
+                return E_FAIL;
+            }
+            m_vChunks.resize(footer.uChunkCount);
+            m_vSpans.resize((size_t)footer.uChunkCount * uSpansPerChunk);
+            for (UINT32 i = 0; i < footer.uChunkCount; i++)
+            {
+                if (!Read(pCur, pEnd, &m_vChunks[i], sizeof(FooterChunk)) ||
+                    !Read(pCur, pEnd, &m_vSpans[i * uSpansPerChunk], uSpansPerChunk * sizeof(ColumnSpan)))
+                {
+                    return E_FAIL;
+                }
+            }
+            for (const ColumnSpan& span : m_vSpans)
+            {
+                if (span.uSize > trailer.uFooterOffset || span.uOffset > trailer.uFooterOffset - span.uSize)
+                {
+                    return E_FAIL;
+                }
+            }
+
+            // ReadColumn() sizes its buffers from uRows, so every chunk's row count must add up to the footer's
+            // and be one its column bytes could actually hold.  The writer never writes an empty chunk.
+            UINT64 uRowsLeft = footer.uRowCount;
+            for (UINT32 i = 0; i < footer.uChunkCount; i++)
+            {
+                const FooterChunk& chunk = m_vChunks[i];
+                if (chunk.uRows == 0 || chunk.uRows > uRowsLeft || chunk.iFirstTime > chunk.iLastTime)
+                {
+                    return E_FAIL;
+                }
+                for (size_t uSpan = 0; uSpan < uSpansPerChunk; uSpan++)
+                {
+                    if (chunk.uRows > TelemetryCodec::GetMaxCount(m_vSpans[i * uSpansPerChunk + uSpan].uSize))
+                    {
+                        return E_FAIL;
+                    }
+                }
+                uRowsLeft -= chunk.uRows;
+            }
+            if (uRowsLeft != 0)
+            {
+                return E_FAIL;
+            }
+            return S_OK;
+        }
+
+        bool DecodeSpan(const ColumnSpan& span, UINT32 uRows, UINT uOrder, INT64* pValues)
+        {
+            m_vBuffer.resize(span.uSize);
+            if (!ReadAt(span.uOffset, m_vBuffer.data(), span.uSize))
+            {
+                return false;
+            }
+            m_uBytesRead += span.uSize;
+
+            const BYTE* pCur = m_vBuffer.data();
+            return TelemetryCodec::DecodeColumn(pCur, pCur + m_vBuffer.size(), uRows, uOrder, pValues);
+        }
+
+        bool ReadAt(UINT64 uOffset, void* pData, size_t uSize)
+        {
+            return _fseeki64(m_pFile, (INT64)uOffset, SEEK_SET) == 0 && (uSize == 0 || fread(pData, 1, uSize, m_pFile) == uSize);
+        }
+
+        static bool Read(const BYTE*& pCur, const BYTE* pEnd, void* pData, size_t uSize)
+        {
+            if ((size_t)(pEnd - pCur) < uSize)
+            {
+                return false;
+            }
+            memcpy(pData, pCur, uSize);
+            pCur += uSize;
+            return true;
+        }
+
+        std::vector<TelemetryColumnInfo>    m_vColumns;
+        std::vector<FooterChunk>            m_vChunks;
+        std::vector<ColumnSpan>             m_vSpans;
+        std::vector<INT64>                  m_vTime;
+        std::vector<INT64>                  m_vValues;
+        std::vector<BYTE>                   m_vBuffer;
+        FILE*                               m_pFile = nullptr;
+        UINT64                              m_uRows = 0;
+        UINT64                              m_uBytesRead = 0;
+    };
+    /** @} */
+}
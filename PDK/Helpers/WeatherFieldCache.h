@@ -0,0 +1,563 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// WeatherFieldCache.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "IWeatherSystem.h"
+#include "SimulationWorkerPool.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup weatherservice */ /** @{ */
+
+    /// Weather at a point, as returned by WeatherFieldCache queries.
+    struct WeatherSample
+    {
+        float fWindNorth;       ///< North component of the air velocity, knots.  Wind from the south is positive.
+        float fWindEast;        ///< East component of the air velocity, knots.  Wind from the west is positive.
+        float fTemperature;     ///< Deg C
+        float fDewPoint;        ///< Deg C
+        float fPressure;        ///< Millibars at the sample altitude
+        float fVisibility;      ///< Meters
+        float fCloudCover;      ///< Fraction of the sky covered by clouds at the sample altitude, 0 to 1
+    };
+
+    /// Point of a batched WeatherFieldCache query.
+    struct WeatherQuery
+    {
+        double dLatRadians;
+        double dLonRadians;
+        double dAltFeet;
+    };
+
+    /**
+    * Extent and resolution of a WeatherFieldCache grid.  The grid may not cross the poles or the
+    * International Date Line.  Each count must be at least 2.
+    */
+    struct WeatherFieldGrid
+    {
+        double  dLatRadiansMin;
+        double  dLonRadiansMin;
+        double  dAltFeetMin;
+        double  dLatRadiansMax;
+        double  dLonRadiansMax;
+        double  dAltFeetMax;
+        UINT    uLatCount;
+        UINT    uLonCount;
+        UINT    uAltCount;
+    };
+
+    /**
+    * Samples weather station layers into a regular latitude, longitude and altitude grid and answers
+    * point queries by trilinear interpolation, without any COM call or METAR parsing per query.
+    * Stations are registered with their position since IWeatherStationV430 does not report one.  Each
+    * station's cloud, wind aloft, temperature and visibility layers are reduced to a profile at the grid
+    * altitudes, and grid columns blend the profiles of the nearest stations by inverse distance weighting.
+    * @remarks  Update() refreshes incrementally: every call reads at most uStationBudget stations and
+    *           then builds at most uColumnBudget grid columns into a back buffer, optionally in parallel
+    *           on a SimulationWorkerPool.  Queries keep reading the previous grid until the new one is
+    *           complete, so results never mix two refreshes.  Queries must not run concurrently with Update().
+    * @remarks  Wind aloft is interpolated as a vector between layers.  Temperature follows the temperature
+    *           layers and the standard lapse rate outside them, and pressure follows the standard atmosphere
+    *           from the station sea level pressure.  Outside visibility layers the global visibility is used.
+    * Sample usage:
+    * ```
+    *      WeatherFieldGrid grid = { dLatMin, dLonMin, 0.0, dLatMax, dLonMax, 40000.0, 32, 32, 21 };
+    *      WeatherFieldCache cache(grid);
+    *      cache.AddStation("KSEA", dSeaLat, dSeaLon);
+    *      cache.AddStation("KPDX", dPdxLat, dPdxLon);
+    *      cache.Refresh(spWeatherSystem);
+    *
+    *      // Every frame:
+    *      cache.Update(spWeatherSystem, 8, 64);
+    *
+    *      WeatherSample sample;
+    *      cache.Query(dLat, dLon, dAltFeet, sample);
+    * ```
+    */
+    class WeatherFieldCache
+    {
+    public:
+        /// Stations blended into each grid column.
+        static const UINT MAX_BLEND_STATIONS = 4;
+
+        explicit WeatherFieldCache(__in const WeatherFieldGrid& grid)
+            : m_Grid(grid)
+        {
+            m_Grid.uLatCount = std::max(m_Grid.uLatCount, 2u);
+            m_Grid.uLonCount = std::max(m_Grid.uLonCount, 2u);
+            m_Grid.uAltCount = std::max(m_Grid.uAltCount, 2u);
+            m_dLatStep = (m_Grid.dLatRadiansMax - m_Grid.dLatRadiansMin) / (m_Grid.uLatCount - 1);
+            m_dLonStep = (m_Grid.dLonRadiansMax - m_Grid.dLonRadiansMin) / (m_Grid.uLonCount - 1);
+            m_dAltStep = (m_Grid.dAltFeetMax - m_Grid.dAltFeetMin) / (m_Grid.uAltCount - 1);
+
+            const size_t uNodes = (size_t)m_Grid.uLatCount * m_Grid.uLonCount * m_Grid.uAltCount;
+            m_vFront.resize(uNodes);
+            m_vBack.resize(uNodes);
+            Defaults defaults = { 15.0f, 5.0f, STANDARD_PRESSURE, 100000.0f };
+            m_Defaults = defaults;
+            for (UINT i = 0; i < m_Grid.uAltCount; i++)
+            {
+                WeatherSample sample;
+                SampleDefaults(GetAltitudeMeters(i), m_Defaults, sample);
+                for (size_t uColumn = 0; uColumn < (size_t)m_Grid.uLatCount * m_Grid.uLonCount; uColumn++)
+                {
+                    m_vFront[uColumn * m_Grid.uAltCount + i] = sample;
+                }
+            }
+        }
+
+        /**
+        * Registers a station to sample.
+        * @param pszIcao        ICAO passed to IWeatherSystemV500::GetWeatherStation().
+        * @param dLatRadians    Station latitude.
+        * @param dLonRadians    Station longitude.
+        */
+        void AddStation(__in LPCSTR pszIcao, __in double dLatRadians, __in double dLonRadians)
+        {
+            Station station;
+            station.strIcao = pszIcao;
+            station.dLatRadians = dLatRadians;
+            station.dLonRadians = dLonRadians;
+            m_vStations.push_back(station);
+        }
+
+        /**
+        * Advances the incremental refresh.
+        * @param pWeather           Weather system to read stations and global values from.
+        * @param uStationBudget     Maximum number of stations read during this call.
+        * @param uColumnBudget      Maximum number of grid columns built during this call.
+        * @param pPool              Optional pool used to build columns in parallel.
+        * @return                   S_OK if a refreshed grid was published by this call, S_FALSE otherwise.
+        */
+        HRESULT Update(__in __notnull IWeatherSystemV500* pWeather, __in UINT uStationBudget, __in UINT uColumnBudget,
+                       __in SimulationWorkerPool* pPool = nullptr)
+        {
+            if (m_uNextStation == 0 && m_uNextColumn == 0)
+            {
+                m_Defaults.fTemperature = pWeather->GetGlobalTemp();
+                m_Defaults.fDewPoint = pWeather->GetGlobalDewPoint();
+                m_Defaults.fPressure = pWeather->GetGlobalBaroPressure();
+                m_Defaults.fVisibility = pWeather->GetGlobalVisRange();
+            }
+
+            for (UINT i = 0; i < uStationBudget && m_uNextStation < m_vStations.size(); i++)
+            {
+                ReadStation(pWeather, m_vStations[m_uNextStation++]);
+            }
+            if (m_uNextStation < m_vStations.size())
+            {
+                return S_FALSE;
+            }
+
+            const UINT uColumns = m_Grid.uLatCount * m_Grid.uLonCount;
+            const UINT uCount = std::min(uColumnBudget, uColumns - m_uNextColumn);
+            m_vTasks.resize(uCount);
+            for (UINT i = 0; i < uCount; i++)
+            {
+                m_vTasks[i] = m_uNextColumn + i;
+            }
+            if (pPool != nullptr)
+            {
+                pPool->Run(m_vTasks.data(), uCount, &WeatherFieldCache::BuildColumnTask, this);
+            }
+            else
+            {
+                for (UINT uColumn : m_vTasks)
+                {
+                    BuildColumn(uColumn);
+                }
+            }
+            m_uNextColumn += uCount;
+            if (m_uNextColumn < uColumns)
+            {
+                return S_FALSE;
+            }
+
+            m_vFront.swap(m_vBack);
+            m_uVersion++;
+            m_uNextStation = 0;
+            m_uNextColumn = 0;
+            return S_OK;
+        }
+
+        /** Runs a complete refresh immediately. */
+        void Refresh(__in __notnull IWeatherSystemV500* pWeather, __in SimulationWorkerPool* pPool = nullptr)
+        {
+            m_uNextStation = 0;
+            m_uNextColumn = 0;
+            Update(pWeather, UINT_MAX, UINT_MAX, pPool);
+        }
+
+        /**
+        * Interpolates the weather at a point.  Points outside the grid are clamped to its boundary.
+        * @return   S_OK, or E_INVALIDARG and a zeroed sample if a coordinate is NaN.
+        */
+        HRESULT Query(__in double dLatRadians, __in double dLonRadians, __in double dAltFeet, __out WeatherSample& sample) const
+        {
+            if (std::isnan(dLatRadians) || std::isnan(dLonRadians) || std::isnan(dAltFeet))
+            {
+                memset(&sample, 0, sizeof(sample));
+                return E_INVALIDARG;
+            }
+
+            double dLat = Clamp((dLatRadians - m_Grid.dLatRadiansMin) / m_dLatStep, m_Grid.uLatCount);
+            double dLon = Clamp((dLonRadians - m_Grid.dLonRadiansMin) / m_dLonStep, m_Grid.uLonCount);
+            double dAlt = Clamp((dAltFeet - m_Grid.dAltFeetMin) / m_dAltStep, m_Grid.uAltCount);
+
+            UINT uLat = std::min((UINT)dLat, m_Grid.uLatCount - 2);
+            UINT uLon = std::min((UINT)dLon, m_Grid.uLonCount - 2);
+            UINT uAlt = std::min((UINT)dAlt, m_Grid.uAltCount - 2);
+            const float fLat = (float)(dLat - uLat);
+            const float fLon = (float)(dLon - uLon);
+            const float fAlt = (float)(dAlt - uAlt);
+
+            const size_t uAltStride = 1;
+            const size_t uLonStride = m_Grid.uAltCount;
+            const size_t uLatStride = (size_t)m_Grid.uLonCount * m_Grid.uAltCount;
+            const WeatherSample* p000 = &m_vFront[uLat * uLatStride + uLon * uLonStride + uAlt];
+
+            const float fWeights[8] =
+            {
+                (1 - fLat) * (1 - fLon) * (1 - fAlt), (1 - fLat) * (1 - fLon) * fAlt,
+                (1 - fLat) * fLon * (1 - fAlt),       (1 - fLat) * fLon * fAlt,
+                fLat * (1 - fLon) * (1 - fAlt),       fLat * (1 - fLon) * fAlt,
+                fLat * fLon * (1 - fAlt),             fLat * fLon * fAlt,
+            };
+            const WeatherSample* pCorners[8] =
+            {
+                p000,                           p000 + uAltStride,
+                p000 + uLonStride,              p000 + uLonStride + uAltStride,
+                p000 + uLatStride,              p000 + uLatStride + uAltStride,
+                p000 + uLatStride + uLonStride, p000 + uLatStride + uLonStride + uAltStride,
+            };
+
+            float fResult[FIELD_COUNT] = {};
+            for (UINT i = 0; i < 8; i++)
+            {
+                const float* pFields = &pCorners[i]->fWindNorth;
+                for (UINT uField = 0; uField < FIELD_COUNT; uField++)
+                {
+                    fResult[uField] += fWeights[i] * pFields[uField];
+                }
+            }
+            memcpy(&sample, fResult, sizeof(sample));
+            return S_OK;
+        }
+
+        /** Interpolates the weather at a batch of points. @return S_OK, or E_INVALIDARG if any point had a NaN coordinate. */
+        HRESULT QueryBatch(__in const WeatherQuery* pQueries, __in UINT uCount, __out WeatherSample* pSamples) const
+        {
+            HRESULT hr = S_OK;
+            for (UINT i = 0; i < uCount; i++)
+            {
+                if (FAILED(Query(pQueries[i].dLatRadians, pQueries[i].dLonRadians, pQueries[i].dAltFeet, pSamples[i])))
+                {
+                    hr = E_INVALIDARG;
+                }
+            }
+            return hr;
+        }
+
+        /// Number of grids published by Update() and Refresh().
+        UINT64 GetVersion() const { return m_uVersion; }
+        /// True while a refresh is part way through.
+        bool IsRefreshing() const { return m_uNextStation != 0 || m_uNextColumn != 0; }
+        UINT GetStationCount() const { return (UINT)m_vStations.size(); }
+        const WeatherFieldGrid& GetGrid() const { return m_Grid; }
+
+    private:
+        static const UINT FIELD_COUNT = sizeof(WeatherSample) / sizeof(float);
+        static constexpr float STANDARD_PRESSURE = 1013.25f;
+        static constexpr float LAPSE_RATE = 0.0065f;      // Deg C per meter
+        static constexpr double FEET_TO_METERS = 0.3048;
+
+        struct Defaults
+        {
+            float fTemperature;
+            float fDewPoint;
+            float fPressure;
+            float fVisibility;
+        };
+
+        struct Station
+        {
+            std::string                 strIcao;
+            double                      dLatRadians = 0.0;
+            double                      dLonRadians = 0.0;
+            bool                        bValid = false;
+            std::vector<WeatherSample>  vProfile;
+        };
+
+        /// Reads a station's layers and reduces them to a profile at the grid altitudes.
+        void ReadStation(IWeatherSystemV500* pWeather, Station& station)
+        {
+            CComPtr<IWeatherStationV430> spStation;
+            station.bValid = SUCCEEDED(pWeather->GetWeatherStation(station.strIcao.c_str(), &spStation)) && spStation != nullptr && spStation->IsValid();
+            if (!station.bValid)
+            {
+                return;
+            }
+
+            m_vAloft.clear();
+            for (UINT i = 0; i < spStation->GetAloftLayerCount(); i++)
+            {
+                WindAloftLayer layer;
+                if (SUCCEEDED(spStation->GetAloftLayerAtIndex(i, layer)))
+                {
+                    m_vAloft.push_back(layer);
+                }
+            }
+            std::sort(m_vAloft.begin(), m_vAloft.end(), [](const WindAloftLayer& a, const WindAloftLayer& b) { return a.fAlt < b.fAlt; });
+
+            m_vTemp.clear();
+            for (UINT i = 0; i < spStation->GetTempLayerCount(); i++)
+            {
+                TempLayer layer;
+                if (SUCCEEDED(spStation->GetTempLayerAtIndex(i, layer)))
+                {
+                    m_vTemp.push_back(layer);
+                }
+            }
+            std::sort(m_vTemp.begin(), m_vTemp.end(), [](const TempLayer& a, const TempLayer& b) { return a.fAlt < b.fAlt; });
+
+            m_vVis.clear();
+            for (UINT i = 0; i < spStation->GetVisibilityLayerCount(); i++)
+            {
+                VisibilityLayer layer;
+                if (SUCCEEDED(spStation->GetVisibilityLayerAtIndex(i, layer)))
+                {
+                    m_vVis.push_back(layer);
+                }
+            }
+
+            m_vClouds.clear();
+            const int iClouds = spStation->GetCloudLayerCount();
+            for (int i = 0; i < iClouds; i++)
+            {
+                CloudLayer layer;
+                if (SUCCEEDED(spStation->GetCloudAtIndex((UINT)i, layer)))
+                {
+                    m_vClouds.push_back(layer);
+                }
+            }
+
+            const float fBaro = spStation->GetBaroPressure();
+            const float fSeaLevelPressure = fBaro > 0.0f ? fBaro : m_Defaults.fPressure;
+
+            station.vProfile.resize(m_Grid.uAltCount);
+            for (UINT i = 0; i < m_Grid.uAltCount; i++)
+            {
+                const float fAltMeters = GetAltitudeMeters(i);
+                WeatherSample& sample = station.vProfile[i];
+                SampleDefaults(fAltMeters, m_Defaults, sample);
+                sample.fPressure = PressureAtAltitude(fSeaLevelPressure, fAltMeters);
+                SampleWind(m_vAloft, fAltMeters, sample);
+                SampleTemperature(m_vTemp, fAltMeters, sample);
+
+                for (const VisibilityLayer& layer : m_vVis)
+                {
+                    if (fAltMeters >= layer.fBase && fAltMeters <= layer.fTops)
+                    {
+                        sample.fVisibility = std::min(sample.fVisibility, layer.fVis);
+                    }
+                }
+                for (const CloudLayer& layer : m_vClouds)
+                {
+                    if (fAltMeters >= layer.fCloudBase && fAltMeters <= layer.fCloudTops)
+                    {
+                        sample.fCloudCover = std::max(sample.fCloudCover, (float)layer.eCloudCover / (float)CLOUD_OVERCAST_8_8);
+                    }
+                }
+            }
+        }
+
+        static void BuildColumnTask(void* pContext, UINT uColumn)
+        {
+            static_cast<WeatherFieldCache*>(pContext)->BuildColumn(uColumn);
+        }
+
+        /// Blends the profiles of the nearest stations into one grid column of the back buffer.
+        void BuildColumn(UINT uColumn)
+        {
+            const UINT uLat = uColumn / m_Grid.uLonCount;
+            const UINT uLon = uColumn % m_Grid.uLonCount;
+            const double dLat = m_Grid.dLatRadiansMin + uLat * m_dLatStep;
+            const double dLon = m_Grid.dLonRadiansMin + uLon * m_dLonStep;
+            const double dCosLat = cos(dLat);
+
+            const Station* pNearest[MAX_BLEND_STATIONS] = {};
+            double dNearest[MAX_BLEND_STATIONS] = {};
+            UINT uNearest = 0;
+            for (const Station& station : m_vStations)
+            {
+                if (!station.bValid)
+                {
+                    continue;
+                }
+                const double dNorth = station.dLatRadians - dLat;
+                const double dEast = (station.dLonRadians - dLon) * dCosLat;
+                const double dDistanceSq = dNorth * dNorth + dEast * dEast;
+
+                // Insertion into the short sorted list of nearest stations.
+                UINT uSlot = uNearest < MAX_BLEND_STATIONS ? uNearest++ : MAX_BLEND_STATIONS;
+                while (uSlot > 0 && dNearest[uSlot - 1] > dDistanceSq)
+                {
+                    if (uSlot < MAX_BLEND_STATIONS)
+                    {
+                        dNearest[uSlot] = dNearest[uSlot - 1];
+                        pNearest[uSlot] = pNearest[uSlot - 1];
+                    }
+                    uSlot--;
+                }
+                if (uSlot < MAX_BLEND_STATIONS)
+                {
+                    dNearest[uSlot] = dDistanceSq;
+                    pNearest[uSlot] = &station;
+                }
+            }
+
+            float fWeights[MAX_BLEND_STATIONS] = {};
+            float fTotal = 0.0f;
+            for (UINT i = 0; i < uNearest; i++)
+            {
+                // 1e-12 rad^2 is a few centimeters, enough to keep a node on top of a station finite.
+                fWeights[i] = (float)(1.0 / (dNearest[i] + 1e-12));
+                fTotal += fWeights[i];
+            }
+
+            WeatherSample* pColumn = &m_vBack[(size_t)uColumn * m_Grid.uAltCount];
+            for (UINT uAlt = 0; uAlt < m_Grid.uAltCount; uAlt++)
+            {
+                if (uNearest == 0)
+                {
+                    SampleDefaults(GetAltitudeMeters(uAlt), m_Defaults, pColumn[uAlt]);
+                    continue;
+                }
+
+                float fResult[FIELD_COUNT] = {};
+                for (UINT i = 0; i < uNearest; i++)
+                {
+                    const float* pFields = &pNearest[i]->vProfile[uAlt].fWindNorth;
+                    const float fWeight = fWeights[i] / fTotal;
+                    for (UINT uField = 0; uField < FIELD_COUNT; uField++)
+                    {
+                        fResult[uField] += fWeight * pFields[uField];
+                    }
+                }
+                memcpy(&pColumn[uAlt], fResult, sizeof(WeatherSample));
+            }
+        }
+
+        float GetAltitudeMeters(UINT uAlt) const
+        {
+            return (float)((m_Grid.dAltFeetMin + uAlt * m_dAltStep) * FEET_TO_METERS);
+        }
+
+        static double Clamp(double dIndex, UINT uCount)
+        {
+            return dIndex < 0.0 ? 0.0 : (dIndex > uCount - 1 ? uCount - 1 : dIndex);
+        }
+
+        static float PressureAtAltitude(float fSeaLevelPressure, float fAltMeters)
+        {
+            // Standard atmosphere troposphere.
+            float fRatio = std::max(1.0f - 2.25577e-5f * fAltMeters, 0.0f);
+            return fSeaLevelPressure * powf(fRatio, 5.25588f);
+        }
+
+        static void SampleDefaults(float fAltMeters, const Defaults& defaults, WeatherSample& sample)
+        {
+            sample.fWindNorth = 0.0f;
+            sample.fWindEast = 0.0f;
+            sample.fTemperature = defaults.fTemperature - LAPSE_RATE * fAltMeters;
+            sample.fDewPoint = std::min(defaults.fDewPoint - LAPSE_RATE * fAltMeters, sample.fTemperature);
+            sample.fPressure = PressureAtAltitude(defaults.fPressure, fAltMeters);
+            sample.fVisibility = defaults.fVisibility;
+            sample.fCloudCover = 0.0f;
+        }
+
+        static void SampleWind(const std::vector<WindAloftLayer>& vLayers, float fAltMeters, WeatherSample& sample)
+        {
+            if (vLayers.empty())
+            {
+                return;
+            }
+
+            size_t uUpper = 0;
+            while (uUpper < vLayers.size() && vLayers[uUpper].fAlt < fAltMeters)
+            {
+                uUpper++;
+            }
+            const WindAloftLayer& upper = vLayers[std::min(uUpper, vLayers.size() - 1)];
+            const WindAloftLayer& lower = vLayers[uUpper > 0 ? uUpper - 1 : 0];
+            float fT = upper.fAlt > lower.fAlt ? (fAltMeters - lower.fAlt) / (upper.fAlt - lower.fAlt) : 0.0f;
+            fT = std::min(std::max(fT, 0.0f), 1.0f);
+
+            // Layer directions are where the wind blows from.
+            const float fDegToRad = 0.01745329252f;
+            float fLowerNorth = -lower.fSpeed * cosf(lower.fDirection * fDegToRad);
+            float fLowerEast = -lower.fSpeed * sinf(lower.fDirection * fDegToRad);
+            float fUpperNorth = -upper.fSpeed * cosf(upper.fDirection * fDegToRad);
+            float fUpperEast = -upper.fSpeed * sinf(upper.fDirection * fDegToRad);
+            sample.fWindNorth = fLowerNorth + (fUpperNorth - fLowerNorth) * fT;
+            sample.fWindEast = fLowerEast + (fUpperEast - fLowerEast) * fT;
+        }
+
+        static void SampleTemperature(const std::vector<TempLayer>& vLayers, float fAltMeters, WeatherSample& sample)
+        {
+            if (vLayers.empty())
+            {
+                return;
+            }
+
+            if (fAltMeters <= vLayers.front().fAlt || fAltMeters >= vLayers.back().fAlt)
+            {
+                const TempLayer& layer = fAltMeters <= vLayers.front().fAlt ? vLayers.front() : vLayers.back();
+                const float fOffset = LAPSE_RATE * (fAltMeters - layer.fAlt);
+                sample.fTemperature = layer.fTemp - fOffset;
+                sample.fDewPoint = std::min(layer.fDewPoint - fOffset, sample.fTemperature);
+                return;
+            }
+
+            size_t uUpper = 1;
+            while (vLayers[uUpper].fAlt < fAltMeters)
+            {
+                uUpper++;
+            }
+            const TempLayer& lower = vLayers[uUpper - 1];
+            const TempLayer& upper = vLayers[uUpper];
+            const float fT = upper.fAlt > lower.fAlt ? (fAltMeters - lower.fAlt) / (upper.fAlt - lower.fAlt) : 0.0f;
+            sample.fTemperature = lower.fTemp + (upper.fTemp - lower.fTemp) * fT;
+            sample.fDewPoint = lower.fDewPoint + (upper.fDewPoint - lower.fDewPoint) * fT;
+        }
+
+        WeatherFieldGrid            m_Grid;
+        double                      m_dLatStep;
+        double                      m_dLonStep;
+        double                      m_dAltStep;
+        Defaults                    m_Defaults;
+        std::vector<Station>        m_vStations;
+        std::vector<WeatherSample>  m_vFront;
+        std::vector<WeatherSample>  m_vBack;
+        std::vector<UINT>           m_vTasks;
+        std::vector<WindAloftLayer> m_vAloft;
+        std::vector<TempLayer>      m_vTemp;
+        std::vector<VisibilityLayer> m_vVis;
+        std::vector<CloudLayer>     m_vClouds;
+        UINT64                      m_uVersion = 0;
+        size_t                      m_uNextStation = 0;
+        UINT                        m_uNextColumn = 0;
+    };
+    /** @} */
+}
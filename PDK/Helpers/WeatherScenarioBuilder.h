@@ -0,0 +1,417 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// WeatherScenarioBuilder.h
+
+#pragma once
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include "IWeatherSystem.h"
+#include "MetarCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup weatherservice */ /** @{ */
+
+    /// Desired layers and values of one weather station.
+    struct WeatherStationState
+    {
+        float                           fBaroPressure = 0.0f;   ///< Millibars at sea level.  0 leaves the pressure unchanged.
+        float                           fSurfaceWind = -1.0f;   ///< Knots.  Negative leaves the surface wind unchanged.
+        std::vector<CloudLayer>         vClouds;
+        std::vector<WindAloftLayer>     vWinds;
+        std::vector<TempLayer>          vTemps;
+        std::vector<VisibilityLayer>    vVisibilities;
+
+        /// Fills the state from a parsed METAR.  Surface winds set fSurfaceWind and are not added as aloft layers.
+        void SetFromMetar(__in const MetarData& metar)
+        {
+            fBaroPressure = metar.fBaroPressure;
+            fSurfaceWind = -1.0f;
+            vClouds.assign(metar.Clouds, metar.Clouds + std::min(metar.uCloudCount, (UINT)MetarData::MAX_LAYERS));
+            vTemps.assign(metar.Temps, metar.Temps + std::min(metar.uTempCount, (UINT)MetarData::MAX_LAYERS));
+            vVisibilities.assign(metar.Visibilities, metar.Visibilities + std::min(metar.uVisibilityCount, (UINT)MetarData::MAX_LAYERS));
+            vWinds.clear();
+            for (UINT i = 0; i < metar.uWindCount && i < MetarData::MAX_LAYERS; i++)
+            {
+                if (metar.Winds[i].fAlt > 0.0f)
+                {
+                    vWinds.push_back(metar.Winds[i]);
+                }
+                else
+                {
+                    fSurfaceWind = metar.Winds[i].fSpeed;
+                }
+            }
+        }
+    };
+
+    /// Progress of a WeatherScenarioBuilder transaction.
+    struct WeatherScenarioStats
+    {
+        UINT    uStationsPending;   ///< Stations not yet applied
+        UINT    uStationsApplied;   ///< Stations that needed at least one edit
+        UINT    uStationsUnchanged; ///< Stations that already matched
+        UINT    uStationsFailed;    ///< Stations that could not be found or rejected an edit
+        UINT    uEdits;             ///< Add, remove, clear and set calls issued
+    };
+
+    /**
+    * Pushes a weather scenario to many weather stations with the fewest IWeatherStationV430 edits.
+    * Desired station states are staged with SetStation() and applied as one transaction by Apply(),
+    * which is called once per frame with a budget.  For every station the current layers are read and
+    * compared with the desired ones: layers already present are kept, stale layers are removed and
+    * missing layers are added.  When every layer of a kind is stale a single clear replaces the
+    * removals.
+    * @remarks  All edits of a station are issued in the same frame, so no station is ever observed
+    *           half edited.  A station is deferred to the next frame when its edits do not fit in the
+    *           remaining budget, except that the first station of a frame is always applied so that
+    *           stations with more edits than the budget still make progress.
+    * @remarks  Reading a station costs one unit of budget and each edit costs one unit.
+    * Sample usage:
+    * ```
+    *      WeatherScenarioBuilder builder;
+    *      for (const Station& station : vScenario)
+    *      {
+    *          WeatherStationState state;
+    *          state.SetFromMetar(station.metar);
+    *          builder.SetStation(station.szIcao, state);
+    *      }
+    *      builder.Commit();
+    *
+    *      // Every frame:
+    *      if (builder.Apply(spWeatherSystem, 200) == S_OK)
+    *      {
+    *          // Scenario fully applied.
+    *      }
+    * ```
+    */
+    class WeatherScenarioBuilder
+    {
+    public:
+        /**
+        * Stages the desired state of a station.  Staging the same station again replaces its state.
+        * Staged stations are not applied until Commit().
+        */
+        void SetStation(__in LPCSTR pszIcao, __in const WeatherStationState& state)
+        {
+            for (PendingStation& station : m_vStaged)
+            {
+                if (station.strIcao == pszIcao)
+                {
+                    station.State = state;
+                    return;
+                }
+            }
+            PendingStation station;
+            station.strIcao = pszIcao;
+            station.State = state;
+            m_vStaged.push_back(station);
+        }
+
+        /// Discards staged stations that have not been committed.
+        void ClearStaged()
+        {
+            m_vStaged.clear();
+        }
+
+        /**
+        * Makes the staged stations the transaction applied by Apply().  Any unfinished earlier
+        * transaction is replaced.
+        */
+        void Commit()
+        {
+            m_vPending.swap(m_vStaged);
+            m_vStaged.clear();
+            m_uNext = 0;
+            m_Stats = WeatherScenarioStats();
+            m_Stats.uStationsPending = (UINT)m_vPending.size();
+        }
+
+        /**
+        * Applies committed stations until the budget is spent.
+        * @param pWeather   Weather system owning the stations.
+        * @param uBudget    Station reads plus layer edits allowed during this call.
+        * @return           S_OK when every committed station has been applied, S_FALSE if stations remain.
+        */
+        HRESULT Apply(__in __notnull IWeatherSystemV500* pWeather, __in UINT uBudget)
+        {
+            UINT uSpent = 0;
+            while (m_uNext < m_vPending.size() && uSpent < uBudget)
+            {
+                PendingStation& pending = m_vPending[m_uNext];
+                CComPtr<IWeatherStationV430> spStation;
+                if (FAILED(pWeather->GetWeatherStation(pending.strIcao.c_str(), &spStation)) || spStation == nullptr || !spStation->IsValid())
+                {
+                    uSpent++;
+                    FinishStation(false, false);
+                    continue;
+                }
+
+                Plan(spStation, pending.State);
+                const UINT uEdits = (UINT)m_vEdits.size();
+                if (uSpent > 0 && uSpent + 1 + uEdits > uBudget)
+                {
+                    break;
+                }
+
+                bool bSucceeded = true;
+                for (const Edit& edit : m_vEdits)
+                {
+                    bSucceeded &= SUCCEEDED(Execute(spStation, pending.State, edit));
+                }
+                uSpent += 1 + uEdits;
+                m_Stats.uEdits += uEdits;
+                FinishStation(bSucceeded, uEdits > 0);
+            }
+
+            if (m_uNext < m_vPending.size())
+            {
+                return S_FALSE;
+            }
+            m_vPending.clear();
+            m_uNext = 0;
+            return S_OK;
+        }
+
+        /// Progress of the committed transaction.
+        const WeatherScenarioStats& GetStats() const { return m_Stats; }
+
+        /// True while committed stations remain to be applied.
+        bool IsApplying() const { return m_uNext < m_vPending.size(); }
+
+    private:
+        enum LAYER_KIND
+        {
+            LAYER_CLOUD,
+            LAYER_WIND,
+            LAYER_TEMP,
+            LAYER_VISIBILITY,
+            LAYER_BARO,
+            LAYER_SURFACE_WIND,
+        };
+
+        enum EDIT_TYPE
+        {
+            EDIT_REMOVE,
+            EDIT_CLEAR,
+            EDIT_ADD,
+            EDIT_SET,
+        };
+
+        struct Edit
+        {
+            LAYER_KIND  eKind;
+            EDIT_TYPE   eType;
+            int         iIndex;     ///< Current layer index for EDIT_REMOVE, desired layer index for EDIT_ADD
+        };
+
+        struct PendingStation
+        {
+            std::string         strIcao;
+            WeatherStationState State;
+        };
+
+        static bool Near(float a, float b)
+        {
+            return fabsf(a - b) <= 0.01f;
+        }
+
+        // Only the fields MetarCodec parses, and so SetFromMetar() fills, are compared.  Cloud density,
+        // scatter and deviation and the temperature range are never set from a METAR, so comparing them
+        // would re-add layers that already match.
+        static bool Equal(const CloudLayer& a, const CloudLayer& b)
+        {
+            return a.eCloudType == b.eCloudType && a.eCloudCover == b.eCloudCover && a.eCloudTop == b.eCloudTop &&
+                   a.eTurbulance == b.eTurbulance && a.ePrecipType == b.ePrecipType && a.ePrecipRate == b.ePrecipRate &&
+                   a.eIcingRate == b.eIcingRate && Near(a.fCloudBase, b.fCloudBase) && Near(a.fCloudTops, b.fCloudTops) &&
+                   Near(a.fPrecipBase, b.fPrecipBase);
+        }
+
+        static bool Equal(const WindAloftLayer& a, const WindAloftLayer& b)
+        {
+            return a.eTurb == b.eTurb && a.eWindShear == b.eWindShear && Near(a.fAlt, b.fAlt) && Near(a.fSpeed, b.fSpeed) &&
+                   Near(a.fGusts, b.fGusts) && Near(a.fDirection, b.fDirection) && Near(a.fVariance, b.fVariance);
+        }
+
+        static bool Equal(const TempLayer& a, const TempLayer& b)
+        {
+            return Near(a.fAlt, b.fAlt) && Near(a.fTemp, b.fTemp) && Near(a.fDewPoint, b.fDewPoint);
+        }
+
+        static bool Equal(const VisibilityLayer& a, const VisibilityLayer& b)
+        {
+            return Near(a.fVis, b.fVis) && Near(a.fBase, b.fBase) && Near(a.fTops, b.fTops);
+        }
+
+        /**
+        * Appends the edits that turn the current layers into the desired ones.  Removals come first,
+        * highest index first, so the indices of the remaining current layers stay valid.
+        */
+        template<class T>
+        void Diff(LAYER_KIND eKind, const std::vector<T>& vCurrent, const std::vector<T>& vDesired)
+        {
+            m_vMatched.assign(vCurrent.size(), false);
+            m_vAdds.clear();
+            for (size_t i = 0; i < vDesired.size(); i++)
+            {
+                size_t j = 0;
+                while (j < vCurrent.size() && (m_vMatched[j] || !Equal(vCurrent[j], vDesired[i])))
+                {
+                    j++;
+                }
+                if (j < vCurrent.size())
+                {
+                    m_vMatched[j] = true;
+                }
+                else
+                {
+                    m_vAdds.push_back((int)i);
+                }
+            }
+
+            const size_t uKept = vDesired.size() - m_vAdds.size();
+            const size_t uStale = vCurrent.size() - uKept;
+            if (uKept == 0 && uStale > 1)
+            {
+                Edit edit = { eKind, EDIT_CLEAR, 0 };
+                m_vEdits.push_back(edit);
+            }
+            else
+            {
+                for (size_t j = vCurrent.size(); j-- > 0;)
+                {
+                    if (!m_vMatched[j])
+                    {
+                        Edit edit = { eKind, EDIT_REMOVE, (int)j };
+                        m_vEdits.push_back(edit);
+                    }
+                }
+            }
+            for (int iAdd : m_vAdds)
+            {
+                Edit edit = { eKind, EDIT_ADD, iAdd };
+                m_vEdits.push_back(edit);
+            }
+        }
+
+        void Plan(IWeatherStationV430* pStation, const WeatherStationState& state)
+        {
+            m_vEdits.clear();
+
+            const int iClouds = pStation->GetCloudLayerCount();
+            m_vClouds.resize(iClouds > 0 ? (size_t)iClouds : 0);
+            for (size_t i = 0; i < m_vClouds.size(); i++)
+            {
+                pStation->GetCloudAtIndex((UINT)i, m_vClouds[i]);
+            }
+            Diff(LAYER_CLOUD, m_vClouds, state.vClouds);
+
+            m_vWinds.resize(pStation->GetAloftLayerCount());
+            for (size_t i = 0; i < m_vWinds.size(); i++)
+            {
+                pStation->GetAloftLayerAtIndex((UINT)i, m_vWinds[i]);
+            }
+            Diff(LAYER_WIND, m_vWinds, state.vWinds);
+
+            m_vTemps.resize(pStation->GetTempLayerCount());
+            for (size_t i = 0; i < m_vTemps.size(); i++)
+            {
+                pStation->GetTempLayerAtIndex((UINT)i, m_vTemps[i]);
+            }
+            Diff(LAYER_TEMP, m_vTemps, state.vTemps);
+
+            m_vVisibilities.resize(pStation->GetVisibilityLayerCount());
+            for (size_t i = 0; i < m_vVisibilities.size(); i++)
+            {
+                pStation->GetVisibilityLayerAtIndex((UINT)i, m_vVisibilities[i]);
+            }
+            Diff(LAYER_VISIBILITY, m_vVisibilities, state.vVisibilities);
+
+            if (state.fBaroPressure > 0.0f && !Near(pStation->GetBaroPressure(), state.fBaroPressure))
+            {
+                Edit edit = { LAYER_BARO, EDIT_SET, 0 };
+                m_vEdits.push_back(edit);
+            }
+            if (state.fSurfaceWind >= 0.0f && !Near(pStation->GetSurfaceWind(), state.fSurfaceWind))
+            {
+                Edit edit = { LAYER_SURFACE_WIND, EDIT_SET, 0 };
+                m_vEdits.push_back(edit);
+            }
+        }
+
+        static HRESULT Execute(IWeatherStationV430* pStation, const WeatherStationState& state, const Edit& edit)
+        {
+            switch (edit.eKind)
+            {
+                case LAYER_CLOUD:
+                {
+                    CloudLayer layer = edit.eType == EDIT_ADD ? state.vClouds[edit.iIndex] : CloudLayer();
+                    return edit.eType == EDIT_ADD ? pStation->AddNewCloudToTower(layer) :
+                           edit.eType == EDIT_CLEAR ? pStation->ClearAllCloudsAtTower() : pStation->RemoveCloudLayerFromTower(edit.iIndex);
+                }
+                case LAYER_WIND:
+                {
+                    WindAloftLayer layer = edit.eType == EDIT_ADD ? state.vWinds[edit.iIndex] : WindAloftLayer();
+                    return edit.eType == EDIT_ADD ? pStation->AddNewAloftToTower(layer) :
+                           edit.eType == EDIT_CLEAR ? pStation->ClearAllWindLayersFromTower() : pStation->RemoveAloftLayerFromTower(edit.iIndex);
+                }
+                case LAYER_TEMP:
+                {
+                    TempLayer layer = edit.eType == EDIT_ADD ? state.vTemps[edit.iIndex] : TempLayer();
+                    return edit.eType == EDIT_ADD ? pStation->AddNewTempToTower(layer) :
+                           edit.eType == EDIT_CLEAR ? pStation->ClearAllTempLayersFromTower() : pStation->RemoveTempLayerFromTower(edit.iIndex);
+                }
+                case LAYER_VISIBILITY:
+                {
+                    VisibilityLayer layer = edit.eType == EDIT_ADD ? state.vVisibilities[edit.iIndex] : VisibilityLayer();
+                    return edit.eType == EDIT_ADD ? pStation->AddNewVisToTower(layer) :
+                           edit.eType == EDIT_CLEAR ? pStation->ClearAllVisLayersFromTower() : pStation->RemoveVisLayerFromTower(edit.iIndex);
+                }
+                case LAYER_BARO:
+                    return pStation->SetBaroPressure(state.fBaroPressure);
+                case LAYER_SURFACE_WIND:
+                    return pStation->SetSurfaceWind(state.fSurfaceWind);
+            }
+            return E_UNEXPECTED;
+        }
+
+        void FinishStation(bool bSucceeded, bool bChanged)
+        {
+            if (!bSucceeded)
+            {
+                m_Stats.uStationsFailed++;
+            }
+            else if (bChanged)
+            {
+                m_Stats.uStationsApplied++;
+            }
+            else
+            {
+                m_Stats.uStationsUnchanged++;
+            }
+            m_Stats.uStationsPending--;
+            m_uNext++;
+        }
+
+        std::vector<PendingStation>     m_vStaged;
+        std::vector<PendingStation>     m_vPending;
+        size_t                          m_uNext = 0;
+        WeatherScenarioStats            m_Stats = {};
+
+        // Scratch reused across stations.
+        std::vector<Edit>               m_vEdits;
+        std::vector<bool>               m_vMatched;
+        std::vector<int>                m_vAdds;
+        std::vector<CloudLayer>         m_vClouds;
+        std::vector<WindAloftLayer>     m_vWinds;
+        std::vector<TempLayer>          m_vTemps;
+        std::vector<VisibilityLayer>    m_vVisibilities;
+    };
+    /** @} */
+}
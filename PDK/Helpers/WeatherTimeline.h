@@ -0,0 +1,634 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// WeatherTimeline.h
+
+#pragma once
+#include <ObjBase.h>
+#include "IGlobalData.h"
+#include "IWeatherSystem.h"
+#include "MetarCodec.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace P3D
+{
+    /** @addtogroup weatherservice */ /** @{ */
+
+    /// Global weather values driven by a WeatherTimeline.
+    enum WEATHER_TIMELINE_GLOBAL
+    {
+        WEATHER_TIMELINE_TEMP,              ///< SetGlobalTemp(), deg C
+        WEATHER_TIMELINE_DEW_POINT,         ///< SetGlobalDewPoint(), deg C
+        WEATHER_TIMELINE_VIS_RANGE,         ///< SetGlobalVisRange(), meters
+        WEATHER_TIMELINE_WIND_SPEED,        ///< SetGlobalHorizWindSpeed(), knots, sent as meters per second
+        WEATHER_TIMELINE_WIND_DIRECTION,    ///< SetGlobalWindDirection(), degrees
+        WEATHER_TIMELINE_BARO_PRESSURE,     ///< SetGlobalBaroPressure(), millibars
+        WEATHER_TIMELINE_GLOBAL_COUNT
+    };
+
+    /**
+    * Plays a keyframed weather scenario against the weather system on simulation time.
+    * Station keyframes are METAR strings and global keyframes are values for the global setters.
+    * When keyframes are added the timeline precomputes, per station, the segment between each pair of
+    * consecutive keyframes and which layer kinds can be interpolated across it: layers interpolate when
+    * both keyframes have the same number of layers of that kind, and otherwise switch at the later
+    * keyframe.  Global values interpolate linearly, and wind direction takes the shorter way around.
+    * @remarks  The weather at a scenario time depends only on that time.  Update() reads the absolute
+    *           simulation time from IGlobalDataV610, which stops while paused and advances with the
+    *           simulation rate, so playback is the same at any rate and a paused simulation produces no
+    *           calls.  Jumping backwards in time is also supported.
+    * @remarks  Only changes are emitted.  A station is sent with SetMetarData() when its formatted METAR
+    *           differs from the one last sent, and a global setter is called when its value moved by at
+    *           least the resolution the value is shown with.  Interpolated stations are evaluated on a fixed
+    *           time step, see SetStationInterval().  Stations holding a constant keyframe cost
+    *           nothing per frame once sent.
+    * Scenario files hold one keyframe per line, with the time in seconds from the start of the scenario:
+    * ```
+    *      # Front passing Seattle
+    *      0       METAR KSEA 18008KT 9999 SCT040 15/08 Q1016
+    *      1800    METAR KSEA 21025G35KT 3000 BKN012 OVC030 12/11 Q1002
+    *      0       GLOBAL TEMP 15
+    *      1800    GLOBAL WINDSPEED 20
+    * ```
+    * Global names are TEMP, DEWPOINT, VISIBILITY, WINDSPEED, WINDDIRECTION and BARO.
+    * Sample usage:
+    * ```
+    *      WeatherTimeline timeline;
+    *      if (SUCCEEDED(timeline.Load(L"Scenarios\\Front.wxt")))
+    *      {
+    *          timeline.Start(spGlobalData);
+    *      }
+    *
+    *      // Every frame:
+    *      timeline.Update(spGlobalData, spWeatherSystem);
+    * ```
+    */
+    class WeatherTimeline
+    {
+    public:
+        /**
+        * Loads keyframes from a scenario file, adding them to any keyframes already present.
+        * @param pszPath    Scenario file path.
+        * @return           S_OK, E_FAIL if the file cannot be opened, or E_INVALIDARG if a line is malformed.
+        *                   See GetErrorLine().
+        */
+        HRESULT Load(__in __notnull LPCWSTR pszPath)
+        {
+            FILE* pFile = nullptr;
+            if (_wfopen_s(&pFile, pszPath, L"rt") != 0 || pFile == nullptr)
+            {
+                return E_FAIL;
+            }
+
+            HRESULT hr = S_OK;
+            char szLine[MetarCodec::MAX_METAR_LENGTH + 64];
+            m_uErrorLine = 0;
+            for (UINT uLine = 1; SUCCEEDED(hr) && fgets(szLine, sizeof(szLine), pFile) != nullptr; uLine++)
+            {
+                hr = ParseLine(szLine);
+                if (FAILED(hr))
+                {
+                    m_uErrorLine = uLine;
+                }
+            }
+            fclose(pFile);
+            return hr;
+        }
+
+        /// Line of the scenario file that failed to load, or 0.
+        UINT GetErrorLine() const { return m_uErrorLine; }
+
+        /**
+        * Adds a station keyframe.
+        * @param dSeconds   Scenario time of the keyframe.
+        * @param pszMetar   METAR of the station at that time.  The station is the METAR station identifier.
+        * @return           S_OK, or E_INVALIDARG if the METAR cannot be parsed.
+        */
+        HRESULT AddMetarKeyframe(__in double dSeconds, __in __notnull LPCWSTR pszMetar)
+        {
+            StationKeyframe keyframe;
+            keyframe.dSeconds = dSeconds;
+            if (FAILED(MetarCodec::Parse(pszMetar, keyframe.Metar)))
+            {
+                return E_INVALIDARG;
+            }
+            keyframe.Metar.uDay = 0;
+
+            Station* pStation = nullptr;
+            for (Station& station : m_vStations)
+            {
+                if (wcscmp(station.szIcao, keyframe.Metar.szIcao) == 0)
+                {
+                    pStation = &station;
+                }
+            }
+            if (pStation == nullptr)
+            {
+                m_vStations.emplace_back();
+                pStation = &m_vStations.back();
+                wcscpy_s(pStation->szIcao, keyframe.Metar.szIcao);
+            }
+            pStation->vKeyframes.push_back(keyframe);
+            m_bBuilt = false;
+            return S_OK;
+        }
+
+        /// Adds a global value keyframe.
+        void AddGlobalKeyframe(__in double dSeconds, __in WEATHER_TIMELINE_GLOBAL eGlobal, __in float fValue)
+        {
+            if (eGlobal < WEATHER_TIMELINE_GLOBAL_COUNT)
+            {
+                GlobalKeyframe keyframe = { dSeconds, fValue };
+                m_Globals[eGlobal].vKeyframes.push_back(keyframe);
+                m_bBuilt = false;
+            }
+        }
+
+        /**
+        * Starts playback at the current simulation time.
+        * @return   S_OK, or E_FAIL if the simulation time is unavailable.
+        */
+        HRESULT Start(__in __notnull IGlobalDataV610* pGlobalData)
+        {
+            double dNow = 0.0;
+            HRESULT hr = GetSimSeconds(pGlobalData, dNow);
+            if (SUCCEEDED(hr))
+            {
+                Start(dNow);
+            }
+            return hr;
+        }
+
+        /// Starts playback so that scenario time 0 is the given absolute simulation time in seconds.
+        void Start(__in double dStartSeconds)
+        {
+            m_dStartSeconds = dStartSeconds;
+            m_bStarted = true;
+            Invalidate();
+        }
+
+        /**
+        * Emits the changes due at the current simulation time.
+        * @return   S_OK, S_FALSE if the simulation is paused or playback has not started, or E_FAIL if the
+        *           simulation time is unavailable.
+        */
+        HRESULT Update(__in __notnull IGlobalDataV610* pGlobalData, __in __notnull IWeatherSystemV500* pWeather)
+        {
+            if (!m_bStarted || pGlobalData->IsPaused())
+            {
+                return S_FALSE;
+            }
+            double dNow = 0.0;
+            if (FAILED(GetSimSeconds(pGlobalData, dNow)))
+            {
+                return E_FAIL;
+            }
+            Evaluate(dNow - m_dStartSeconds, pWeather);
+            return S_OK;
+        }
+
+        /**
+        * Emits the changes needed for the weather to match a scenario time.
+        * @param dSeconds   Scenario time.  Times before the first keyframe hold the first keyframe and
+        *                   times after the last hold the last.
+        * @param pWeather   Weather system to update.
+        * @return           Number of weather system calls made.
+        */
+        UINT Evaluate(__in double dSeconds, __in __notnull IWeatherSystemV500* pWeather)
+        {
+            Build();
+            UINT uCalls = 0;
+
+            for (Station& station : m_vStations)
+            {
+                const Segment& segment = FindSegment(station.vSegments, station.uSegment, dSeconds);
+                if (segment.bConstant && station.uSentSegment == station.uSegment)
+                {
+                    continue;
+                }
+
+                const MetarData& from = station.vKeyframes[segment.uFrom].Metar;
+                const MetarData& to = station.vKeyframes[segment.uTo].Metar;
+                // Interpolated weather steps on a fixed time grid so the sent METARs do not depend on the frame rate.
+                double dStep = m_dStationInterval > 0.0 ? std::max(floor(dSeconds / m_dStationInterval) * m_dStationInterval, segment.dStart) : dSeconds;
+                float fT = segment.bConstant ? 0.0f : (float)((dStep - segment.dStart) / (segment.dEnd - segment.dStart));
+                Interpolate(from, to, segment, fT, m_Scratch);
+
+                // A constant segment is only skipped once its METAR has been accepted, so a rejected one is retried.
+                bool bCurrent = false;
+                if (SUCCEEDED(MetarCodec::Format(m_Scratch, m_szMetar, ARRAYSIZE(m_szMetar))))
+                {
+                    if (station.strSent == m_szMetar)
+                    {
+                        bCurrent = true;
+                    }
+                    else
+                    {
+                        if (pWeather->SetMetarData(m_szMetar, 0) == S_OK)
+                        {
+                            station.strSent = m_szMetar;
+                            bCurrent = true;
+                        }
+                        uCalls++;
+                    }
+                }
+                if (bCurrent)
+                {
+                    station.uSentSegment = station.uSegment;
+                }
+            }
+
+            for (UINT i = 0; i < WEATHER_TIMELINE_GLOBAL_COUNT; i++)
+            {
+                GlobalTrack& track = m_Globals[i];
+                if (track.vKeyframes.empty())
+                {
+                    continue;
+                }
+                float fValue = EvaluateGlobal(track, (WEATHER_TIMELINE_GLOBAL)i, dSeconds);
+                if (!track.bSent || fabsf(fValue - track.fSent) >= GetResolution((WEATHER_TIMELINE_GLOBAL)i) ||
+                    (fValue != track.fSent && IsHolding(track, dSeconds)))
+                {
+                    if (SUCCEEDED(SetGlobal(pWeather, (WEATHER_TIMELINE_GLOBAL)i, fValue)))
+                    {
+                        track.fSent = fValue;
+                        track.bSent = true;
+                    }
+                    uCalls++;
+                }
+            }
+
+            m_uCalls += uCalls;
+            return uCalls;
+        }
+
+        /**
+        * Sets the scenario time step of interpolated station weather.  Stations between two different
+        * keyframes are evaluated at multiples of this step, so each is sent at most once per step.
+        * The default is 5 seconds.  0 evaluates stations at every update.
+        */
+        void SetStationInterval(__in double dSeconds)
+        {
+            m_dStationInterval = std::max(dSeconds, 0.0);
+        }
+
+        /// Forgets what was last sent, so the next update sends the full state again.
+        void Invalidate()
+        {
+            for (Station& station : m_vStations)
+            {
+                station.strSent.clear();
+                station.uSentSegment = UINT_MAX;
+            }
+            for (GlobalTrack& track : m_Globals)
+            {
+                track.bSent = false;
+            }
+        }
+
+        /// Scenario time of the last keyframe.
+        double GetDuration() const
+        {
+            double dDuration = 0.0;
+            for (const Station& station : m_vStations)
+            {
+                for (const StationKeyframe& keyframe : station.vKeyframes)
+                {
+                    dDuration = std::max(dDuration, keyframe.dSeconds);
+                }
+            }
+            for (const GlobalTrack& track : m_Globals)
+            {
+                for (const GlobalKeyframe& keyframe : track.vKeyframes)
+                {
+                    dDuration = std::max(dDuration, keyframe.dSeconds);
+                }
+            }
+            return dDuration;
+        }
+
+        UINT GetStationCount() const { return (UINT)m_vStations.size(); }
+        /// Total weather system calls made by Evaluate() and Update().
+        UINT64 GetCallCount() const { return m_uCalls; }
+
+    private:
+        struct StationKeyframe
+        {
+            double      dSeconds;
+            MetarData   Metar;
+        };
+
+        struct Segment
+        {
+            double  dStart;
+            double  dEnd;
+            UINT    uFrom;
+            UINT    uTo;
+            bool    bConstant;
+            bool    bClouds;        ///< Cloud layers interpolate across the segment
+            bool    bWinds;
+            bool    bTemps;
+            bool    bVisibilities;
+        };
+
+        struct Station
+        {
+            WCHAR                           szIcao[5];
+            std::vector<StationKeyframe>    vKeyframes;
+            std::vector<Segment>            vSegments;
+            UINT                            uSegment = 0;
+            UINT                            uSentSegment = UINT_MAX;
+            std::wstring                    strSent;
+        };
+
+        struct GlobalKeyframe
+        {
+            double  dSeconds;
+            float   fValue;
+        };
+
+        struct GlobalTrack
+        {
+            std::vector<GlobalKeyframe>     vKeyframes;
+            UINT                            uSegment = 0;
+            float                           fSent = 0.0f;
+            bool                            bSent = false;
+        };
+
+        HRESULT GetSimSeconds(IGlobalDataV610* pGlobalData, double& dSeconds)
+        {
+            if (m_iSecondsUnit < 0 && FAILED(pGlobalData->GetUnitCode(L"seconds", m_iSecondsUnit)))
+            {
+                m_iSecondsUnit = -1;
+                return E_FAIL;
+            }
+            return pGlobalData->GetAbsoluteTime(dSeconds, m_iSecondsUnit);
+        }
+
+        HRESULT ParseLine(char* pszLine)
+        {
+            char* pszCur = pszLine;
+            while (*pszCur == ' ' || *pszCur == '\t')
+            {
+                pszCur++;
+            }
+            if (*pszCur == '#' || *pszCur == '\0' || *pszCur == '\r' || *pszCur == '\n')
+            {
+                return S_OK;
+            }
+
+            char* pszEnd = nullptr;
+            double dSeconds = strtod(pszCur, &pszEnd);
+            if (pszEnd == pszCur)
+            {
+                return E_INVALIDARG;
+            }
+            pszCur = pszEnd;
+            while (*pszCur == ' ' || *pszCur == '\t')
+            {
+                pszCur++;
+            }
+
+            if (strncmp(pszCur, "METAR ", 6) == 0)
+            {
+                WCHAR szMetar[MetarCodec::MAX_METAR_LENGTH + 1];
+                size_t i = 0;
+                for (pszCur += 6; pszCur[i] != '\0' && pszCur[i] != '\r' && pszCur[i] != '\n' && i < MetarCodec::MAX_METAR_LENGTH; i++)
+                {
+                    szMetar[i] = (WCHAR)(unsigned char)pszCur[i];
+                }
+                szMetar[i] = L'\0';
+                return AddMetarKeyframe(dSeconds, szMetar);
+            }
+
+            if (strncmp(pszCur, "GLOBAL ", 7) == 0)
+            {
+                static const char* s_pszNames[WEATHER_TIMELINE_GLOBAL_COUNT] = { "TEMP", "DEWPOINT", "VISIBILITY", "WINDSPEED", "WINDDIRECTION", "BARO" };
+                pszCur += 7;
+                for (UINT i = 0; i < WEATHER_TIMELINE_GLOBAL_COUNT; i++)
+                {
+                    size_t uLength = strlen(s_pszNames[i]);
+                    if (strncmp(pszCur, s_pszNames[i], uLength) == 0 && (pszCur[uLength] == ' ' || pszCur[uLength] == '\t'))
+                    {
+                        pszCur += uLength;
+                        float fValue = strtof(pszCur, &pszEnd);
+                        if (pszEnd == pszCur)
+                        {
+                            return E_INVALIDARG;
+                        }
+                        AddGlobalKeyframe(dSeconds, (WEATHER_TIMELINE_GLOBAL)i, fValue);
+                        return S_OK;
+                    }
+                }
+            }
+            return E_INVALIDARG;
+        }
+
+        /// Sorts keyframes and precomputes the station segments.
+        void Build()
+        {
+            if (m_bBuilt)
+            {
+                return;
+            }
+            m_bBuilt = true;
+
+            for (Station& station : m_vStations)
+            {
+                std::stable_sort(station.vKeyframes.begin(), station.vKeyframes.end(),
+                                 [](const StationKeyframe& a, const StationKeyframe& b) { return a.dSeconds < b.dSeconds; });
+
+                // Segment 0 holds the first keyframe before its time and the last segment holds the last keyframe.
+                const UINT uKeyframes = (UINT)station.vKeyframes.size();
+                station.vSegments.clear();
+                Segment hold = { -HUGE_VAL, station.vKeyframes[0].dSeconds, 0, 0, true, false, false, false, false };
+                station.vSegments.push_back(hold);
+                for (UINT i = 0; i + 1 < uKeyframes; i++)
+                {
+                    const StationKeyframe& from = station.vKeyframes[i];
+                    const StationKeyframe& to = station.vKeyframes[i + 1];
+                    Segment segment = { from.dSeconds, to.dSeconds, i, i + 1, false,
+                                        from.Metar.uCloudCount == to.Metar.uCloudCount,
+                                        from.Metar.uWindCount == to.Metar.uWindCount,
+                                        from.Metar.uTempCount == to.Metar.uTempCount,
+                                        from.Metar.uVisibilityCount == to.Metar.uVisibilityCount };
+                    segment.bConstant = segment.dEnd <= segment.dStart || SameMetar(from.Metar, to.Metar);
+                    station.vSegments.push_back(segment);
+                }
+                Segment last = { station.vKeyframes.back().dSeconds, HUGE_VAL, uKeyframes - 1, uKeyframes - 1, true, false, false, false, false };
+                station.vSegments.push_back(last);
+                station.uSegment = 0;
+                station.uSentSegment = UINT_MAX;
+            }
+
+            for (GlobalTrack& track : m_Globals)
+            {
+                std::stable_sort(track.vKeyframes.begin(), track.vKeyframes.end(),
+                                 [](const GlobalKeyframe& a, const GlobalKeyframe& b) { return a.dSeconds < b.dSeconds; });
+                track.uSegment = 0;
+            }
+        }
+
+        static bool SameMetar(const MetarData& a, const MetarData& b)
+        {
+            WCHAR szA[MetarCodec::MAX_METAR_LENGTH + 1];
+            WCHAR szB[MetarCodec::MAX_METAR_LENGTH + 1];
+            return SUCCEEDED(MetarCodec::Format(a, szA, ARRAYSIZE(szA))) && SUCCEEDED(MetarCodec::Format(b, szB, ARRAYSIZE(szB))) &&
+                   wcscmp(szA, szB) == 0;
+        }
+
+        /// Moves a cached segment index to the segment containing dSeconds.  Cheap when time moves steadily.
+        static const Segment& FindSegment(const std::vector<Segment>& vSegments, UINT& uSegment, double dSeconds)
+        {
+            while (uSegment + 1 < vSegments.size() && dSeconds >= vSegments[uSegment].dEnd)
+            {
+                uSegment++;
+            }
+            while (uSegment > 0 && dSeconds < vSegments[uSegment].dStart)
+            {
+                uSegment--;
+            }
+            return vSegments[uSegment];
+        }
+
+        static float Lerp(float a, float b, float fT)
+        {
+            return a + (b - a) * fT;
+        }
+
+        static float LerpDegrees(float a, float b, float fT)
+        {
+            float fDelta = fmodf(b - a + 540.0f, 360.0f) - 180.0f;
+            return fmodf(a + fDelta * fT + 360.0f, 360.0f);
+        }
+
+        /// Weather between two keyframes.  Discrete fields and kinds that cannot interpolate come from the earlier keyframe.
+        static void Interpolate(const MetarData& from, const MetarData& to, const Segment& segment, float fT, MetarData& result)
+        {
+            result = from;
+            if (segment.bConstant)
+            {
+                return;
+            }
+
+            result.fBaroPressure = from.fBaroPressure > 0.0f && to.fBaroPressure > 0.0f ? Lerp(from.fBaroPressure, to.fBaroPressure, fT) : from.fBaroPressure;
+            result.fSurfaceWindDepth = Lerp(from.fSurfaceWindDepth, to.fSurfaceWindDepth, fT);
+            for (UINT i = 0; segment.bClouds && i < from.uCloudCount; i++)
+            {
+                CloudLayer& layer = result.Clouds[i];
+                const CloudLayer& next = to.Clouds[i];
+                layer.fCloudBase = Lerp(layer.fCloudBase, next.fCloudBase, fT);
+                layer.fCloudTops = Lerp(layer.fCloudTops, next.fCloudTops, fT);
+                layer.fCloudDeviation = Lerp(layer.fCloudDeviation, next.fCloudDeviation, fT);
+                layer.fPrecipBase = Lerp(layer.fPrecipBase, next.fPrecipBase, fT);
+                layer.fCloudDensity = Lerp(layer.fCloudDensity, next.fCloudDensity, fT);
+                layer.fCloudScatter = Lerp(layer.fCloudScatter, next.fCloudScatter, fT);
+                layer.eCloudCover = (CLOUD_COVER)lroundf(Lerp((float)layer.eCloudCover, (float)next.eCloudCover, fT));
+            }
+            for (UINT i = 0; segment.bWinds && i < from.uWindCount; i++)
+            {
+                WindAloftLayer& layer = result.Winds[i];
+                const WindAloftLayer& next = to.Winds[i];
+                layer.fAlt = Lerp(layer.fAlt, next.fAlt, fT);
+                layer.fSpeed = Lerp(layer.fSpeed, next.fSpeed, fT);
+                layer.fGusts = Lerp(layer.fGusts, next.fGusts, fT);
+                layer.fDirection = LerpDegrees(layer.fDirection, next.fDirection, fT);
+                layer.fVariance = Lerp(layer.fVariance, next.fVariance, fT);
+            }
+            for (UINT i = 0; segment.bTemps && i < from.uTempCount; i++)
+            {
+                TempLayer& layer = result.Temps[i];
+                const TempLayer& next = to.Temps[i];
+                layer.fAlt = Lerp(layer.fAlt, next.fAlt, fT);
+                layer.fTemp = Lerp(layer.fTemp, next.fTemp, fT);
+                layer.fRange = Lerp(layer.fRange, next.fRange, fT);
+                layer.fDewPoint = Lerp(layer.fDewPoint, next.fDewPoint, fT);
+            }
+            for (UINT i = 0; segment.bVisibilities && i < from.uVisibilityCount; i++)
+            {
+                VisibilityLayer& layer = result.Visibilities[i];
+                const VisibilityLayer& next = to.Visibilities[i];
+                layer.fVis = Lerp(layer.fVis, next.fVis, fT);
+                layer.fBase = Lerp(layer.fBase, next.fBase, fT);
+                layer.fTops = Lerp(layer.fTops, next.fTops, fT);
+            }
+        }
+
+        static float EvaluateGlobal(GlobalTrack& track, WEATHER_TIMELINE_GLOBAL eGlobal, double dSeconds)
+        {
+            const std::vector<GlobalKeyframe>& vKeyframes = track.vKeyframes;
+            if (dSeconds <= vKeyframes.front().dSeconds)
+            {
+                return vKeyframes.front().fValue;
+            }
+            if (dSeconds >= vKeyframes.back().dSeconds)
+            {
+                return vKeyframes.back().fValue;
+            }
+
+            UINT& i = track.uSegment;
+            while (i + 2 < vKeyframes.size() && dSeconds >= vKeyframes[i + 1].dSeconds)
+            {
+                i++;
+            }
+            while (i > 0 && dSeconds < vKeyframes[i].dSeconds)
+            {
+                i--;
+            }
+            const GlobalKeyframe& from = vKeyframes[i];
+            const GlobalKeyframe& to = vKeyframes[i + 1];
+            float fT = (float)((dSeconds - from.dSeconds) / (to.dSeconds - from.dSeconds));
+            return eGlobal == WEATHER_TIMELINE_WIND_DIRECTION ? LerpDegrees(from.fValue, to.fValue, fT) : Lerp(from.fValue, to.fValue, fT);
+        }
+
+        /// True outside the keyframe range, where the value is final and must be sent exactly.
+        static bool IsHolding(const GlobalTrack& track, double dSeconds)
+        {
+            return dSeconds <= track.vKeyframes.front().dSeconds || dSeconds >= track.vKeyframes.back().dSeconds;
+        }
+
+        static float GetResolution(WEATHER_TIMELINE_GLOBAL eGlobal)
+        {
+            static const float s_fResolution[WEATHER_TIMELINE_GLOBAL_COUNT] = { 0.1f, 0.1f, 10.0f, 0.5f, 1.0f, 0.1f };
+            return s_fResolution[eGlobal];
+        }
+
+        /// Wind speed keyframes and their resolution are in knots; the weather system takes meters per second.
+        static constexpr float KNOTS_TO_METERS_PER_SECOND = 0.514444f;
+
+        static HRESULT SetGlobal(IWeatherSystemV500* pWeather, WEATHER_TIMELINE_GLOBAL eGlobal, float fValue)
+        {
+            switch (eGlobal)
+            {
+                case WEATHER_TIMELINE_TEMP:             return pWeather->SetGlobalTemp(fValue);
+                case WEATHER_TIMELINE_DEW_POINT:        return pWeather->SetGlobalDewPoint(fValue);
+                case WEATHER_TIMELINE_VIS_RANGE:        return pWeather->SetGlobalVisRange(fValue);
+                case WEATHER_TIMELINE_WIND_SPEED:       return pWeather->SetGlobalHorizWindSpeed(fValue * KNOTS_TO_METERS_PER_SECOND);
+                case WEATHER_TIMELINE_WIND_DIRECTION:   return pWeather->SetGlobalWindDirection(fValue);
+                case WEATHER_TIMELINE_BARO_PRESSURE:    return pWeather->SetGlobalBaroPressure(fValue);
+                default:                                return E_INVALIDARG;
+            }
+        }
+
+        std::vector<Station>    m_vStations;
+        GlobalTrack             m_Globals[WEATHER_TIMELINE_GLOBAL_COUNT];
+        MetarData               m_Scratch;
+        WCHAR                   m_szMetar[MetarCodec::MAX_METAR_LENGTH + 1];
+        double                  m_dStartSeconds = 0.0;
+        double                  m_dStationInterval = 5.0;
+        int                     m_iSecondsUnit = -1;
+        UINT                    m_uErrorLine = 0;
+        UINT64                  m_uCalls = 0;
+        bool                    m_bStarted = false;
+        bool                    m_bBuilt = true;
+    };
+    /** @} */
+}
@@ -0,0 +1,450 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// ComponentControlRoundTrip.cpp
+//
+// Round-trip test for ComponentControlPacker.  Builds as a console application with the PDK and
+// PDK\Helpers directories on the include path; no running simulation is needed.  A stand-in
+// ICigiServiceV430 calls every registered IComponentControlCallbackV430::OnSend() as a CIGI host would,
+// then delivers each queued packet to OnReceive() as an IG would.  Returns 0 when every check passes.
+
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "INetworkServices.h"
+#include "ComponentControlPacker.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    /** Component Control packet that stores its data words the way they go on the wire. */
+    class StandInComponentControl : public IComponentControlV430
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        /// Packets queued by SendData().
+        std::vector<StandInComponentControl>* m_pQueue = nullptr;
+        /// Number of setter calls made on this interface.
+        UINT64 m_uSetterCalls = 0;
+
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_IComponentControlV430))
+            {
+                *ppv = static_cast<IComponentControlV430*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHOD_(void, SendData)() override
+        {
+            if (m_pQueue != nullptr)
+            {
+                m_pQueue->push_back(*this);
+                m_pQueue->back().m_pQueue = nullptr;
+            }
+        }
+        STDMETHOD_(void, ClearData)() override
+        {
+            m_bShort = false;
+            m_uComponentID = 0;
+            m_uInstanceID = 0;
+            m_uClass = 0;
+            m_uState = 0;
+            memset(m_uWords, 0, sizeof(m_uWords));
+        }
+
+        STDMETHOD_(void, SetShortComponent)(bool bIsShort) override { m_uSetterCalls++; m_bShort = bIsShort; }
+        STDMETHOD_(bool, GetShortComponent)() const override { return m_bShort; }
+        STDMETHOD_(void, SetComponentID)(UINT16 uID) override { m_uSetterCalls++; m_uComponentID = uID; }
+        STDMETHOD_(UINT16, GetComponentID)() const override { return m_uComponentID; }
+        STDMETHOD_(void, SetComponentClass)(UINT8 uClass) override { m_uSetterCalls++; m_uClass = uClass; }
+        STDMETHOD_(UINT8, GetComponentClass)() const override { return m_uClass; }
+        STDMETHOD_(void, SetComponentState)(UINT8 uState) override { m_uSetterCalls++; m_uState = uState; }
+        STDMETHOD_(UINT8, GetComponentState)() const override { return m_uState; }
+        STDMETHOD_(void, SetInstanceID)(UINT16 uInstanceID) override { m_uSetterCalls++; m_uInstanceID = uInstanceID; }
+        STDMETHOD_(UINT16, GetInstanceID)() const override { return m_uInstanceID; }
+
+        STDMETHOD_(void, SetUCharData)(UINT8 uData, UINT uWord, P3D::BYTE_POS ePos) override { SetBits(uData, uWord, ePos * 8, 0xFF); }
+        STDMETHOD_(UINT8, GetUCharData)(UINT uWord, P3D::BYTE_POS ePos) const override { return (UINT8)(GetWord(uWord) >> (ePos * 8)); }
+        STDMETHOD_(void, SetCharData)(INT8 iData, UINT uWord, P3D::BYTE_POS ePos) override { SetBits((UINT8)iData, uWord, ePos * 8, 0xFF); }
+        STDMETHOD_(INT8, GetCharData)(UINT uWord, P3D::BYTE_POS ePos) const override { return (INT8)GetUCharData(uWord, ePos); }
+        STDMETHOD_(void, SetUShortData)(UINT16 uData, UINT uWord, P3D::SHORT_POS ePos) override { SetBits(uData, uWord, ePos * 16, 0xFFFF); }
+        STDMETHOD_(UINT16, GetUShortData)(UINT uWord, P3D::SHORT_POS ePos) const override { return (UINT16)(GetWord(uWord) >> (ePos * 16)); }
+        STDMETHOD_(void, SetShortData)(INT16 iData, UINT uWord, P3D::SHORT_POS ePos) override { SetBits((UINT16)iData, uWord, ePos * 16, 0xFFFF); }
+        STDMETHOD_(INT16, GetShortData)(UINT uWord, P3D::SHORT_POS ePos) const override { return (INT16)GetUShortData(uWord, ePos); }
+        STDMETHOD_(void, SetUIntData)(UINT32 uData, UINT uWord) override { SetBits(uData, uWord, 0, 0xFFFFFFFF); }
+        STDMETHOD_(UINT32, GetUIntData)(UINT uWord) const override { return GetWord(uWord); }
+        STDMETHOD_(void, SetIntData)(INT32 iData, UINT uWord) override { SetBits((UINT32)iData, uWord, 0, 0xFFFFFFFF); }
+        STDMETHOD_(INT32, GetIntData)(UINT uWord) const override { return (INT32)GetWord(uWord); }
+        STDMETHOD_(void, SetFloatData)(float fData, UINT uWord) override { UINT32 u; memcpy(&u, &fData, sizeof(u)); SetBits(u, uWord, 0, 0xFFFFFFFF); }
+        STDMETHOD_(float, GetFloatData)(UINT uWord) const override { UINT32 u = GetWord(uWord); float f; memcpy(&f, &u, sizeof(f)); return f; }
+
+        // 64-bit word n occupies data words 2n (high half) and 2n+1 (low half).
+        STDMETHOD_(void, SetUInt64Data)(UINT64 uData, UINT uWord) override
+        {
+            m_uSetterCalls++;
+            if (uWord * 2 + 1 < MAX_WORDS)
+            {
+                m_uWords[uWord * 2] = (UINT32)(uData >> 32);
+                m_uWords[uWord * 2 + 1] = (UINT32)uData;
+            }
+        }
+        STDMETHOD_(UINT64, GetUInt64Data)(UINT uWord) const override
+        {
+            return ((UINT64)GetWord(uWord * 2) << 32) | GetWord(uWord * 2 + 1);
+        }
+        STDMETHOD_(void, SetDoubleData)(double dData, UINT uWord) override { UINT64 u; memcpy(&u, &dData, sizeof(u)); SetUInt64Data(u, uWord); }
+        STDMETHOD_(double, GetDoubleData)(UINT uWord) const override { UINT64 u = GetUInt64Data(uWord); double d; memcpy(&d, &u, sizeof(d)); return d; }
+
+        /// True if the header and the data words visible to the packet type match.
+        bool SameWireData(const StandInComponentControl& other) const
+        {
+            const UINT uWords = m_bShort ? 2 : MAX_WORDS;
+            return m_bShort == other.m_bShort && m_uComponentID == other.m_uComponentID && m_uInstanceID == other.m_uInstanceID &&
+                   m_uClass == other.m_uClass && m_uState == other.m_uState && memcmp(m_uWords, other.m_uWords, uWords * sizeof(UINT32)) == 0;
+        }
+
+    private:
+        static const UINT MAX_WORDS = 6;
+
+        void SetBits(UINT32 uValue, UINT uWord, UINT uShift, UINT32 uMask)
+        {
+            m_uSetterCalls++;
+            if (uWord < MAX_WORDS)
+            {
+                m_uWords[uWord] = (m_uWords[uWord] & ~(uMask << uShift)) | ((uValue & uMask) << uShift);
+            }
+        }
+
+        UINT32 GetWord(UINT uWord) const { return uWord < MAX_WORDS ? m_uWords[uWord] : 0; }
+
+        bool    m_bShort = false;
+        UINT16  m_uComponentID = 0;
+        UINT16  m_uInstanceID = 0;
+        UINT8   m_uClass = 0;
+        UINT8   m_uState = 0;
+        UINT32  m_uWords[MAX_WORDS] = {};
+    };
+
+    /** Stand-in CIGI service.  Tick() runs one host frame followed by one IG frame. */
+    class StandInCigiService : public ICigiServiceV430
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown))
+            {
+                *ppv = static_cast<IUnknown*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHOD_(bool, InSession)() const override { return true; }
+        STDMETHOD_(bool, IsHosting)() const override { return true; }
+        STDMETHOD_(bool, IsIG)() const override { return false; }
+        STDMETHOD_(UINT, GetMajorVersion)() const override { return 4; }
+        STDMETHOD_(UINT, GetMinorVersion)() const override { return 0; }
+        STDMETHOD(GetEntityID)(__in UINT, __out USHORT&) const override { return E_NOTIMPL; }
+        STDMETHOD(GetObjectID)(__in USHORT, __out UINT&) const override { return E_NOTIMPL; }
+
+        STDMETHOD(RegisterComponentControlCallback)(__in __notnull P3D::IComponentControlCallbackV430* pCallback) override
+        {
+            m_vCallbacks.push_back(CComPtr<IComponentControlCallbackV430>(pCallback));
+            return S_OK;
+        }
+
+        STDMETHOD(UnregisterComponentControlCallback)(__in __notnull P3D::IComponentControlCallbackV430* pCallback) override
+        {
+            for (auto it = m_vCallbacks.begin(); it != m_vCallbacks.end(); ++it)
+            {
+                if (*it == pCallback)
+                {
+                    m_vCallbacks.erase(it);
+                    return S_OK;
+                }
+            }
+            return E_FAIL;
+        }
+
+        STDMETHOD(RegisterCigiPacketCallback)(__in const USHORT&, __in __notnull P3D::ICigiPacketCallbackV440*) override { return E_NOTIMPL; }
+        STDMETHOD(UnregisterCigiPacketCallback)(__in const USHORT&, __in __notnull P3D::ICigiPacketCallbackV440*) override { return E_NOTIMPL; }
+        STDMETHOD(AddExcludedSendID)(__in const USHORT&) override { return E_NOTIMPL; }
+        STDMETHOD(RemoveExcludedSendID)(__in const USHORT&) override { return E_NOTIMPL; }
+        STDMETHOD(AddExcludedReceiveID)(__in const USHORT&) override { return E_NOTIMPL; }
+        STDMETHOD(RemoveExcludedReceiveID)(__in const USHORT&) override { return E_NOTIMPL; }
+
+        /**
+        * Calls OnSend() on every callback with one reused Component Control interface, then delivers every
+        * queued packet to every callback's OnReceive().
+        */
+        void Tick()
+        {
+            m_vWire.clear();
+
+            StandInComponentControl outgoing;
+            outgoing.m_pQueue = &m_vWire;
+            for (auto& spCallback : m_vCallbacks)
+            {
+                spCallback->OnSend(outgoing);
+            }
+            m_uSetterCalls += outgoing.m_uSetterCalls;
+
+            for (const StandInComponentControl& packet : m_vWire)
+            {
+                for (auto& spCallback : m_vCallbacks)
+                {
+                    spCallback->OnReceive(packet);
+                }
+            }
+        }
+
+        const std::vector<StandInComponentControl>& GetWire() const { return m_vWire; }
+        UINT64 GetSetterCalls() const { return m_uSetterCalls; }
+
+    private:
+        std::vector<CComPtr<IComponentControlCallbackV430>> m_vCallbacks;
+        std::vector<StandInComponentControl> m_vWire;
+        UINT64 m_uSetterCalls = 0;
+    };
+
+    /// Component state used by the host side of the test.
+    struct LightState
+    {
+        float   fIntensity;
+        UINT8   uMode;
+        INT8    iTrim;
+        INT16   iAngle;
+        UINT16  uFlags;
+        INT32   iCounter;
+        double  dTimestamp;
+    };
+
+    const UINT8 LIGHT_CLASS = 7;
+
+    /** Plugin callback that sends a batch of LightState components and decodes what it receives. */
+    class LightCallback : public IComponentControlCallbackV430
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        explicit LightCallback(bool bShort) : m_Packer(bShort) {}
+
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_IComponentControlCallbackV430))
+            {
+                *ppv = static_cast<IComponentControlCallbackV430*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        virtual HRESULT OnSend(IComponentControlV430& CompCtrl) override
+        {
+            if (!m_vSend.empty())
+            {
+                m_Packer.EncodeBatch(CompCtrl, m_vHeaders.data(), m_vSend.data(), sizeof(LightState), (UINT)m_vSend.size());
+            }
+            return S_OK;
+        }
+
+        virtual HRESULT OnReceive(const IComponentControlV430& CompCtrl) override
+        {
+            if (CompCtrl.GetComponentClass() == LIGHT_CLASS && CompCtrl.GetShortComponent() == m_Packer.IsShortComponent())
+            {
+                ComponentControlHeader header;
+                LightState state = {};
+                m_Packer.Decode(CompCtrl, header, &state);
+                m_vReceivedHeaders.push_back(header);
+                m_vReceived.push_back(state);
+            }
+            return S_OK;
+        }
+
+        ComponentControlPacker              m_Packer;
+        std::vector<ComponentControlHeader> m_vHeaders;
+        std::vector<LightState>             m_vSend;
+        std::vector<ComponentControlHeader> m_vReceivedHeaders;
+        std::vector<LightState>             m_vReceived;
+    };
+
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    bool SameHeader(const ComponentControlHeader& a, const ComponentControlHeader& b)
+    {
+        return a.uComponentID == b.uComponentID && a.uInstanceID == b.uInstanceID &&
+               a.uComponentClass == b.uComponentClass && a.uComponentState == b.uComponentState;
+    }
+
+    /** Encodes a LightState field by field with the interface's own setters, the way callers did before the packer. */
+    void EncodePerField(IComponentControlV430& CompCtrl, const ComponentControlHeader& header, const LightState& state)
+    {
+        CompCtrl.SetShortComponent(false);
+        CompCtrl.SetComponentID(header.uComponentID);
+        CompCtrl.SetInstanceID(header.uInstanceID);
+        CompCtrl.SetComponentClass(header.uComponentClass);
+        CompCtrl.SetComponentState(header.uComponentState);
+        CompCtrl.SetFloatData(state.fIntensity, 0);
+        CompCtrl.SetUCharData(state.uMode, 1, BYTE_POS_0);
+        CompCtrl.SetCharData(state.iTrim, 1, BYTE_POS_1);
+        CompCtrl.SetShortData(state.iAngle, 1, SHORT_POS_1);
+        CompCtrl.SetUShortData(state.uFlags, 2, SHORT_POS_0);
+        CompCtrl.SetUShortData(0, 2, SHORT_POS_1);
+        CompCtrl.SetIntData(state.iCounter, 3);
+        CompCtrl.SetDoubleData(state.dTimestamp, 2);
+        CompCtrl.SendData();
+    }
+}
+
+int main()
+{
+    const UINT COMPONENTS = 256;
+    const UINT FRAMES = 10;
+
+    CComPtr<StandInCigiService> spService;
+    spService.Attach(new StandInCigiService());
+
+    // Full Component Control layout: words 0-3 narrow fields, 64-bit word 2 (data words 4-5) a double.
+    CComPtr<LightCallback> spLights;
+    spLights.Attach(new LightCallback(false));
+    ComponentControlPacker& packer = spLights->m_Packer;
+    Check(packer.AddField(COMPONENT_FIELD_FLOAT, offsetof(LightState, fIntensity), 0) == S_OK &&
+          packer.AddField(COMPONENT_FIELD_UCHAR, offsetof(LightState, uMode), 1, BYTE_POS_0) == S_OK &&
+          packer.AddField(COMPONENT_FIELD_CHAR, offsetof(LightState, iTrim), 1, BYTE_POS_1) == S_OK &&
+          packer.AddField(COMPONENT_FIELD_SHORT, offsetof(LightState, iAngle), 1, SHORT_POS_1) == S_OK &&
+          packer.AddField(COMPONENT_FIELD_USHORT, offsetof(LightState, uFlags), 2, SHORT_POS_0) == S_OK &&
+          packer.AddField(COMPONENT_FIELD_INT, offsetof(LightState, iCounter), 3) == S_OK &&
+          packer.AddField(COMPONENT_FIELD_DOUBLE, offsetof(LightState, dTimestamp), 2) == S_OK, "layout accepted");
+
+    Check(packer.AddField(COMPONENT_FIELD_UCHAR, offsetof(LightState, uMode), 1, BYTE_POS_3) == E_INVALIDARG, "overlapping byte rejected");
+    Check(packer.AddField(COMPONENT_FIELD_UINT, offsetof(LightState, iCounter), 4) == E_INVALIDARG, "word owned by a 64-bit field rejected");
+    Check(packer.AddField(COMPONENT_FIELD_UINT, offsetof(LightState, iCounter), 6) == E_INVALIDARG, "word out of range rejected");
+    Check(packer.AddField(COMPONENT_FIELD_USHORT, offsetof(LightState, uFlags), 3, 2) == E_INVALIDARG, "short position out of range rejected");
+
+    // Short Component Control layout with two data words.
+    CComPtr<LightCallback> spShort;
+    spShort.Attach(new LightCallback(true));
+    Check(spShort->m_Packer.AddField(COMPONENT_FIELD_FLOAT, offsetof(LightState, fIntensity), 0) == S_OK &&
+          spShort->m_Packer.AddField(COMPONENT_FIELD_USHORT, offsetof(LightState, uFlags), 1, SHORT_POS_0) == S_OK &&
+          spShort->m_Packer.AddField(COMPONENT_FIELD_SHORT, offsetof(LightState, iAngle), 1, SHORT_POS_1) == S_OK, "short layout accepted");
+    Check(spShort->m_Packer.AddField(COMPONENT_FIELD_UINT, offsetof(LightState, iCounter), 2) == E_INVALIDARG, "short layout limited to two words");
+    Check(spShort->m_Packer.AddField(COMPONENT_FIELD_DOUBLE, offsetof(LightState, dTimestamp), 0) == E_INVALIDARG, "short layout 64-bit field overlap rejected");
+
+    spService->RegisterComponentControlCallback(spLights);
+    spService->RegisterComponentControlCallback(spShort);
+
+    UINT uBad = 0;
+    UINT uShortBad = 0;
+    for (UINT uFrame = 0; uFrame < FRAMES; uFrame++)
+    {
+        spLights->m_vHeaders.resize(COMPONENTS);
+        spLights->m_vSend.resize(COMPONENTS);
+        for (UINT i = 0; i < COMPONENTS; i++)
+        {
+            const INT32 iValue = (INT32)(uFrame * COMPONENTS + i);
+            ComponentControlHeader header = { (UINT16)i, (UINT16)(1000 + i), LIGHT_CLASS, (UINT8)(uFrame & 0xFF) };
+            LightState state = { iValue * 0.25f, (UINT8)iValue, (INT8)-iValue, (INT16)(-97 * iValue), (UINT16)(65535 - iValue),
+                                 -iValue * 1001, iValue * 1.0e-3 + 1.0e9 };
+            spLights->m_vHeaders[i] = header;
+            spLights->m_vSend[i] = state;
+        }
+        spShort->m_vHeaders.assign(spLights->m_vHeaders.begin(), spLights->m_vHeaders.begin() + 16);
+        spShort->m_vSend.assign(spLights->m_vSend.begin(), spLights->m_vSend.begin() + 16);
+
+        spLights->m_vReceived.clear();
+        spLights->m_vReceivedHeaders.clear();
+        spShort->m_vReceived.clear();
+        spShort->m_vReceivedHeaders.clear();
+        spService->Tick();
+
+        if (spLights->m_vReceived.size() != COMPONENTS || spShort->m_vReceived.size() != 16)
+        {
+            uBad++;
+            continue;
+        }
+
+        for (UINT i = 0; i < COMPONENTS; i++)
+        {
+            const LightState& sent = spLights->m_vSend[i];
+            const LightState& received = spLights->m_vReceived[i];
+            if (memcmp(&sent.fIntensity, &received.fIntensity, sizeof(float)) != 0 || sent.uMode != received.uMode ||
+                sent.iTrim != received.iTrim || sent.iAngle != received.iAngle || sent.uFlags != received.uFlags ||
+                sent.iCounter != received.iCounter || sent.dTimestamp != received.dTimestamp ||
+                !SameHeader(spLights->m_vHeaders[i], spLights->m_vReceivedHeaders[i]))
+            {
+                uBad++;
+            }
+        }
+        for (UINT i = 0; i < 16; i++)
+        {
+            const LightState& sent = spShort->m_vSend[i];
+            const LightState& received = spShort->m_vReceived[i];
+            if (memcmp(&sent.fIntensity, &received.fIntensity, sizeof(float)) != 0 || sent.uFlags != received.uFlags ||
+                sent.iAngle != received.iAngle || !SameHeader(spShort->m_vHeaders[i], spShort->m_vReceivedHeaders[i]))
+            {
+                uShortBad++;
+            }
+        }
+    }
+
+    Check(uBad == 0, "full components round trip through the stand-in service");
+    Check(uShortBad == 0, "short components round trip through the stand-in service");
+    Check(packer.GetEncodedCount() == (UINT64)COMPONENTS * FRAMES, "encoded count matches");
+
+    // The packer must put exactly the same bits on the wire as per-field setters.
+    std::vector<StandInComponentControl> vReference;
+    StandInComponentControl reference;
+    reference.m_pQueue = &vReference;
+    for (UINT i = 0; i < COMPONENTS; i++)
+    {
+        EncodePerField(reference, spLights->m_vHeaders[i], spLights->m_vSend[i]);
+    }
+    UINT uMismatch = 0;
+    for (UINT i = 0; i < COMPONENTS; i++)
+    {
+        if (!vReference[i].SameWireData(spService->GetWire()[i]))
+        {
+            uMismatch++;
+        }
+    }
+    Check(uMismatch == 0, "packed words match per-field setter encoding");
+
+    // Setter calls per component: 5 header setters, one per narrow word, one per 64-bit field.
+    const double dCallsPerPacket = (double)spService->GetSetterCalls() / (double)((COMPONENTS + 16) * FRAMES);
+    const double dReferenceCalls = (double)reference.m_uSetterCalls / (double)COMPONENTS;
+    printf("setter calls per component: packer %.2f, per-field %.2f\n", dCallsPerPacket, dReferenceCalls);
+    Check(dCallsPerPacket < dReferenceCalls, "packer makes fewer interface calls than per-field encoding");
+
+    spService->UnregisterComponentControlCallback(spShort);
+    spService->UnregisterComponentControlCallback(spLights);
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}
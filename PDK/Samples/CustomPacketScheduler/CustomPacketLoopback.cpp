@@ -0,0 +1,385 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// CustomPacketLoopback.cpp
+//
+// Loopback test harness for CustomPacketScheduler.  Builds as a console application with the PDK and
+// PDK\Helpers directories on the include path; no running simulation is needed.  A stand-in
+// IMultiplayerServiceV540 delivers every sent packet straight back to the packet's OnReceive().
+// Returns 0 when every check passes.
+
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "INetworkServices.h"
+#include "NetInOutPublic.h"
+#include "CustomPacketScheduler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    /** Byte buffer written by the loopback service's OnSend() call. */
+    class LoopbackNetOut : public NetOutPublic
+    {
+    public:
+        virtual void WriteData(const void* pv, unsigned int len) override { const BYTE* p = (const BYTE*)pv; m_vData.insert(m_vData.end(), p, p + len); }
+        virtual void WriteBool(bool b) override { WriteData(&b, sizeof(b)); }
+        virtual void WriteByte(unsigned char b) override { WriteData(&b, sizeof(b)); }
+        virtual void WriteShort(short value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteInt32(INT32 value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteUShort(unsigned short value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteFloat(float value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteDouble(double value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteDword(DWORD value) override { UINT32 u = (UINT32)value; WriteData(&u, sizeof(u)); }
+        virtual void WriteString(LPCWSTR pszStr) override { WriteData(pszStr, (unsigned int)((wcslen(pszStr) + 1) * sizeof(WCHAR))); }
+
+        std::vector<BYTE> m_vData;
+    };
+
+    /** Reads back the bytes of a LoopbackNetOut. */
+    class LoopbackNetIn : public NetInPublic
+    {
+    public:
+        explicit LoopbackNetIn(const std::vector<BYTE>& vData) : m_vData(vData) {}
+
+        virtual const void* Read(unsigned int sz) override
+        {
+            if (sz > BytesLeft())
+            {
+                return nullptr;
+            }
+            const void* p = m_vData.data() + m_uPos;
+            m_uPos += sz;
+            return p;
+        }
+        virtual bool ReadBool() override { return ReadValue<bool>(); }
+        virtual unsigned char ReadByte() override { return ReadValue<unsigned char>(); }
+        virtual short ReadShort() override { return ReadValue<short>(); }
+        virtual INT32 ReadInt32() override { return ReadValue<INT32>(); }
+        virtual float ReadFloat() override { return ReadValue<float>(); }
+        virtual double ReadDouble() override { return ReadValue<double>(); }
+        virtual unsigned short ReadUShort() override { return ReadValue<unsigned short>(); }
+        virtual unsigned long ReadDword() override { return ReadValue<UINT32>(); }
+        virtual const BYTE* GetCurBuffer() const override { return m_vData.data() + m_uPos; }
+        virtual unsigned int BytesLeft() const override { return (unsigned int)(m_vData.size() - m_uPos); }
+        virtual const WCHAR* ReadString() override
+        {
+            const WCHAR* psz = (const WCHAR*)GetCurBuffer();
+            size_t uLength = 0;
+            while ((uLength + 1) * sizeof(WCHAR) <= BytesLeft() && psz[uLength] != L'\0')
+            {
+                uLength++;
+            }
+            return Read((unsigned int)((uLength + 1) * sizeof(WCHAR))) != nullptr ? psz : L"";
+        }
+
+    private:
+        template<class T> T ReadValue()
+        {
+            T value = T();
+            const void* p = Read(sizeof(T));
+            if (p != nullptr)
+            {
+                memcpy(&value, p, sizeof(T));
+            }
+            return value;
+        }
+
+        const std::vector<BYTE>& m_vData;
+        size_t m_uPos = 0;
+    };
+
+    /** Stand-in multiplayer service that loops every custom packet back to its own OnReceive(). */
+    class LoopbackMultiplayerService : public IMultiplayerServiceV540
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown))
+            {
+                *ppv = static_cast<IUnknown*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHOD_(bool, InSession)() const override { return true; }
+        STDMETHOD_(bool, IsHosting)() const override { return true; }
+        STDMETHOD(StartHosting)() const override { return S_OK; }
+        STDMETHOD_(bool, IsAntiCheatEnabled)() const override { return false; }
+        STDMETHOD_(bool, IsSlewModeEnabled)() const override { return false; }
+        STDMETHOD_(bool, IsPauseLocalSimulationEnabled)() const override { return false; }
+        STDMETHOD_(UINT, GetPreferredAudioPanel)() const override { return 0; }
+        STDMETHOD_(UINT, GetMaxPlayerCount)() const override { return 16; }
+        STDMETHOD_(double, GetTimeSinceStart)() const override { return 0.0; }
+        STDMETHOD_(UINT, GetPlayerCount)() const override { return (UINT)m_vPlayers.size(); }
+        STDMETHOD_(UINT, GetPlayerObjectID)(__in UINT uIndex) const override { return uIndex < m_vPlayers.size() ? m_vPlayers[uIndex] : 0; }
+        STDMETHOD(GetPlayerName)(__in UINT, __out LPWSTR, __in UINT) const override { return E_NOTIMPL; }
+        STDMETHOD(GetPlayerRoleGUID)(__in UINT, __out GUID&) const override { return E_NOTIMPL; }
+        STDMETHOD(GetPlayerIP)(__in UINT, __out LPWSTR, __in UINT) const override { return E_NOTIMPL; }
+        STDMETHOD(GetAircraftTitle)(__in UINT, __out LPWSTR, __in UINT) const override { return E_NOTIMPL; }
+        STDMETHOD(SetVoiceFrequencies)(__in INT32, __in INT32) override { return E_NOTIMPL; }
+        STDMETHOD(GetVoiceFrequencies)(__in INT32&, __in INT32&) const override { return E_NOTIMPL; }
+        STDMETHOD_(UINT, GetCurrentPlayerID)() const override { return m_vPlayers.empty() ? 0 : m_vPlayers[0]; }
+
+        STDMETHOD(RegisterCustomPacket)(__in const GUID& guidPacketID, __in ICustomPacketV530* pCustomPacket, __in bool, __in bool) override
+        {
+            if (Find(guidPacketID) != nullptr)
+            {
+                return E_FAIL;
+            }
+            m_vPackets.push_back(Registration());
+            m_vPackets.back().guidPacket = guidPacketID;
+            m_vPackets.back().spPacket = pCustomPacket;
+            return S_OK;
+        }
+
+        STDMETHOD(UnregisterCustomPacket)(__in const GUID& guidPacketID) override
+        {
+            for (auto it = m_vPackets.begin(); it != m_vPackets.end(); ++it)
+            {
+                if (IsEqualGUID(it->guidPacket, guidPacketID))
+                {
+                    m_vPackets.erase(it);
+                    return S_OK;
+                }
+            }
+            return E_FAIL;
+        }
+
+        STDMETHOD(SendCustomPacket)(__in const GUID& guidPacketID, __in void* pContext = nullptr) override
+        {
+            Registration* pRegistration = Find(guidPacketID);
+            if (pRegistration == nullptr)
+            {
+                return E_FAIL;
+            }
+
+            LoopbackNetOut out;
+            HRESULT hr = pRegistration->spPacket->OnSend(out, pContext);
+            if (hr == S_OK)
+            {
+                m_uWireBytes += out.m_vData.size();
+                LoopbackNetIn in(out.m_vData);
+                hr = pRegistration->spPacket->OnReceive(in);
+                m_uUnreadBytes += in.BytesLeft();
+            }
+            return hr;
+        }
+
+        STDMETHOD(SetCustomPacketGuaranteed)(__in const GUID&, __in bool) override { return S_OK; }
+
+        std::vector<UINT>   m_vPlayers;
+        UINT64              m_uWireBytes = 0;
+        UINT64              m_uUnreadBytes = 0;
+
+        UINT GetRegisteredCount() const { return (UINT)m_vPackets.size(); }
+
+    private:
+        struct Registration
+        {
+            GUID                        guidPacket;
+            CComPtr<ICustomPacketV530>  spPacket;
+        };
+
+        Registration* Find(const GUID& guidPacketID)
+        {
+            for (Registration& registration : m_vPackets)
+            {
+                if (IsEqualGUID(registration.guidPacket, guidPacketID))
+                {
+                    return &registration;
+                }
+            }
+            return nullptr;
+        }
+
+        std::vector<Registration> m_vPackets;
+    };
+
+    /** Packet that writes a fixed number of doubles and checks them on receipt. */
+    class CounterPacket : public ICustomPacketV530
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        explicit CounterPacket(UINT uValues) : m_uValues(uValues) {}
+
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_ICustomPacketV530))
+            {
+                *ppv = static_cast<ICustomPacketV530*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHOD(OnSend)(__in NetOutPublic& out, __in void* pContext) override
+        {
+            const UINT uSequence = pContext != nullptr ? *(const UINT*)pContext : 0;
+            out.WriteInt32((INT32)uSequence);
+            for (UINT i = 0; i < m_uValues; i++)
+            {
+                out.WriteDouble(uSequence + i * 0.5);
+            }
+            return S_OK;
+        }
+
+        STDMETHOD(OnReceive)(__in NetInPublic& in) override
+        {
+            const INT32 iSequence = in.ReadInt32();
+            for (UINT i = 0; i < m_uValues; i++)
+            {
+                if (in.ReadDouble() != iSequence + i * 0.5)
+                {
+                    m_uCorrupt++;
+                }
+            }
+            m_iLastSequence = iSequence;
+            m_uReceived++;
+            return S_OK;
+        }
+
+        UINT    m_uValues;
+        UINT    m_uReceived = 0;
+        UINT    m_uCorrupt = 0;
+        INT32   m_iLastSequence = -1;
+    };
+
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    // {6E2B9F60-6A3B-4C57-9B0E-1F4C1B5D3A01}
+    const GUID GUID_StatePacket = { 0x6e2b9f60, 0x6a3b, 0x4c57, { 0x9b, 0x0e, 0x1f, 0x4c, 0x1b, 0x5d, 0x3a, 0x01 } };
+    // {6E2B9F60-6A3B-4C57-9B0E-1F4C1B5D3A02}
+    const GUID GUID_BulkPacket = { 0x6e2b9f60, 0x6a3b, 0x4c57, { 0x9b, 0x0e, 0x1f, 0x4c, 0x1b, 0x5d, 0x3a, 0x02 } };
+}
+
+int main()
+{
+    const double FRAME_TIME = 1.0 / 60.0;
+    const UINT FRAMES = 600;
+    const UINT BYTES_PER_SECOND = 20000;
+    const UINT BURST_BYTES = 2000;
+    const float STATE_RATE_HZ = 20.0f;
+
+    CComPtr<LoopbackMultiplayerService> spService;
+    spService.Attach(new LoopbackMultiplayerService());
+    spService->m_vPlayers = { 101, 102, 103 };
+
+    CComPtr<CounterPacket> spState;
+    spState.Attach(new CounterPacket(10));
+    CComPtr<CounterPacket> spBulk;
+    spBulk.Attach(new CounterPacket(100));
+
+    {
+        CustomPacketScheduler scheduler(spService);
+        Check(scheduler.RegisterPacket(GUID_StatePacket, spState, 10, STATE_RATE_HZ, true) == S_OK, "register state packet");
+        Check(scheduler.RegisterPacket(GUID_BulkPacket, spBulk, 1, 0.0f, false) == S_OK, "register bulk packet");
+        Check(scheduler.RegisterPacket(GUID_BulkPacket, spBulk, 1, 0.0f, false) == E_INVALIDARG, "duplicate registration rejected");
+        scheduler.SetBandwidthLimit(BYTES_PER_SECOND, BURST_BYTES);
+
+        // Three state updates and three bulk sends per frame; the last player leaves halfway through.
+        std::vector<UINT> vSequence(FRAMES * 3);
+        UINT uLastStateSequence = 0;
+        double dNow = 0.0;
+        UINT64 uBytesWhileThreePlayers = 0;
+        for (UINT uFrame = 0; uFrame < FRAMES; uFrame++)
+        {
+            if (uFrame == FRAMES / 2)
+            {
+                CustomPacketStats state, bulk;
+                scheduler.GetPacketStats(GUID_StatePacket, state);
+                scheduler.GetPacketStats(GUID_BulkPacket, bulk);
+                uBytesWhileThreePlayers = state.uBytesSent + bulk.uBytesSent;
+                spService->m_vPlayers.pop_back();
+            }
+
+            for (UINT k = 0; k < 3; k++)
+            {
+                UINT& uSequence = vSequence[uFrame * 3 + k];
+                uSequence = uFrame * 3 + k + 1;
+                scheduler.Queue(GUID_StatePacket, &uSequence);
+                scheduler.Queue(GUID_BulkPacket, &uSequence);
+                uLastStateSequence = uSequence;
+            }
+            dNow += FRAME_TIME;
+            scheduler.Pump(dNow);
+        }
+
+        CustomPacketStats state, bulk;
+        scheduler.GetPacketStats(GUID_StatePacket, state);
+        scheduler.GetPacketStats(GUID_BulkPacket, bulk);
+        const double dDuration = FRAMES * FRAME_TIME;
+        const UINT64 uTotalBytes = state.uBytesSent + bulk.uBytesSent;
+
+        printf("state: sent=%llu coalesced=%llu deferred=%llu bytes=%llu\n", state.uSent, state.uCoalesced, state.uDeferred, state.uBytesSent);
+        printf("bulk:  sent=%llu dropped=%llu deferred=%llu bytes=%llu pending=%u\n", bulk.uSent, bulk.uDropped, bulk.uDeferred, bulk.uBytesSent, scheduler.GetPendingCount(GUID_BulkPacket));
+
+        // Rate cap: at most one state packet per 1/20 s, and the high priority packet is never starved.
+        Check(state.uSent <= (UINT64)(dDuration * STATE_RATE_HZ) + 1, "state packet honors its rate cap");
+        Check(state.uSent + 2 >= (UINT64)(dDuration * STATE_RATE_HZ), "state packet is not starved by bulk traffic");
+
+        // Coalescing: superseded state updates are replaced, never queued, and the newest one wins.
+        Check(state.uCoalesced > 0 && scheduler.GetPendingCount(GUID_StatePacket) <= 1, "state packets coalesce");
+        Check(spState->m_iLastSequence >= (INT32)uLastStateSequence - 3 * (INT32)(60.0f / STATE_RATE_HZ), "receiver sees recent state");
+
+        // Bandwidth budget: everything sent fits in the token bucket, allowing one packet of overshoot.
+        const UINT64 uBulkPacketBytes = sizeof(INT32) + 100 * sizeof(double);
+        Check(uTotalBytes <= (UINT64)(dDuration * BYTES_PER_SECOND) + BURST_BYTES + uBulkPacketBytes, "total bytes within the bandwidth budget");
+        Check(bulk.uDeferred > 0 && bulk.uDropped > 0, "bulk traffic is deferred and its queue bounded");
+
+        // Byte accounting matches what crossed the loopback wire in both directions.
+        Check(uTotalBytes == spService->m_uWireBytes, "bytes sent match bytes on the wire");
+        Check(state.uBytesReceived + bulk.uBytesReceived == spService->m_uWireBytes && spService->m_uUnreadBytes == 0, "bytes received match bytes sent");
+        Check(spState->m_uCorrupt == 0 && spBulk->m_uCorrupt == 0, "payloads round trip intact");
+        Check(state.uReceived == state.uSent && bulk.uReceived == bulk.uSent, "every send is received");
+
+        // Per-player accounting: players present for the whole run are charged everything,
+        // the player who left only what was sent while connected.
+        Check(scheduler.GetTrackedPlayerCount() == 3, "three players tracked");
+        for (UINT i = 0; i < scheduler.GetTrackedPlayerCount(); i++)
+        {
+            UINT uObjectID = 0;
+            UINT64 uBytes = 0;
+            bool bConnected = false;
+            scheduler.GetPlayerBytesSent(i, uObjectID, uBytes, bConnected);
+            printf("player %u: bytes=%llu connected=%d\n", uObjectID, uBytes, bConnected ? 1 : 0);
+            if (uObjectID == 103)
+            {
+                Check(!bConnected && uBytes == uBytesWhileThreePlayers, "departed player charged only while connected");
+            }
+            else
+            {
+                Check(bConnected && uBytes == uTotalBytes, "connected player charged for every broadcast");
+            }
+        }
+
+        Check(scheduler.UnregisterPacket(GUID_BulkPacket) == S_OK && spService->GetRegisteredCount() == 1, "unregister removes the packet");
+    }
+
+    Check(spService->GetRegisteredCount() == 0, "scheduler unregisters its packets on destruction");
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// DeltaStateBench.cpp
+//
+// Measures the bandwidth of DeltaStateEncoder against sending the full state every tick.  Builds as a
+// console application with the PDK and PDK\Helpers directories on the include path; build it optimized.
+// A fleet of simulated objects, a third of them parked, writes a 12 field state each tick.  Every object
+// is serialized three ways: as deltas with a keyframe every 30 ticks and acknowledgements every 10 ticks,
+// as a keyframe every tick, and as raw doubles written with WriteDouble().  The deltas are decoded again
+// and must reproduce the state within the field precision.  Prints bytes per object per tick for each
+// and returns 0 when every decoded state matches.
+//      DeltaStateBench.exe [objects] [ticks]
+
+#include <ObjBase.h>
+#include "DeltaStateSerializer.h"
+#include "NetInOutPublic.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <random>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    const UINT FIELD_COUNT = 12;
+    const UINT KEYFRAME_INTERVAL = 30;
+    const UINT ACKNOWLEDGE_INTERVAL = 10;
+    const double TICK_SECONDS = 1.0 / 30.0;
+
+    // Latitude and longitude in radians, altitude in feet, attitude in radians, velocities in feet per second.
+    const double PRECISION[FIELD_COUNT] = { 1e-8, 1e-8, 0.1, 1e-4, 1e-4, 1e-4, 0.01, 0.01, 0.01, 1e-4, 1e-4, 1e-4 };
+
+    /** Collects the bytes written for one object and tick. */
+    class BufferNetOut : public NetOutPublic
+    {
+    public:
+        virtual void WriteData(const void* pv, unsigned int len) override { const BYTE* p = (const BYTE*)pv; m_vData.insert(m_vData.end(), p, p + len); }
+        virtual void WriteBool(bool b) override { WriteData(&b, sizeof(b)); }
+        virtual void WriteByte(unsigned char b) override { WriteData(&b, sizeof(b)); }
+        virtual void WriteShort(short value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteInt32(INT32 value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteUShort(unsigned short value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteFloat(float value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteDouble(double value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteDword(DWORD value) override { UINT32 u = (UINT32)value; WriteData(&u, sizeof(u)); }
+        virtual void WriteString(LPCWSTR pszStr) override { WriteData(pszStr, (unsigned int)((wcslen(pszStr) + 1) * sizeof(WCHAR))); }
+
+        std::vector<BYTE> m_vData;
+    };
+
+    /** Reads back the bytes of a BufferNetOut. */
+    class BufferNetIn : public NetInPublic
+    {
+    public:
+        explicit BufferNetIn(const std::vector<BYTE>& vData) : m_vData(vData) {}
+
+        virtual const void* Read(unsigned int sz) override
+        {
+            if (sz > BytesLeft())
+            {
+                return nullptr;
+            }
+            const void* p = m_vData.data() + m_uPos;
+            m_uPos += sz;
+            return p;
+        }
+        virtual bool ReadBool() override { return ReadValue<bool>(); }
+        virtual unsigned char ReadByte() override { return ReadValue<unsigned char>(); }
+        virtual short ReadShort() override { return ReadValue<short>(); }
+        virtual INT32 ReadInt32() override { return ReadValue<INT32>(); }
+        virtual float ReadFloat() override { return ReadValue<float>(); }
+        virtual double ReadDouble() override { return ReadValue<double>(); }
+        virtual unsigned short ReadUShort() override { return ReadValue<unsigned short>(); }
+        virtual unsigned long ReadDword() override { return ReadValue<UINT32>(); }
+        virtual const BYTE* GetCurBuffer() const override { return m_vData.data() + m_uPos; }
+        virtual unsigned int BytesLeft() const override { return (unsigned int)(m_vData.size() - m_uPos); }
+        virtual const WCHAR* ReadString() override { return L""; }
+
+    private:
+        template<class T> T ReadValue()
+        {
+            T value = T();
+            const void* p = Read(sizeof(T));
+            if (p != nullptr)
+            {
+                memcpy(&value, p, sizeof(T));
+            }
+            return value;
+        }
+
+        const std::vector<BYTE>&    m_vData;
+        size_t                      m_uPos = 0;
+    };
+
+    /** One simulated object: a slowly turning aircraft, or a parked one whose state never changes. */
+    struct SimulatedObject
+    {
+        double  dState[FIELD_COUNT];
+        double  dTurnRate;
+        bool    bParked;
+
+        void Step(double dSeconds)
+        {
+            if (bParked)
+            {
+                return;
+            }
+            const double dSpeed = 400.0;
+            dState[5] += dTurnRate * dSeconds;
+            dState[6] = dSpeed * sin(dState[5]);
+            dState[7] = dSpeed * cos(dState[5]);
+            dState[0] += dState[7] * dSeconds / 20902231.0;
+            dState[1] += dState[6] * dSeconds / (20902231.0 * cos(dState[0]));
+            dState[2] += dState[8] * dSeconds;
+            dState[4] = atan(dSpeed * dTurnRate / 32.174);
+            dState[11] = dTurnRate;
+        }
+    };
+
+    template<class T> void DeclareFields(T& schema)
+    {
+        for (UINT i = 0; i < FIELD_COUNT; i++)
+        {
+            schema.AddField(PRECISION[i]);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uObjectCount = argc > 1 ? (UINT)atoi(argv[1]) : 500;
+    const UINT uTickCount = argc > 2 ? (UINT)atoi(argv[2]) : 900;
+
+    std::mt19937 rng(28);
+    std::uniform_real_distribution<double> offset(-1.0, 1.0);
+    std::vector<SimulatedObject> vObjects(uObjectCount);
+    std::vector<DeltaStateEncoder> vDelta(uObjectCount, DeltaStateEncoder(KEYFRAME_INTERVAL));
+    std::vector<DeltaStateEncoder> vFull(uObjectCount, DeltaStateEncoder(1));
+    std::vector<DeltaStateDecoder> vDecoders(uObjectCount);
+    for (UINT i = 0; i < uObjectCount; i++)
+    {
+        SimulatedObject& object = vObjects[i];
+        std::fill(object.dState, object.dState + FIELD_COUNT, 0.0);
+        object.dState[0] = 0.6 + 0.01 * offset(rng);
+        object.dState[1] = -1.9 + 0.01 * offset(rng);
+        object.dState[2] = 5000.0 + 4000.0 * offset(rng);
+        object.dState[5] = 3.14 * offset(rng);
+        object.dState[8] = 10.0 * offset(rng);
+        object.dTurnRate = 0.05 * offset(rng);
+        object.bParked = i % 3 == 0;
+
+        DeclareFields(vDelta[i]);
+        DeclareFields(vFull[i]);
+        DeclareFields(vDecoders[i]);
+    }
+
+    UINT64 uRawBytes = 0;
+    UINT64 uMismatches = 0;
+    double dEncodeMs = 0.0;
+    BufferNetOut netOut;
+    std::vector<double> vDecoded(FIELD_COUNT);
+
+    for (UINT uTick = 0; uTick < uTickCount; uTick++)
+    {
+        for (UINT i = 0; i < uObjectCount; i++)
+        {
+            SimulatedObject& object = vObjects[i];
+            object.Step(TICK_SECONDS);
+
+            netOut.m_vData.clear();
+            const auto start = std::chrono::steady_clock::now();
+            vDelta[i].Write(netOut, object.dState);
+            dEncodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            BufferNetIn netIn(netOut.m_vData);
+            if (vDecoders[i].Read(netIn, vDecoded.data()) != S_OK)
+            {
+                uMismatches++;
+            }
+            else
+            {
+                for (UINT uField = 0; uField < FIELD_COUNT; uField++)
+                {
+                    if (fabs(vDecoded[uField] - object.dState[uField]) > PRECISION[uField] * 0.5 + 1e-12)
+                    {
+                        uMismatches++;
+                    }
+                }
+            }
+            if (uTick % ACKNOWLEDGE_INTERVAL == ACKNOWLEDGE_INTERVAL - 1)
+            {
+                vDelta[i].Acknowledge(vDecoders[i].GetSequence());
+            }
+
+            netOut.m_vData.clear();
+            vFull[i].Write(netOut, object.dState);
+
+            netOut.m_vData.clear();
+            for (UINT uField = 0; uField < FIELD_COUNT; uField++)
+            {
+                netOut.WriteDouble(object.dState[uField]);
+            }
+            uRawBytes += netOut.m_vData.size();
+        }
+    }
+
+    UINT64 uDeltaBytes = 0;
+    UINT64 uFullBytes = 0;
+    UINT64 uKeyframes = 0;
+    for (UINT i = 0; i < uObjectCount; i++)
+    {
+        uDeltaBytes += vDelta[i].GetBytesWritten();
+        uFullBytes += vFull[i].GetBytesWritten();
+        uKeyframes += vDelta[i].GetKeyframeCount();
+    }
+
+    const double dSamples = (double)uObjectCount * uTickCount;
+    printf("%u objects, %u ticks, %u fields each\n", uObjectCount, uTickCount, FIELD_COUNT);
+    printf("delta state:      %6.2f bytes per object per tick (%.1f%% keyframes)\n", uDeltaBytes / dSamples, 100.0 * uKeyframes / dSamples);
+    printf("keyframe per tick:%6.2f bytes per object per tick\n", uFullBytes / dSamples);
+    printf("raw doubles:      %6.2f bytes per object per tick\n", uRawBytes / dSamples);
+    printf("delta encode:     %6.3f us per object per tick\n", dEncodeMs * 1000.0 / dSamples);
+    printf("%s\n", uMismatches == 0 ? "Decoded states match." : "Decoded states differ.");
+    return uMismatches == 0 ? 0 : 1;
+}
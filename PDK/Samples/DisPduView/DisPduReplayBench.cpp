@@ -0,0 +1,400 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// DisPduReplayBench.cpp
+//
+// Replays a recorded DIS capture through DisPduView as fast as possible.  Builds as a console application
+// with the PDK and PDK\Helpers directories on the include path; build it optimized.  The capture holds
+// Entity State PDUs, some with articulation records, mixed with Fire PDUs, stored back to back as a
+// logger records them.  Each PDU is found by attaching a view to the rest of the capture, which the view
+// bounds by the PDU's header length.  The capture is replayed three ways: reading the dead reckoning
+// fields through the views, converting every PDU with ToRecord(), and reading the same fields one at a
+// time through a stand-in IPduReaderV440 as a plugin without the views would.  All three must see the
+// same PDUs and values.  Returns 0 when every check passes.
+//      DisPduReplayBench.exe [pdus] [passes]
+
+#include <ObjBase.h>
+#include <IUnknownHelper.h>
+#include "ISimObjectDIS.h"
+#include "DisPduView.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    /** Appends PDUs in network byte order to a capture buffer. */
+    class CaptureWriter
+    {
+    public:
+        void EntityState(unsigned short usEntity, double dX, double dY, double dZ, UINT uArticulations)
+        {
+            const UINT uStart = Begin(DIS_PDU_ENTITY_STATE, 1, DIS_ENTITY_STATE_SIZE + uArticulations * DIS_ARTICULATION_RECORD_SIZE);
+            U16(1); U16(2); U16(usEntity);                          // Entity ID
+            U8(1); U8((BYTE)uArticulations);                        // Force ID, articulation count
+            U8(1); U8(2); U16(225); U8(1); U8(1); U8(3); U8(0);     // Entity type
+            Zero(8);                                                // Alternative entity type
+            F32(120.0f); F32(-4.0f); F32(0.5f);                     // Linear velocity
+            F64(dX); F64(dY); F64(dZ);                              // Location
+            F32(0.1f); F32(0.02f); F32(-0.03f);                     // Orientation
+            U32(0);                                                 // Appearance
+            U8(4); Zero(15);                                        // Dead reckoning algorithm and parameters
+            Zero(24);                                               // Linear acceleration, angular velocity
+            U8(1); Text("REPLAY", 11);                              // Marking
+            U32(0);                                                 // Capabilities
+            for (UINT i = 0; i < uArticulations; i++)
+            {
+                U8(0); U8(0); U16(0); U32(4096 + i * 32); F32(0.25f * i); F32(0.0f);
+            }
+            End(uStart);
+        }
+
+        void Fire(unsigned short usEvent, double dX, double dY, double dZ)
+        {
+            const UINT uStart = Begin(DIS_PDU_FIRE, 2, DIS_FIRE_SIZE);
+            U16(1); U16(2); U16(7);                                 // Firing entity
+            U16(1); U16(2); U16(8);                                 // Target entity
+            Zero(6);                                                // Munition
+            U16(1); U16(2); U16(usEvent);                           // Event
+            U32(0);                                                 // Fire mission index
+            F64(dX); F64(dY); F64(dZ);                              // Location
+            Zero(16);                                               // Burst descriptor
+            F32(300.0f); F32(0.0f); F32(0.0f);                      // Velocity
+            F32(1500.0f);                                           // Range
+            End(uStart);
+        }
+
+        std::vector<BYTE> m_vData;
+
+    private:
+        UINT Begin(BYTE yType, BYTE yFamily, UINT uSize)
+        {
+            const UINT uStart = (UINT)m_vData.size();
+            U8(6); U8(1); U8(yType); U8(yFamily); U32(0); U16((unsigned short)uSize); U16(0);
+            return uStart;
+        }
+
+        void End(UINT uStart)
+        {
+            const UINT uSize = ((UINT)m_vData[uStart + 8] << 8) | m_vData[uStart + 9];
+            if (m_vData.size() - uStart != uSize)
+            {
+                printf("capture writer produced %u bytes for a %u byte PDU\n", (UINT)(m_vData.size() - uStart), uSize);
+                exit(1);
+            }
+        }
+
+        void U8(BYTE y) { m_vData.push_back(y); }
+        void U16(unsigned short us) { U8((BYTE)(us >> 8)); U8((BYTE)us); }
+        void U32(unsigned int u) { U16((unsigned short)(u >> 16)); U16((unsigned short)u); }
+        void F32(float f) { unsigned int u; memcpy(&u, &f, sizeof(u)); U32(u); }
+        void F64(double d) { unsigned long long u; memcpy(&u, &d, sizeof(u)); U32((unsigned int)(u >> 32)); U32((unsigned int)u); }
+        void Zero(UINT uCount) { m_vData.insert(m_vData.end(), uCount, 0); }
+        void Text(const char* psz, UINT uCount) { for (UINT i = 0; i < uCount; i++) { U8(*psz != '\0' ? (BYTE)*psz++ : 0); } }
+    };
+
+    /** PDU reader stand-in that returns one network ordered field per call, as the DIS service does. */
+    class CaptureReader : public IPduReaderV440
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        void Attach(const BYTE* pData, UINT uSize)
+        {
+            m_pData = pData;
+            m_uSize = uSize;
+            m_uPos = 0;
+        }
+
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_IPduReaderV440))
+            {
+                *ppv = static_cast<IPduReaderV440*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHOD_(char, ReadChar)() override { return (char)Next(1); }
+        STDMETHOD_(unsigned char, ReadUChar)() override { return (unsigned char)Next(1); }
+        STDMETHOD_(float, ReadFloat)() override { unsigned int u = (unsigned int)Next(4); float f; memcpy(&f, &u, sizeof(f)); return f; }
+        STDMETHOD_(double, ReadDouble)() override { unsigned long long u = Next(8); double d; memcpy(&d, &u, sizeof(d)); return d; }
+        STDMETHOD_(int, ReadInt)() override { return (int)Next(4); }
+        STDMETHOD_(unsigned int, ReadUInt)() override { return (unsigned int)Next(4); }
+        STDMETHOD_(long, ReadLong)() override { return (long)Next(4); }
+        STDMETHOD_(unsigned long, ReadULong)() override { return (unsigned long)Next(4); }
+        STDMETHOD_(long long, ReadLongLong)() override { return (long long)Next(8); }
+        STDMETHOD_(unsigned short, ReadUShort)() override { return (unsigned short)Next(2); }
+        STDMETHOD_(short, ReadShort)() override { return (short)Next(2); }
+        STDMETHOD_(const char*, GetRawData)() const override { return reinterpret_cast<const char*>(m_pData); }
+        STDMETHOD_(UINT, GetSize)() const override { return m_uSize; }
+
+    private:
+        unsigned long long Next(UINT uBytes)
+        {
+            unsigned long long u = 0;
+            for (UINT i = 0; i < uBytes && m_uPos < m_uSize; i++)
+            {
+                u = (u << 8) | m_pData[m_uPos++];
+            }
+            return u;
+        }
+
+        const BYTE* m_pData = nullptr;
+        UINT        m_uSize = 0;
+        UINT        m_uPos = 0;
+    };
+
+    /** What each replay pass accumulates; passes agree when every field matches. */
+    struct ReplayTotals
+    {
+        UINT64  uEntityStates;
+        UINT64  uFires;
+        UINT64  uArticulations;
+        double  dLocationSum;
+        double  dVelocitySum;
+        double  dOrientationSum;
+        double  dRangeSum;
+
+        bool operator==(const ReplayTotals& other) const
+        {
+            return uEntityStates == other.uEntityStates && uFires == other.uFires && uArticulations == other.uArticulations &&
+                   dLocationSum == other.dLocationSum && dVelocitySum == other.dVelocitySum &&
+                   dOrientationSum == other.dOrientationSum && dRangeSum == other.dRangeSum;
+        }
+    };
+
+    /// Views over the rest of the capture; each header view stops at its PDU's declared length.
+    bool ReplayViews(const std::vector<BYTE>& vCapture, ReplayTotals& totals)
+    {
+        totals = ReplayTotals();
+        const BYTE* p = vCapture.data();
+        const BYTE* pEnd = p + vCapture.size();
+        DisEntityStateView entity;
+        DisFireView fire;
+        while (p < pEnd)
+        {
+            DisPduView header;
+            if (FAILED(header.Attach(p, (UINT)(pEnd - p))))
+            {
+                return false;
+            }
+            if (header.GetPduType() == DIS_PDU_ENTITY_STATE && SUCCEEDED(entity.Attach(p, header.GetSize())))
+            {
+                const DisWorldCoordinates location = entity.GetLocation();
+                const DisVector velocity = entity.GetLinearVelocity();
+                const DisOrientation orientation = entity.GetOrientation();
+                totals.uEntityStates++;
+                totals.uArticulations += entity.GetArticulationCount();
+                totals.dLocationSum += location.dX + location.dY + location.dZ;
+                totals.dVelocitySum += velocity.fX + velocity.fY + velocity.fZ;
+                totals.dOrientationSum += orientation.fPsi + orientation.fTheta + orientation.fPhi;
+            }
+            else if (header.GetPduType() == DIS_PDU_FIRE && SUCCEEDED(fire.Attach(p, header.GetSize())))
+            {
+                const DisWorldCoordinates location = fire.GetLocation();
+                totals.uFires++;
+                totals.dLocationSum += location.dX + location.dY + location.dZ;
+                totals.dRangeSum += fire.GetRange();
+            }
+            p += header.GetSize();
+        }
+        return true;
+    }
+
+    /// Full conversion of every PDU to its record.
+    bool ReplayRecords(const std::vector<BYTE>& vCapture, ReplayTotals& totals)
+    {
+        totals = ReplayTotals();
+        const BYTE* p = vCapture.data();
+        const BYTE* pEnd = p + vCapture.size();
+        DisEntityStateView entity;
+        DisFireView fire;
+        DisEntityStateRecord entityRecord;
+        DisFireRecord fireRecord;
+        while (p < pEnd)
+        {
+            DisPduView header;
+            if (FAILED(header.Attach(p, (UINT)(pEnd - p))))
+            {
+                return false;
+            }
+            if (header.GetPduType() == DIS_PDU_ENTITY_STATE && SUCCEEDED(entity.Attach(p, header.GetSize())))
+            {
+                entity.ToRecord(entityRecord);
+                totals.uEntityStates++;
+                totals.uArticulations += entityRecord.uArticulationCount;
+                totals.dLocationSum += entityRecord.Location.dX + entityRecord.Location.dY + entityRecord.Location.dZ;
+                totals.dVelocitySum += entityRecord.LinearVelocity.fX + entityRecord.LinearVelocity.fY + entityRecord.LinearVelocity.fZ;
+                totals.dOrientationSum += entityRecord.Orientation.fPsi + entityRecord.Orientation.fTheta + entityRecord.Orientation.fPhi;
+            }
+            else if (header.GetPduType() == DIS_PDU_FIRE && SUCCEEDED(fire.Attach(p, header.GetSize())))
+            {
+                fire.ToRecord(fireRecord);
+                totals.uFires++;
+                totals.dLocationSum += fireRecord.Location.dX + fireRecord.Location.dY + fireRecord.Location.dZ;
+                totals.dRangeSum += fireRecord.fRange;
+            }
+            p += header.GetSize();
+        }
+        return true;
+    }
+
+    /// One virtual call per field through IPduReaderV440, skipping the fields that are not needed.
+    bool ReplayReader(const std::vector<BYTE>& vCapture, IPduReaderV440* pReader, CaptureReader& capture, ReplayTotals& totals)
+    {
+        totals = ReplayTotals();
+        const BYTE* p = vCapture.data();
+        const BYTE* pEnd = p + vCapture.size();
+        while (pEnd - p >= DIS_HEADER_SIZE)
+        {
+            const UINT uLength = ((UINT)p[8] << 8) | p[9];
+            if (uLength < DIS_HEADER_SIZE || uLength > (UINT)(pEnd - p))
+            {
+                return false;
+            }
+            capture.Attach(p, uLength);
+            pReader->ReadUChar();
+            pReader->ReadUChar();
+            const unsigned char yType = pReader->ReadUChar();
+            pReader->ReadUChar();
+            pReader->ReadUInt();
+            pReader->ReadUShort();
+            pReader->ReadUShort();
+            if (yType == DIS_PDU_ENTITY_STATE)
+            {
+                pReader->ReadUShort();
+                pReader->ReadUShort();
+                pReader->ReadUShort();
+                pReader->ReadUChar();
+                totals.uArticulations += pReader->ReadUChar();
+                pReader->ReadLongLong();
+                pReader->ReadLongLong();
+                const float fVelocityX = pReader->ReadFloat();
+                const float fVelocityY = pReader->ReadFloat();
+                const float fVelocityZ = pReader->ReadFloat();
+                const double dX = pReader->ReadDouble();
+                const double dY = pReader->ReadDouble();
+                const double dZ = pReader->ReadDouble();
+                const float fPsi = pReader->ReadFloat();
+                const float fTheta = pReader->ReadFloat();
+                const float fPhi = pReader->ReadFloat();
+                totals.uEntityStates++;
+                totals.dLocationSum += dX + dY + dZ;
+                totals.dVelocitySum += fVelocityX + fVelocityY + fVelocityZ;
+                totals.dOrientationSum += fPsi + fTheta + fPhi;
+            }
+            else if (yType == DIS_PDU_FIRE)
+            {
+                for (UINT i = 0; i < 12; i++)
+                {
+                    pReader->ReadUShort();
+                }
+                pReader->ReadUInt();
+                const double dX = pReader->ReadDouble();
+                const double dY = pReader->ReadDouble();
+                const double dZ = pReader->ReadDouble();
+                pReader->ReadLongLong();
+                pReader->ReadLongLong();
+                pReader->ReadFloat();
+                pReader->ReadFloat();
+                pReader->ReadFloat();
+                totals.uFires++;
+                totals.dLocationSum += dX + dY + dZ;
+                totals.dRangeSum += pReader->ReadFloat();
+            }
+            p += uLength;
+        }
+        return p == pEnd;
+    }
+
+    template<class F> double TimePasses(UINT uPasses, F fnPass)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (UINT i = 0; i < uPasses; i++)
+        {
+            fnPass();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uPduCount = argc > 1 ? (UINT)atoi(argv[1]) : 100000;
+    const UINT uPasses = argc > 2 ? (UINT)atoi(argv[2]) : 20;
+
+    // One Fire PDU in sixteen; every fourth Entity State carries articulated parts.
+    CaptureWriter writer;
+    for (UINT i = 0; i < uPduCount; i++)
+    {
+        const double dX = 1.1e6 + 13.0 * i;
+        const double dY = -4.8e6 - 7.0 * i;
+        const double dZ = 3.9e6 + 0.5 * i;
+        if (i % 16 == 15)
+        {
+            writer.Fire((unsigned short)i, dX, dY, dZ);
+        }
+        else
+        {
+            writer.EntityState((unsigned short)i, dX, dY, dZ, i % 4 == 0 ? 1 + i % 3 : 0);
+        }
+    }
+    const std::vector<BYTE>& vCapture = writer.m_vData;
+
+    CComPtr<CaptureReader> spCapture;
+    spCapture.Attach(new CaptureReader());
+    IPduReaderV440* volatile pReader = spCapture;
+
+    ReplayTotals views, records, reader;
+    bool bViews = true, bRecords = true, bReader = true;
+    const double dViewSeconds = TimePasses(uPasses, [&]() { bViews = ReplayViews(vCapture, views) && bViews; });
+    const double dRecordSeconds = TimePasses(uPasses, [&]() { bRecords = ReplayRecords(vCapture, records) && bRecords; });
+    const double dReaderSeconds = TimePasses(uPasses, [&]() { bReader = ReplayReader(vCapture, pReader, *spCapture, reader) && bReader; });
+
+    const double dPdus = (double)uPduCount * uPasses;
+    printf("%u PDUs, %.1f MB capture, %u passes\n", uPduCount, vCapture.size() / 1048576.0, uPasses);
+    printf("views, dead reckoning fields:   %7.2f million PDUs per second\n", dPdus / dViewSeconds / 1e6);
+    printf("views, ToRecord():              %7.2f million PDUs per second\n", dPdus / dRecordSeconds / 1e6);
+    printf("IPduReaderV440, per field:      %7.2f million PDUs per second\n", dPdus / dReaderSeconds / 1e6);
+
+    Check(bViews && bRecords && bReader, "every pass walks the capture to its end");
+    Check(views.uEntityStates + views.uFires == uPduCount, "the views find every PDU by its header length");
+    Check(views == records, "view fields match ToRecord()");
+    Check(views == reader, "view fields match the per-field reader");
+
+    // A view over the rest of the capture must stop at its own PDU.
+    DisEntityStateView first;
+    Check(SUCCEEDED(first.Attach(vCapture.data(), (UINT)vCapture.size())) && first.GetSize() == DIS_ENTITY_STATE_SIZE + DIS_ARTICULATION_RECORD_SIZE,
+          "a view over the whole capture is bounded by the first PDU's length");
+
+    // Claim a second articulation record that the PDU's length does not cover; the bytes after it belong to the next PDU.
+    std::vector<BYTE> vOvercounted(vCapture);
+    vOvercounted[19] = 2;
+    DisEntityStateView overcounted;
+    ArticulatedParameter param;
+    Check(SUCCEEDED(overcounted.Attach(vOvercounted.data(), (UINT)vOvercounted.size())) && overcounted.GetArticulation(0, param) && !overcounted.GetArticulation(1, param),
+          "articulations past the PDU's length are not read from the next PDU");
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}
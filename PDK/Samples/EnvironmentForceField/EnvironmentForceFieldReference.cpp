@@ -0,0 +1,309 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// EnvironmentForceFieldReference.cpp
+//
+// Compares EnvironmentForceField with the sum of GetForceAtLocation() over every force, as a force
+// manager client without the field would evaluate it.  Builds as a console application with the PDK
+// and PDK\Helpers directories on the include path; build it optimized.  Stand-in forces are spread
+// around a point: uniform and linear spheres and cones, a few forces large enough to span many hash
+// cells, and forces falling with the square of distance, which match neither model.  Aircraft of 32
+// body points each are scattered through the region and evaluated once in a single batch, once point
+// by point, and once through the virtual calls.  The batch must match the virtual sum within float
+// rounding and the single point results exactly.  Returns 0 when every check passes.
+//      EnvironmentForceFieldReference.exe [forces] [aircraft]
+
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "IEnvironmentForces.h"
+#include "DeadReckoning.h"
+#include "EnvironmentForceField.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    const UINT BODY_POINTS = 32;
+    const UINT IGNORED_OWNER = 3;
+    const float REGION_FEET = 30000.0f;     // Covers the corners of the square the forces are spread over
+    const double TOLERANCE_POUNDS = 0.01;   // The field works in float feet around the region center
+
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    /// How a stand-in force varies inside its volume.
+    enum STAND_IN_PROFILE
+    {
+        PROFILE_UNIFORM,
+        PROFILE_LINEAR,
+        PROFILE_QUADRATIC,  ///< Falling with the square of distance; matches neither model
+    };
+
+    /** Environment force stand-in evaluated in double precision in its own frame, as a force implementation would. */
+    class StandInForce : public IEnvironmentForceV400
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        StandInForce(const DXYZ& vPosition, const DXYZ& vForce, float fRadius, float fHalfAngle, UINT uOwner, STAND_IN_PROFILE eProfile)
+            : m_vPosition(vPosition), m_vForce(vForce), m_fRadius(fRadius), m_fHalfAngle(fHalfAngle), m_uOwner(uOwner), m_eProfile(eProfile)
+        {
+        }
+
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_IEnvironmentForceV400))
+            {
+                *ppv = static_cast<IEnvironmentForceV400*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        virtual float GetRadius() const override { return m_fRadius; }
+        virtual float GetHalfAngle() const override { return m_fHalfAngle; }
+        virtual void GetPosition(DXYZ& vWorldPosRadiansFeet) const override { vWorldPosRadiansFeet = m_vPosition; }
+        virtual void GetForce(DXYZ& vWorldForcePounds) const override { vWorldForcePounds = m_vForce; }
+        virtual UINT GetOwnerId() const override { return m_uOwner; }
+
+        virtual void GetForceAtLocation(const DXYZ& vWorldPosRadiansFeet, DXYZ& vWorldForcePounds) const override
+        {
+            DXYZ vOffset;
+            DeadReckoning::Difference(m_vPosition, vWorldPosRadiansFeet, vOffset);
+            const double dDistance = sqrt(vOffset.dX * vOffset.dX + vOffset.dY * vOffset.dY + vOffset.dZ * vOffset.dZ);
+            const double dLength = sqrt(m_vForce.dX * m_vForce.dX + m_vForce.dY * m_vForce.dY + m_vForce.dZ * m_vForce.dZ);
+            const double dDot = (vOffset.dX * m_vForce.dX + vOffset.dY * m_vForce.dY + vOffset.dZ * m_vForce.dZ) / dLength;
+            const bool bInside = dDistance <= m_fRadius && (m_fHalfAngle >= 3.14159265f || dDot >= cos(m_fHalfAngle) * dDistance);
+
+            double dWeight = 0.0;
+            if (bInside)
+            {
+                switch (m_eProfile)
+                {
+                case PROFILE_UNIFORM:   dWeight = 1.0; break;
+                case PROFILE_LINEAR:    dWeight = 1.0 - dDistance / m_fRadius; break;
+                case PROFILE_QUADRATIC: dWeight = 1.0 - dDistance * dDistance / ((double)m_fRadius * m_fRadius); break;
+                }
+            }
+            vWorldForcePounds.dX = dWeight * m_vForce.dX;
+            vWorldForcePounds.dY = dWeight * m_vForce.dY;
+            vWorldForcePounds.dZ = dWeight * m_vForce.dZ;
+        }
+
+        STAND_IN_PROFILE GetProfile() const { return m_eProfile; }
+
+    private:
+        DXYZ                m_vPosition;
+        DXYZ                m_vForce;
+        float               m_fRadius;
+        float               m_fHalfAngle;
+        UINT                m_uOwner;
+        STAND_IN_PROFILE    m_eProfile;
+    };
+
+    /** Force manager stand-in returning every force whose volume reaches the region. */
+    class StandInForceManager : public IEnvironmentForceManagerV410
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_IEnvironmentForceManagerV410))
+            {
+                *ppv = static_cast<IEnvironmentForceManagerV410*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        virtual HRESULT RegisterEnvironmentForce(IEnvironmentForceV400* pEnvironmentForce) override
+        {
+            m_vForces.push_back(pEnvironmentForce);
+            return S_OK;
+        }
+
+        virtual HRESULT UnregisterEnvironmentForce(IEnvironmentForceV400* pEnvironmentForce) override
+        {
+            m_vForces.erase(std::remove(m_vForces.begin(), m_vForces.end(), pEnvironmentForce), m_vForces.end());
+            return S_OK;
+        }
+
+        virtual HRESULT GetForcesInRadius(const DXYZ& vWorldPosRadiansFeet, float fRadiusFeet, IEnvironmentForceList& vecForces) const override
+        {
+            vecForces.BeginBuilding();
+            for (const CComPtr<IEnvironmentForceV400>& spForce : m_vForces)
+            {
+                DXYZ vPosition, vOffset;
+                spForce->GetPosition(vPosition);
+                DeadReckoning::Difference(vWorldPosRadiansFeet, vPosition, vOffset);
+                if (sqrt(vOffset.dX * vOffset.dX + vOffset.dY * vOffset.dY + vOffset.dZ * vOffset.dZ) <= fRadiusFeet + spForce->GetRadius())
+                {
+                    vecForces.AddItem(spForce);
+                }
+            }
+            vecForces.EndBuilding();
+            return S_OK;
+        }
+
+        virtual HRESULT RegisterNotification(UINT, float, IEnvironmentForceCallbackV410*) override { return S_OK; }
+        virtual HRESULT UnregisterNotification(UINT, IEnvironmentForceCallbackV410*) override { return S_OK; }
+
+    private:
+        std::vector<CComPtr<IEnvironmentForceV400>> m_vForces;
+    };
+
+    /// Sum of GetForceAtLocation() over every force of the manager, skipping one owner.
+    void SumVirtual(const EnvironmentForceField& field, const DXYZ& vPosition, UINT uIgnoreOwnerId, DXYZ& vSum)
+    {
+        vSum = DXYZ();
+        for (UINT i = 0; i < field.GetForceCount(); i++)
+        {
+            IEnvironmentForceV400* volatile pForce = field.GetForce(i);
+            if (uIgnoreOwnerId != 0 && pForce->GetOwnerId() == uIgnoreOwnerId)
+            {
+                continue;
+            }
+            DXYZ vForce;
+            pForce->GetForceAtLocation(vPosition, vForce);
+            vSum.dX += vForce.dX;
+            vSum.dY += vForce.dY;
+            vSum.dZ += vForce.dZ;
+        }
+    }
+
+    double Distance(const DXYZ& a, const DXYZ& b)
+    {
+        return sqrt((a.dX - b.dX) * (a.dX - b.dX) + (a.dY - b.dY) * (a.dY - b.dY) + (a.dZ - b.dZ) * (a.dZ - b.dZ));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uForceCount = argc > 1 ? (UINT)atoi(argv[1]) : 400;
+    const UINT uAircraftCount = argc > 2 ? (UINT)atoi(argv[2]) : 500;
+
+    const DXYZ vCenter = { -1.5, 1000.0, 0.7 };
+    std::mt19937 rng(46);
+    std::uniform_real_distribution<double> offset(-1.0, 1.0);
+
+    CComPtr<StandInForceManager> spManager;
+    spManager.Attach(new StandInForceManager());
+    UINT uQuadratic = 0;
+    for (UINT i = 0; i < uForceCount; i++)
+    {
+        const DXYZ vOffset = { 20000.0 * offset(rng), 2000.0 + 2000.0 * offset(rng), 20000.0 * offset(rng) };
+        DXYZ vPosition;
+        DeadReckoning::Offset(vCenter, vOffset, vPosition);
+        const DXYZ vForce = { 100.0 * offset(rng), 100.0 * offset(rng), 100.0 * offset(rng) };
+
+        // Every tenth force spans many cells, every third is a sphere, the rest cones of 20 to 75 degrees.
+        const float fRadius = i % 10 == 0 ? 8000.0f : (float)(300.0 + 1500.0 * fabs(offset(rng)));
+        const float fHalfAngle = i % 3 == 0 ? 3.14159265f : (float)(0.35 + 0.95 * fabs(offset(rng)));
+        const STAND_IN_PROFILE eProfile = i % 8 == 7 ? PROFILE_QUADRATIC : (i % 2 == 0 ? PROFILE_UNIFORM : PROFILE_LINEAR);
+        uQuadratic += eProfile == PROFILE_QUADRATIC ? 1 : 0;
+
+        CComPtr<StandInForce> spForce;
+        spForce.Attach(new StandInForce(vPosition, vForce, fRadius, fHalfAngle, i % 7, eProfile));
+        spManager->RegisterEnvironmentForce(spForce);
+    }
+
+    // Aircraft whose body points lie within 40 feet of their reference point.
+    std::vector<DXYZ> vPoints((size_t)uAircraftCount * BODY_POINTS);
+    for (UINT uAircraft = 0; uAircraft < uAircraftCount; uAircraft++)
+    {
+        const DXYZ vOffset = { 20000.0 * offset(rng), 2000.0 + 2000.0 * offset(rng), 20000.0 * offset(rng) };
+        DXYZ vReference;
+        DeadReckoning::Offset(vCenter, vOffset, vReference);
+        for (UINT uPoint = 0; uPoint < BODY_POINTS; uPoint++)
+        {
+            const DXYZ vBody = { 40.0 * offset(rng), 10.0 * offset(rng), 40.0 * offset(rng) };
+            DeadReckoning::Offset(vReference, vBody, vPoints[(size_t)uAircraft * BODY_POINTS + uPoint]);
+        }
+    }
+
+    EnvironmentForceField field;
+    const auto snapshotStart = std::chrono::steady_clock::now();
+    const HRESULT hr = field.Snapshot(spManager, vCenter, REGION_FEET);
+    const double dSnapshotMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - snapshotStart).count();
+
+    UINT uModelMismatches = 0;
+    UINT uVirtual = 0;
+    for (UINT i = 0; i < field.GetForceCount(); i++)
+    {
+        const StandInForce* pForce = static_cast<const StandInForce*>(field.GetForce(i));
+        const ENVIRONMENT_FORCE_MODEL eModel = field.GetForceModel(i);
+        const ENVIRONMENT_FORCE_MODEL eExpected = pForce->GetProfile() == PROFILE_UNIFORM ? ENVIRONMENT_FORCE_UNIFORM :
+                                                  (pForce->GetProfile() == PROFILE_LINEAR ? ENVIRONMENT_FORCE_LINEAR : ENVIRONMENT_FORCE_VIRTUAL);
+        uModelMismatches += eModel != eExpected ? 1 : 0;
+        uVirtual += eModel == ENVIRONMENT_FORCE_VIRTUAL ? 1 : 0;
+    }
+
+    const UINT uPointCount = (UINT)vPoints.size();
+    std::vector<DXYZ> vBatch(uPointCount), vBatchIgnored(uPointCount), vSingle(uPointCount), vExact(uPointCount), vExactIgnored(uPointCount);
+
+    auto start = std::chrono::steady_clock::now();
+    field.Evaluate(vPoints.data(), uPointCount, vBatch.data());
+    const double dBatchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    field.Evaluate(vPoints.data(), uPointCount, vBatchIgnored.data(), IGNORED_OWNER);
+
+    start = std::chrono::steady_clock::now();
+    for (UINT uPoint = 0; uPoint < uPointCount; uPoint++)
+    {
+        SumVirtual(field, vPoints[uPoint], 0, vExact[uPoint]);
+    }
+    const double dVirtualMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double dMaxError = 0.0;
+    double dMaxIgnoredError = 0.0;
+    UINT uSingleMismatches = 0;
+    UINT uForcedPoints = 0;
+    for (UINT uPoint = 0; uPoint < uPointCount; uPoint++)
+    {
+        SumVirtual(field, vPoints[uPoint], IGNORED_OWNER, vExactIgnored[uPoint]);
+        field.Evaluate(&vPoints[uPoint], 1, &vSingle[uPoint]);
+        dMaxError = std::max(dMaxError, Distance(vBatch[uPoint], vExact[uPoint]));
+        dMaxIgnoredError = std::max(dMaxIgnoredError, Distance(vBatchIgnored[uPoint], vExactIgnored[uPoint]));
+        uSingleMismatches += Distance(vSingle[uPoint], vBatch[uPoint]) != 0.0 ? 1 : 0;
+        uForcedPoints += Distance(vExact[uPoint], DXYZ()) > 0.0 ? 1 : 0;
+    }
+
+    printf("%u forces (%u quadratic), %u points in %u aircraft\n", field.GetForceCount(), uQuadratic, uPointCount, uAircraftCount);
+    printf("%u points inside at least one force\n", uForcedPoints);
+    printf("snapshot:          %8.3f ms\n", dSnapshotMs);
+    printf("field batch:       %8.3f ms, %.3f us per point\n", dBatchMs, dBatchMs * 1000.0 / uPointCount);
+    printf("virtual per force: %8.3f ms, %.3f us per point\n", dVirtualMs, dVirtualMs * 1000.0 / uPointCount);
+    printf("largest difference %.6f lb, %.6f lb ignoring owner %u\n", dMaxError, dMaxIgnoredError, IGNORED_OWNER);
+
+    Check(SUCCEEDED(hr) && field.GetForceCount() == uForceCount, "snapshot collects every force in the region");
+    Check(uModelMismatches == 0, "uniform and linear forces are modeled and quadratic forces are evaluated virtually");
+    Check(uVirtual == uQuadratic, "only the quadratic forces are evaluated virtually");
+    Check(uForcedPoints * 10 > uPointCount, "a useful share of the points is inside a force");
+    Check(dMaxError <= TOLERANCE_POUNDS, "batch matches the sum of GetForceAtLocation()");
+    Check(dMaxIgnoredError <= TOLERANCE_POUNDS, "batch matches the virtual sum when skipping an owner");
+    Check(uSingleMismatches == 0, "single point evaluation matches the batch exactly");
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}
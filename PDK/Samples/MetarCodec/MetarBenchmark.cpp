@@ -0,0 +1,224 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// MetarBenchmark.cpp
+//
+// Parses and formats one million generated METAR strings with MetarCodec and reports the time per
+// string.  Builds as a console application with the PDK and PDK\Helpers directories on the include
+// path; build it optimized.  The global operator new is counted to confirm that neither Parse() nor
+// Format() allocates.  Returns 0 when every string parsed and no allocation was seen.
+//      MetarBenchmark.exe [count]
+
+#include <ObjBase.h>
+#include "MetarCodec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    std::atomic<UINT64> g_uAllocations(0);
+}
+
+void* operator new(size_t uSize)
+{
+    g_uAllocations++;
+    void* p = malloc(uSize > 0 ? uSize : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    /** Appends printf-style text to a wide character buffer. */
+    class MetarBuilder
+    {
+    public:
+        explicit MetarBuilder(std::vector<WCHAR>& vText) : m_vText(vText) {}
+
+        void Append(const char* pszFormat, ...)
+        {
+            char szBuffer[128];
+            va_list args;
+            va_start(args, pszFormat);
+            int iLength = vsnprintf(szBuffer, sizeof(szBuffer), pszFormat, args);
+            va_end(args);
+            for (int i = 0; i < iLength && i < (int)sizeof(szBuffer) - 1; i++)
+            {
+                m_vText.push_back((WCHAR)szBuffer[i]);
+            }
+        }
+
+    private:
+        std::vector<WCHAR>& m_vText;
+    };
+
+    const char* const STATIONS[] = { "KSEA", "KORD", "KJFK", "EGLL", "LFPG", "EDDF", "RJTT", "YSSY", "CYYZ", "PHNL", "KDEN", "UUEE" };
+    const char* const COVERS[] = { "FEW", "SCT", "BKN", "OVC" };
+    const char* const WEATHER[] = { "-RA", "+SN", "BR", "FG", "-DZ", "SHRA", "TSRA" };
+
+    /** Generates a plausible METAR.  Roughly a third use the layer extensions written by Format(). */
+    void GenerateMetar(std::mt19937& rng, std::vector<WCHAR>& vText)
+    {
+        MetarBuilder builder(vText);
+        const bool bExtended = rng() % 3 == 0;
+
+        builder.Append("%s %02u%02u%02uZ", STATIONS[rng() % ARRAYSIZE(STATIONS)], 1 + rng() % 28, rng() % 24, rng() % 60);
+
+        const UINT uSpeed = rng() % 35;
+        builder.Append(" %03u%02u", (rng() % 36) * 10, uSpeed);
+        if (rng() % 4 == 0)
+        {
+            builder.Append("G%02u", uSpeed + 5 + rng() % 15);
+        }
+        builder.Append(rng() % 10 == 0 ? "MPS" : "KT");
+        if (bExtended)
+        {
+            builder.Append("&D%uNG", 300 + rng() % 1000);
+            for (UINT i = rng() % 3; i > 0; i--)
+            {
+                builder.Append(" %03u%02uKT&A%u%c%c", (rng() % 36) * 10, 10 + rng() % 60, 1000 * (1 + rng() % 10), "NLMHS"[rng() % 5], "GMSI"[rng() % 4]);
+            }
+        }
+
+        switch (rng() % 4)
+        {
+        case 0: builder.Append(" 9999"); break;
+        case 1: builder.Append(" %uSM", 1 + rng() % 10); break;
+        case 2: builder.Append(" 1 1/2SM"); break;
+        default: builder.Append(" %04u", 500 + rng() % 9000); break;
+        }
+        if (bExtended)
+        {
+            builder.Append("&B-0050&D%u", 2000 + rng() % 8000);
+        }
+        if (rng() % 3 == 0)
+        {
+            builder.Append(" %s", WEATHER[rng() % ARRAYSIZE(WEATHER)]);
+        }
+
+        UINT uBase = 5 + rng() % 40;
+        for (UINT i = rng() % 5; i > 0; i--)
+        {
+            builder.Append(" %s%03u", COVERS[rng() % ARRAYSIZE(COVERS)], uBase);
+            if (bExtended)
+            {
+                builder.Append("&CU%03uFNMN000N", 5 + rng() % 40);
+            }
+            uBase += 10 + rng() % 80;
+        }
+
+        const int iTemp = (int)(rng() % 50) - 15;
+        const int iDew = iTemp - (int)(rng() % 10);
+        builder.Append(iTemp < 0 ? " M%02d" : " %02d", abs(iTemp));
+        builder.Append(iDew < 0 ? "/M%02d" : "/%02d", abs(iDew));
+        if (rng() % 2 == 0)
+        {
+            builder.Append(" Q%04u", 980 + rng() % 50);
+        }
+        else
+        {
+            builder.Append(" A%04u", 2900 + rng() % 150);
+        }
+        if (rng() % 2 == 0)
+        {
+            builder.Append(" RMK AO2 SLP%03u", rng() % 1000);
+        }
+        vText.push_back(L'\0');
+    }
+
+    double SecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uCount = argc > 1 ? (UINT)atoi(argv[1]) : 1000000;
+
+    // Generate every string up front into one buffer so the timed loops only touch the codec.
+    std::vector<WCHAR> vText;
+    std::vector<size_t> vOffsets;
+    vText.reserve((size_t)uCount * 80);
+    vOffsets.reserve(uCount);
+    std::mt19937 rng(42);
+    for (UINT i = 0; i < uCount; i++)
+    {
+        vOffsets.push_back(vText.size());
+        GenerateMetar(rng, vText);
+    }
+    const size_t cchTotal = vText.size() - uCount;
+    printf("%u METARs, %.1f characters on average\n", uCount, (double)cchTotal / uCount);
+
+    std::vector<MetarData> vParsed(4096);
+    UINT uFailed = 0;
+    UINT64 uLayers = 0;
+
+    // Parse
+    UINT64 uAllocationsBefore = g_uAllocations;
+    auto start = std::chrono::steady_clock::now();
+    for (UINT i = 0; i < uCount; i++)
+    {
+        MetarData& metar = vParsed[i % vParsed.size()];
+        if (FAILED(MetarCodec::Parse(&vText[vOffsets[i]], metar)))
+        {
+            uFailed++;
+        }
+        uLayers += metar.uCloudCount + metar.uWindCount;
+    }
+    const double dParseSeconds = SecondsSince(start);
+    const UINT64 uParseAllocations = g_uAllocations - uAllocationsBefore;
+
+    // Format the parsed weather of every string.  Parse into a small ring first so Format() reads varied data.
+    WCHAR szMetar[MetarCodec::MAX_METAR_LENGTH + 1];
+    size_t cchFormatted = 0;
+    double dFormatSeconds = 0.0;
+    uAllocationsBefore = g_uAllocations;
+    for (UINT uFirst = 0; uFirst < uCount; uFirst += (UINT)vParsed.size())
+    {
+        const UINT uBatch = std::min((UINT)vParsed.size(), uCount - uFirst);
+        for (UINT i = 0; i < uBatch; i++)
+        {
+            MetarCodec::Parse(&vText[vOffsets[uFirst + i]], vParsed[i]);
+        }
+        start = std::chrono::steady_clock::now();
+        for (UINT i = 0; i < uBatch; i++)
+        {
+            size_t cchLength = 0;
+            if (FAILED(MetarCodec::Format(vParsed[i], szMetar, ARRAYSIZE(szMetar), &cchLength)))
+            {
+                uFailed++;
+            }
+            cchFormatted += cchLength;
+        }
+        dFormatSeconds += SecondsSince(start);
+    }
+    const UINT64 uFormatAllocations = g_uAllocations - uAllocationsBefore;
+
+    printf("parse:  %7.1f ms  %6.1f ns/METAR  %6.1f MB/s\n", dParseSeconds * 1e3, dParseSeconds * 1e9 / uCount,
+           cchTotal * sizeof(WCHAR) / dParseSeconds / 1e6);
+    printf("format: %7.1f ms  %6.1f ns/METAR  %6.1f MB/s\n", dFormatSeconds * 1e3, dFormatSeconds * 1e9 / uCount,
+           cchFormatted * sizeof(WCHAR) / dFormatSeconds / 1e6);
+    printf("allocations: parse %llu, format %llu\n", (unsigned long long)uParseAllocations, (unsigned long long)uFormatAllocations);
+    printf("failed %u, %llu wind and cloud layers\n", uFailed, (unsigned long long)uLayers);
+
+    return uFailed == 0 && uParseAllocations == 0 && uFormatAllocations == 0 ? 0 : 1;
+}
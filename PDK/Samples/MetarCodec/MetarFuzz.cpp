@@ -0,0 +1,208 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// MetarFuzz.cpp
+//
+// Fuzz target for MetarCodec.  Every input is parsed without a terminator, and anything that parses is
+// formatted into a full and a short buffer and parsed again; the second format must equal the first.
+//
+// With libFuzzer (clang or MSVC /fsanitize=fuzzer), define METAR_FUZZ_LIBFUZZER and run:
+//      MetarFuzz.exe corpus
+// Without it, the built-in driver replays the files named on the command line and then runs a fixed
+// number of seeded mutations of them:
+//      MetarFuzz.exe corpus\*.txt [iterations]
+// The driver stops with a non-zero exit code and prints the input on the first failure.
+
+#include <ObjBase.h>
+#include "MetarCodec.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    void Fail(const WCHAR* pszInput, size_t cchInput, const char* pszWhat)
+    {
+        printf("FAIL: %s\ninput: ", pszWhat);
+        for (size_t i = 0; i < cchInput; i++)
+        {
+            putchar(pszInput[i] >= 0x20 && pszInput[i] < 0x7F ? (char)pszInput[i] : '?');
+        }
+        putchar('\n');
+        fflush(stdout);
+        abort();
+    }
+
+    void RunOne(const WCHAR* pszInput, size_t cchInput)
+    {
+        MetarData metar;
+        if (FAILED(MetarCodec::Parse(pszInput, cchInput, metar)))
+        {
+            return;
+        }
+        if (metar.uCloudCount > MetarData::MAX_LAYERS || metar.uWindCount > MetarData::MAX_LAYERS ||
+            metar.uTempCount > MetarData::MAX_LAYERS || metar.uVisibilityCount > MetarData::MAX_LAYERS)
+        {
+            Fail(pszInput, cchInput, "layer count out of range");
+        }
+
+        static WCHAR szFirst[MetarCodec::MAX_METAR_LENGTH + 1];
+        static WCHAR szSecond[MetarCodec::MAX_METAR_LENGTH + 1];
+        size_t cchFirst = 0;
+        if (FAILED(MetarCodec::Format(metar, szFirst, ARRAYSIZE(szFirst), &cchFirst)))
+        {
+            // Sixteen layers of each kind can exceed the weather system's limit; that is reported, not written.
+            return;
+        }
+        if (cchFirst != wcslen(szFirst))
+        {
+            Fail(pszInput, cchInput, "reported length differs from the string");
+        }
+
+        // A buffer one character short must fail cleanly and leave an empty string.
+        if (cchFirst > 0)
+        {
+            std::vector<WCHAR> vShort(cchFirst, L'#');
+            if (SUCCEEDED(MetarCodec::Format(metar, vShort.data(), vShort.size())) || vShort[0] != L'\0')
+            {
+                Fail(pszInput, cchInput, "short buffer not rejected");
+            }
+        }
+
+        MetarData reparsed;
+        if (MetarCodec::Parse(szFirst, reparsed) != S_OK)
+        {
+            Fail(pszInput, cchInput, "formatted METAR does not parse cleanly");
+        }
+        if (FAILED(MetarCodec::Format(reparsed, szSecond, ARRAYSIZE(szSecond))) || wcscmp(szFirst, szSecond) != 0)
+        {
+            Fail(pszInput, cchInput, "format is not stable across a parse");
+        }
+    }
+
+    void RunBytes(const BYTE* pData, size_t uSize)
+    {
+        // Bytes are widened one to one so the corpus stays readable text; the input is not terminated.
+        std::vector<WCHAR> vInput(pData, pData + uSize);
+        RunOne(vInput.data(), vInput.size());
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const BYTE* pData, size_t uSize)
+{
+    RunBytes(pData, uSize);
+    return 0;
+}
+
+#ifndef METAR_FUZZ_LIBFUZZER
+
+namespace
+{
+    const char MUTATION_CHARS[] = "0123456789ABCDEFGKLMNOPQRSTVWXYZ/&- ";
+
+    void Mutate(std::string& strInput, const std::vector<std::string>& vCorpus, std::mt19937& rng)
+    {
+        const UINT uEdits = 1 + rng() % 4;
+        for (UINT i = 0; i < uEdits; i++)
+        {
+            const size_t uPos = strInput.empty() ? 0 : rng() % (strInput.size() + 1);
+            switch (rng() % 5)
+            {
+            case 0:     // Replace a character
+                if (uPos < strInput.size())
+                {
+                    strInput[uPos] = MUTATION_CHARS[rng() % (sizeof(MUTATION_CHARS) - 1)];
+                }
+                break;
+            case 1:     // Insert a character
+                strInput.insert(strInput.begin() + uPos, MUTATION_CHARS[rng() % (sizeof(MUTATION_CHARS) - 1)]);
+                break;
+            case 2:     // Erase a run
+                if (uPos < strInput.size())
+                {
+                    strInput.erase(uPos, 1 + rng() % 6);
+                }
+                break;
+            case 3:     // Splice in a token from another seed
+            {
+                const std::string& strOther = vCorpus[rng() % vCorpus.size()];
+                if (!strOther.empty())
+                {
+                    const size_t uStart = rng() % strOther.size();
+                    strInput.insert(uPos, strOther, uStart, 1 + rng() % 16);
+                }
+                break;
+            }
+            default:    // Repeat a run, which grows layer counts past their limits
+                if (uPos < strInput.size())
+                {
+                    const std::string strRun = strInput.substr(uPos, 1 + rng() % 24);
+                    for (UINT k = rng() % 20; k > 0 && strInput.size() < 4 * MetarCodec::MAX_METAR_LENGTH; k--)
+                    {
+                        strInput.insert(uPos, strRun);
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> vCorpus;
+    UINT uIterations = 1000000;
+    for (int i = 1; i < argc; i++)
+    {
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, argv[i], "rb") != 0 || pFile == nullptr)
+        {
+            if (i == argc - 1 && argv[i][0] != '\0' && strspn(argv[i], "0123456789") == strlen(argv[i]))
+            {
+                uIterations = (UINT)atoi(argv[i]);
+                continue;
+            }
+            printf("cannot open %s\n", argv[i]);
+            return 2;
+        }
+        std::string strSeed;
+        char buffer[512];
+        size_t uRead = 0;
+        while ((uRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+        {
+            strSeed.append(buffer, uRead);
+        }
+        fclose(pFile);
+        vCorpus.push_back(strSeed);
+    }
+    if (vCorpus.empty())
+    {
+        printf("usage: MetarFuzz corpus-file... [iterations]\n");
+        return 2;
+    }
+
+    for (const std::string& strSeed : vCorpus)
+    {
+        RunBytes(reinterpret_cast<const BYTE*>(strSeed.data()), strSeed.size());
+    }
+
+    std::mt19937 rng(20181012);
+    for (UINT i = 0; i < uIterations; i++)
+    {
+        std::string strInput = vCorpus[rng() % vCorpus.size()];
+        Mutate(strInput, vCorpus, rng);
+        RunBytes(reinterpret_cast<const BYTE*>(strInput.data()), strInput.size());
+    }
+
+    printf("%zu seeds and %u mutations passed.\n", vCorpus.size(), uIterations);
+    return 0;
+}
+
+#endif // METAR_FUZZ_LIBFUZZER
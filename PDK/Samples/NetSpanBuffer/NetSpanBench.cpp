@@ -0,0 +1,270 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// NetSpanBench.cpp
+//
+// Times NetSpanWriter and NetSpanReader against the per-field NetOutPublic and NetInPublic calls for a
+// packet of 1,000 fields.  Builds as a console application with the PDK and PDK\Helpers directories on
+// the include path; build it optimized.  The packet holds 400 INT32, 300 float and 300 double fields.
+// Each packet is written field by field through the stream, field by field through NetSpanWriter, and
+// as three arrays through NetSpanWriter::WriteArray(), then read back the same three ways.  All writes
+// must produce the same bytes and all reads the same fields.  Returns 0 when they do.
+//      NetSpanBench.exe [packets]
+
+#include <ObjBase.h>
+#include "NetInOutPublic.h"
+#include "NetSpanBuffer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <vector>
+
+using namespace P3D;
+
+namespace
+{
+    const UINT INT_FIELDS = 400;
+    const UINT FLOAT_FIELDS = 300;
+    const UINT DOUBLE_FIELDS = 300;
+
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    /** Stream stand-in that appends every write to a buffer, as the multiplayer service does. */
+    class BufferNetOut : public NetOutPublic
+    {
+    public:
+        virtual void WriteData(const void* pv, unsigned int len) override { const BYTE* p = (const BYTE*)pv; m_vData.insert(m_vData.end(), p, p + len); }
+        virtual void WriteBool(bool b) override { WriteData(&b, sizeof(b)); }
+        virtual void WriteByte(unsigned char b) override { WriteData(&b, sizeof(b)); }
+        virtual void WriteShort(short value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteInt32(INT32 value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteUShort(unsigned short value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteFloat(float value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteDouble(double value) override { WriteData(&value, sizeof(value)); }
+        virtual void WriteDword(DWORD value) override { UINT32 u = (UINT32)value; WriteData(&u, sizeof(u)); }
+        virtual void WriteString(LPCWSTR pszStr) override { WriteData(pszStr, (unsigned int)((wcslen(pszStr) + 1) * sizeof(WCHAR))); }
+
+        std::vector<BYTE> m_vData;
+    };
+
+    /** Stream stand-in that reads back a BufferNetOut and exposes its buffer. */
+    class BufferNetIn : public NetInPublic
+    {
+    public:
+        explicit BufferNetIn(const std::vector<BYTE>& vData) : m_vData(vData) {}
+
+        virtual const void* Read(unsigned int sz) override
+        {
+            if (sz > BytesLeft())
+            {
+                return nullptr;
+            }
+            const void* p = m_vData.data() + m_uPos;
+            m_uPos += sz;
+            return p;
+        }
+        virtual bool ReadBool() override { return ReadValue<bool>(); }
+        virtual unsigned char ReadByte() override { return ReadValue<unsigned char>(); }
+        virtual short ReadShort() override { return ReadValue<short>(); }
+        virtual INT32 ReadInt32() override { return ReadValue<INT32>(); }
+        virtual float ReadFloat() override { return ReadValue<float>(); }
+        virtual double ReadDouble() override { return ReadValue<double>(); }
+        virtual unsigned short ReadUShort() override { return ReadValue<unsigned short>(); }
+        virtual unsigned long ReadDword() override { return ReadValue<UINT32>(); }
+        virtual const BYTE* GetCurBuffer() const override { return m_vData.data() + m_uPos; }
+        virtual unsigned int BytesLeft() const override { return (unsigned int)(m_vData.size() - m_uPos); }
+        virtual const WCHAR* ReadString() override { return L""; }
+
+    private:
+        template<class T> T ReadValue()
+        {
+            T value = T();
+            const void* p = Read(sizeof(T));
+            if (p != nullptr)
+            {
+                memcpy(&value, p, sizeof(T));
+            }
+            return value;
+        }
+
+        const std::vector<BYTE>&    m_vData;
+        size_t                      m_uPos = 0;
+    };
+
+    struct Packet
+    {
+        INT32   iValues[INT_FIELDS];
+        float   fValues[FLOAT_FIELDS];
+        double  dValues[DOUBLE_FIELDS];
+
+        bool operator==(const Packet& other) const { return memcmp(this, &other, sizeof(Packet)) == 0; }
+    };
+
+    void WritePerField(NetOutPublic& out, const Packet& packet)
+    {
+        for (UINT i = 0; i < INT_FIELDS; i++)
+        {
+            out.WriteInt32(packet.iValues[i]);
+        }
+        for (UINT i = 0; i < FLOAT_FIELDS; i++)
+        {
+            out.WriteFloat(packet.fValues[i]);
+        }
+        for (UINT i = 0; i < DOUBLE_FIELDS; i++)
+        {
+            out.WriteDouble(packet.dValues[i]);
+        }
+    }
+
+    void WriteSpanFields(NetOutPublic& out, const Packet& packet)
+    {
+        NetSpanWriter writer(out, sizeof(Packet));
+        for (UINT i = 0; i < INT_FIELDS; i++)
+        {
+            writer.Write(packet.iValues[i]);
+        }
+        for (UINT i = 0; i < FLOAT_FIELDS; i++)
+        {
+            writer.Write(packet.fValues[i]);
+        }
+        for (UINT i = 0; i < DOUBLE_FIELDS; i++)
+        {
+            writer.Write(packet.dValues[i]);
+        }
+    }
+
+    void WriteSpanArrays(NetOutPublic& out, const Packet& packet)
+    {
+        NetSpanWriter writer(out, sizeof(Packet));
+        writer.WriteArray(packet.iValues, INT_FIELDS);
+        writer.WriteArray(packet.fValues, FLOAT_FIELDS);
+        writer.WriteArray(packet.dValues, DOUBLE_FIELDS);
+    }
+
+    void ReadPerField(NetInPublic& in, Packet& packet)
+    {
+        for (UINT i = 0; i < INT_FIELDS; i++)
+        {
+            packet.iValues[i] = in.ReadInt32();
+        }
+        for (UINT i = 0; i < FLOAT_FIELDS; i++)
+        {
+            packet.fValues[i] = in.ReadFloat();
+        }
+        for (UINT i = 0; i < DOUBLE_FIELDS; i++)
+        {
+            packet.dValues[i] = in.ReadDouble();
+        }
+    }
+
+    void ReadSpanFields(NetInPublic& in, Packet& packet)
+    {
+        NetSpanReader reader(in);
+        for (UINT i = 0; i < INT_FIELDS; i++)
+        {
+            reader.Read(packet.iValues[i]);
+        }
+        for (UINT i = 0; i < FLOAT_FIELDS; i++)
+        {
+            reader.Read(packet.fValues[i]);
+        }
+        for (UINT i = 0; i < DOUBLE_FIELDS; i++)
+        {
+            reader.Read(packet.dValues[i]);
+        }
+    }
+
+    void ReadSpanArrays(NetInPublic& in, Packet& packet)
+    {
+        NetSpanReader reader(in);
+        reader.ReadArray(packet.iValues, INT_FIELDS);
+        reader.ReadArray(packet.fValues, FLOAT_FIELDS);
+        reader.ReadArray(packet.dValues, DOUBLE_FIELDS);
+    }
+
+    /// Writes the packet uPackets times and returns microseconds per packet.  The stream keeps the last packet.
+    /// The stream is reached through a volatile pointer so its calls stay virtual, as they are across the simulator boundary.
+    double TimeWrite(void (*pfnWrite)(NetOutPublic&, const Packet&), const Packet& packet, UINT uPackets, BufferNetOut& out)
+    {
+        out.m_vData.reserve(sizeof(Packet));
+        NetOutPublic* volatile pOut = &out;
+        const auto start = std::chrono::steady_clock::now();
+        for (UINT i = 0; i < uPackets; i++)
+        {
+            out.m_vData.clear();
+            pfnWrite(*pOut, packet);
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / uPackets;
+    }
+
+    /// Reads the packet uPackets times and returns microseconds per packet.
+    double TimeRead(void (*pfnRead)(NetInPublic&, Packet&), const std::vector<BYTE>& vData, UINT uPackets, Packet& packet)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (UINT i = 0; i < uPackets; i++)
+        {
+            BufferNetIn in(vData);
+            NetInPublic* volatile pIn = &in;
+            pfnRead(*pIn, packet);
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / uPackets;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uPackets = argc > 1 ? (UINT)atoi(argv[1]) : 20000;
+
+    Packet packet;
+    for (UINT i = 0; i < INT_FIELDS; i++)
+    {
+        packet.iValues[i] = (INT32)(i * 2654435761u);
+    }
+    for (UINT i = 0; i < FLOAT_FIELDS; i++)
+    {
+        packet.fValues[i] = 0.37f * i - 50.0f;
+    }
+    for (UINT i = 0; i < DOUBLE_FIELDS; i++)
+    {
+        packet.dValues[i] = 1.0e5 / (i + 1.0);
+    }
+
+    BufferNetOut perField, spanFields, spanArrays;
+    const double dWritePerField = TimeWrite(WritePerField, packet, uPackets, perField);
+    const double dWriteSpanFields = TimeWrite(WriteSpanFields, packet, uPackets, spanFields);
+    const double dWriteSpanArrays = TimeWrite(WriteSpanArrays, packet, uPackets, spanArrays);
+
+    Packet readPerField, readSpanFields, readSpanArrays;
+    const double dReadPerField = TimeRead(ReadPerField, perField.m_vData, uPackets, readPerField);
+    const double dReadSpanFields = TimeRead(ReadSpanFields, perField.m_vData, uPackets, readSpanFields);
+    const double dReadSpanArrays = TimeRead(ReadSpanArrays, perField.m_vData, uPackets, readSpanArrays);
+
+    printf("%u fields, %u bytes per packet, %u packets\n", INT_FIELDS + FLOAT_FIELDS + DOUBLE_FIELDS, (UINT)sizeof(Packet), uPackets);
+    printf("write per field:        %8.3f us per packet\n", dWritePerField);
+    printf("write span per field:   %8.3f us per packet\n", dWriteSpanFields);
+    printf("write span arrays:      %8.3f us per packet\n", dWriteSpanArrays);
+    printf("read per field:         %8.3f us per packet\n", dReadPerField);
+    printf("read span per field:    %8.3f us per packet\n", dReadSpanFields);
+    printf("read span arrays:       %8.3f us per packet\n", dReadSpanArrays);
+
+    Check(spanFields.m_vData == perField.m_vData, "span field writes match per-field writes byte for byte");
+    Check(spanArrays.m_vData == perField.m_vData, "span array writes match per-field writes byte for byte");
+    Check(readPerField == packet, "per-field reads return the packet");
+    Check(readSpanFields == packet, "span field reads return the packet");
+    Check(readSpanArrays == packet, "span array reads return the packet");
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarContactBench.cpp
+//
+// Times RadarContactDetector with 5000 targets around the aircraft.  Builds as a console application with
+// the PDK and PDK\Helpers directories on the include path; build it optimized.  A stand-in
+// ISimulatedRadarV500 sweeps its beam with RadarBeam as the radar service does.  The detector runs for
+// ten simulated seconds at 60 Hz on a SimulationWorkerPool and again on the calling thread, and the two
+// track files must be identical.  Returns 0 when they are.
+//      RadarContactBench.exe [targets]
+
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "ISimulatedRadar.h"
+#include "RadarBeam.h"
+#include "RadarContactDetector.h"
+#include "SimulationWorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace Radar;
+
+namespace
+{
+    const double SCAN_AZIMUTH = 60.0;
+    const double SWEEP_RATE = 60.0;
+    const double RANGE_MILES = 40.0;
+    const double FRAME_SECONDS = 1.0 / 60.0;
+    const UINT FRAMES = 600;
+
+    /** Radar service stand-in that sweeps its beam and reports fixed scan settings. */
+    class StandInRadar : public ISimulatedRadarV500
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        /// Moves the beam as the radar service does once per frame.
+        void Tick(double dSeconds)
+        {
+            double dMin, dMax;
+            m_Beam.Advance(SCAN_AZIMUTH, SWEEP_RATE * dSeconds, dMin, dMax);
+        }
+
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_ISimulatedRadarV500))
+            {
+                *ppv = static_cast<ISimulatedRadarV500*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        // Settings read by the detector.
+        virtual double GetScanAzimuth() const override { return SCAN_AZIMUTH; }
+        virtual double GetSweepRate() const override { return SWEEP_RATE; }
+        virtual double GetRangeMiles() const override { return RANGE_MILES; }
+        virtual bool FreezeEnabled() const override { return false; }
+        virtual double GetFrontBlindspotDegrees() const override { return 4.0; }
+        virtual double GetSideBlindspotDegrees() const override { return 5.0; }
+        virtual double GetCurrentRadarScanElevationDegrees() const override { return -2.0; }
+        virtual double GetCurrentRadarBeamOffsetDegrees() const override { return m_Beam.GetAzimuth(); }
+
+        // The rest of the interface is not used by the detector.
+        virtual HRESULT Init(const WCHAR*, UINT, UINT) override { return S_OK; }
+        virtual HRESULT DeInit(void) override { return S_OK; }
+        virtual bool IsInitialized() const override { return true; }
+        virtual bool NeedsUpdate() const override { return false; }
+        virtual bool ShowRangeRings() const override { return false; }
+        virtual bool ShowCursor() const override { return false; }
+        virtual bool FarShoreEnhance() const override { return false; }
+        virtual double GetVisualZoom() const override { return 1.0; }
+        virtual double GetDataZoom() const override { return 1.0; }
+        virtual bool RenderingEnabled() const override { return true; }
+        virtual void GetCursorPositionXY(double& x, double& y) const override { x = y = 0.5; }
+        virtual void GetCursorPositionLLA(LLA& lla) const override { lla = LLA(); }
+        virtual void GetRadarResolution(double& x, double& y) const override { x = y = 256.0; }
+        virtual void GetGaugeResolution(double& x, double& y) const override { x = y = 256.0; }
+        virtual void ClearRadarImage() override {}
+        virtual void SetShowRangeRings(bool) override {}
+        virtual void SetShowCursor(bool) override {}
+        virtual void SetFarShoreEnhancementEnabled(bool) override {}
+        virtual void SetVisualZoom(double) override {}
+        virtual void SetDataZoom(double) override {}
+        virtual void SetScanRateDegreesPerSecond(double) override {}
+        virtual void SetRangeMiles(double) override {}
+        virtual void SetRenderingEnabled(bool) override {}
+        virtual void SetFreeze(bool) override {}
+        virtual void SetCursorPositionXY(double, double) override {}
+        virtual void SetCursorPositionLLA(const LLA&) override {}
+        virtual void SetRadarImageResolution(double, double) override {}
+        virtual void SetRadarGaugeResolution(double, double) override {}
+        virtual void SetScanAzimuthDegrees(double) override {}
+        virtual void SetFrontBlindSpotDegrees(double) override {}
+        virtual void SetSideBlindSpotDegrees(double) override {}
+        virtual void SetRadarScanColor(float, float, float) override {}
+        virtual void SetRadarGain(float) override {}
+        virtual void SetRadarTextureInterpolation(bool) override {}
+        virtual void UseCustomRadarAngles(bool) override {}
+        virtual void SetCustomRadarAngles(double, double) override {}
+        virtual void GetLLAFromLocalXY(LLA& lla, double, double) const override { lla = LLA(); }
+        virtual void GetLLAFromGlobalXY(LLA& lla, double, double) const override { lla = LLA(); }
+        virtual void GetLocalXYCoord(double& dX, double& dY, const LLA&) const override { dX = dY = 0.0; }
+        virtual void GetGlobalXYCoord(double& dX, double& dY, const LLA&) const override { dX = dY = 0.0; }
+        virtual void SetRadarGaugeColor(float, float, float) override {}
+
+    private:
+        RadarBeam   m_Beam;
+    };
+
+    struct RunResult
+    {
+        double                  dAverageMs;
+        double                  dWorstMs;
+        double                  dAverageCandidates;
+        std::vector<RadarTrack> vTrackFile;
+    };
+
+    RunResult Run(const std::vector<RadarTarget>& vTargets, const LLA& vAircraft, P3D::SimulationWorkerPool* pPool)
+    {
+        CComPtr<StandInRadar> spRadar;
+        spRadar.Attach(new StandInRadar());
+        RadarContactDetector detector(pPool);
+        detector.SetTargets(vTargets.data(), (UINT)vTargets.size());
+
+        RunResult result = {};
+        double dTotalMs = 0.0;
+        UINT64 uCandidates = 0;
+        for (UINT uFrame = 0; uFrame < FRAMES; uFrame++)
+        {
+            spRadar->Tick(FRAME_SECONDS);
+            const auto start = std::chrono::steady_clock::now();
+            detector.Update(spRadar, vAircraft, 35.0, FRAME_SECONDS);
+            const double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            dTotalMs += dMs;
+            result.dWorstMs = std::max(result.dWorstMs, dMs);
+            uCandidates += detector.GetCandidateCount();
+        }
+        result.dAverageMs = dTotalMs / FRAMES;
+        result.dAverageCandidates = (double)uCandidates / FRAMES;
+        result.vTrackFile = detector.GetTrackFile();
+        return result;
+    }
+
+    bool SameTracks(const std::vector<RadarTrack>& a, const std::vector<RadarTrack>& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].uObjectId != b[i].uObjectId || a[i].dRangeFeet != b[i].dRangeFeet || a[i].dLastDetection != b[i].dLastDetection)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uTargetCount = argc > 1 ? (UINT)atoi(argv[1]) : 5000;
+
+    // Targets spread over about 50 nautical miles around the aircraft, at 2000 to 30000 feet.
+    const LLA vAircraft(0.6, -1.9, 12000.0);
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> offset(-1.0, 1.0);
+    std::vector<RadarTarget> vTargets(uTargetCount);
+    for (UINT i = 0; i < uTargetCount; i++)
+    {
+        vTargets[i].uObjectId = i + 1;
+        vTargets[i].vPosition = LLA(vAircraft.Lat + offset(rng) * 0.015, vAircraft.Lon + offset(rng) * 0.018, 16000.0 + 14000.0 * offset(rng));
+        vTargets[i].fRcsSquareMeters = (float)(0.1 + 20.0 * fabs(offset(rng)));
+    }
+
+    P3D::SimulationWorkerPool pool(3);
+    const RunResult pooled = Run(vTargets, vAircraft, &pool);
+    const RunResult serial = Run(vTargets, vAircraft, nullptr);
+
+    printf("%u targets, %u frames at 60 Hz, %.0f candidates per frame\n", uTargetCount, FRAMES, pooled.dAverageCandidates);
+    printf("pool of 3:      %.3f ms per frame, worst %.3f ms\n", pooled.dAverageMs, pooled.dWorstMs);
+    printf("calling thread: %.3f ms per frame, worst %.3f ms\n", serial.dAverageMs, serial.dWorstMs);
+    printf("%zu confirmed tracks\n", pooled.vTrackFile.size());
+
+    const bool bSame = SameTracks(pooled.vTrackFile, serial.vTrackFile);
+    printf("%s\n", bSame ? "Track files match." : "Track files differ.");
+    return bSame ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarProjectionReference.cpp
+//
+// Compares the RadarProjection batch methods with the radar's own conversion methods.  Builds as a console
+// application with the PDK and PDK\Helpers directories on the include path; build it optimized.  A
+// stand-in ISimulatedRadarV500 projects a heading-up display around the aircraft, which sits at the bottom
+// center, with the local display zoomed in around it.  For several headings, ranges and zooms, positions
+// spread over one and a half times the display, including the corners a rotated display leaves off the
+// screen, are converted to global and local XY, and display coordinates on and around the display are
+// converted to LLA.  Every batch result must match the virtual method within the projection's tolerances,
+// and positions well inside the display must be converted by the fit.  Returns 0 when every check passes.
+//      RadarProjectionReference.exe [points]
+
+#include <ObjBase.h>
+#include <atlcomcli.h>
+#include <IUnknownHelper.h>
+#include "ISimulatedRadar.h"
+#include "RadarProjection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace Radar;
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+    const double FEET_PER_RADIAN = 20902230.971;
+    const double FEET_PER_MILE = 6076.12;
+    const double TOLERANCE_XY = 1.0e-5;
+    const double TOLERANCE_FEET = 1.0;
+
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    /**
+    * Radar service stand-in with an azimuthal equidistant, heading-up display.  Global XY spans the radar
+    * range with the aircraft at (0.5, 1); local XY is the global display zoomed about the aircraft.
+    */
+    class StandInRadar : public ISimulatedRadarV500
+    {
+        DEFAULT_REFCOUNT_INLINE_IMPL();
+
+    public:
+        void Place(const LLA& vAircraft, double dHeadingRadians, double dRangeMiles, double dZoom)
+        {
+            m_vAircraft = vAircraft;
+            m_dHeading = dHeadingRadians;
+            m_dRangeMiles = dRangeMiles;
+            m_dZoom = dZoom;
+        }
+
+        UINT64 GetConversionCount() const { return m_uConversions; }
+
+        STDMETHOD(QueryInterface)(REFIID riid, PVOID* ppv) override
+        {
+            if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_ISimulatedRadarV500))
+            {
+                *ppv = static_cast<ISimulatedRadarV500*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        // Conversions used by the projection.
+        virtual void GetLLAFromGlobalXY(LLA& lla, double dX, double dY) const override
+        {
+            m_uConversions++;
+            FromXY(lla, dX, dY);
+        }
+        virtual void GetGlobalXYCoord(double& dX, double& dY, const LLA& lla) const override
+        {
+            m_uConversions++;
+            ToXY(dX, dY, lla);
+        }
+        virtual void GetLLAFromLocalXY(LLA& lla, double dX, double dY) const override
+        {
+            m_uConversions++;
+            FromXY(lla, (dX - 0.5) / m_dZoom + 0.5, (dY - 1.0) / m_dZoom + 1.0);
+        }
+        virtual void GetLocalXYCoord(double& dX, double& dY, const LLA& lla) const override
+        {
+            m_uConversions++;
+            ToXY(dX, dY, lla);
+            dX = (dX - 0.5) * m_dZoom + 0.5;
+            dY = (dY - 1.0) * m_dZoom + 1.0;
+        }
+
+        virtual double GetRangeMiles() const override { return m_dRangeMiles; }
+        virtual double GetVisualZoom() const override { return m_dZoom; }
+
+        // The rest of the interface is not used by the projection.
+        virtual HRESULT Init(const WCHAR*, UINT, UINT) override { return S_OK; }
+        virtual HRESULT DeInit(void) override { return S_OK; }
+        virtual bool IsInitialized() const override { return true; }
+        virtual bool NeedsUpdate() const override { return false; }
+        virtual bool ShowRangeRings() const override { return false; }
+        virtual bool ShowCursor() const override { return false; }
+        virtual bool FarShoreEnhance() const override { return false; }
+        virtual bool FreezeEnabled() const override { return false; }
+        virtual double GetScanAzimuth() const override { return 60.0; }
+        virtual double GetSweepRate() const override { return 60.0; }
+        virtual double GetDataZoom() const override { return 1.0; }
+        virtual double GetFrontBlindspotDegrees() const override { return 0.0; }
+        virtual double GetSideBlindspotDegrees() const override { return 0.0; }
+        virtual double GetCurrentRadarScanElevationDegrees() const override { return 0.0; }
+        virtual double GetCurrentRadarBeamOffsetDegrees() const override { return 0.0; }
+        virtual bool RenderingEnabled() const override { return true; }
+        virtual void GetCursorPositionXY(double& x, double& y) const override { x = y = 0.5; }
+        virtual void GetCursorPositionLLA(LLA& lla) const override { lla = LLA(); }
+        virtual void GetRadarResolution(double& x, double& y) const override { x = y = 256.0; }
+        virtual void GetGaugeResolution(double& x, double& y) const override { x = y = 256.0; }
+        virtual void ClearRadarImage() override {}
+        virtual void SetShowRangeRings(bool) override {}
+        virtual void SetShowCursor(bool) override {}
+        virtual void SetFarShoreEnhancementEnabled(bool) override {}
+        virtual void SetVisualZoom(double) override {}
+        virtual void SetDataZoom(double) override {}
+        virtual void SetScanRateDegreesPerSecond(double) override {}
+        virtual void SetRangeMiles(double) override {}
+        virtual void SetRenderingEnabled(bool) override {}
+        virtual void SetFreeze(bool) override {}
+        virtual void SetCursorPositionXY(double, double) override {}
+        virtual void SetCursorPositionLLA(const LLA&) override {}
+        virtual void SetRadarImageResolution(double, double) override {}
+        virtual void SetRadarGaugeResolution(double, double) override {}
+        virtual void SetScanAzimuthDegrees(double) override {}
+        virtual void SetFrontBlindSpotDegrees(double) override {}
+        virtual void SetSideBlindSpotDegrees(double) override {}
+        virtual void SetRadarScanColor(float, float, float) override {}
+        virtual void SetRadarGain(float) override {}
+        virtual void SetRadarTextureInterpolation(bool) override {}
+        virtual void UseCustomRadarAngles(bool) override {}
+        virtual void SetCustomRadarAngles(double, double) override {}
+        virtual void SetRadarGaugeColor(float, float, float) override {}
+
+    private:
+        /// Great circle distance and bearing from the aircraft, scaled so the range is the display height.
+        void ToXY(double& dX, double& dY, const LLA& lla) const
+        {
+            const double dLat0 = m_vAircraft.Lat;
+            const double dLon = lla.Lon - m_vAircraft.Lon;
+            const double dCos = std::max(-1.0, std::min(1.0, sin(dLat0) * sin(lla.Lat) + cos(dLat0) * cos(lla.Lat) * cos(dLon)));
+            const double dBearing = atan2(sin(dLon) * cos(lla.Lat), cos(dLat0) * sin(lla.Lat) - sin(dLat0) * cos(lla.Lat) * cos(dLon));
+            const double dDistance = acos(dCos) * FEET_PER_RADIAN / (m_dRangeMiles * FEET_PER_MILE);
+            dX = 0.5 + 0.5 * dDistance * sin(dBearing - m_dHeading);
+            dY = 1.0 - dDistance * cos(dBearing - m_dHeading);
+        }
+
+        void FromXY(LLA& lla, double dX, double dY) const
+        {
+            const double dRight = (dX - 0.5) * 2.0;
+            const double dAhead = 1.0 - dY;
+            const double dBearing = atan2(dRight, dAhead) + m_dHeading;
+            const double dAngle = sqrt(dRight * dRight + dAhead * dAhead) * m_dRangeMiles * FEET_PER_MILE / FEET_PER_RADIAN;
+            const double dLat0 = m_vAircraft.Lat;
+            lla.Lat = asin(sin(dLat0) * cos(dAngle) + cos(dLat0) * sin(dAngle) * cos(dBearing));
+            lla.Lon = m_vAircraft.Lon + atan2(sin(dBearing) * sin(dAngle) * cos(dLat0), cos(dAngle) - sin(dLat0) * sin(lla.Lat));
+            lla.Lon -= floor((lla.Lon + PI) / (2.0 * PI)) * 2.0 * PI;
+            lla.Alt = 0.0;
+        }
+
+        LLA             m_vAircraft;
+        double          m_dHeading = 0.0;
+        double          m_dRangeMiles = 40.0;
+        double          m_dZoom = 1.0;
+        mutable UINT64  m_uConversions = 0;
+    };
+
+    struct Totals
+    {
+        UINT    uSettings = 0;
+        UINT    uFitted = 0;
+        double  dErrorXY = 0.0;         ///< Largest batch XY difference from the radar
+        double  dErrorFeet = 0.0;
+        UINT64  uMismatches = 0;        ///< Points where the LLA overload differs from the array overload
+        UINT64  uInsideFallbacks = 0;   ///< Radar calls for positions well inside the display
+        UINT64  uInsidePoints = 0;
+        double  dBatchMs = 0.0;         ///< Time converting the positions well inside the display
+        double  dVirtualMs = 0.0;
+    };
+
+    double FeetBetween(const LLA& a, const LLA& b)
+    {
+        const double dNorth = (a.Lat - b.Lat) * FEET_PER_RADIAN;
+        double dLon = a.Lon - b.Lon;
+        dLon -= floor((dLon + PI) / (2.0 * PI)) * 2.0 * PI;
+        const double dEast = dLon * FEET_PER_RADIAN * cos(a.Lat);
+        return std::max(sqrt(dNorth * dNorth + dEast * dEast), fabs(a.Alt - b.Alt));
+    }
+
+    void Compare(StandInRadar& radar, const RadarProjection& projection, bool bLocal, UINT uPoints, std::mt19937& rng, Totals& totals)
+    {
+        ISimulatedRadarV500* volatile pRadar = &radar;
+        std::uniform_real_distribution<double> spread(-0.25, 1.25);
+        std::uniform_real_distribution<double> inside(0.02, 0.98);
+
+        // Positions over one and a half times the display, and the display coordinates they came from.
+        std::vector<double> vSourceX(uPoints), vSourceY(uPoints), vLat(uPoints), vLon(uPoints), vAlt(uPoints);
+        std::vector<LLA> vLLA(uPoints);
+        for (UINT i = 0; i < uPoints; i++)
+        {
+            const bool bInside = i % 4 == 0;
+            vSourceX[i] = bInside ? inside(rng) : spread(rng);
+            vSourceY[i] = bInside ? inside(rng) : spread(rng);
+            if (bLocal)
+            {
+                pRadar->GetLLAFromLocalXY(vLLA[i], vSourceX[i], vSourceY[i]);
+            }
+            else
+            {
+                pRadar->GetLLAFromGlobalXY(vLLA[i], vSourceX[i], vSourceY[i]);
+            }
+            vLLA[i].Alt = 1000.0 + 10.0 * i;
+            vLat[i] = vLLA[i].Lat;
+            vLon[i] = vLLA[i].Lon;
+            vAlt[i] = vLLA[i].Alt;
+        }
+
+        // Positions well inside the display alone, to count the radar calls the fit leaves and to time the
+        // batch against the virtual method where the fit applies.
+        std::vector<double> vInsideLat, vInsideLon, vInsideAlt;
+        for (UINT i = 0; i < uPoints; i += 4)
+        {
+            vInsideLat.push_back(vLat[i]);
+            vInsideLon.push_back(vLon[i]);
+            vInsideAlt.push_back(vAlt[i]);
+        }
+        std::vector<double> vInsideX(vInsideLat.size()), vInsideY(vInsideLat.size());
+        const UINT64 uBefore = radar.GetConversionCount();
+        auto start = std::chrono::steady_clock::now();
+        if (bLocal)
+        {
+            projection.GetLocalXYCoords(vInsideLat.data(), vInsideLon.data(), vInsideAlt.data(), (UINT)vInsideLat.size(), vInsideX.data(), vInsideY.data());
+        }
+        else
+        {
+            projection.GetGlobalXYCoords(vInsideLat.data(), vInsideLon.data(), vInsideAlt.data(), (UINT)vInsideLat.size(), vInsideX.data(), vInsideY.data());
+        }
+        const double dBatchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < vInsideLat.size(); i++)
+        {
+            const LLA lla(vInsideLat[i], vInsideLon[i], vInsideAlt[i]);
+            if (bLocal)
+            {
+                pRadar->GetLocalXYCoord(vInsideX[i], vInsideY[i], lla);
+            }
+            else
+            {
+                pRadar->GetGlobalXYCoord(vInsideX[i], vInsideY[i], lla);
+            }
+        }
+        const double dVirtualMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (projection.IsFitted())
+        {
+            totals.uInsideFallbacks += radar.GetConversionCount() - uBefore - vInsideLat.size();
+            totals.uInsidePoints += vInsideLat.size();
+            totals.dBatchMs += dBatchMs;
+            totals.dVirtualMs += dVirtualMs;
+        }
+
+        // LLA to XY: structure of arrays, LLA array and the virtual method.
+        std::vector<double> vX(uPoints), vY(uPoints), vArrayX(uPoints), vArrayY(uPoints), vExpectedX(uPoints), vExpectedY(uPoints);
+        if (bLocal)
+        {
+            projection.GetLocalXYCoords(vLat.data(), vLon.data(), vAlt.data(), uPoints, vX.data(), vY.data());
+        }
+        else
+        {
+            projection.GetGlobalXYCoords(vLat.data(), vLon.data(), vAlt.data(), uPoints, vX.data(), vY.data());
+        }
+        if (bLocal)
+        {
+            projection.GetLocalXYCoords(vLLA.data(), uPoints, vArrayX.data(), vArrayY.data());
+        }
+        else
+        {
+            projection.GetGlobalXYCoords(vLLA.data(), uPoints, vArrayX.data(), vArrayY.data());
+        }
+        for (UINT i = 0; i < uPoints; i++)
+        {
+            if (bLocal)
+            {
+                pRadar->GetLocalXYCoord(vExpectedX[i], vExpectedY[i], vLLA[i]);
+            }
+            else
+            {
+                pRadar->GetGlobalXYCoord(vExpectedX[i], vExpectedY[i], vLLA[i]);
+            }
+        }
+
+        // XY to LLA, on and around the display.
+        std::vector<double> vBackLat(uPoints), vBackLon(uPoints), vBackAlt(uPoints);
+        std::vector<LLA> vBack(uPoints);
+        if (bLocal)
+        {
+            projection.GetLLAFromLocalXY(vSourceX.data(), vSourceY.data(), uPoints, vBackLat.data(), vBackLon.data(), vBackAlt.data());
+            projection.GetLLAFromLocalXY(vSourceX.data(), vSourceY.data(), uPoints, vBack.data());
+        }
+        else
+        {
+            projection.GetLLAFromGlobalXY(vSourceX.data(), vSourceY.data(), uPoints, vBackLat.data(), vBackLon.data(), vBackAlt.data());
+            projection.GetLLAFromGlobalXY(vSourceX.data(), vSourceY.data(), uPoints, vBack.data());
+        }
+
+        for (UINT i = 0; i < uPoints; i++)
+        {
+            LLA expected;
+            if (bLocal)
+            {
+                pRadar->GetLLAFromLocalXY(expected, vSourceX[i], vSourceY[i]);
+            }
+            else
+            {
+                pRadar->GetLLAFromGlobalXY(expected, vSourceX[i], vSourceY[i]);
+            }
+            const double dErrorXY = std::max(fabs(vX[i] - vExpectedX[i]), fabs(vY[i] - vExpectedY[i]));
+            const double dErrorFeet = std::max(FeetBetween(LLA(vBackLat[i], vBackLon[i], vBackAlt[i]), expected), FeetBetween(vBack[i], expected));
+            if (vArrayX[i] != vX[i] || vArrayY[i] != vY[i] || vBack[i].Lat != vBackLat[i] || vBack[i].Lon != vBackLon[i] || vBack[i].Alt != vBackAlt[i])
+            {
+                totals.uMismatches++;
+            }
+            totals.dErrorXY = std::max(totals.dErrorXY, dErrorXY);
+            totals.dErrorFeet = std::max(totals.dErrorFeet, dErrorFeet);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uPoints = argc > 1 ? (UINT)atoi(argv[1]) : 20000;
+
+    CComPtr<StandInRadar> spRadar;
+    spRadar.Attach(new StandInRadar());
+    std::mt19937 rng(49);
+    Totals totals;
+    UINT uShortRangeFitted = 0;
+    UINT uShortRangeSettings = 0;
+
+    const LLA vAircraft(0.7, -1.2, 12000.0);
+    const double dHeadings[] = { 0.0, 37.0, 135.0, 270.0 };
+    const double dRanges[] = { 10.0, 40.0, 80.0 };
+    const double dZooms[] = { 1.0, 2.0, 4.0 };
+    for (double dHeading : dHeadings)
+    {
+        for (double dRange : dRanges)
+        {
+            for (double dZoom : dZooms)
+            {
+                spRadar->Place(vAircraft, dHeading * PI / 180.0, dRange, dZoom);
+                RadarProjection projection(TOLERANCE_XY, TOLERANCE_FEET);
+                projection.Capture(spRadar);
+                totals.uSettings++;
+                totals.uFitted += projection.IsFitted() ? 1 : 0;
+                if (dRange <= 40.0)
+                {
+                    uShortRangeSettings++;
+                    uShortRangeFitted += projection.IsFitted() ? 1 : 0;
+                }
+                printf("heading %3.0f range %2.0f zoom %.0f: %s, fit error %.2e XY %.3f ft\n", dHeading, dRange, dZoom,
+                       projection.IsFitted() ? "fitted" : "radar ", projection.GetErrorXY(), projection.GetErrorFeet());
+                Compare(*spRadar, projection, false, uPoints, rng, totals);
+                Compare(*spRadar, projection, true, uPoints, rng, totals);
+            }
+        }
+    }
+
+    printf("%u of %u settings fitted\n", totals.uFitted, totals.uSettings);
+    printf("largest difference from the radar: %.2e XY, %.3f ft\n", totals.dErrorXY, totals.dErrorFeet);
+    printf("radar calls for %llu positions well inside the display: %llu\n", (unsigned long long)totals.uInsidePoints, (unsigned long long)totals.uInsideFallbacks);
+    printf("well inside the display where fitted: batch %.3f ms, virtual %.3f ms\n", totals.dBatchMs, totals.dVirtualMs);
+
+    Check(uShortRangeFitted == uShortRangeSettings, "every setting up to 40 miles is fitted");
+    Check(totals.dErrorXY <= TOLERANCE_XY, "batch XY matches the radar within the tolerance, including off-display corners");
+    Check(totals.dErrorFeet <= TOLERANCE_FEET, "batch LLA matches the radar within the tolerance");
+    Check(totals.uMismatches == 0, "LLA and array overloads agree");
+    Check(totals.uInsideFallbacks == 0, "positions well inside the display are converted by the fit");
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}
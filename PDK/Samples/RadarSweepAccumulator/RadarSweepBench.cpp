@@ -0,0 +1,175 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarSweepBench.cpp
+//
+// Times RadarSweepAccumulator::Update() and Resolve() against a scope that repaints its whole image every
+// frame.  Builds as a console application with the PDK and PDK\Helpers directories on the include path;
+// build it optimized.  Both scopes run a 256 x 256 image at 60 Hz with the beam sweeping 90 degrees per
+// second and returns fading with a four second half-life.  The repainting scope keeps its image in
+// floating point in display order, decays every pixel, paints the swept columns and converts the whole
+// image to 8 bits each frame.  The accumulator paints the swept columns and resolves the image.  The
+// final images must match within a step of the 8 bit scale, and a move that ends exactly on a scan limit
+// must turn the beam around.  Returns 0 when every check passes.
+//      RadarSweepBench.exe [frames]
+
+#include <ObjBase.h>
+#include "RadarSweepAccumulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace Radar;
+
+namespace
+{
+    const UINT AZIMUTH_BINS = 256;
+    const UINT RANGE_BINS = 256;
+    const double SCAN_AZIMUTH = 60.0;       // Degrees either side of center
+    const double SWEEP_RATE = 90.0;         // Degrees per second
+    const double HALF_LIFE = 4.0;           // Seconds
+    const double FRAME_SECONDS = 1.0 / 60.0;
+    const int TOLERANCE = 2;                // 8 bit steps; fixed point and floating point decay round differently
+
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    UINT AzimuthToColumn(double dAzimuth)
+    {
+        const double dColumn = (dAzimuth + SCAN_AZIMUTH) / (2.0 * SCAN_AZIMUTH) * AZIMUTH_BINS;
+        return (UINT)std::max(0.0, std::min(dColumn, AZIMUTH_BINS - 1.0));
+    }
+
+    /** Returns of a column: ground clutter fading with range and two fixed contacts. */
+    void SampleColumn(void* pContext, double dAzimuthDegrees, USHORT* pBins, UINT uBinCount)
+    {
+        const UINT uColumn = AzimuthToColumn(dAzimuthDegrees);
+        for (UINT uBin = 0; uBin < uBinCount; uBin++)
+        {
+            const UINT uHash = (uColumn * 2654435761u) ^ (uBin * 40503u);
+            pBins[uBin] = (USHORT)(uHash % 16 == 0 ? 40000 - uBin * 100 : 0);
+        }
+        if (uColumn == 80 || uColumn == 200)
+        {
+            pBins[uBinCount / 2] = 65535;
+        }
+        ++*static_cast<UINT64*>(pContext);
+    }
+
+    /** Scope without the accumulator: the whole image is decayed and converted every frame. */
+    class RepaintScope
+    {
+    public:
+        RepaintScope() : m_vPixels((size_t)AZIMUTH_BINS * RANGE_BINS, 0.0f), m_vColumn(RANGE_BINS) {}
+
+        void Update(double dElapsedSeconds, UINT64& uColumnsPainted)
+        {
+            const float fGain = (float)exp2(-dElapsedSeconds / HALF_LIFE);
+            for (float& fPixel : m_vPixels)
+            {
+                fPixel *= fGain;
+            }
+
+            double dMin, dMax;
+            m_Beam.Advance(SCAN_AZIMUTH, SWEEP_RATE * dElapsedSeconds, dMin, dMax);
+            for (UINT uColumn = AzimuthToColumn(dMin); uColumn <= AzimuthToColumn(dMax); uColumn++)
+            {
+                const double dAzimuth = ((uColumn + 0.5) / AZIMUTH_BINS * 2.0 - 1.0) * SCAN_AZIMUTH;
+                SampleColumn(&uColumnsPainted, dAzimuth, m_vColumn.data(), RANGE_BINS);
+                for (UINT uBin = 0; uBin < RANGE_BINS; uBin++)
+                {
+                    float& fPixel = m_vPixels[(size_t)(RANGE_BINS - 1 - uBin) * AZIMUTH_BINS + uColumn];
+                    fPixel = std::max(fPixel, (float)m_vColumn[uBin]);
+                }
+            }
+        }
+
+        void Resolve(BYTE* pImage) const
+        {
+            for (size_t i = 0; i < m_vPixels.size(); i++)
+            {
+                pImage[i] = (BYTE)(m_vPixels[i] * (1.0f / 256.0f));
+            }
+        }
+
+    private:
+        std::vector<float>  m_vPixels;      ///< Display order, maximum range in the top row
+        std::vector<USHORT> m_vColumn;
+        RadarBeam           m_Beam;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    const UINT uFrames = argc > 1 ? (UINT)atoi(argv[1]) : 3600;
+
+    RadarSweepAccumulator accumulator(AZIMUTH_BINS, RANGE_BINS);
+    accumulator.SetPersistence(HALF_LIFE);
+    RepaintScope repaint;
+    std::vector<BYTE> vIncrementalImage((size_t)AZIMUTH_BINS * RANGE_BINS);
+    std::vector<BYTE> vRepaintImage((size_t)AZIMUTH_BINS * RANGE_BINS);
+    UINT64 uIncrementalColumns = 0;
+    UINT64 uRepaintColumns = 0;
+
+    double dUpdateMs = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (UINT uFrame = 0; uFrame < uFrames; uFrame++)
+    {
+        const auto updateStart = std::chrono::steady_clock::now();
+        accumulator.Update(SCAN_AZIMUTH, SWEEP_RATE, FRAME_SECONDS, SampleColumn, &uIncrementalColumns);
+        dUpdateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - updateStart).count();
+        accumulator.Resolve(vIncrementalImage.data(), AZIMUTH_BINS);
+    }
+    const double dIncrementalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / uFrames;
+    dUpdateMs /= uFrames;
+
+    start = std::chrono::steady_clock::now();
+    for (UINT uFrame = 0; uFrame < uFrames; uFrame++)
+    {
+        repaint.Update(FRAME_SECONDS, uRepaintColumns);
+        repaint.Resolve(vRepaintImage.data());
+    }
+    const double dRepaintMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / uFrames;
+
+    int iMaxDifference = 0;
+    for (size_t i = 0; i < vIncrementalImage.size(); i++)
+    {
+        iMaxDifference = std::max(iMaxDifference, abs((int)vIncrementalImage[i] - (int)vRepaintImage[i]));
+    }
+
+    // A move that ends exactly on the right limit paints up to it, then sweeps back from it.
+    RadarSweepAccumulator turn(AZIMUTH_BINS, RANGE_BINS);
+    UINT64 uTurnColumns = 0;
+    UINT uFirst, uCount;
+    turn.Update(SCAN_AZIMUTH, SCAN_AZIMUTH, 1.0, SampleColumn, &uTurnColumns);
+    turn.GetSweptColumns(uFirst, uCount);
+    const bool bReachedLimit = turn.GetBeamAzimuth() == SCAN_AZIMUTH && uFirst + uCount == AZIMUTH_BINS;
+    turn.Update(SCAN_AZIMUTH, SCAN_AZIMUTH, 0.25, SampleColumn, &uTurnColumns);
+    const bool bTurnedBack = turn.GetBeamAzimuth() == 0.75 * SCAN_AZIMUTH;
+
+    printf("%u x %u image, %u frames at 60 Hz\n", AZIMUTH_BINS, RANGE_BINS, uFrames);
+    printf("incremental update and resolve: %.4f ms per frame, %.1f columns sampled per frame\n", dIncrementalMs, (double)uIncrementalColumns / uFrames);
+    printf("  of which update:              %.4f ms per frame\n", dUpdateMs);
+    printf("full repaint:                   %.4f ms per frame, %.1f columns sampled per frame\n", dRepaintMs, (double)uRepaintColumns / uFrames);
+    printf("largest pixel difference %d of 255\n", iMaxDifference);
+
+    Check(iMaxDifference <= TOLERANCE, "resolved image matches the full repaint");
+    Check(uIncrementalColumns <= uRepaintColumns + uFrames, "incremental update samples no more columns than the repaint");
+    Check(bReachedLimit, "a move ending on the scan limit paints up to the limit");
+    Check(bTurnedBack, "the next move sweeps back from the limit");
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// Copyright (c) 2010-2018 Lockheed Martin Corporation. All rights reserved.
+// Use of this file is bound by the PREPAR3D® SOFTWARE DEVELOPER KIT END USER LICENSE AGREEMENT
+
+// RadarSweepReference.cpp
+//
+// Compares RadarSweepAccumulator with a reference scope that repaints the whole image every frame.
+// Builds as a console application with the PDK and PDK\Helpers directories on the include path; no
+// running simulation is needed.  The reference computes the beam position in closed form from the total
+// beam travel, decays every bin every frame in floating point, and paints the swept columns with the
+// same returns.  The accumulator must paint the same columns and match every bin to within its fixed
+// point rounding.  Returns 0 when every check passes.
+
+#include <ObjBase.h>
+#include "RadarSweepAccumulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace Radar;
+
+namespace
+{
+    const UINT AZIMUTH_BINS = 128;
+    const UINT RANGE_BINS = 128;
+    const double SCAN_AZIMUTH = 60.0;       // Degrees either side of center
+    const double SWEEP_RATE = 90.0;         // Degrees per second
+    const double HALF_LIFE = 2.0;           // Seconds
+    const UINT FRAMES = 4000;
+    const int TOLERANCE = 64;               // Bins are 0-65535; lazy fixed point decay rounds once per paint
+
+    UINT g_uFailures = 0;
+
+    void Check(bool bCondition, const char* pszWhat)
+    {
+        printf("%s  %s\n", bCondition ? "pass" : "FAIL", pszWhat);
+        if (!bCondition)
+        {
+            g_uFailures++;
+        }
+    }
+
+    UINT AzimuthToColumn(double dAzimuth)
+    {
+        const double dColumn = (dAzimuth + SCAN_AZIMUTH) / (2.0 * SCAN_AZIMUTH) * AZIMUTH_BINS;
+        return (UINT)std::max(0.0, std::min(dColumn, AZIMUTH_BINS - 1.0));
+    }
+
+    /** Return of a range bin of a column in a frame: sparse clutter and three fixed contacts. */
+    USHORT GetReturn(UINT uFrame, UINT uColumn, UINT uBin)
+    {
+        if ((uColumn == 20 && uBin == 90) || (uColumn == 64 && uBin == 30) || (uColumn == 110 && uBin == 100))
+        {
+            return 60000;
+        }
+        UINT64 uHash = ((UINT64)uFrame << 32) ^ ((UINT64)uColumn << 16) ^ uBin;
+        uHash = (uHash ^ (uHash >> 30)) * 0xBF58476D1CE4E5B9ull;
+        uHash = (uHash ^ (uHash >> 27)) * 0x94D049BB133111EBull;
+        uHash ^= uHash >> 31;
+        return uHash % 40 == 0 ? (USHORT)(uHash >> 48) : 0;
+    }
+
+    struct SampleContext
+    {
+        UINT    uFrame;
+        UINT64  uColumnsPainted;
+    };
+
+    void SampleColumn(void* pContext, double dAzimuthDegrees, USHORT* pBins, UINT uBinCount)
+    {
+        SampleContext& context = *static_cast<SampleContext*>(pContext);
+        const UINT uColumn = AzimuthToColumn(dAzimuthDegrees);
+        for (UINT uBin = 0; uBin < uBinCount; uBin++)
+        {
+            pBins[uBin] = GetReturn(context.uFrame, uColumn, uBin);
+        }
+        context.uColumnsPainted++;
+    }
+
+    /** Whole image scope: every bin is decayed every frame and the beam is a triangle wave of its travel. */
+    class ReferenceScope
+    {
+    public:
+        ReferenceScope() : m_vBins((size_t)AZIMUTH_BINS * RANGE_BINS, 0.0) {}
+
+        void Update(UINT uFrame, double dElapsedSeconds, UINT& uFirst, UINT& uCount)
+        {
+            const double dGain = exp2(-dElapsedSeconds / HALF_LIFE);
+            for (double& dBin : m_vBins)
+            {
+                dBin *= dGain;
+            }
+
+            const double dStart = m_dTravel;
+            m_dTravel += SWEEP_RATE * dElapsedSeconds;
+            double dMin = std::min(Position(dStart), Position(m_dTravel));
+            double dMax = std::max(Position(dStart), Position(m_dTravel));
+            if (m_dTravel - dStart >= 2.0 * SCAN_AZIMUTH || Reaches(dStart, m_dTravel, SCAN_AZIMUTH))
+            {
+                dMax = SCAN_AZIMUTH;
+            }
+            if (m_dTravel - dStart >= 2.0 * SCAN_AZIMUTH || Reaches(dStart, m_dTravel, 3.0 * SCAN_AZIMUTH))
+            {
+                dMin = -SCAN_AZIMUTH;
+            }
+
+            uFirst = AzimuthToColumn(dMin);
+            uCount = AzimuthToColumn(dMax) - uFirst + 1;
+            for (UINT uColumn = uFirst; uColumn < uFirst + uCount; uColumn++)
+            {
+                for (UINT uBin = 0; uBin < RANGE_BINS; uBin++)
+                {
+                    double& dBin = m_vBins[(size_t)uColumn * RANGE_BINS + uBin];
+                    dBin = std::max(dBin, (double)GetReturn(uFrame, uColumn, uBin));
+                }
+            }
+        }
+
+        double GetBin(UINT uColumn, UINT uBin) const { return m_vBins[(size_t)uColumn * RANGE_BINS + uBin]; }
+
+    private:
+        /// Beam azimuth after a total travel, starting at center and sweeping right.
+        static double Position(double dTravel)
+        {
+            const double dPhase = fmod(dTravel, 4.0 * SCAN_AZIMUTH);
+            if (dPhase < SCAN_AZIMUTH)
+            {
+                return dPhase;
+            }
+            return dPhase < 3.0 * SCAN_AZIMUTH ? 2.0 * SCAN_AZIMUTH - dPhase : dPhase - 4.0 * SCAN_AZIMUTH;
+        }
+
+        /// True if the travel passes dOffset plus a whole number of scan cycles, i.e. the beam touches that limit.
+        static bool Reaches(double dStart, double dEnd, double dOffset)
+        {
+            const double dCycle = 4.0 * SCAN_AZIMUTH;
+            const double dFirst = ceil((dStart - dOffset) / dCycle) * dCycle + dOffset;
+            return dFirst <= dEnd;
+        }
+
+        std::vector<double> m_vBins;
+        double              m_dTravel = 0.0;
+    };
+}
+
+int main()
+{
+    RadarSweepAccumulator accumulator(AZIMUTH_BINS, RANGE_BINS);
+    accumulator.SetPersistence(HALF_LIFE);
+    ReferenceScope reference;
+    SampleContext context = {};
+
+    std::vector<USHORT> vColumn(RANGE_BINS);
+    UINT uColumnMismatches = 0;
+    int iMaxDifference = 0;
+    UINT64 uReferenceColumns = 0;
+
+    for (UINT uFrame = 0; uFrame < FRAMES; uFrame++)
+    {
+        // Mostly 64 Hz, with slower frames and one stall long enough to cover the whole scan.
+        const double dElapsed = uFrame == 2000 ? 4.0 : (uFrame % 7 == 0 ? 1.0 / 32.0 : 1.0 / 64.0);
+        context.uFrame = uFrame;
+        accumulator.Update(SCAN_AZIMUTH, SWEEP_RATE, dElapsed, SampleColumn, &context);
+
+        UINT uFirst, uCount, uReferenceFirst, uReferenceCount;
+        accumulator.GetSweptColumns(uFirst, uCount);
+        reference.Update(uFrame, dElapsed, uReferenceFirst, uReferenceCount);
+        uReferenceColumns += AZIMUTH_BINS;
+        if (uFirst != uReferenceFirst || uCount != uReferenceCount)
+        {
+            uColumnMismatches++;
+        }
+
+        for (UINT uColumn = 0; uColumn < AZIMUTH_BINS; uColumn++)
+        {
+            accumulator.GetColumn(uColumn, vColumn.data());
+            for (UINT uBin = 0; uBin < RANGE_BINS; uBin++)
+            {
+                const int iDifference = abs((int)vColumn[uBin] - (int)(reference.GetBin(uColumn, uBin) + 0.5));
+                iMaxDifference = std::max(iMaxDifference, iDifference);
+            }
+        }
+    }
+
+    printf("largest bin difference %d of 65535 over %u frames\n", iMaxDifference, FRAMES);
+    printf("columns painted: incremental %llu, reference %llu\n", (unsigned long long)context.uColumnsPainted, (unsigned long long)uReferenceColumns);
+    Check(uColumnMismatches == 0, "swept columns match the closed form beam");
+    Check(iMaxDifference <= TOLERANCE, "every bin matches the full repaint within the tolerance");
+    Check(context.uColumnsPainted * 4 < uReferenceColumns, "incremental update paints a fraction of the columns");
+
+    printf("%s\n", g_uFailures == 0 ? "All checks passed." : "Some checks failed.");
+    return g_uFailures == 0 ? 0 : 1;
+}